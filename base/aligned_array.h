@@ -0,0 +1,55 @@
+// Copyright 2013, Beeri 15.  All rights reserved.
+// Author: Roman Gershman (romange@gmail.com)
+//
+#ifndef _BASE_ALIGNED_ARRAY_H
+#define _BASE_ALIGNED_ARRAY_H
+
+#include <cstddef>
+#include <new>
+
+#include "base/logging.h"
+#include "base/port.h"
+
+namespace base {
+
+// Fixed size heap array that respects the alignment of T. Before C++17, new T[n] only
+// guarantees the alignment of malloc, therefore arrays of CACHELINE_ALIGNED shards must be
+// allocated with this class.
+template<typename T> class AlignedArray {
+ public:
+  explicit AlignedArray(size_t size) : size_(size) {
+    void* ptr = aligned_malloc(sizeof(T) * size, alignof(T) < sizeof(void*) ?
+                               sizeof(void*) : alignof(T));
+    CHECK(ptr) << "Could not allocate " << size << " aligned items";
+    data_ = static_cast<T*>(ptr);
+    for (size_t i = 0; i < size; ++i)
+      new (data_ + i) T();
+  }
+
+  ~AlignedArray() {
+    for (size_t i = 0; i < size_; ++i)
+      data_[i].~T();
+    aligned_free(data_);
+  }
+
+  T& operator[](size_t i) { return data_[i]; }
+  const T& operator[](size_t i) const { return data_[i]; }
+
+  T* begin() { return data_; }
+  T* end() { return data_ + size_; }
+  const T* begin() const { return data_; }
+  const T* end() const { return data_ + size_; }
+
+  size_t size() const { return size_; }
+
+ private:
+  T* data_;
+  size_t size_;
+
+  AlignedArray(const AlignedArray&) = delete;
+  void operator=(const AlignedArray&) = delete;
+};
+
+}  // namespace base
+
+#endif  // _BASE_ALIGNED_ARRAY_H
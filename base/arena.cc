@@ -3,26 +3,40 @@
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
 #include "base/arena.h"
+#include <sys/mman.h>
+#include <algorithm>
 #include <cassert>
 
+#include "base/logging.h"
+
 namespace base {
 
-static const int kBlockSize = 8192;
+constexpr size_t Arena::kDefaultBlockSize;
+constexpr size_t Arena::kHugePageSize;
+constexpr unsigned ConcurrentArena::kNumShards;
 
-Arena::Arena() {
+Arena::Arena(size_t block_size, unsigned flags) : block_size_(block_size), flags_(flags) {
+  if (flags_ & HUGE_PAGES) {
+    block_size_ = (block_size_ + kHugePageSize - 1) & ~(kHugePageSize - 1);
+  }
+  assert(block_size_ > 0);
   blocks_memory_ = 0;
   alloc_ptr_ = NULL;  // First allocation will allocate a block
   alloc_bytes_remaining_ = 0;
+  next_block_ = 0;
 }
 
 Arena::~Arena() {
   for (size_t i = 0; i < blocks_.size(); i++) {
-    delete[] blocks_[i];
+    FreeBlock(blocks_[i]);
+  }
+  for (size_t i = 0; i < large_blocks_.size(); i++) {
+    FreeBlock(large_blocks_[i]);
   }
 }
 
 char* Arena::AllocateFallback(size_t bytes) {
-  if (bytes > kBlockSize / 4) {
+  if (bytes > block_size_ / 4) {
     // Object is more than a quarter of our block size.  Allocate it separately
     // to avoid wasting too much space in leftover bytes.
     char* result = AllocateNewBlock(bytes);
@@ -30,8 +44,8 @@ char* Arena::AllocateFallback(size_t bytes) {
   }
 
   // We waste the remaining space in the current block.
-  alloc_ptr_ = AllocateNewBlock(kBlockSize);
-  alloc_bytes_remaining_ = kBlockSize;
+  alloc_ptr_ = NextStandardBlock();
+  alloc_bytes_remaining_ = block_size_;
 
   char* result = alloc_ptr_;
   alloc_ptr_ += bytes;
@@ -39,9 +53,9 @@ char* Arena::AllocateFallback(size_t bytes) {
   return result;
 }
 
-char* Arena::AllocateAligned(size_t bytes) {
-  const int align = sizeof(void*);    // We'll align to pointer size
-  assert((align & (align-1)) == 0);   // Pointer size should be a power of 2
+char* Arena::AllocateAligned(size_t bytes, size_t align) {
+  assert((align & (align-1)) == 0);   // Alignment should be a power of 2
+  assert(align <= 16);                // new[] and mmap return 16 byte aligned blocks.
   size_t current_mod = reinterpret_cast<uintptr_t>(alloc_ptr_) & (align-1);
   size_t slop = (current_mod == 0 ? 0 : align - current_mod);
   size_t needed = bytes + slop;
@@ -61,23 +75,115 @@ char* Arena::AllocateAligned(size_t bytes) {
 char* Arena::AllocateNewBlock(size_t block_bytes) {
   char* result = new char[block_bytes];
   blocks_memory_ += block_bytes;
-  blocks_.push_back(result);
+  large_blocks_.push_back(Block{result, block_bytes, false});
   return result;
 }
 
-void Arena::Swap(Arena& other) {
-  char* tmp = other.alloc_ptr_;
-  other.alloc_ptr_ = alloc_ptr_;
-  alloc_ptr_ = tmp;
+char* Arena::NextStandardBlock() {
+  if (next_block_ < blocks_.size()) {
+    return blocks_[next_block_++].ptr;
+  }
+
+  Block block{nullptr, block_size_, false};
+  if (flags_ & HUGE_PAGES) {
+    void* ptr = mmap(NULL, block_size_, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (ptr == MAP_FAILED) {
+      // No reserved huge pages, ask for transparent ones.
+      ptr = mmap(NULL, block_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      CHECK(ptr != MAP_FAILED) << "Could not mmap " << block_size_ << " bytes";
+      madvise(ptr, block_size_, MADV_HUGEPAGE);
+    }
+    block.ptr = reinterpret_cast<char*>(ptr);
+    block.mmapped = true;
+  } else {
+    block.ptr = new char[block_size_];
+  }
+  blocks_memory_ += block_size_;
+  blocks_.push_back(block);
+  next_block_ = blocks_.size();
+  return block.ptr;
+}
+
+void Arena::FreeBlock(const Block& block) {
+  if (block.mmapped) {
+    munmap(block.ptr, block.size);
+  } else {
+    delete[] block.ptr;
+  }
+}
 
-  size_t s = other.alloc_bytes_remaining_;
-  other.alloc_bytes_remaining_ = alloc_bytes_remaining_;
-  alloc_bytes_remaining_ = s;
+void Arena::Reset() {
+  for (size_t i = 0; i < large_blocks_.size(); i++) {
+    blocks_memory_ -= large_blocks_[i].size;
+    FreeBlock(large_blocks_[i]);
+  }
+  large_blocks_.clear();
+  next_block_ = 0;
+  alloc_ptr_ = NULL;
+  alloc_bytes_remaining_ = 0;
+}
 
+void Arena::Swap(Arena& other) {
+  std::swap(block_size_, other.block_size_);
+  std::swap(flags_, other.flags_);
+  std::swap(alloc_ptr_, other.alloc_ptr_);
+  std::swap(alloc_bytes_remaining_, other.alloc_bytes_remaining_);
   blocks_.swap(other.blocks_);
-  s = other.blocks_memory_;
-  other.blocks_memory_ = blocks_memory_;
-  blocks_memory_ = s;
+  std::swap(next_block_, other.next_block_);
+  large_blocks_.swap(other.large_blocks_);
+  std::swap(blocks_memory_, other.blocks_memory_);
+}
+
+ConcurrentArena::ConcurrentArena(size_t block_size, unsigned flags)
+    : chunk_size_(std::max<size_t>(block_size / 8, 256)), arena_(block_size, flags),
+      memory_usage_(0), shards_(kNumShards) {
+}
+
+ConcurrentArena::Shard* ConcurrentArena::ShardForThisThread() {
+  static std::atomic<uint32_t> next_thread_index(0);
+  static __thread uint32_t thread_index = UINT32_MAX;
+  if (thread_index == UINT32_MAX)
+    thread_index = next_thread_index.fetch_add(1, std::memory_order_relaxed);
+  return &shards_[thread_index % kNumShards];
+}
+
+char* ConcurrentArena::AllocateShared(size_t bytes, size_t align) {
+  MutexLock lock(&mu_);
+  char* res = arena_.AllocateAligned(bytes, align);
+  memory_usage_.store(arena_.MemoryUsage(), std::memory_order_relaxed);
+  return res;
+}
+
+char* ConcurrentArena::AllocateAligned(size_t bytes, size_t align) {
+  assert(bytes > 0);
+  if (bytes > chunk_size_ / 4) {
+    return AllocateShared(bytes, align);
+  }
+
+  Shard* shard = ShardForThisThread();
+  MutexLock lock(&shard->mu);
+  size_t slop = -reinterpret_cast<uintptr_t>(shard->ptr) & (align - 1);
+  if (bytes + slop > shard->remaining) {
+    // We waste the remaining space in the current chunk.
+    shard->ptr = AllocateShared(chunk_size_, 16);
+    shard->remaining = chunk_size_;
+    slop = 0;
+  }
+  char* res = shard->ptr + slop;
+  shard->ptr += bytes + slop;
+  shard->remaining -= bytes + slop;
+  return res;
+}
+
+void ConcurrentArena::Reset() {
+  MutexLock lock(&mu_);
+  for (unsigned i = 0; i < kNumShards; ++i) {
+    shards_[i].ptr = nullptr;
+    shards_[i].remaining = 0;
+  }
+  arena_.Reset();
+  memory_usage_.store(arena_.MemoryUsage(), std::memory_order_relaxed);
 }
 
 }  // namespace base
@@ -6,16 +6,30 @@
 #ifndef _BASE_UTIL_ARENA_H_
 #define _BASE_UTIL_ARENA_H_
 
+#include <atomic>
 #include <cstddef>
+#include <memory>
 #include <vector>
 #include <cassert>
 #include <cstdint>
 
+#include "base/aligned_array.h"
+#include "base/mutex.h"
+
 namespace base {
 
 class Arena {
  public:
-  Arena();
+  enum Flags {
+    // Standard blocks are mmapped with MAP_HUGETLB. If no huge pages are reserved in the
+    // system, falls back to transparent huge pages. The block size is rounded up to 2MB.
+    HUGE_PAGES = 1,
+  };
+
+  static constexpr size_t kDefaultBlockSize = 8192;
+  static constexpr size_t kHugePageSize = 1 << 21;
+
+  explicit Arena(size_t block_size = kDefaultBlockSize, unsigned flags = 0);
   ~Arena();
 
   // Return a pointer to a newly allocated memory block of "bytes" bytes.
@@ -24,25 +38,52 @@ class Arena {
   // Allocate memory with the normal alignment guarantees provided by malloc
   char* AllocateAligned(size_t bytes);
 
+  // align must be a power of 2 and not greater than 16.
+  char* AllocateAligned(size_t bytes, size_t align);
+
+  // Invalidates all the allocations. Keeps the standard blocks for reuse and frees the blocks
+  // that were allocated for large objects.
+  void Reset();
+
   // Returns an estimate of the total memory usage of data allocated
   // by the arena (including space allocated but not yet used for user
   // allocations).
   size_t MemoryUsage() const {
-    return blocks_memory_ + blocks_.capacity() * sizeof(char*);
+    return blocks_memory_ + (blocks_.capacity() + large_blocks_.capacity()) * sizeof(Block);
   }
 
+  size_t block_size() const { return block_size_; }
+
   void Swap(Arena& other);
 
  private:
+  struct Block {
+    char* ptr;
+    size_t size;
+    bool mmapped;
+  };
+
   char* AllocateFallback(size_t bytes);
   char* AllocateNewBlock(size_t block_bytes);
 
+  // Returns the next standard block, reusing the blocks that were kept by Reset().
+  char* NextStandardBlock();
+
+  static void FreeBlock(const Block& block);
+
+  size_t block_size_;
+  unsigned flags_;
+
   // Allocation state
   char* alloc_ptr_;
   size_t alloc_bytes_remaining_;
 
-  // Array of new[] allocated memory blocks
-  std::vector<char*> blocks_;
+  // Standard blocks, blocks_[0, next_block_) are in use.
+  std::vector<Block> blocks_;
+  size_t next_block_;
+
+  // Blocks allocated for objects larger than a quarter of the block size.
+  std::vector<Block> large_blocks_;
 
   // Bytes of memory in blocks allocated so far
   size_t blocks_memory_;
@@ -66,6 +107,117 @@ inline char* Arena::Allocate(size_t bytes) {
   return AllocateFallback(bytes);
 }
 
+inline char* Arena::AllocateAligned(size_t bytes) {
+  return AllocateAligned(bytes, sizeof(void*));
+}
+
+// Thread-safe arena. Small allocations are served from per-thread chunks that are carved from
+// a shared arena, so threads do not contend on a single allocation pointer.
+// Reset() must not run concurrently with allocations.
+class ConcurrentArena {
+ public:
+  explicit ConcurrentArena(size_t block_size = Arena::kDefaultBlockSize, unsigned flags = 0);
+
+  char* Allocate(size_t bytes) {
+    return AllocateAligned(bytes, 1);
+  }
+
+  char* AllocateAligned(size_t bytes) {
+    return AllocateAligned(bytes, sizeof(void*));
+  }
+
+  char* AllocateAligned(size_t bytes, size_t align);
+
+  void Reset();
+
+  size_t MemoryUsage() const {
+    return memory_usage_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  static constexpr unsigned kNumShards = 16;
+
+  // Shards are cache line aligned, so threads that allocate from different shards do not
+  // share cache lines.
+  struct Shard {
+    Mutex mu;
+    char* ptr = nullptr;
+    size_t remaining = 0;
+  } CACHELINE_ALIGNED;
+
+  Shard* ShardForThisThread();
+  char* AllocateShared(size_t bytes, size_t align);
+
+  const size_t chunk_size_;
+
+  Mutex mu_;
+  Arena arena_;  // guarded by mu_.
+  std::atomic<size_t> memory_usage_;
+
+  AlignedArray<Shard> shards_;
+};
+
+// std compatible allocator that allocates from an arena. deallocate() is a no-op, the memory
+// is reclaimed when the arena is reset or destroyed.
+template<typename T, typename A = Arena>
+class arena_allocator {
+public:
+  using pointer = T*;
+  using const_pointer = T const*;
+  using void_pointer = void*;
+  using const_void_pointer = void const*;
+  using value_type = T;
+  using size_type = std::size_t;
+  using difference_type = std::ptrdiff_t;
+  typedef T& reference;
+  typedef const T& const_reference;
+
+  template<typename U>
+  struct rebind {
+      using other = arena_allocator<U, A>;
+  };
+
+  explicit arena_allocator(A* arena) : arena_(arena) {}
+
+  template<typename U> arena_allocator(const arena_allocator<U, A>& other)
+      : arena_(other.arena_) {
+  }
+
+  pointer allocate(size_type n, const_void_pointer = 0) {
+      static_assert(alignof(T) <= 16, "Unsupported alignment");
+      if (n == 0)
+        return nullptr;
+      return reinterpret_cast<pointer>(arena_->AllocateAligned(n * sizeof(T), alignof(T)));
+  }
+
+  void deallocate(pointer ptr, size_type n) {
+  }
+
+  size_type max_size() const  {
+      return static_cast<size_type>(-1) / sizeof(value_type);
+  }
+
+  template <typename U, typename... Args> void construct (U* p, Args&&... args) {
+    ::new ((void*)p) U(std::forward<Args>(args)...);
+  }
+
+  template <typename U> void destroy(U* p) { p->~U(); }
+
+  A* arena() const { return arena_; }
+
+  template<typename U> bool operator==(const arena_allocator<U, A>& b) const {
+    return arena_ == b.arena_;
+  }
+
+  template<typename U> bool operator!=(const arena_allocator<U, A>& b) const {
+    return arena_ != b.arena_;
+  }
+private:
+  template <typename U, typename B> friend class arena_allocator;
+
+  A* arena_;
+};
+
 }  // namespace base
 
 #endif  // _BASE_UTIL_ARENA_H_
@@ -2,45 +2,53 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
-#include "util/arena.h"
+#include "base/arena.h"
 
-#include "util/random.h"
-#include "util/testharness.h"
+#include <cstring>
+#include <map>
+#include <random>
+#include <thread>
+#include "base/gtest.h"
 
-namespace leveldb {
+namespace base {
 
-class ArenaTest { };
+class ArenaTest : public testing::Test {
+protected:
+  std::mt19937 rnd_{301};
 
-TEST(ArenaTest, Empty) {
+  bool OneIn(unsigned n) { return rnd_() % n == 0; }
+  unsigned Uniform(unsigned n) { return rnd_() % n; }
+};
+
+TEST_F(ArenaTest, Empty) {
   Arena arena;
 }
 
-TEST(ArenaTest, Simple) {
+TEST_F(ArenaTest, Simple) {
   std::vector<std::pair<size_t, char*> > allocated;
   Arena arena;
   const int N = 100000;
   size_t bytes = 0;
-  Random rnd(301);
   for (int i = 0; i < N; i++) {
     size_t s;
     if (i % (N / 10) == 0) {
       s = i;
     } else {
-      s = rnd.OneIn(4000) ? rnd.Uniform(6000) :
-          (rnd.OneIn(10) ? rnd.Uniform(100) : rnd.Uniform(20));
+      s = OneIn(4000) ? Uniform(6000) :
+          (OneIn(10) ? Uniform(100) : Uniform(20));
     }
     if (s == 0) {
       // Our arena disallows size 0 allocations.
       s = 1;
     }
     char* r;
-    if (rnd.OneIn(10)) {
+    if (OneIn(10)) {
       r = arena.AllocateAligned(s);
     } else {
       r = arena.Allocate(s);
     }
 
-    for (int b = 0; b < s; b++) {
+    for (size_t b = 0; b < s; b++) {
       // Fill the "i"th allocation with a known bit pattern
       r[b] = i % 256;
     }
@@ -51,18 +59,116 @@ TEST(ArenaTest, Simple) {
       ASSERT_LE(arena.MemoryUsage(), bytes * 1.10);
     }
   }
-  for (int i = 0; i < allocated.size(); i++) {
+  for (size_t i = 0; i < allocated.size(); i++) {
     size_t num_bytes = allocated[i].first;
     const char* p = allocated[i].second;
-    for (int b = 0; b < num_bytes; b++) {
+    for (size_t b = 0; b < num_bytes; b++) {
       // Check the "i"th allocation for the known bit pattern
       ASSERT_EQ(int(p[b]) & 0xff, i % 256);
     }
   }
 }
 
-}  // namespace leveldb
+TEST_F(ArenaTest, Reset) {
+  Arena arena(1024);
+  char* first = arena.Allocate(10);
+  for (int i = 0; i < 100; ++i)
+    arena.Allocate(100);
+  arena.Allocate(5000);  // large block.
+  size_t usage = arena.MemoryUsage();
+
+  arena.Reset();
+  EXPECT_LT(arena.MemoryUsage(), usage);
+  usage = arena.MemoryUsage();
+
+  // Standard blocks are reused.
+  EXPECT_EQ(first, arena.Allocate(10));
+  for (int i = 0; i < 100; ++i)
+    arena.Allocate(100);
+  EXPECT_EQ(usage, arena.MemoryUsage());
+}
+
+TEST_F(ArenaTest, Aligned) {
+  Arena arena;
+  arena.Allocate(1);
+  char* p = arena.AllocateAligned(8, 16);
+  EXPECT_EQ(0, reinterpret_cast<uintptr_t>(p) % 16);
+}
 
-int main(int argc, char** argv) {
-  return leveldb::test::RunAllTests();
+TEST_F(ArenaTest, HugePages) {
+  Arena arena(4096, Arena::HUGE_PAGES);
+  EXPECT_EQ(Arena::kHugePageSize, arena.block_size());
+  char* p = arena.Allocate(100);
+  memset(p, 1, 100);
+  arena.Reset();
+  EXPECT_EQ(p, arena.Allocate(100));
 }
+
+TEST_F(ArenaTest, Allocator) {
+  Arena arena;
+  typedef arena_allocator<std::pair<const int, int>> Alloc;
+  std::map<int, int, std::less<int>, Alloc> m{std::less<int>(), Alloc(&arena)};
+  for (int i = 0; i < 1000; ++i)
+    m[i] = i * 2;
+  EXPECT_EQ(1000, m.size());
+  EXPECT_EQ(20, m[10]);
+  EXPECT_GT(arena.MemoryUsage(), 1000 * sizeof(std::pair<int, int>));
+
+  arena_allocator<double> alloc(&arena);
+  std::vector<double, arena_allocator<double>> v(alloc);
+  v.resize(100, 1.5);
+  EXPECT_EQ(1.5, v[99]);
+}
+
+TEST_F(ArenaTest, Concurrent) {
+  ConcurrentArena arena;
+  const int kThreads = 4, kAllocs = 10000;
+  std::vector<std::thread> threads;
+  std::vector<std::vector<char*>> allocated(kThreads);
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&, t] {
+      for (int i = 0; i < kAllocs; ++i) {
+        size_t sz = 1 + i % 300;
+        char* p = arena.AllocateAligned(sz);
+        memset(p, t, sz);
+        allocated[t].push_back(p);
+      }
+    });
+  }
+  for (auto& t : threads)
+    t.join();
+  for (int t = 0; t < kThreads; ++t) {
+    for (int i = 0; i < kAllocs; ++i) {
+      const char* p = allocated[t][i];
+      ASSERT_EQ(0, reinterpret_cast<uintptr_t>(p) % sizeof(void*));
+      for (int j = 0; j < 1 + i % 300; ++j)
+        ASSERT_EQ(t, p[j]);
+    }
+  }
+  size_t usage = arena.MemoryUsage();
+  arena.Reset();
+  arena.Allocate(10);
+  EXPECT_LE(arena.MemoryUsage(), usage);
+}
+
+static void BM_ArenaReset(benchmark::State& state) {
+  Arena arena;
+  while (state.KeepRunning()) {
+    for (int i = 0; i < state.range_x(); ++i)
+      arena.Allocate(64);
+    arena.Reset();
+  }
+}
+BENCHMARK(BM_ArenaReset)->Arg(1024);
+
+static void BM_ArenaSwap(benchmark::State& state) {
+  Arena arena;
+  while (state.KeepRunning()) {
+    for (int i = 0; i < state.range_x(); ++i)
+      arena.Allocate(64);
+    Arena().Swap(arena);
+  }
+}
+BENCHMARK(BM_ArenaSwap)->Arg(1024);
+
+}  // namespace base
@@ -0,0 +1,385 @@
+// Copyright 2013, Beeri 15.  All rights reserved.
+// Author: Roman Gershman (romange@gmail.com)
+//
+#ifndef _BASE_CONCURRENT_CUCKOO_MAP_H
+#define _BASE_CONCURRENT_CUCKOO_MAP_H
+
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "base/bits.h"
+#include "base/integral_types.h"
+#include "base/logging.h"
+#include "base/rcu.h"
+
+namespace base {
+
+/*
+  Cuckoo map with a single writer and lock-free readers. T must be trivially copyable.
+
+  Every bucket has a version counter which is odd while the writer modifies the bucket.
+  Readers read both candidate buckets of a key and retry if any of the versions was odd or
+  changed meanwhile, like a seqlock. Insert looks for a cuckoo path to an empty slot first
+  and then moves the keys along it backwards, starting with the one next to the empty slot.
+  Every move copies a key to its other bucket before erasing it from the old one, so readers
+  always find the keys that are not being inserted.
+  When no path is found, the writer builds a larger table and publishes it. The old table is
+  freed with rcu::Delete once all the readers that could have seen it are done.
+
+  find() takes a nestable rcu::ReadLock internally, callers that do many lookups can hold
+  their own rcu::ReadLock around them to amortize its cost.
+*/
+template<typename T> class ConcurrentCuckooMap {
+public:
+  typedef uint64 KeyType;
+
+  explicit ConcurrentCuckooMap(uint32 capacity = 0) : size_(0) {
+    table_.store(new Table(BucketCountFor(capacity)), std::memory_order_relaxed);
+  }
+
+  ~ConcurrentCuckooMap() { delete table_.load(std::memory_order_relaxed); }
+
+  // Writer only. Must be called before any insertion.
+  void SetEmptyKey(KeyType k) {
+    CHECK_EQ(0, size_.load(std::memory_order_relaxed));
+    empty_key_ = k;
+    Table* t = table_.load(std::memory_order_relaxed);
+    t->Clear(k);
+    empty_key_set_ = true;
+  }
+
+  // Any thread. Returns true and copies the value into val if key exists.
+  bool find(KeyType key, T* val) const {
+    rcu::ReadLock lock;
+    const Table* t = table_.load(std::memory_order_acquire);
+    uint32 b1, b2;
+    t->Buckets(key, &b1, &b2);
+    const Bucket& bucket1 = t->buckets[b1];
+    const Bucket& bucket2 = t->buckets[b2];
+
+    while (true) {
+      uint32 v1 = bucket1.version.load(std::memory_order_acquire);
+      uint32 v2 = bucket2.version.load(std::memory_order_acquire);
+      if ((v1 | v2) & 1) {
+        asm volatile("pause");
+        continue;
+      }
+      bool found = bucket1.Read(key, val) || bucket2.Read(key, val);
+
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (bucket1.version.load(std::memory_order_relaxed) == v1 &&
+          bucket2.version.load(std::memory_order_relaxed) == v2) {
+        return found;
+      }
+    }
+  }
+
+  bool contains(KeyType key) const {
+    T val;
+    return find(key, &val);
+  }
+
+  // Writer only. Inserts key if it does not exist, returns false otherwise.
+  bool Insert(KeyType key, const T& val) {
+    DCHECK(empty_key_set_);
+    DCHECK_NE(empty_key_, key);
+    Table* t = table_.load(std::memory_order_relaxed);
+    uint32 b1, b2;
+    t->Buckets(key, &b1, &b2);
+    if (t->buckets[b1].Find(key) >= 0 || t->buckets[b2].Find(key) >= 0)
+      return false;
+
+    while (!t->Insert(key, val, empty_key_, &path_)) {
+      t = Grow(t, t->bucket_count() * 2);
+    }
+    size_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  // Writer only. Overwrites the value of an existing key, returns false if key does not exist.
+  bool Update(KeyType key, const T& val) {
+    Table* t = table_.load(std::memory_order_relaxed);
+    uint32 b[2];
+    t->Buckets(key, b, b + 1);
+    for (uint32 id : b) {
+      Bucket& bucket = t->buckets[id];
+      int slot = bucket.Find(key);
+      if (slot >= 0) {
+        bucket.BeginWrite();
+        bucket.WriteValue(slot, val);
+        bucket.EndWrite();
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Writer only. Rebuilds the table to the smallest size that fits size() * ratio keys.
+  void Compact(double ratio) {
+    CHECK_GT(ratio, 1.0);
+    Table* t = table_.load(std::memory_order_relaxed);
+    uint32 count = BucketCountFor(size() * ratio);
+    if (count < t->bucket_count())
+      Grow(t, count);
+  }
+
+  size_t size() const { return size_.load(std::memory_order_relaxed); }
+  bool empty() const { return size() == 0; }
+
+  // Number of slots in the current table. Any thread, but may be stale.
+  size_t Capacity() const {
+    return table_.load(std::memory_order_acquire)->bucket_count() * kBucketLength;
+  }
+
+  double Utilization() const { return size() * 1.0 / Capacity(); }
+
+private:
+  static constexpr unsigned kBucketLength = 4;
+  static constexpr unsigned kValueWords = (sizeof(T) + 7) / 8;
+
+  // The number of buckets explored when looking for a cuckoo path.
+  static constexpr unsigned kMaxPathSearch = 256;
+
+  static constexpr uint64 kMul1 = 0x9E3779B97F4A7C15ULL;
+  static constexpr uint64 kMul2 = 0xc949d7c7509e6557ULL;
+
+  // Values are stored as atomic words so that concurrent reads are well defined.
+  struct Bucket {
+    std::atomic<uint32> version;
+    std::atomic<uint64> key[kBucketLength];
+    std::atomic<uint64> value[kBucketLength][kValueWords];
+
+    int Find(KeyType k) const {
+      for (unsigned i = 0; i < kBucketLength; ++i) {
+        if (key[i].load(std::memory_order_relaxed) == k)
+          return i;
+      }
+      return -1;
+    }
+
+    bool Read(KeyType k, T* val) const {
+      int i = Find(k);
+      if (i < 0)
+        return false;
+      uint64 words[kValueWords];
+      for (unsigned j = 0; j < kValueWords; ++j)
+        words[j] = value[i][j].load(std::memory_order_relaxed);
+      memcpy(val, words, sizeof(T));
+      return true;
+    }
+
+    void BeginWrite() {
+      version.store(version.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    void EndWrite() {
+      version.store(version.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    void WriteValue(unsigned i, const T& val) {
+      uint64 words[kValueWords] = {0};
+      memcpy(words, &val, sizeof(T));
+      for (unsigned j = 0; j < kValueWords; ++j)
+        value[i][j].store(words[j], std::memory_order_relaxed);
+    }
+
+    void CopySlot(unsigned dest, const Bucket& src, unsigned src_index) {
+      key[dest].store(src.key[src_index].load(std::memory_order_relaxed),
+                      std::memory_order_relaxed);
+      for (unsigned j = 0; j < kValueWords; ++j) {
+        value[dest][j].store(src.value[src_index][j].load(std::memory_order_relaxed),
+                             std::memory_order_relaxed);
+      }
+    }
+  };
+
+  // A step of the cuckoo path: the key at slot of the parent's bucket moves to bucket.
+  struct PathNode {
+    uint32 bucket;
+    int32 parent;
+    uint8 slot;
+  };
+
+  struct Table {
+    std::unique_ptr<Bucket[]> buckets;
+    uint32 shift;  // 64 - log2(bucket count).
+
+    explicit Table(uint32 bucket_count)
+        : buckets(new Bucket[bucket_count]), shift(64 - Bits::Log2FloorNonZero(bucket_count)) {
+      for (uint32 i = 0; i < bucket_count; ++i)
+        buckets[i].version.store(0, std::memory_order_relaxed);
+    }
+
+    uint32 bucket_count() const { return 1U << (64 - shift); }
+
+    void Clear(KeyType empty_key) {
+      for (uint32 i = 0; i < bucket_count(); ++i) {
+        for (unsigned j = 0; j < kBucketLength; ++j)
+          buckets[i].key[j].store(empty_key, std::memory_order_relaxed);
+      }
+    }
+
+    // Multiplicative hashing, the high bits of the products are well mixed.
+    void Buckets(KeyType k, uint32* b1, uint32* b2) const {
+      *b1 = (k * kMul1) >> shift;
+      *b2 = ((k ^ (k >> 29)) * kMul2) >> shift;
+      if (*b2 == *b1)
+        *b2 ^= 1;
+    }
+
+    uint32 OtherBucket(KeyType k, uint32 current) const {
+      uint32 b1, b2;
+      Buckets(k, &b1, &b2);
+      DCHECK(current == b1 || current == b2);
+      return current == b1 ? b2 : b1;
+    }
+
+    // Returns false if no cuckoo path was found.
+    bool Insert(KeyType key, const T& val, KeyType empty_key, std::vector<PathNode>* path);
+
+    // Moves the keys along the path that ends with an empty slot in the last node.
+    // Returns false if the path became invalid because it visits a bucket twice.
+    bool ApplyPath(const std::vector<PathNode>& path, KeyType empty_key, unsigned* root_slot);
+  };
+
+  static uint32 BucketCountFor(size_t capacity) {
+    // Aim for 90% utilization.
+    uint32 count = 2;
+    while (count * kBucketLength * 9 / 10 < capacity)
+      count *= 2;
+    return count;
+  }
+
+  // Builds a table with bucket_count buckets, or larger if needed, publishes it and retires
+  // the old one.
+  Table* Grow(Table* old, uint32 bucket_count);
+
+  std::atomic<Table*> table_;
+  std::atomic<size_t> size_;
+
+  KeyType empty_key_ = 0;
+  bool empty_key_set_ = false;
+
+  std::vector<PathNode> path_;  // reused by Insert.
+
+  ConcurrentCuckooMap(const ConcurrentCuckooMap&) = delete;
+  void operator=(const ConcurrentCuckooMap&) = delete;
+};
+
+template<typename T> constexpr unsigned ConcurrentCuckooMap<T>::kBucketLength;
+template<typename T> constexpr unsigned ConcurrentCuckooMap<T>::kMaxPathSearch;
+template<typename T> constexpr uint64 ConcurrentCuckooMap<T>::kMul1;
+template<typename T> constexpr uint64 ConcurrentCuckooMap<T>::kMul2;
+
+template<typename T> bool ConcurrentCuckooMap<T>::Table::Insert(
+    KeyType key, const T& val, KeyType empty_key, std::vector<PathNode>* path) {
+  uint32 b1, b2;
+  Buckets(key, &b1, &b2);
+
+  while (true) {
+    // Breadth first search for a bucket with an empty slot.
+    path->clear();
+    path->push_back(PathNode{b1, -1, 0});
+    path->push_back(PathNode{b2, -1, 0});
+    int32 found = -1;
+    for (uint32 i = 0; i < path->size() && found < 0; ++i) {
+      PathNode node = (*path)[i];
+      const Bucket& bucket = buckets[node.bucket];
+      if (bucket.Find(empty_key) >= 0) {
+        found = i;
+        break;
+      }
+      if (path->size() >= kMaxPathSearch)
+        continue;
+      for (unsigned j = 0; j < kBucketLength; ++j) {
+        KeyType k = bucket.key[j].load(std::memory_order_relaxed);
+        path->push_back(PathNode{OtherBucket(k, node.bucket), int32(i), uint8(j)});
+      }
+    }
+    if (found < 0)
+      return false;
+
+    // Keep only the nodes of the found path, from the root to the empty slot.
+    std::vector<PathNode> chain;
+    for (int32 i = found; i >= 0; i = (*path)[i].parent)
+      chain.push_back((*path)[i]);
+    path->assign(chain.rbegin(), chain.rend());
+
+    unsigned slot;
+    if (!ApplyPath(*path, empty_key, &slot))
+      continue;  // Some moves were done, the table is valid, so we just search again.
+
+    Bucket& dest = buckets[path->front().bucket];
+    dest.BeginWrite();
+    dest.WriteValue(slot, val);
+    dest.key[slot].store(key, std::memory_order_relaxed);
+    dest.EndWrite();
+    return true;
+  }
+}
+
+template<typename T> bool ConcurrentCuckooMap<T>::Table::ApplyPath(
+    const std::vector<PathNode>& path, KeyType empty_key, unsigned* root_slot) {
+  int empty_slot = buckets[path.back().bucket].Find(empty_key);
+  DCHECK_GE(empty_slot, 0);
+  for (size_t i = path.size() - 1; i > 0; --i) {
+    Bucket& dest = buckets[path[i].bucket];
+    Bucket& src = buckets[path[i - 1].bucket];
+    unsigned src_slot = path[i].slot;
+    KeyType k = src.key[src_slot].load(std::memory_order_relaxed);
+    if (k == empty_key) {
+      // An earlier move of this path already freed the slot.
+      empty_slot = src_slot;
+      continue;
+    }
+    if (OtherBucket(k, path[i - 1].bucket) != path[i].bucket)
+      return false;
+
+    // Copy first, then erase, so that the key is always visible in at least one bucket.
+    dest.BeginWrite();
+    src.BeginWrite();
+    dest.CopySlot(empty_slot, src, src_slot);
+    src.key[src_slot].store(empty_key, std::memory_order_relaxed);
+    src.EndWrite();
+    dest.EndWrite();
+    empty_slot = src_slot;
+  }
+  *root_slot = empty_slot;
+  return buckets[path.front().bucket].key[empty_slot].load(std::memory_order_relaxed) ==
+      empty_key;
+}
+
+template<typename T> typename ConcurrentCuckooMap<T>::Table*
+    ConcurrentCuckooMap<T>::Grow(Table* old, uint32 bucket_count) {
+  while (true) {
+    VLOG(1) << "Rebuilding ConcurrentCuckooMap with " << bucket_count << " buckets";
+    std::unique_ptr<Table> t(new Table(bucket_count));
+    t->Clear(empty_key_);
+    bool success = true;
+    for (uint32 i = 0; i < old->bucket_count() && success; ++i) {
+      const Bucket& bucket = old->buckets[i];
+      for (unsigned j = 0; j < kBucketLength && success; ++j) {
+        KeyType k = bucket.key[j].load(std::memory_order_relaxed);
+        if (k == empty_key_)
+          continue;
+        T val;
+        bucket.Read(k, &val);
+        success = t->Insert(k, val, empty_key_, &path_);
+      }
+    }
+    if (success) {
+      Table* res = t.release();
+      table_.store(res, std::memory_order_release);
+      rcu::Delete(old);
+      return res;
+    }
+    bucket_count *= 2;
+  }
+}
+
+}  // namespace base
+
+#endif  // _BASE_CONCURRENT_CUCKOO_MAP_H
@@ -0,0 +1,181 @@
+// Copyright 2013, Beeri 15.  All rights reserved.
+// Author: Roman Gershman (romange@gmail.com)
+//
+#include "base/concurrent_cuckoo_map.h"
+
+#include <thread>
+#include <vector>
+#include "base/cuckoo_map.h"
+#include "base/gtest.h"
+#include "base/mutex.h"
+#include "base/random.h"
+
+namespace base {
+
+namespace {
+
+struct Pair {
+  uint64 a;
+  uint32 b;
+};
+
+}  // namespace
+
+class ConcurrentCuckooMapTest : public testing::Test {
+};
+
+TEST_F(ConcurrentCuckooMapTest, Basic) {
+  ConcurrentCuckooMap<Pair> m;
+  m.SetEmptyKey(kuint64max);
+  Pair p;
+  EXPECT_FALSE(m.find(5, &p));
+  EXPECT_TRUE(m.Insert(5, Pair{10, 20}));
+  EXPECT_FALSE(m.Insert(5, Pair{0, 0}));
+  ASSERT_TRUE(m.find(5, &p));
+  EXPECT_EQ(10, p.a);
+  EXPECT_EQ(20, p.b);
+  EXPECT_TRUE(m.Update(5, Pair{11, 21}));
+  EXPECT_FALSE(m.Update(6, Pair{11, 21}));
+  ASSERT_TRUE(m.find(5, &p));
+  EXPECT_EQ(11, p.a);
+  EXPECT_TRUE(m.Insert(0, Pair{1, 2}));
+  EXPECT_TRUE(m.contains(0));
+  EXPECT_EQ(2, m.size());
+}
+
+TEST_F(ConcurrentCuckooMapTest, GrowAndCompact) {
+  ConcurrentCuckooMap<uint32> m;
+  m.SetEmptyKey(0);
+  MTRandom rand(10);
+  std::vector<uint64> keys;
+  for (unsigned i = 0; i < 100000; ++i) {
+    uint64 k = rand.Rand64() | 1;
+    if (m.Insert(k, i))
+      keys.push_back(k);
+  }
+  EXPECT_EQ(keys.size(), m.size());
+  LOG(INFO) << "Utilization " << m.Utilization();
+  for (unsigned i = 0; i < keys.size(); ++i) {
+    uint32 val;
+    ASSERT_TRUE(m.find(keys[i], &val));
+    ASSERT_FALSE(m.contains(keys[i] + 1));
+  }
+
+  ConcurrentCuckooMap<uint32> small(1 << 20);
+  small.SetEmptyKey(0);
+  for (unsigned i = 0; i < 1000; ++i)
+    small.Insert(keys[i], i);
+  size_t capacity = small.Capacity();
+  small.Compact(1.5);
+  EXPECT_LT(small.Capacity(), capacity);
+  for (unsigned i = 0; i < 1000; ++i) {
+    uint32 val;
+    ASSERT_TRUE(small.find(keys[i], &val));
+    ASSERT_EQ(i, val);
+  }
+  rcu::Synchronize();
+}
+
+// Readers must always see every key that was inserted before they started to look for it,
+// with a consistent value, while the writer displaces keys and grows the table.
+TEST_F(ConcurrentCuckooMapTest, ConcurrentReaders) {
+  ConcurrentCuckooMap<Pair> m;
+  m.SetEmptyKey(0);
+  const unsigned kLength = 200000;
+  std::vector<uint64> keys(kLength);
+  MTRandom rand(20);
+  for (uint64& k : keys)
+    k = rand.Rand64() | 1;
+
+  std::atomic<unsigned> published(0);
+  std::atomic<unsigned> bad_reads(0);
+  std::vector<std::thread> readers;
+  for (unsigned r = 0; r < 3; ++r) {
+    readers.emplace_back([&, r] {
+      unsigned i = r;
+      while (true) {
+        unsigned limit = published.load(std::memory_order_acquire);
+        if (limit == kLength)
+          break;
+        if (limit == 0)
+          continue;
+        unsigned index = (i++ * 7919) % limit;
+        Pair p;
+        if (!m.find(keys[index], &p) || p.a != keys[index] || p.b != index)
+          ++bad_reads;
+      }
+    });
+  }
+  for (unsigned i = 0; i < kLength; ++i) {
+    if (!m.Insert(keys[i], Pair{keys[i], i}))
+      m.Update(keys[i], Pair{keys[i], i});  // a duplicate random key, overwrite its index.
+    published.store(i + 1, std::memory_order_release);
+  }
+  for (auto& t : readers)
+    t.join();
+  EXPECT_EQ(0, bad_reads);
+  rcu::Synchronize();
+  EXPECT_EQ(0, rcu::PendingCount());
+}
+
+constexpr unsigned kBenchItems = 1 << 20;
+
+static std::vector<uint64> BenchKeys() {
+  MTRandom rand(30);
+  std::vector<uint64> keys(kBenchItems);
+  for (uint64& k : keys)
+    k = rand.Rand64() | 1;
+  return keys;
+}
+
+static void BM_ConcurrentFind(benchmark::State& state) {
+  static ConcurrentCuckooMap<uint64>* m = nullptr;
+  static std::vector<uint64> keys;
+  if (state.thread_index == 0) {
+    keys = BenchKeys();
+    m = new ConcurrentCuckooMap<uint64>(kBenchItems);
+    m->SetEmptyKey(0);
+    for (uint64 k : keys)
+      m->Insert(k, k);
+  }
+  unsigned i = state.thread_index * 7919;
+  while (state.KeepRunning()) {
+    uint64 val = 0;
+    m->find(keys[i % kBenchItems], &val);
+    base::sink_result(val);
+    ++i;
+  }
+  if (state.thread_index == 0) {
+    delete m;
+    keys.clear();
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ConcurrentFind)->ThreadRange(1, 8);
+
+static void BM_MutexCuckooFind(benchmark::State& state) {
+  static CuckooMap<uint64>* m = nullptr;
+  static std::vector<uint64> keys;
+  static Mutex mu;
+  if (state.thread_index == 0) {
+    keys = BenchKeys();
+    m = new CuckooMap<uint64>(kBenchItems);
+    m->SetEmptyKey(0);
+    for (uint64 k : keys)
+      m->Insert(k, k);
+  }
+  unsigned i = state.thread_index * 7919;
+  while (state.KeepRunning()) {
+    MutexLock lock(&mu);
+    base::sink_result(m->find(keys[i % kBenchItems]));
+    ++i;
+  }
+  if (state.thread_index == 0) {
+    delete m;
+    keys.clear();
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_MutexCuckooFind)->ThreadRange(1, 8);
+
+}  // namespace base
@@ -138,12 +138,7 @@ CuckooMapTable::~CuckooMapTable() {
 }
 
 inline uint32 CuckooMapTable::CheckEmpty(const Bucket& bucket) const {
-  // I trust compiler to do loop unrolling in opt mode.
-  uint32 result = 0;
-  for (uint8 i = 0; i < kBucketLength; ++i) {
-    result |= ((bucket.key[i] == empty_value_) << i);
-  }
-  return result;
+  return MatchKeys(bucket.key, empty_value_);
 }
 
 inline CuckooMapTable::BucketId CuckooMapTable::NextBucketId(
@@ -171,14 +166,12 @@ CuckooMapTable::BucketIdPair CuckooMapTable::HashToIdPair(const key_type v) cons
 
 inline CuckooMapTable::dense_id CuckooMapTable::FindInBucket(
   const BucketIdPair& id_pair, const key_type k) const {
-  const key_type* a = GetBucketById(id_pair.first)->key;
-  for (uint8 i = 0; i < kBucketLength; ++i) {
-    if (a[i] == k) return ToDenseId(id_pair.first, i);
-  }
-  a = GetBucketById(id_pair.second)->key;
-  for (uint8 i = 0; i < kBucketLength; ++i) {
-    if (a[i] == k) return ToDenseId(id_pair.second, i);
-  }
+  uint32 mask = MatchKeys(GetBucketById(id_pair.first)->key, k);
+  if (mask)
+    return ToDenseId(id_pair.first, Bits::FindLSBSetNonZero(mask));
+  mask = MatchKeys(GetBucketById(id_pair.second)->key, k);
+  if (mask)
+    return ToDenseId(id_pair.second, Bits::FindLSBSetNonZero(mask));
   return npos;
 }
 
@@ -229,7 +222,10 @@ inline int CuckooMapTable::InsertIntoBucket(const uint32 empty_mask, Bucket* buc
 inline void CuckooMapTable::SwapPending(Bucket* bucket, uint8 index) {
   VLOG(3) << "Swapping " << pending_key_ << " and " << bucket->key[index]
           << " which now will be pending";
-  std::swap(pending_key_, bucket->key[index]);
+  // std::swap can not bind to the packed key.
+  key_type evicted = bucket->key[index];
+  bucket->key[index] = pending_key_;
+  pending_key_ = evicted;
   uint8* next_ptr = (pending_ptr_ == tmp_value_.get()) ? pending_ptr_ + value_size_ :
       tmp_value_.get();
   uint8* value_ptr = bucket->data + value_size_* index;
@@ -5,7 +5,9 @@
 #include "base/random.h"
 #include "base/gtest.h"
 
+#include <unordered_map>
 #include <unordered_set>
+#include <sparsehash/dense_hash_map>
 #include <sparsehash/dense_hash_set>
 // #include "base/hash.h"
 #include "base/random.h"
@@ -111,6 +113,17 @@ TEST_F(CuckooMapTest, Compact) {
   }
 }
 
+TEST_F(CuckooMapTest, MatchKeys) {
+  const uint64 v = 0x123456789ULL;
+  uint64 keys[4] = {1, v, v ^ (1ULL << 40), v};
+  EXPECT_EQ(10, CuckooMapTable::MatchKeys(keys, v));
+  EXPECT_EQ(4, CuckooMapTable::MatchKeys(keys, v ^ (1ULL << 40)));
+
+  // Only the low half matches.
+  EXPECT_EQ(0, CuckooMapTable::MatchKeys(keys, v & 0xFFFFFFFF));
+  EXPECT_EQ(0, CuckooMapTable::MatchKeys(keys, 0));
+}
+
 // Crash at Compact() if has less than 4 elements.
 TEST_F(CuckooMapTest, CompactBug) {
   CuckooMap<int> m(2000);
@@ -293,4 +306,109 @@ static void BM_CuckooCompact(benchmark::State& state) {
 }
 BENCHMARK(BM_CuckooCompact)->Arg(800)->Arg(1 << 16)->Arg(1<<18);
 
+// Find benchmarks at a given load factor, in percents. Every iteration looks up a present key
+// and a missing one.
+constexpr unsigned kLoadItems = 1 << 16;
+
+static std::vector<uint64> LoadKeys() {
+  MTRandom rand(30);
+  std::vector<uint64> keys(kLoadItems * 2);
+  for (uint64& k : keys) {
+    k = rand.Rand64();
+    if (k == 0) k = 1;
+  }
+  return keys;
+}
+
+static void BM_FindCuckooLoad(benchmark::State& state) {
+  std::vector<uint64> keys = LoadKeys();
+  CuckooMap<uint64> m(kLoadItems * 100 / state.range_x());
+  m.SetEmptyKey(0);
+  for (unsigned i = 0; i < kLoadItems; ++i)
+    m.Insert(keys[i], i);
+  unsigned i = 0;
+  while (state.KeepRunning()) {
+    sink_result(m.find(keys[i]));
+    sink_result(m.find(keys[i + kLoadItems]));
+    i = (i + 1) % kLoadItems;
+  }
+  state.SetLabel(std::to_string(int(m.Utilization() * 100)) + "% utilization");
+}
+BENCHMARK(BM_FindCuckooLoad)->Arg(50)->Arg(75)->Arg(90);
+
+static void BM_FindDenseMapLoad(benchmark::State& state) {
+  std::vector<uint64> keys = LoadKeys();
+  ::google::dense_hash_map<uint64, uint64, cityhash32> m;
+  m.set_empty_key(0);
+  m.max_load_factor(state.range_x() / 100.0);
+  m.resize(kLoadItems);
+  for (unsigned i = 0; i < kLoadItems; ++i)
+    m[keys[i]] = i;
+  unsigned i = 0;
+  while (state.KeepRunning()) {
+    sink_result(m.find(keys[i]) == m.end());
+    sink_result(m.find(keys[i + kLoadItems]) == m.end());
+    i = (i + 1) % kLoadItems;
+  }
+}
+BENCHMARK(BM_FindDenseMapLoad)->Arg(50)->Arg(75)->Arg(90);
+
+static void BM_FindUnorderedMapLoad(benchmark::State& state) {
+  std::vector<uint64> keys = LoadKeys();
+  std::unordered_map<uint64, uint64, cityhash32> m;
+  m.max_load_factor(state.range_x() / 100.0);
+  m.reserve(kLoadItems);
+  for (unsigned i = 0; i < kLoadItems; ++i)
+    m[keys[i]] = i;
+  unsigned i = 0;
+  while (state.KeepRunning()) {
+    sink_result(m.find(keys[i]) == m.end());
+    sink_result(m.find(keys[i + kLoadItems]) == m.end());
+    i = (i + 1) % kLoadItems;
+  }
+}
+BENCHMARK(BM_FindUnorderedMapLoad)->Arg(50)->Arg(75)->Arg(90);
+
+static void BM_InsertCuckooLoad(benchmark::State& state) {
+  std::vector<uint64> keys = LoadKeys();
+  while (state.KeepRunning()) {
+    CuckooMap<uint64> m(kLoadItems * 100 / state.range_x());
+    m.SetEmptyKey(0);
+    for (unsigned i = 0; i < kLoadItems; ++i)
+      m.Insert(keys[i], i);
+    sink_result(m.size());
+  }
+  state.SetItemsProcessed(state.iterations() * kLoadItems);
+}
+BENCHMARK(BM_InsertCuckooLoad)->Arg(50)->Arg(75)->Arg(90);
+
+static void BM_InsertDenseMapLoad(benchmark::State& state) {
+  std::vector<uint64> keys = LoadKeys();
+  while (state.KeepRunning()) {
+    ::google::dense_hash_map<uint64, uint64, cityhash32> m;
+    m.set_empty_key(0);
+    m.max_load_factor(state.range_x() / 100.0);
+    m.resize(kLoadItems);
+    for (unsigned i = 0; i < kLoadItems; ++i)
+      m[keys[i]] = i;
+    sink_result(m.size());
+  }
+  state.SetItemsProcessed(state.iterations() * kLoadItems);
+}
+BENCHMARK(BM_InsertDenseMapLoad)->Arg(50)->Arg(75)->Arg(90);
+
+static void BM_InsertUnorderedMapLoad(benchmark::State& state) {
+  std::vector<uint64> keys = LoadKeys();
+  while (state.KeepRunning()) {
+    std::unordered_map<uint64, uint64, cityhash32> m;
+    m.max_load_factor(state.range_x() / 100.0);
+    m.reserve(kLoadItems);
+    for (unsigned i = 0; i < kLoadItems; ++i)
+      m[keys[i]] = i;
+    sink_result(m.size());
+  }
+  state.SetItemsProcessed(state.iterations() * kLoadItems);
+}
+BENCHMARK(BM_InsertUnorderedMapLoad)->Arg(50)->Arg(75)->Arg(90);
+
 }  // namespace base
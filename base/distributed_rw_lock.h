@@ -0,0 +1,125 @@
+// Copyright 2013, Beeri 15.  All rights reserved.
+// Author: Roman Gershman (romange@gmail.com)
+//
+#ifndef _BASE_DISTRIBUTED_RW_LOCK_H
+#define _BASE_DISTRIBUTED_RW_LOCK_H
+
+#include <sched.h>
+#include <atomic>
+
+#include "base/integral_types.h"
+#include "base/macros.h"
+#include "base/port.h"
+
+namespace base {
+
+/*
+  Reader-writer spin lock for read-mostly data. Every thread counts its readers in its own
+  cache line, so readers on different cores do not share any writable memory. A writer raises
+  a flag and waits until all the reader counters drop to zero. Readers that see the flag back
+  off until the writer is done, so writers are not starved, but they pay O(kNumSlots) per lock.
+  Readers must unlock on the thread that locked. Use it when writes are rare, for example for
+  configuration snapshots or registries that are scanned often.
+*/
+class DistributedRWLock {
+public:
+  static constexpr unsigned kNumSlots = 64;
+
+  // constexpr so that global locks are initialized before any dynamic initializer runs.
+  constexpr DistributedRWLock() : writer_(false) {}
+
+  void lock_shared() {
+    std::atomic<uint32>& readers = slots_[ThreadSlot()].readers;
+    while (true) {
+      readers.fetch_add(1, std::memory_order_seq_cst);
+      if (!writer_.load(std::memory_order_seq_cst))
+        return;
+      readers.fetch_sub(1, std::memory_order_release);
+      WaitForWriter();
+    }
+  }
+
+  bool try_lock_shared() {
+    std::atomic<uint32>& readers = slots_[ThreadSlot()].readers;
+    readers.fetch_add(1, std::memory_order_seq_cst);
+    if (!writer_.load(std::memory_order_seq_cst))
+      return true;
+    readers.fetch_sub(1, std::memory_order_release);
+    return false;
+  }
+
+  void unlock_shared() {
+    slots_[ThreadSlot()].readers.fetch_sub(1, std::memory_order_release);
+  }
+
+  void lock() {
+    bool expected = false;
+    unsigned spins = 0;
+    while (!writer_.compare_exchange_weak(expected, true, std::memory_order_seq_cst)) {
+      expected = false;
+      Backoff(&spins);
+    }
+    for (unsigned i = 0; i < kNumSlots; ++i) {
+      while (slots_[i].readers.load(std::memory_order_acquire) != 0)
+        Backoff(&spins);
+    }
+  }
+
+  void unlock() {
+    writer_.store(false, std::memory_order_release);
+  }
+
+  class ReadHolder {
+  public:
+    explicit ReadHolder(DistributedRWLock* lock) : lock_(lock) { lock_->lock_shared(); }
+    ~ReadHolder() { lock_->unlock_shared(); }
+  private:
+    DistributedRWLock* lock_;
+    DISALLOW_COPY_AND_ASSIGN(ReadHolder);
+  };
+
+  class WriteHolder {
+  public:
+    explicit WriteHolder(DistributedRWLock* lock) : lock_(lock) { lock_->lock(); }
+    ~WriteHolder() { lock_->unlock(); }
+  private:
+    DistributedRWLock* lock_;
+    DISALLOW_COPY_AND_ASSIGN(WriteHolder);
+  };
+
+private:
+  struct Slot {
+    std::atomic<uint32> readers{0};
+  } CACHELINE_ALIGNED;
+
+  static unsigned ThreadSlot() {
+    static std::atomic<uint32> next_index(0);
+    static __thread uint32 index = kuint32max;
+    if (index == kuint32max)
+      index = next_index.fetch_add(1, std::memory_order_relaxed) % kNumSlots;
+    return index;
+  }
+
+  static void Backoff(unsigned* spins) {
+    if (++*spins < 1000) {
+      asm volatile("pause");
+    } else {
+      sched_yield();
+    }
+  }
+
+  void WaitForWriter() {
+    unsigned spins = 0;
+    while (writer_.load(std::memory_order_relaxed))
+      Backoff(&spins);
+  }
+
+  Slot slots_[kNumSlots];
+  std::atomic_bool writer_ CACHELINE_ALIGNED;
+
+  DISALLOW_COPY_AND_ASSIGN(DistributedRWLock);
+};
+
+}  // namespace base
+
+#endif  // _BASE_DISTRIBUTED_RW_LOCK_H
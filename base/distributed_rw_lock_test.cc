@@ -0,0 +1,130 @@
+// Copyright 2013, Beeri 15.  All rights reserved.
+// Author: Roman Gershman (romange@gmail.com)
+//
+#include "base/distributed_rw_lock.h"
+
+#include <pthread.h>
+#include <thread>
+#include <vector>
+#include "base/gtest.h"
+#include "base/RWSpinLock.h"
+
+namespace base {
+
+class DistributedRWLockTest : public testing::Test {
+protected:
+  DistributedRWLock lock_;
+};
+
+TEST_F(DistributedRWLockTest, Basic) {
+  lock_.lock_shared();
+  EXPECT_TRUE(lock_.try_lock_shared());
+  lock_.unlock_shared();
+  lock_.unlock_shared();
+
+  lock_.lock();
+  EXPECT_FALSE(lock_.try_lock_shared());
+  std::thread([this] { EXPECT_FALSE(lock_.try_lock_shared()); }).join();
+  lock_.unlock();
+
+  DistributedRWLock::ReadHolder holder(&lock_);
+  std::thread([this] { EXPECT_TRUE(lock_.try_lock_shared()); lock_.unlock_shared(); }).join();
+}
+
+TEST_F(DistributedRWLockTest, Concurrent) {
+  // Writers keep a == b, readers must never see them differ.
+  uint64 a = 0, b = 0;
+  std::atomic_bool stop(false);
+  std::atomic<uint64> reads(0), bad_reads(0);
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.emplace_back([&] {
+      while (!stop.load(std::memory_order_relaxed)) {
+        DistributedRWLock::ReadHolder holder(&lock_);
+        if (a != b)
+          bad_reads.fetch_add(1);
+        reads.fetch_add(1, std::memory_order_relaxed);
+      }
+    });
+  }
+  for (int i = 0; i < 2; ++i) {
+    threads.emplace_back([&] {
+      for (int j = 0; j < 2000; ++j) {
+        DistributedRWLock::WriteHolder holder(&lock_);
+        ++a;
+        ++b;
+      }
+    });
+  }
+  threads[4].join();
+  threads[5].join();
+  stop = true;
+  for (int i = 0; i < 4; ++i)
+    threads[i].join();
+  EXPECT_EQ(4000, a);
+  EXPECT_EQ(4000, b);
+  EXPECT_EQ(0, bad_reads);
+  EXPECT_GT(reads, 0);
+}
+
+static volatile uint64 bm_sink;
+
+// Read-mostly workload: one write per 1024 reads.
+template<typename Lock, void (*RLock)(Lock*), void (*RUnlock)(Lock*),
+         void (*WLock)(Lock*), void (*WUnlock)(Lock*)>
+void ReadMostly(benchmark::State& state, Lock* lock) {
+  static uint64 val = 0;
+  uint64 sum = 0;
+  unsigned i = 0;
+  while (state.KeepRunning()) {
+    if ((++i & 1023) == 0) {
+      WLock(lock);
+      ++val;
+      WUnlock(lock);
+    } else {
+      RLock(lock);
+      sum += val;
+      RUnlock(lock);
+    }
+  }
+  bm_sink = sum;
+}
+
+static void DistRLock(DistributedRWLock* l) { l->lock_shared(); }
+static void DistRUnlock(DistributedRWLock* l) { l->unlock_shared(); }
+static void DistWLock(DistributedRWLock* l) { l->lock(); }
+static void DistWUnlock(DistributedRWLock* l) { l->unlock(); }
+
+static void SpinRLock(folly::RWSpinLock* l) { l->lock_shared(); }
+static void SpinRUnlock(folly::RWSpinLock* l) { l->unlock_shared(); }
+static void SpinWLock(folly::RWSpinLock* l) { l->lock(); }
+static void SpinWUnlock(folly::RWSpinLock* l) { l->unlock(); }
+
+static void PthreadRLock(pthread_rwlock_t* l) { pthread_rwlock_rdlock(l); }
+static void PthreadWLock(pthread_rwlock_t* l) { pthread_rwlock_wrlock(l); }
+static void PthreadUnlock(pthread_rwlock_t* l) { pthread_rwlock_unlock(l); }
+
+static DistributedRWLock dist_lock;
+static folly::RWSpinLock spin_lock;
+static pthread_rwlock_t pthread_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+static void BM_DistributedRWLock(benchmark::State& state) {
+  ReadMostly<DistributedRWLock, DistRLock, DistRUnlock, DistWLock, DistWUnlock>(
+      state, &dist_lock);
+}
+BENCHMARK(BM_DistributedRWLock)->ThreadRange(1, 8);
+
+static void BM_RWSpinLock(benchmark::State& state) {
+  ReadMostly<folly::RWSpinLock, SpinRLock, SpinRUnlock, SpinWLock, SpinWUnlock>(
+      state, &spin_lock);
+}
+BENCHMARK(BM_RWSpinLock)->ThreadRange(1, 8);
+
+static void BM_PthreadRWLock(benchmark::State& state) {
+  ReadMostly<pthread_rwlock_t, PthreadRLock, PthreadUnlock, PthreadWLock, PthreadUnlock>(
+      state, &pthread_lock);
+}
+BENCHMARK(BM_PthreadRWLock)->ThreadRange(1, 8);
+
+}  // namespace base
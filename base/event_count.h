@@ -0,0 +1,168 @@
+// Copyright 2013, Beeri 15.  All rights reserved.
+// Author: Roman Gershman (romange@gmail.com)
+//
+#ifndef _BASE_EVENT_COUNT_H
+#define _BASE_EVENT_COUNT_H
+
+#include <atomic>
+#include <climits>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "base/integral_types.h"
+#include "base/macros.h"
+
+namespace base {
+
+/*
+  Futex based event count. Lets threads block until some condition on lock-free state becomes
+  true without holding a mutex on the fast path. Notify is a fence and an atomic load when
+  nobody waits.
+
+  Waiter:
+    EventCount::Key key = ec.PrepareWait();
+    if (condition()) {
+      ec.CancelWait();
+    } else {
+      ec.Wait(key);
+    }
+  Notifier: makes condition() true and then calls ec.Notify().
+  Await(condition) wraps the waiter protocol in a loop.
+*/
+class EventCount {
+public:
+  typedef uint32 Key;
+
+  EventCount() : val_(0) {}
+
+  // Registers the calling thread as a waiter. Must be followed by CancelWait or Wait.
+  Key PrepareWait() {
+    uint64 prev = val_.fetch_add(kAddWaiter, std::memory_order_seq_cst);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    return prev >> kEpochShift;
+  }
+
+  void CancelWait() { Unregister(); }
+
+  // Blocks until Notify is called after the PrepareWait that returned key.
+  void Wait(Key key) {
+    while (Epoch() == key) {
+      FutexCall(FUTEX_WAIT_PRIVATE, key, nullptr);
+    }
+    Unregister();
+  }
+
+  // Like Wait but gives up after ms milliseconds. Returns false on timeout.
+  bool WaitFor(Key key, uint32 ms) {
+    timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    AddMillis(ms, &deadline);
+    bool res = true;
+    while (Epoch() == key) {
+      timespec now;
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      timespec left = {deadline.tv_sec - now.tv_sec, deadline.tv_nsec - now.tv_nsec};
+      if (left.tv_nsec < 0) {
+        --left.tv_sec;
+        left.tv_nsec += 1000000000L;
+      }
+      if (left.tv_sec < 0) {
+        res = false;
+        break;
+      }
+      FutexCall(FUTEX_WAIT_PRIVATE, key, &left);
+    }
+    Unregister();
+    return res;
+  }
+
+  // Wakes up one waiter, if there are any.
+  void Notify() { DoNotify(1); }
+
+  void NotifyAll() { DoNotify(INT_MAX); }
+
+  // Blocks until cond() returns true. Spins for a short while before sleeping because
+  // in producer-consumer pipelines the condition usually flips within microseconds and
+  // a futex round trip costs more than that.
+  template<typename Cond> void Await(Cond cond) {
+    static const unsigned spin_count = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? kSpinCount : 0;
+    for (unsigned i = 0; i < spin_count; ++i) {
+      if (cond())
+        return;
+      asm volatile("pause");
+    }
+    while (!cond()) {
+      Key key = PrepareWait();
+      if (cond()) {
+        CancelWait();
+        return;
+      }
+      Wait(key);
+    }
+  }
+
+  // Returns false if cond() is still false after ms milliseconds.
+  template<typename Cond> bool AwaitFor(Cond cond, uint32 ms) {
+    if (cond())
+      return true;
+    Key key = PrepareWait();
+    if (cond()) {
+      CancelWait();
+      return true;
+    }
+    WaitFor(key, ms);
+    return cond();
+  }
+
+private:
+  static constexpr unsigned kSpinCount = 200;
+
+  // val_ keeps the number of registered waiters in the low 32 bits and the epoch in the high
+  // 32 bits, which are also the futex word. Notifiers only bump the epoch and never touch
+  // the waiter count: every waiter removes its own registration, whether it was woken,
+  // timed out or cancelled, so a late CancelWait can not unregister another thread.
+  static constexpr uint64 kAddWaiter = 1;
+  static constexpr uint64 kWaiterMask = (1ULL << 32) - 1;
+  static constexpr unsigned kEpochShift = 32;
+  static constexpr uint64 kAddEpoch = 1ULL << kEpochShift;
+
+  static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "The futex word is the high half");
+
+  Key Epoch() const { return val_.load(std::memory_order_acquire) >> kEpochShift; }
+
+  void Unregister() { val_.fetch_sub(kAddWaiter, std::memory_order_seq_cst); }
+
+  void DoNotify(int count) {
+    // Pairs with PrepareWait: either the waiter sees the new state or we see the waiter.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if ((val_.load(std::memory_order_relaxed) & kWaiterMask) == 0)
+      return;
+    uint64 prev = val_.fetch_add(kAddEpoch, std::memory_order_acq_rel);
+    if (prev & kWaiterMask)
+      FutexCall(FUTEX_WAKE_PRIVATE, count, nullptr);
+  }
+
+  void FutexCall(int op, uint32 val, const timespec* timeout) {
+    uint32* epoch = reinterpret_cast<uint32*>(&val_) + 1;
+    syscall(SYS_futex, epoch, op, val, timeout, nullptr, 0);
+  }
+
+  static void AddMillis(uint32 ms, timespec* ts) {
+    ts->tv_sec += ms / 1000;
+    ts->tv_nsec += (ms % 1000) * 1000000L;
+    if (ts->tv_nsec >= 1000000000L) {
+      ++ts->tv_sec;
+      ts->tv_nsec -= 1000000000L;
+    }
+  }
+
+  std::atomic<uint64> val_;
+
+  DISALLOW_COPY_AND_ASSIGN(EventCount);
+};
+
+}  // namespace base
+
+#endif  // _BASE_EVENT_COUNT_H
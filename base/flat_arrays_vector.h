@@ -10,8 +10,10 @@ namespace base {
 // Represents vector of vectors using flat memory block.
 // Useful when you build vector of vectors once and continously use them afterwards.
 // The data structure allows to map from dense index to vector items of type T.
-template<typename T> class FlatArraysVec {
-  std::vector<uint32> offsets_;
+// Offsets holds the start offsets and must provide push_back, operator[], size and
+// shrink_to_fit like std::vector. util::coding::EliasFano compresses them on Finalize().
+template<typename T, typename Offsets = std::vector<uint32>> class FlatArraysVec {
+  Offsets offsets_;
   std::vector<T> data_;
 public:
 
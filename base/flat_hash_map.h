@@ -0,0 +1,408 @@
+// Copyright 2013, Beeri 15.  All rights reserved.
+// Author: Roman Gershman (romange@gmail.com)
+//
+#ifndef _BASE_FLAT_HASH_MAP_H
+#define _BASE_FLAT_HASH_MAP_H
+
+#include <emmintrin.h>
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <new>
+#include <tuple>
+#include <utility>
+
+#include "base/bits.h"
+#include "base/integral_types.h"
+#include "base/logging.h"
+
+namespace base {
+
+/*
+  Open addressing hash table in the style of Swiss tables. Values are stored in a flat array
+  of slots without per element allocations. Every slot has a control byte which is either
+  empty, deleted or holds 7 bits of the hash of the key in the slot. Lookups compare the
+  control bytes of a group of 16 slots at once with SSE2 and compare keys only for the
+  matching slots. Groups are probed quadratically and a lookup stops at the first group with
+  an empty slot.
+
+  find(), count() and erase() accept any key type K for which Hash and Eq are defined,
+  which allows looking up string keys by StringPiece without building strings.
+  Insertions and rehashing invalidate iterators and pointers to values.
+*/
+namespace detail {
+
+struct FlatHashGroup {
+  static constexpr unsigned kWidth = 16;
+
+  // Full slots hold H2 of the hash, which is in [0, 127].
+  static constexpr int8 kEmpty = -128;
+  static constexpr int8 kDeleted = -2;
+
+  __m128i ctrl;
+
+  explicit FlatHashGroup(const int8* pos)
+      : ctrl(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pos))) {}
+
+  // Returns a mask with bit i set if ctrl[i] == h2.
+  uint32 Match(int8 h2) const {
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), ctrl));
+  }
+
+  uint32 MatchEmpty() const { return Match(kEmpty); }
+
+  // Both empty and deleted have the high bit set.
+  uint32 MatchEmptyOrDeleted() const { return _mm_movemask_epi8(ctrl); }
+
+  static const int8* EmptyGroup() {
+    alignas(16) static const int8 kEmptyGroup[kWidth] = {
+        kEmpty, kEmpty, kEmpty, kEmpty, kEmpty, kEmpty, kEmpty, kEmpty,
+        kEmpty, kEmpty, kEmpty, kEmpty, kEmpty, kEmpty, kEmpty, kEmpty};
+    return kEmptyGroup;
+  }
+};
+
+template<typename T> struct IdentityKey {
+  const T& operator()(const T& v) const { return v; }
+};
+
+template<typename Pair> struct PairFirstKey {
+  const typename Pair::first_type& operator()(const Pair& v) const { return v.first; }
+};
+
+template<typename Table, typename V> class FlatHashIterator {
+public:
+  typedef std::forward_iterator_tag iterator_category;
+  typedef V value_type;
+  typedef V& reference;
+  typedef V* pointer;
+  typedef std::ptrdiff_t difference_type;
+
+  FlatHashIterator() : table_(nullptr), index_(0) {}
+
+  FlatHashIterator(Table* table, size_t index) : table_(table), index_(index) {
+    SkipEmpty();
+  }
+
+  // Converts iterator to const_iterator.
+  template<typename T2, typename V2> FlatHashIterator(const FlatHashIterator<T2, V2>& o)
+      : table_(o.table_), index_(o.index_) {}
+
+  V& operator*() const { return table_->slots_[index_]; }
+  V* operator->() const { return table_->slots_ + index_; }
+
+  FlatHashIterator& operator++() {
+    ++index_;
+    SkipEmpty();
+    return *this;
+  }
+
+  FlatHashIterator operator++(int) {
+    FlatHashIterator res = *this;
+    ++*this;
+    return res;
+  }
+
+  bool operator==(const FlatHashIterator& o) const { return index_ == o.index_; }
+  bool operator!=(const FlatHashIterator& o) const { return index_ != o.index_; }
+
+private:
+  template<typename T2, typename V2> friend class FlatHashIterator;
+  template<typename V2, typename K2, typename KO, typename H, typename E>
+      friend class FlatHashTable;
+
+  void SkipEmpty() {
+    while (index_ < table_->capacity_ && table_->ctrl_[index_] < 0)
+      ++index_;
+  }
+
+  Table* table_;
+  size_t index_;
+};
+
+template<typename Value, typename Key, typename KeyOf, typename Hash, typename Eq>
+class FlatHashTable {
+  typedef FlatHashGroup Group;
+public:
+  typedef Key key_type;
+  typedef Value value_type;
+  typedef size_t size_type;
+  typedef Hash hasher;
+  typedef Eq key_equal;
+  typedef FlatHashIterator<FlatHashTable, Value> iterator;
+  typedef FlatHashIterator<const FlatHashTable, const Value> const_iterator;
+
+  FlatHashTable() {}
+
+  FlatHashTable(FlatHashTable&& o) { swap(o); }
+
+  FlatHashTable& operator=(FlatHashTable&& o) {
+    swap(o);
+    return *this;
+  }
+
+  ~FlatHashTable() {
+    DestroySlots();
+    Deallocate();
+  }
+
+  iterator begin() { return iterator(this, 0); }
+  const_iterator begin() const { return const_iterator(this, 0); }
+  iterator end() { return iterator(this, capacity_); }
+  const_iterator end() const { return const_iterator(this, capacity_); }
+
+  template<typename K> iterator find(const K& key) {
+    return iterator(this, FindIndex(key, HashOf(key)));
+  }
+
+  template<typename K> const_iterator find(const K& key) const {
+    return const_iterator(this, FindIndex(key, HashOf(key)));
+  }
+
+  template<typename K> size_t count(const K& key) const {
+    return FindIndex(key, HashOf(key)) != capacity_;
+  }
+
+  void erase(iterator it) { erase(const_iterator(it)); }
+
+  void erase(const_iterator it) {
+    size_t i = it.index_;
+    DCHECK_LT(i, capacity_);
+    slots_[i].~Value();
+    SetCtrl(i, Group::kDeleted);
+    --size_;
+  }
+
+  template<typename K> size_t erase(const K& key) {
+    size_t i = FindIndex(key, HashOf(key));
+    if (i == capacity_)
+      return 0;
+    erase(const_iterator(this, i));
+    return 1;
+  }
+
+  // Keeps the allocated slots.
+  void clear() {
+    DestroySlots();
+    if (capacity_) {
+      std::fill(ctrl_, ctrl_ + capacity_ + Group::kWidth, int8(Group::kEmpty));
+      growth_left_ = MaxLoad(capacity_);
+    }
+    size_ = 0;
+  }
+
+  // Makes sure that n elements can be inserted without rehashing.
+  void reserve(size_t n) {
+    size_t capacity = Group::kWidth;
+    while (MaxLoad(capacity) < n)
+      capacity *= 2;
+    if (capacity > capacity_)
+      Resize(capacity);
+  }
+
+  void swap(FlatHashTable& o) {
+    std::swap(ctrl_, o.ctrl_);
+    std::swap(slots_, o.slots_);
+    std::swap(capacity_, o.capacity_);
+    std::swap(size_, o.size_);
+    std::swap(growth_left_, o.growth_left_);
+    std::swap(hash_, o.hash_);
+    std::swap(eq_, o.eq_);
+  }
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  size_t bucket_count() const { return capacity_; }
+  double load_factor() const { return capacity_ ? size_ * 1.0 / capacity_ : 0; }
+
+  // Bytes allocated by the table, not including memory owned by the values.
+  size_t MemoryUsage() const {
+    return capacity_ ? AllocSize(capacity_) : 0;
+  }
+
+protected:
+  // Inserts a value constructed from args if key does not exist.
+  template<typename K, typename... Args>
+  std::pair<iterator, bool> EmplaceUnique(const K& key, Args&&... args) {
+    size_t hash = HashOf(key);
+    size_t i = FindIndex(key, hash);
+    if (i != capacity_)
+      return std::make_pair(iterator(this, i), false);
+    if (growth_left_ == 0) {
+      // Rehash in place if most of the used slots are tombstones.
+      size_t capacity = capacity_ ? capacity_ * 2 : Group::kWidth;
+      Resize(size_ * 2 < MaxLoad(capacity_) ? capacity_ : capacity);
+    }
+    i = FindInsertSlot(hash);
+    if (ctrl_[i] == Group::kEmpty)
+      --growth_left_;
+    new (slots_ + i) Value(std::forward<Args>(args)...);
+    SetCtrl(i, H2(hash));
+    ++size_;
+    return std::make_pair(iterator(this, i), true);
+  }
+
+private:
+  template<typename T2, typename V2> friend class FlatHashIterator;
+
+  // 7/8 of the slots may be used.
+  static size_t MaxLoad(size_t capacity) { return capacity - capacity / 8; }
+
+  static size_t SlotsOffset(size_t capacity) {
+    size_t ctrl_size = capacity + Group::kWidth;
+    return (ctrl_size + alignof(Value) - 1) / alignof(Value) * alignof(Value);
+  }
+
+  static size_t AllocSize(size_t capacity) {
+    return SlotsOffset(capacity) + capacity * sizeof(Value);
+  }
+
+  // Spreads the hash so that the identity hashes of integers work too.
+  template<typename K> size_t HashOf(const K& key) const {
+    uint64 h = uint64(hash_(key)) * 0x9E3779B97F4A7C15ULL;
+    return h ^ (h >> 32);
+  }
+
+  static size_t H1(size_t hash) { return hash >> 7; }
+  static int8 H2(size_t hash) { return hash & 0x7f; }
+
+  // Returns capacity_ if key is not found.
+  template<typename K> size_t FindIndex(const K& key, size_t hash) const {
+    if (capacity_ == 0)
+      return 0;
+    size_t mask = capacity_ - 1;
+    size_t pos = H1(hash) & mask;
+    int8 h2 = H2(hash);
+    for (size_t step = Group::kWidth; ; step += Group::kWidth) {
+      Group g(ctrl_ + pos);
+      for (uint32 m = g.Match(h2); m; m &= (m - 1)) {
+        size_t i = (pos + Bits::FindLSBSetNonZero(m)) & mask;
+        if (eq_(KeyOf()(slots_[i]), key))
+          return i;
+      }
+      if (g.MatchEmpty())
+        return capacity_;
+      pos = (pos + step) & mask;
+    }
+  }
+
+  size_t FindInsertSlot(size_t hash) const {
+    size_t mask = capacity_ - 1;
+    size_t pos = H1(hash) & mask;
+    for (size_t step = Group::kWidth; ; step += Group::kWidth) {
+      uint32 m = Group(ctrl_ + pos).MatchEmptyOrDeleted();
+      if (m)
+        return (pos + Bits::FindLSBSetNonZero(m)) & mask;
+      pos = (pos + step) & mask;
+    }
+  }
+
+  // The first kWidth control bytes are mirrored after the last one, so that a group
+  // starting at any slot can be loaded without wrapping around.
+  void SetCtrl(size_t i, int8 h) {
+    ctrl_[i] = h;
+    if (i < Group::kWidth)
+      ctrl_[capacity_ + i] = h;
+  }
+
+  void Resize(size_t capacity) {
+    DCHECK_EQ(0, capacity & (capacity - 1));
+    VLOG(2) << "Resizing FlatHashTable from " << capacity_ << " to " << capacity;
+
+    int8* old_ctrl = ctrl_;
+    Value* old_slots = slots_;
+    size_t old_capacity = capacity_;
+
+    char* mem = static_cast<char*>(::operator new(AllocSize(capacity)));
+    ctrl_ = reinterpret_cast<int8*>(mem);
+    slots_ = reinterpret_cast<Value*>(mem + SlotsOffset(capacity));
+    capacity_ = capacity;
+    std::fill(ctrl_, ctrl_ + capacity + Group::kWidth, int8(Group::kEmpty));
+    growth_left_ = MaxLoad(capacity) - size_;
+
+    for (size_t i = 0; i < old_capacity; ++i) {
+      if (old_ctrl[i] < 0)
+        continue;
+      size_t hash = HashOf(KeyOf()(old_slots[i]));
+      size_t dest = FindInsertSlot(hash);
+      new (slots_ + dest) Value(std::move(old_slots[i]));
+      old_slots[i].~Value();
+      SetCtrl(dest, H2(hash));
+    }
+    if (old_capacity)
+      ::operator delete(old_ctrl);
+  }
+
+  void DestroySlots() {
+    for (size_t i = 0; i < capacity_; ++i) {
+      if (ctrl_[i] >= 0)
+        slots_[i].~Value();
+    }
+  }
+
+  void Deallocate() {
+    if (capacity_)
+      ::operator delete(ctrl_);
+  }
+
+  int8* ctrl_ = const_cast<int8*>(Group::EmptyGroup());
+  Value* slots_ = nullptr;
+  size_t capacity_ = 0;
+  size_t size_ = 0;
+  size_t growth_left_ = 0;
+
+  Hash hash_;
+  Eq eq_;
+
+  FlatHashTable(const FlatHashTable&) = delete;
+  void operator=(const FlatHashTable&) = delete;
+};
+
+}  // namespace detail
+
+template<typename Key, typename Hash = std::hash<Key>, typename Eq = std::equal_to<Key>>
+class FlatHashSet
+    : public detail::FlatHashTable<Key, Key, detail::IdentityKey<Key>, Hash, Eq> {
+  typedef detail::FlatHashTable<Key, Key, detail::IdentityKey<Key>, Hash, Eq> Parent;
+public:
+  typedef typename Parent::iterator iterator;
+
+  std::pair<iterator, bool> insert(const Key& key) {
+    return this->EmplaceUnique(key, key);
+  }
+
+  std::pair<iterator, bool> insert(Key&& key) {
+    return this->EmplaceUnique(key, std::move(key));
+  }
+};
+
+template<typename Key, typename T, typename Hash = std::hash<Key>,
+         typename Eq = std::equal_to<Key>>
+class FlatHashMap
+    : public detail::FlatHashTable<std::pair<const Key, T>, Key,
+                                   detail::PairFirstKey<std::pair<const Key, T>>, Hash, Eq> {
+  typedef detail::FlatHashTable<std::pair<const Key, T>, Key,
+                                detail::PairFirstKey<std::pair<const Key, T>>, Hash, Eq> Parent;
+public:
+  typedef T mapped_type;
+  typedef typename Parent::value_type value_type;
+  typedef typename Parent::iterator iterator;
+
+  std::pair<iterator, bool> insert(const value_type& val) {
+    return this->EmplaceUnique(val.first, val);
+  }
+
+  // Constructs the value from args if key does not exist.
+  template<typename... Args> std::pair<iterator, bool> emplace(const Key& key, Args&&... args) {
+    return this->EmplaceUnique(key, std::piecewise_construct, std::forward_as_tuple(key),
+                               std::forward_as_tuple(std::forward<Args>(args)...));
+  }
+
+  T& operator[](const Key& key) {
+    return emplace(key).first->second;
+  }
+};
+
+}  // namespace base
+
+#endif  // _BASE_FLAT_HASH_MAP_H
@@ -0,0 +1,154 @@
+// Copyright 2013, Beeri 15.  All rights reserved.
+// Author: Roman Gershman (romange@gmail.com)
+//
+#include "base/flat_hash_map.h"
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "base/gtest.h"
+#include "base/random.h"
+
+namespace base {
+
+class FlatHashMapTest : public testing::Test {
+};
+
+TEST_F(FlatHashMapTest, Basic) {
+  FlatHashMap<int, std::string> m;
+  EXPECT_TRUE(m.empty());
+  EXPECT_TRUE(m.find(1) == m.end());
+  EXPECT_EQ(0, m.MemoryUsage());
+
+  EXPECT_TRUE(m.emplace(1, "one").second);
+  EXPECT_FALSE(m.emplace(1, "uno").second);
+  EXPECT_TRUE(m.insert(std::make_pair(2, std::string("two"))).second);
+  m[3] = "three";
+  EXPECT_EQ(3, m.size());
+  EXPECT_EQ("one", m.find(1)->second);
+  EXPECT_EQ("three", m[3]);
+  EXPECT_EQ(1, m.count(2));
+
+  EXPECT_EQ(1, m.erase(2));
+  EXPECT_EQ(0, m.erase(2));
+  EXPECT_TRUE(m.find(2) == m.end());
+  EXPECT_EQ(2, m.size());
+
+  int sum = 0;
+  for (const auto& k_v : m)
+    sum += k_v.first;
+  EXPECT_EQ(4, sum);
+  EXPECT_GT(m.MemoryUsage(), 0);
+
+  m.clear();
+  EXPECT_TRUE(m.empty());
+  EXPECT_TRUE(m.begin() == m.end());
+}
+
+TEST_F(FlatHashMapTest, Grow) {
+  FlatHashMap<uint64, uint64> m;
+  std::unordered_map<uint64, uint64> expected;
+  MTRandom rand(10);
+  for (unsigned i = 0; i < 100000; ++i) {
+    uint64 k = rand.Rand64() % 50000;
+    m[k] += i;
+    expected[k] += i;
+
+    // Erase some keys to leave tombstones behind.
+    if (i % 3 == 0) {
+      k = rand.Rand64() % 50000;
+      ASSERT_EQ(expected.erase(k), m.erase(k));
+    }
+  }
+  ASSERT_EQ(expected.size(), m.size());
+  for (const auto& k_v : expected) {
+    auto it = m.find(k_v.first);
+    ASSERT_TRUE(it != m.end());
+    ASSERT_EQ(k_v.second, it->second);
+  }
+  size_t count = 0;
+  for (const auto& k_v : m) {
+    ASSERT_EQ(1, expected.count(k_v.first));
+    ++count;
+  }
+  EXPECT_EQ(expected.size(), count);
+  LOG(INFO) << "Load factor " << m.load_factor();
+}
+
+namespace {
+
+struct StringHash {
+  size_t operator()(const std::string& s) const { return std::hash<std::string>()(s); }
+  size_t operator()(const char* s) const { return std::hash<std::string>()(s); }
+};
+
+struct StringEq {
+  bool operator()(const std::string& a, const std::string& b) const { return a == b; }
+  bool operator()(const std::string& a, const char* b) const { return a == b; }
+};
+
+}  // namespace
+
+TEST_F(FlatHashMapTest, Heterogeneous) {
+  FlatHashSet<std::string, StringHash, StringEq> s;
+  EXPECT_TRUE(s.insert(std::string("foo")).second);
+  EXPECT_FALSE(s.insert(std::string("foo")).second);
+  EXPECT_TRUE(s.find("foo") != s.end());
+  EXPECT_EQ(0, s.count("bar"));
+  EXPECT_EQ(1, s.erase("foo"));
+  EXPECT_TRUE(s.empty());
+}
+
+TEST_F(FlatHashMapTest, MoveOnly) {
+  FlatHashMap<int, std::unique_ptr<int>> m;
+  for (int i = 0; i < 1000; ++i)
+    m.emplace(i, new int(i));
+  for (int i = 0; i < 1000; ++i)
+    ASSERT_EQ(i, *m[i]);
+
+  FlatHashMap<int, std::unique_ptr<int>> m2(std::move(m));
+  EXPECT_TRUE(m.empty());
+  EXPECT_EQ(1000, m2.size());
+}
+
+constexpr unsigned kBenchItems = 1 << 20;
+
+static std::vector<uint64> BenchKeys() {
+  MTRandom rand(30);
+  std::vector<uint64> keys(kBenchItems * 2);
+  for (uint64& k : keys)
+    k = rand.Rand64();
+  return keys;
+}
+
+// Every iteration looks up a present key and a missing one.
+template<typename Map> void BM_Find(benchmark::State& state) {
+  std::vector<uint64> keys = BenchKeys();
+  Map m;
+  for (unsigned i = 0; i < kBenchItems; ++i)
+    m.emplace(keys[i], i);
+  unsigned i = 0;
+  while (state.KeepRunning()) {
+    sink_result(m.find(keys[i]) == m.end());
+    sink_result(m.find(keys[i + kBenchItems]) == m.end());
+    i = (i + 1) % kBenchItems;
+  }
+}
+BENCHMARK_TEMPLATE(BM_Find, FlatHashMap<uint64, uint64>);
+BENCHMARK_TEMPLATE(BM_Find, std::unordered_map<uint64, uint64>);
+
+template<typename Map> void BM_Insert(benchmark::State& state) {
+  std::vector<uint64> keys = BenchKeys();
+  while (state.KeepRunning()) {
+    Map m;
+    for (unsigned i = 0; i < kBenchItems; ++i)
+      m.emplace(keys[i], i);
+    sink_result(m.size());
+  }
+  state.SetItemsProcessed(state.iterations() * kBenchItems);
+}
+BENCHMARK_TEMPLATE(BM_Insert, FlatHashMap<uint64, uint64>);
+BENCHMARK_TEMPLATE(BM_Insert, std::unordered_map<uint64, uint64>);
+
+}  // namespace base
@@ -0,0 +1,281 @@
+// Copyright 2013, Beeri 15.  All rights reserved.
+// Author: Roman Gershman (romange@gmail.com)
+//
+#define __STDC_FORMAT_MACROS 1
+
+#include "base/hdr_histogram.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <utility>
+
+#include "base/logging.h"
+
+namespace base {
+
+constexpr unsigned HdrHistogram::kMaxPrecisionBits;
+
+namespace {
+
+constexpr uint32 kMagic = 0x52444801;  // "\1HDR"
+
+void PutVarint(uint64 v, std::string* out) {
+  while (v >= 0x80) {
+    out->push_back(char(v | 0x80));
+    v >>= 7;
+  }
+  out->push_back(char(v));
+}
+
+// new does not respect alignments above the one of malloc before C++17.
+template<typename T, typename... Args> T* NewAligned(Args&&... args) {
+  void* ptr = aligned_malloc(sizeof(T), alignof(T));
+  CHECK(ptr);
+  return new (ptr) T(std::forward<Args>(args)...);
+}
+
+template<typename T> void DeleteAligned(T* t) {
+  if (t) {
+    t->~T();
+    aligned_free(t);
+  }
+}
+
+bool GetVarint(const char** data, const char* end, uint64* v) {
+  *v = 0;
+  for (unsigned shift = 0; shift < 64 && *data < end; shift += 7) {
+    uint8 byte = *(*data)++;
+    *v |= uint64(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0)
+      return true;
+  }
+  return false;
+}
+
+}  // namespace
+
+HdrHistogram::HdrHistogram(unsigned precision_bits, unsigned max_bits)
+    : precision_bits_(precision_bits), max_bits_(max_bits) {
+  CHECK_GT(precision_bits, 0);
+  CHECK_LE(precision_bits, kMaxPrecisionBits);
+  CHECK_LT(precision_bits, max_bits);
+  CHECK_LE(max_bits, 64);
+  limit_ = max_bits == 64 ? kuint64max : 1ULL << max_bits;
+  buckets_.resize(NumBuckets(precision_bits, max_bits));
+}
+
+uint64 HdrHistogram::BucketStart(unsigned index, unsigned precision_bits, uint64* width) {
+  unsigned block = index >> precision_bits;
+  if (block == 0) {
+    *width = 1;
+    return index;
+  }
+  unsigned shift = block - 1;
+  *width = 1ULL << shift;
+  return uint64(index - (shift << precision_bits)) << shift;
+}
+
+void HdrHistogram::Record(uint64 value, uint64 count) {
+  buckets_[Bucket(value)] += count;
+  count_ += count;
+  sum_ += value * count;
+  if (value < min_)
+    min_ = value;
+  if (value > max_)
+    max_ = value;
+}
+
+void HdrHistogram::Clear() {
+  std::fill(buckets_.begin(), buckets_.end(), 0);
+  count_ = sum_ = max_ = 0;
+  min_ = kuint64max;
+}
+
+void HdrHistogram::Merge(const HdrHistogram& other) {
+  CHECK_EQ(precision_bits_, other.precision_bits_);
+  CHECK_EQ(max_bits_, other.max_bits_);
+  for (size_t i = 0; i < buckets_.size(); ++i)
+    buckets_[i] += other.buckets_[i];
+  count_ += other.count_;
+  sum_ += other.sum_;
+  min_ = std::min(min_, other.min_);
+  max_ = std::max(max_, other.max_);
+}
+
+uint64 HdrHistogram::Percentile(double p) const {
+  if (count_ == 0)
+    return 0;
+  uint64 rank = count_ * (p / 100.0);
+  if (rank >= count_)
+    return max_;
+  if (rank == 0)
+    rank = 1;
+  uint64 sum = 0;
+  for (size_t i = 0; i < buckets_.size(); ++i) {
+    sum += buckets_[i];
+    if (sum >= rank) {
+      uint64 width;
+      uint64 start = BucketStart(i, precision_bits_, &width);
+      uint64 res = start + width / 2;
+      return std::max(min_, std::min(res, max_));
+    }
+  }
+  return max_;
+}
+
+std::string HdrHistogram::ToString() const {
+  char buf[256];
+  snprintf(buf, sizeof(buf), "Count: %" PRIu64 " Average: %.2f Min: %" PRIu64 " Max: %" PRIu64
+           "\nP50: %" PRIu64 " P90: %" PRIu64 " P99: %" PRIu64 " P99.9: %" PRIu64 "\n",
+           count_, Average(), min(), max(), Percentile(50), Percentile(90), Percentile(99),
+           Percentile(99.9));
+  return buf;
+}
+
+void HdrHistogram::Serialize(std::string* out) const {
+  PutVarint(kMagic, out);
+  PutVarint(precision_bits_, out);
+  PutVarint(max_bits_, out);
+  PutVarint(sum_, out);
+  PutVarint(min_, out);
+  PutVarint(max_, out);
+
+  // Pairs of (bucket delta, count) for non-empty buckets.
+  unsigned non_empty = 0;
+  for (uint64 c : buckets_)
+    non_empty += (c != 0);
+  PutVarint(non_empty, out);
+  size_t prev = 0;
+  for (size_t i = 0; i < buckets_.size(); ++i) {
+    if (buckets_[i] == 0)
+      continue;
+    PutVarint(i - prev, out);
+    PutVarint(buckets_[i], out);
+    prev = i;
+  }
+}
+
+bool HdrHistogram::Parse(const char* data, size_t size) {
+  const char* end = data + size;
+  uint64 magic, precision_bits, max_bits, sum, min, max, non_empty;
+  if (!GetVarint(&data, end, &magic) || magic != kMagic ||
+      !GetVarint(&data, end, &precision_bits) || !GetVarint(&data, end, &max_bits) ||
+      precision_bits == 0 || precision_bits > kMaxPrecisionBits ||
+      precision_bits >= max_bits || max_bits > 64 ||
+      !GetVarint(&data, end, &sum) || !GetVarint(&data, end, &min) ||
+      !GetVarint(&data, end, &max) || !GetVarint(&data, end, &non_empty)) {
+    return false;
+  }
+  HdrHistogram res(precision_bits, max_bits);
+  uint64 index = 0;
+  for (uint64 i = 0; i < non_empty; ++i) {
+    uint64 delta, count;
+    if (!GetVarint(&data, end, &delta) || !GetVarint(&data, end, &count))
+      return false;
+    index += delta;
+    if (index >= res.buckets_.size())
+      return false;
+    res.buckets_[index] += count;
+    res.count_ += count;
+  }
+  if (data != end)
+    return false;
+  res.sum_ = sum;
+  res.min_ = min;
+  res.max_ = max;
+  *this = std::move(res);
+  return true;
+}
+
+constexpr unsigned ConcurrentHdrHistogram::kNumShards;
+
+ConcurrentHdrHistogram::Shard::Shard(unsigned num_buckets)
+    : buckets(new std::atomic<uint64>[num_buckets]) {
+  Clear(num_buckets);
+}
+
+void ConcurrentHdrHistogram::Shard::Clear(unsigned num_buckets) {
+  for (unsigned i = 0; i < num_buckets; ++i)
+    buckets[i].store(0, std::memory_order_relaxed);
+  sum.store(0, std::memory_order_relaxed);
+  min.store(kuint64max, std::memory_order_relaxed);
+  max.store(0, std::memory_order_relaxed);
+}
+
+void ConcurrentHdrHistogram::Shard::UpdateMin(uint64 value) {
+  uint64 current = min.load(std::memory_order_relaxed);
+  while (value < current &&
+         !min.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+  }
+}
+
+void ConcurrentHdrHistogram::Shard::UpdateMax(uint64 value) {
+  uint64 current = max.load(std::memory_order_relaxed);
+  while (value > current &&
+         !max.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+  }
+}
+
+ConcurrentHdrHistogram::ConcurrentHdrHistogram(unsigned precision_bits, unsigned max_bits)
+    : precision_bits_(precision_bits), max_bits_(max_bits) {
+  HdrHistogram validate(precision_bits, max_bits);
+  limit_ = validate.limit_;
+  num_buckets_ = validate.num_buckets();
+  for (auto& shard : shards_)
+    shard.store(nullptr, std::memory_order_relaxed);
+}
+
+ConcurrentHdrHistogram::~ConcurrentHdrHistogram() {
+  for (auto& shard : shards_)
+    DeleteAligned(shard.load(std::memory_order_relaxed));
+}
+
+unsigned ConcurrentHdrHistogram::ThreadShard() {
+  static std::atomic<unsigned> next_shard(0);
+  static __thread unsigned thread_shard = kuint32max;
+  if (PREDICT_FALSE(thread_shard == kuint32max))
+    thread_shard = next_shard.fetch_add(1, std::memory_order_relaxed) % kNumShards;
+  return thread_shard;
+}
+
+auto ConcurrentHdrHistogram::AllocateShard() -> Shard* {
+  std::atomic<Shard*>& slot = shards_[ThreadShard()];
+  Shard* shard = NewAligned<Shard>(num_buckets_);
+  Shard* expected = nullptr;
+  if (!slot.compare_exchange_strong(expected, shard, std::memory_order_acq_rel)) {
+    DeleteAligned(shard);
+    return expected;
+  }
+  return shard;
+}
+
+HdrHistogram ConcurrentHdrHistogram::Snapshot() const {
+  HdrHistogram res(precision_bits_, max_bits_);
+  for (const auto& slot : shards_) {
+    const Shard* shard = slot.load(std::memory_order_acquire);
+    if (shard == nullptr)
+      continue;
+    for (unsigned i = 0; i < num_buckets_; ++i) {
+      uint64 count = shard->buckets[i].load(std::memory_order_relaxed);
+      res.buckets_[i] += count;
+      res.count_ += count;
+    }
+    res.sum_ += shard->sum.load(std::memory_order_relaxed);
+    res.min_ = std::min(res.min_, shard->min.load(std::memory_order_relaxed));
+    res.max_ = std::max(res.max_, shard->max.load(std::memory_order_relaxed));
+  }
+  return res;
+}
+
+void ConcurrentHdrHistogram::Clear() {
+  for (auto& slot : shards_) {
+    Shard* shard = slot.load(std::memory_order_acquire);
+    if (shard)
+      shard->Clear(num_buckets_);
+  }
+}
+
+}  // namespace base
@@ -0,0 +1,164 @@
+// Copyright 2013, Beeri 15.  All rights reserved.
+// Author: Roman Gershman (romange@gmail.com)
+//
+#ifndef _BASE_HDR_HISTOGRAM_H
+#define _BASE_HDR_HISTOGRAM_H
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/bits.h"
+#include "base/integral_types.h"
+#include "base/port.h"
+
+namespace base {
+
+/*
+  Log-linear histogram of non-negative integers, like HdrHistogram. Values below
+  2^precision_bits have their own buckets, every larger power of 2 range is split into
+  2^precision_bits equal buckets. Therefore the relative error of percentiles is at most
+  2^-precision_bits, and the bucket of a value is computed with a few bit operations.
+  Values above 2^max_bits - 1 are counted in the last bucket.
+  Not thread-safe, see ConcurrentHdrHistogram.
+*/
+class HdrHistogram {
+public:
+  // Bounds the number of buckets to (64 - kMaxPrecisionBits + 1) << kMaxPrecisionBits.
+  static constexpr unsigned kMaxPrecisionBits = 16;
+
+  // Requires 0 < precision_bits <= kMaxPrecisionBits and precision_bits < max_bits <= 64.
+  explicit HdrHistogram(unsigned precision_bits = 7, unsigned max_bits = 40);
+
+  void Record(uint64 value) { Record(value, 1); }
+  void Record(uint64 value, uint64 count);
+
+  void Clear();
+
+  // other must have the same precision_bits and max_bits.
+  void Merge(const HdrHistogram& other);
+
+  uint64 count() const { return count_; }
+  uint64 min() const { return count_ ? min_ : 0; }
+  uint64 max() const { return max_; }
+  double Average() const { return count_ ? double(sum_) / count_ : 0; }
+
+  // p in [0, 100]. Returns the middle of the bucket of the p-th percentile, clamped by
+  // min() and max(). Percentile(100) is max().
+  uint64 Percentile(double p) const;
+
+  std::string ToString() const;
+
+  // Appends a compact representation which contains only non-empty buckets.
+  void Serialize(std::string* out) const;
+
+  // Replaces the contents of the histogram. Returns false if the data is corrupted.
+  bool Parse(const char* data, size_t size);
+
+  unsigned precision_bits() const { return precision_bits_; }
+  unsigned max_bits() const { return max_bits_; }
+  size_t num_buckets() const { return buckets_.size(); }
+
+  // Bucket layout, exposed for ConcurrentHdrHistogram.
+  static size_t NumBuckets(unsigned precision_bits, unsigned max_bits) {
+    return size_t(max_bits - precision_bits + 1) << precision_bits;
+  }
+
+  // Values with the same most significant precision_bits + 1 bits share a bucket.
+  static unsigned BucketIndex(uint64 value, unsigned precision_bits) {
+    unsigned shift = Bits::FindMSBSetNonZero64(value | (1ULL << precision_bits)) -
+        precision_bits;
+    return (shift << precision_bits) + (value >> shift);
+  }
+
+  // The smallest value and the width of the bucket.
+  static uint64 BucketStart(unsigned index, unsigned precision_bits, uint64* width);
+
+private:
+  friend class ConcurrentHdrHistogram;
+
+  unsigned Bucket(uint64 value) const {
+    return value >= limit_ ? buckets_.size() - 1 : BucketIndex(value, precision_bits_);
+  }
+
+  unsigned precision_bits_;
+  unsigned max_bits_;
+  uint64 limit_;
+
+  uint64 count_ = 0;
+  uint64 sum_ = 0;
+  uint64 min_ = kuint64max;
+  uint64 max_ = 0;
+  std::vector<uint64> buckets_;
+};
+
+/*
+  Thread-safe HdrHistogram. Every thread records into its own shard with relaxed atomic
+  operations, so Record never takes a lock or shares a cache line with other threads.
+  Threads are mapped to kNumShards shards which are allocated on first use. Snapshot merges
+  the shards.
+*/
+class ConcurrentHdrHistogram {
+public:
+  explicit ConcurrentHdrHistogram(unsigned precision_bits = 7, unsigned max_bits = 40);
+  ~ConcurrentHdrHistogram();
+
+  void Record(uint64 value) {
+    Shard* shard = shards_[ThreadShard()].load(std::memory_order_acquire);
+    if (shard == nullptr)
+      shard = AllocateShard();
+    shard->Record(value, precision_bits_, limit_, num_buckets_);
+  }
+
+  // Returns the merge of all the shards. Values recorded concurrently may be partially
+  // reflected, e.g. in count() but not yet in max().
+  HdrHistogram Snapshot() const;
+
+  // Values recorded concurrently with Clear may be lost.
+  void Clear();
+
+private:
+  static constexpr unsigned kNumShards = 64;
+
+  struct Shard {
+    std::atomic<uint64> sum;
+    std::atomic<uint64> min;
+    std::atomic<uint64> max;
+    std::unique_ptr<std::atomic<uint64>[]> buckets;
+
+    explicit Shard(unsigned num_buckets);
+    void Clear(unsigned num_buckets);
+
+    void Record(uint64 value, unsigned precision_bits, uint64 limit, unsigned num_buckets) {
+      unsigned b = value >= limit ? num_buckets - 1 :
+          HdrHistogram::BucketIndex(value, precision_bits);
+      buckets[b].fetch_add(1, std::memory_order_relaxed);
+      sum.fetch_add(value, std::memory_order_relaxed);
+      if (value < min.load(std::memory_order_relaxed))
+        UpdateMin(value);
+      if (value > max.load(std::memory_order_relaxed))
+        UpdateMax(value);
+    }
+
+    void UpdateMin(uint64 value);
+    void UpdateMax(uint64 value);
+  } CACHELINE_ALIGNED;
+
+  static unsigned ThreadShard();
+  Shard* AllocateShard();
+
+  unsigned precision_bits_;
+  unsigned max_bits_;
+  uint64 limit_;
+  unsigned num_buckets_;
+
+  std::atomic<Shard*> shards_[kNumShards];
+
+  ConcurrentHdrHistogram(const ConcurrentHdrHistogram&) = delete;
+  void operator=(const ConcurrentHdrHistogram&) = delete;
+};
+
+}  // namespace base
+
+#endif  // _BASE_HDR_HISTOGRAM_H
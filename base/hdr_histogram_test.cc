@@ -0,0 +1,189 @@
+// Copyright 2013, Beeri 15.  All rights reserved.
+// Author: Roman Gershman (romange@gmail.com)
+//
+#include "base/hdr_histogram.h"
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include "base/gtest.h"
+#include "base/histogram.h"
+#include "base/random.h"
+
+namespace base {
+
+class HdrHistogramTest : public testing::Test {
+};
+
+TEST_F(HdrHistogramTest, Layout) {
+  const unsigned kPrecision = 4;
+  unsigned prev = 0;
+  for (uint64 v = 0; v < 100000; ++v) {
+    unsigned index = HdrHistogram::BucketIndex(v, kPrecision);
+    ASSERT_TRUE(index == prev || index == prev + 1) << v;
+    uint64 width;
+    uint64 start = HdrHistogram::BucketStart(index, kPrecision, &width);
+    ASSERT_LE(start, v);
+    ASSERT_LT(v, start + width);
+    ASSERT_LE(width * (1 << kPrecision), std::max<uint64>(start, 1 << kPrecision));
+    prev = index;
+  }
+  EXPECT_EQ(HdrHistogram::NumBuckets(kPrecision, 64) - 1,
+            HdrHistogram::BucketIndex(kuint64max, kPrecision));
+}
+
+TEST_F(HdrHistogramTest, Percentiles) {
+  HdrHistogram hist;
+  std::vector<uint64> values;
+  MTRandom rand(10);
+  for (unsigned i = 0; i < 100000; ++i) {
+    // Log-uniform values from 1ns to ~1s.
+    uint64 v = 1ULL << (rand.Rand32() % 30);
+    v += rand.Rand64() % v;
+    values.push_back(v);
+    hist.Record(v);
+  }
+  std::sort(values.begin(), values.end());
+  EXPECT_EQ(values.size(), hist.count());
+  EXPECT_EQ(values.front(), hist.min());
+  EXPECT_EQ(values.back(), hist.max());
+  for (double p : {1.0, 25.0, 50.0, 90.0, 99.0, 99.9}) {
+    uint64 expected = values[values.size() * p / 100 - 1];
+    uint64 actual = hist.Percentile(p);
+    EXPECT_NEAR(expected, actual, expected / 64.0 + 1) << p;
+  }
+  EXPECT_EQ(values.back(), hist.Percentile(100));
+
+  // Values above the limit go to the last bucket.
+  HdrHistogram small(3, 10);
+  small.Record(1 << 20);
+  small.Record(5);
+  EXPECT_EQ(1 << 20, small.Percentile(100));
+  EXPECT_EQ(5, small.Percentile(50));
+}
+
+TEST_F(HdrHistogramTest, MergeAndSerialize) {
+  HdrHistogram a, b;
+  for (unsigned i = 1; i <= 1000; ++i) {
+    a.Record(i);
+    b.Record(i * 1000, 2);
+  }
+  a.Merge(b);
+  EXPECT_EQ(3000, a.count());
+  EXPECT_EQ(1, a.min());
+  EXPECT_EQ(1000000, a.max());
+
+  std::string buf;
+  a.Serialize(&buf);
+  HdrHistogram c(3, 20);
+  ASSERT_TRUE(c.Parse(buf.data(), buf.size()));
+  EXPECT_EQ(a.precision_bits(), c.precision_bits());
+  EXPECT_EQ(a.count(), c.count());
+  EXPECT_EQ(a.Average(), c.Average());
+  EXPECT_EQ(a.min(), c.min());
+  EXPECT_EQ(a.max(), c.max());
+  for (double p : {10.0, 50.0, 99.0})
+    EXPECT_EQ(a.Percentile(p), c.Percentile(p));
+  LOG(INFO) << buf.size() << " bytes\n" << c.ToString();
+
+  EXPECT_FALSE(c.Parse(buf.data(), buf.size() - 1));
+  buf.push_back(0);
+  EXPECT_FALSE(c.Parse(buf.data(), buf.size()));
+  EXPECT_FALSE(c.Parse(buf.data() + 1, buf.size() - 1));
+}
+
+static void AppendVarint(uint64 v, std::string* out) {
+  for (; v >= 0x80; v >>= 7)
+    out->push_back(char(v | 0x80));
+  out->push_back(char(v));
+}
+
+TEST_F(HdrHistogramTest, ParseHostileHeader) {
+  HdrHistogram hist;
+  std::string valid;
+  hist.Serialize(&valid);
+  ASSERT_TRUE(hist.Parse(valid.data(), valid.size()));
+
+  // magic, precision_bits, max_bits, sum, min, max, non_empty.
+  for (uint64 precision_bits : {17, 26, 31, 32, 63}) {
+    const uint64 header[] = {0x52444801, precision_bits, 64, 0, 0, 0, 1};
+    std::string buf;
+    for (uint64 v : header)
+      AppendVarint(v, &buf);
+    AppendVarint(0, &buf);
+    AppendVarint(1, &buf);
+    EXPECT_FALSE(hist.Parse(buf.data(), buf.size())) << precision_bits;
+  }
+  EXPECT_EQ(7, hist.precision_bits());
+  EXPECT_EQ(0, hist.count());
+
+  const uint64 data[] = {0x52444801, 16, 64, 5, 5, 5, 1, 5, 1};
+  std::string buf;
+  for (uint64 v : data)
+    AppendVarint(v, &buf);
+  ASSERT_TRUE(hist.Parse(buf.data(), buf.size()));
+  EXPECT_EQ(HdrHistogram::NumBuckets(16, 64), hist.num_buckets());
+  EXPECT_EQ(5, hist.Percentile(50));
+}
+
+TEST_F(HdrHistogramTest, Concurrent) {
+  ConcurrentHdrHistogram hist;
+  const unsigned kThreads = 4;
+  const unsigned kValues = 100000;
+  std::vector<std::thread> threads;
+  for (unsigned t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&hist, t] {
+      for (unsigned i = 0; i < kValues; ++i)
+        hist.Record(t * kValues + i);
+    });
+  }
+  // Snapshots while recording must not crash.
+  for (unsigned i = 0; i < 10; ++i)
+    EXPECT_LE(hist.Snapshot().count(), kThreads * kValues);
+  for (auto& t : threads)
+    t.join();
+
+  HdrHistogram res = hist.Snapshot();
+  EXPECT_EQ(kThreads * kValues, res.count());
+  EXPECT_EQ(0, res.min());
+  EXPECT_EQ(kThreads * kValues - 1, res.max());
+  EXPECT_NEAR(kThreads * kValues / 2, res.Percentile(50), kThreads * kValues / 100);
+
+  hist.Clear();
+  EXPECT_EQ(0, hist.Snapshot().count());
+}
+
+static void BM_Record(benchmark::State& state) {
+  HdrHistogram hist;
+  uint64 v = 1;
+  while (state.KeepRunning()) {
+    hist.Record(v & 0xfffff);
+    v = v * 6364136223846793005ULL + 1442695040888963407ULL;
+  }
+  sink_result(hist.count());
+}
+BENCHMARK(BM_Record);
+
+static void BM_HistogramAdd(benchmark::State& state) {
+  Histogram hist;
+  uint64 v = 1;
+  while (state.KeepRunning()) {
+    hist.Add(v & 0xfffff);
+    v = v * 6364136223846793005ULL + 1442695040888963407ULL;
+  }
+  sink_result(hist.count());
+}
+BENCHMARK(BM_HistogramAdd);
+
+static ConcurrentHdrHistogram concurrent_hist;
+
+static void BM_ConcurrentRecord(benchmark::State& state) {
+  uint64 v = state.thread_index + 1;
+  while (state.KeepRunning()) {
+    concurrent_hist.Record(v & 0xfffff);
+    v = v * 6364136223846793005ULL + 1442695040888963407ULL;
+  }
+}
+BENCHMARK(BM_ConcurrentRecord)->ThreadRange(1, 8);
+
+}  // namespace base
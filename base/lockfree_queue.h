@@ -0,0 +1,347 @@
+// Copyright 2013, Beeri 15.  All rights reserved.
+// Author: Roman Gershman (romange@gmail.com)
+//
+#ifndef _BASE_LOCKFREE_QUEUE_H
+#define _BASE_LOCKFREE_QUEUE_H
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+#include "base/event_count.h"
+#include "base/integral_types.h"
+#include "base/logging.h"
+#include "base/port.h"
+
+namespace base {
+
+namespace detail {
+
+inline size_t RoundUpPow2(size_t v) {
+  size_t res = 1;
+  while (res < v)
+    res <<= 1;
+  return res;
+}
+
+// Uninitialized storage for T.
+template<typename T> struct QueueSlot {
+  typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+
+  T* ptr() { return reinterpret_cast<T*>(&storage); }
+};
+
+}  // namespace detail
+
+/*
+  Bounded multi-producer multi-consumer queue based on Dmitry Vyukov's array queue.
+  Each cell holds a sequence number that tells producers and consumers whether the cell
+  is free for the current lap. Producers and consumers only contend on their own
+  index and on the cell they claim, indices sit on separate cache lines.
+  Items are moved in and out, so move-only types are supported.
+  try_ functions never block, push/pop block on futex based waiters when the queue is full or
+  empty. The interface follows sync_queue so users can switch between them.
+*/
+template<typename T> class mpmc_queue {
+  struct Cell {
+    std::atomic<size_t> seq;
+    detail::QueueSlot<T> slot;
+  };
+
+public:
+  // capacity is rounded up to a power of 2.
+  explicit mpmc_queue(size_t capacity)
+      : mask_(detail::RoundUpPow2(std::max<size_t>(capacity, 2)) - 1),
+        cells_(new Cell[mask_ + 1]) {
+    for (size_t i = 0; i <= mask_; ++i)
+      cells_[i].seq.store(i, std::memory_order_relaxed);
+    enqueue_pos_.store(0, std::memory_order_relaxed);
+    dequeue_pos_.store(0, std::memory_order_relaxed);
+  }
+
+  ~mpmc_queue() {
+    size_t end = enqueue_pos_.load(std::memory_order_relaxed);
+    for (size_t pos = dequeue_pos_.load(std::memory_order_relaxed); pos != end; ++pos)
+      cells_[pos & mask_].slot.ptr()->~T();
+  }
+
+  size_t capacity() const { return mask_ + 1; }
+
+  bool try_push(const T& item) { return try_push(T(item)); }
+  bool try_push(T&& item) {
+    if (!try_push_internal(&item))
+      return false;
+    not_empty_.Notify();
+    return true;
+  }
+
+  bool try_pop(T* dest) {
+    if (!try_pop_internal(dest))
+      return false;
+    NotifyPopped();
+    return true;
+  }
+
+  // Pushes up to count items from src, moving them. Returns the number of pushed items.
+  // Waiters are notified once per batch.
+  size_t try_push_n(T* src, size_t count) {
+    size_t res = 0;
+    while (res < count && try_push_internal(src + res))
+      ++res;
+    if (res)
+      not_empty_.NotifyAll();
+    return res;
+  }
+
+  // Pops up to max items into dest. Returns the number of popped items.
+  size_t try_pop_n(T* dest, size_t max) {
+    size_t res = 0;
+    while (res < max && try_pop_internal(dest + res))
+      ++res;
+    if (res) {
+      not_full_.NotifyAll();
+      NotifyIfEmpty();
+    }
+    return res;
+  }
+
+  // Blocks while the queue is full.
+  void push(const T& item) { push(T(item)); }
+  void push(T&& item) {
+    while (!try_push_internal(&item)) {
+      not_full_.Await([this] { return !full(); });
+    }
+    not_empty_.Notify();
+  }
+
+  // Blocks while the queue is empty.
+  T pop() {
+    T res;
+    while (!try_pop_internal(&res)) {
+      not_empty_.Await([this] { return !empty(); });
+    }
+    NotifyPopped();
+    return res;
+  }
+
+  // Waits up to ms milliseconds for an item. Returns false on timeout.
+  bool pop(uint32 ms, T* dest) {
+    while (!try_pop_internal(dest)) {
+      if (!not_empty_.AwaitFor([this] { return !empty(); }, ms))
+        return false;
+    }
+    NotifyPopped();
+    return true;
+  }
+
+  // Approximate when called concurrently with push/pop.
+  size_t size() const {
+    size_t enq = enqueue_pos_.load(std::memory_order_acquire);
+    size_t deq = dequeue_pos_.load(std::memory_order_acquire);
+    return enq > deq ? enq - deq : 0;
+  }
+
+  bool empty() const { return size() == 0; }
+  bool full() const { return size() > mask_; }
+
+  void WaitTillEmpty() {
+    drained_.Await([this] { return empty(); });
+  }
+
+  mpmc_queue(const mpmc_queue&) = delete;
+  mpmc_queue& operator=(const mpmc_queue&) = delete;
+
+private:
+  void NotifyPopped() {
+    not_full_.Notify();
+    NotifyIfEmpty();
+  }
+
+  // WaitTillEmpty has its own EventCount, otherwise it could swallow the single wake up
+  // that a pop sends to blocked producers.
+  void NotifyIfEmpty() {
+    if (empty())
+      drained_.NotifyAll();
+  }
+
+  bool try_push_internal(T* item) {
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    Cell* cell;
+    while (true) {
+      cell = &cells_[pos & mask_];
+      size_t seq = cell->seq.load(std::memory_order_acquire);
+      intptr_t dif = intptr_t(seq) - intptr_t(pos);
+      if (dif == 0) {
+        if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+          break;
+      } else if (dif < 0) {
+        return false;  // full.
+      } else {
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    new (cell->slot.ptr()) T(std::move(*item));
+    cell->seq.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool try_pop_internal(T* dest) {
+    size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    Cell* cell;
+    while (true) {
+      cell = &cells_[pos & mask_];
+      size_t seq = cell->seq.load(std::memory_order_acquire);
+      intptr_t dif = intptr_t(seq) - intptr_t(pos + 1);
+      if (dif == 0) {
+        if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+          break;
+      } else if (dif < 0) {
+        return false;  // empty.
+      } else {
+        pos = dequeue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    T* src = cell->slot.ptr();
+    *dest = std::move(*src);
+    src->~T();
+    cell->seq.store(pos + mask_ + 1, std::memory_order_release);
+    return true;
+  }
+
+  const size_t mask_;
+  std::unique_ptr<Cell[]> cells_;
+
+  char pad1_[CACHELINE_SIZE];
+  std::atomic<size_t> enqueue_pos_;
+  char pad2_[CACHELINE_SIZE - sizeof(size_t)];
+  std::atomic<size_t> dequeue_pos_;
+  char pad3_[CACHELINE_SIZE - sizeof(size_t)];
+
+  EventCount not_empty_, not_full_, drained_;
+};
+
+/*
+  Bounded single-producer single-consumer ring. Only one thread may push and only one thread
+  may pop. Each side caches the other side's index and reloads it only when the ring looks
+  full or empty, so in the steady state push and pop touch only their own cache line.
+*/
+template<typename T> class spsc_queue {
+public:
+  // capacity is rounded up to a power of 2.
+  explicit spsc_queue(size_t capacity)
+      : mask_(detail::RoundUpPow2(std::max<size_t>(capacity, 2)) - 1),
+        slots_(new detail::QueueSlot<T>[mask_ + 1]) {
+    head_.store(0, std::memory_order_relaxed);
+    tail_.store(0, std::memory_order_relaxed);
+  }
+
+  ~spsc_queue() {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    for (size_t i = head_.load(std::memory_order_relaxed); i != tail; ++i)
+      slots_[i & mask_].ptr()->~T();
+  }
+
+  size_t capacity() const { return mask_ + 1; }
+
+  bool try_push(const T& item) { return try_push(T(item)); }
+  bool try_push(T&& item) { return try_push_n(&item, 1) == 1; }
+
+  bool try_pop(T* dest) { return try_pop_n(dest, 1) == 1; }
+
+  // Producer only. Moves up to count items from src. Returns the number of pushed items.
+  size_t try_push_n(T* src, size_t count) {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - cached_head_ + count > capacity()) {
+      cached_head_ = head_.load(std::memory_order_acquire);
+      count = std::min(count, capacity() - (tail - cached_head_));
+    }
+    for (size_t i = 0; i < count; ++i)
+      new (slots_[(tail + i) & mask_].ptr()) T(std::move(src[i]));
+    if (count) {
+      tail_.store(tail + count, std::memory_order_release);
+      not_empty_.Notify();
+    }
+    return count;
+  }
+
+  // Consumer only. Pops up to max items into dest. Returns the number of popped items.
+  size_t try_pop_n(T* dest, size_t max) {
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (cached_tail_ - head < max) {
+      cached_tail_ = tail_.load(std::memory_order_acquire);
+      max = std::min(max, cached_tail_ - head);
+    }
+    for (size_t i = 0; i < max; ++i) {
+      T* src = slots_[(head + i) & mask_].ptr();
+      dest[i] = std::move(*src);
+      src->~T();
+    }
+    if (max) {
+      head_.store(head + max, std::memory_order_release);
+      not_full_.Notify();
+      if (empty())
+        drained_.NotifyAll();
+    }
+    return max;
+  }
+
+  void push(const T& item) { push(T(item)); }
+  void push(T&& item) {
+    while (try_push_n(&item, 1) == 0) {
+      not_full_.Await([this] { return !full(); });
+    }
+  }
+
+  T pop() {
+    T res;
+    while (try_pop_n(&res, 1) == 0) {
+      not_empty_.Await([this] { return !empty(); });
+    }
+    return res;
+  }
+
+  bool pop(uint32 ms, T* dest) {
+    while (try_pop_n(dest, 1) == 0) {
+      if (!not_empty_.AwaitFor([this] { return !empty(); }, ms))
+        return false;
+    }
+    return true;
+  }
+
+  size_t size() const {
+    return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+  }
+
+  bool empty() const { return size() == 0; }
+  bool full() const { return size() > mask_; }
+
+  void WaitTillEmpty() {
+    drained_.Await([this] { return empty(); });
+  }
+
+  spsc_queue(const spsc_queue&) = delete;
+  spsc_queue& operator=(const spsc_queue&) = delete;
+
+private:
+  const size_t mask_;
+  std::unique_ptr<detail::QueueSlot<T>[]> slots_;
+
+  // Consumer side.
+  char pad1_[CACHELINE_SIZE];
+  std::atomic<size_t> head_;
+  size_t cached_tail_ = 0;
+  char pad2_[CACHELINE_SIZE - 2 * sizeof(size_t)];
+
+  // Producer side.
+  std::atomic<size_t> tail_;
+  size_t cached_head_ = 0;
+  char pad3_[CACHELINE_SIZE - 2 * sizeof(size_t)];
+
+  EventCount not_empty_, not_full_, drained_;
+};
+
+}  // namespace base
+
+#endif  // _BASE_LOCKFREE_QUEUE_H
@@ -0,0 +1,194 @@
+// Copyright 2013, Beeri 15.  All rights reserved.
+// Author: Roman Gershman (romange@gmail.com)
+//
+#include "base/lockfree_queue.h"
+
+#include <future>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "base/gtest.h"
+#include "base/sync_queue.h"
+
+namespace base {
+
+class LockFreeQueueTest : public testing::Test {
+protected:
+};
+
+TEST_F(LockFreeQueueTest, Basic) {
+  mpmc_queue<int> q(5);
+  EXPECT_EQ(8, q.capacity());
+  EXPECT_TRUE(q.empty());
+  for (int i = 0; i < 8; ++i) {
+    ASSERT_TRUE(q.try_push(i));
+  }
+  EXPECT_TRUE(q.full());
+  EXPECT_FALSE(q.try_push(8));
+  int val = -1;
+  for (int i = 0; i < 8; ++i) {
+    ASSERT_TRUE(q.try_pop(&val));
+    EXPECT_EQ(i, val);
+  }
+  EXPECT_FALSE(q.try_pop(&val));
+  EXPECT_FALSE(q.pop(10, &val));
+}
+
+TEST_F(LockFreeQueueTest, MoveOnly) {
+  mpmc_queue<std::unique_ptr<int>> q(4);
+  q.push(std::unique_ptr<int>(new int(5)));
+  ASSERT_TRUE(q.try_push(std::unique_ptr<int>(new int(6))));
+  EXPECT_EQ(5, *q.pop());
+
+  spsc_queue<std::unique_ptr<int>> sq(4);
+  sq.push(std::unique_ptr<int>(new int(7)));
+  EXPECT_EQ(7, *sq.pop());
+
+  // Items left in the queues are destroyed with them.
+  sq.push(std::unique_ptr<int>(new int(8)));
+}
+
+TEST_F(LockFreeQueueTest, Batch) {
+  spsc_queue<int> q(16);
+  std::vector<int> src(20);
+  for (int i = 0; i < 20; ++i)
+    src[i] = i;
+  EXPECT_EQ(16, q.try_push_n(src.data(), src.size()));
+  EXPECT_EQ(0, q.try_push_n(src.data(), 1));
+
+  std::vector<int> dest(20, -1);
+  EXPECT_EQ(10, q.try_pop_n(dest.data(), 10));
+  EXPECT_EQ(4, q.try_push_n(src.data() + 16, 4));
+  EXPECT_EQ(10, q.try_pop_n(dest.data() + 10, 20));
+  dest.resize(20);
+  EXPECT_EQ(src, dest);
+
+  mpmc_queue<int> mq(8);
+  EXPECT_EQ(8, mq.try_push_n(src.data(), 10));
+  EXPECT_EQ(8, mq.try_pop_n(dest.data(), 10));
+  EXPECT_EQ(7, dest[7]);
+}
+
+TEST_F(LockFreeQueueTest, MPMC) {
+  constexpr int kProducers = 4, kConsumers = 4, kItems = 50000;
+  mpmc_queue<int> q(64);
+  std::vector<std::future<long>> consumers;
+  for (int i = 0; i < kConsumers; ++i) {
+    consumers.push_back(std::async(std::launch::async, [&q] {
+      long sum = 0;
+      while (true) {
+        int v = q.pop();
+        if (v < 0)
+          return sum;
+        sum += v;
+      }
+    }));
+  }
+  std::vector<std::thread> producers;
+  for (int i = 0; i < kProducers; ++i) {
+    producers.emplace_back([&q] {
+      for (int j = 1; j <= kItems; ++j)
+        q.push(j);
+    });
+  }
+  for (auto& t : producers)
+    t.join();
+  for (int i = 0; i < kConsumers; ++i)
+    q.push(-1);
+  long total = 0;
+  for (auto& f : consumers)
+    total += f.get();
+  EXPECT_EQ(long(kProducers) * kItems * (kItems + 1) / 2, total);
+  EXPECT_TRUE(q.empty());
+}
+
+TEST_F(LockFreeQueueTest, SPSC) {
+  constexpr int kItems = 200000;
+  spsc_queue<int> q(128);
+  auto consumer = std::async(std::launch::async, [&q] {
+    for (int i = 0; i < kItems; ++i) {
+      if (q.pop() != i)
+        return false;
+    }
+    return true;
+  });
+  for (int i = 0; i < kItems; ++i)
+    q.push(i);
+  EXPECT_TRUE(consumer.get());
+  q.WaitTillEmpty();
+}
+
+// A waiter that cancels after a notification must not unregister another waiter.
+TEST_F(LockFreeQueueTest, EventCountCancelAfterNotify) {
+  EventCount ec;
+  ec.PrepareWait();  // X
+  ec.Notify();
+  EventCount::Key z = ec.PrepareWait();
+  ec.CancelWait();  // X
+  ec.Notify();
+  EXPECT_TRUE(ec.WaitFor(z, 0));
+
+  EventCount::Key key = ec.PrepareWait();
+  auto waiter = std::async(std::launch::async, [&ec, key] { return ec.WaitFor(key, 5000); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  ec.Notify();
+  EXPECT_TRUE(waiter.get());
+
+  key = ec.PrepareWait();
+  EXPECT_FALSE(ec.WaitFor(key, 1));
+}
+
+// WaitTillEmpty must not take the wake ups that pops send to blocked producers.
+TEST_F(LockFreeQueueTest, WaitTillEmptyWithBlockedProducer) {
+  mpmc_queue<int> q(2);
+  q.push(0);
+  q.push(1);
+  auto waiter = std::async(std::launch::async, [&q] { q.WaitTillEmpty(); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  auto producer = std::async(std::launch::async, [&q] { q.push(2); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+  int val = -1;
+  for (int i = 0; i < 3; ++i) {
+    ASSERT_TRUE(q.pop(5000, &val));
+    EXPECT_EQ(i, val);
+  }
+  producer.wait();
+  EXPECT_EQ(std::future_status::ready, waiter.wait_for(std::chrono::seconds(5)));
+}
+
+template<typename Q> void RunPipeline(Q* q, int items) {
+  auto consumer = std::async(std::launch::async, [q, items] {
+    for (int i = 0; i < items; ++i)
+      q->pop();
+  });
+  for (int i = 0; i < items; ++i)
+    q->push(i);
+  consumer.wait();
+}
+
+static void BM_SyncQueue(benchmark::State& state) {
+  sync_queue<int> q(1024);
+  while (state.KeepRunning()) {
+    RunPipeline(&q, state.range_x());
+  }
+}
+BENCHMARK(BM_SyncQueue)->Arg(1 << 16);
+
+static void BM_MPMCQueue(benchmark::State& state) {
+  mpmc_queue<int> q(1024);
+  while (state.KeepRunning()) {
+    RunPipeline(&q, state.range_x());
+  }
+}
+BENCHMARK(BM_MPMCQueue)->Arg(1 << 16);
+
+static void BM_SPSCQueue(benchmark::State& state) {
+  spsc_queue<int> q(1024);
+  while (state.KeepRunning()) {
+    RunPipeline(&q, state.range_x());
+  }
+}
+BENCHMARK(BM_SPSCQueue)->Arg(1 << 16);
+
+}  // namespace base
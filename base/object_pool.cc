@@ -0,0 +1,114 @@
+// Copyright 2015, Beeri 15.  All rights reserved.
+// Author: Roman Gershman (romange@gmail.com)
+//
+
+#include "base/object_pool.h"
+
+#include <algorithm>
+#include "base/logging.h"
+
+namespace base {
+
+ObjectPoolBase::ObjectPoolBase(size_t block_size, unsigned magazine_size, size_t high_water)
+    : block_size_(block_size), magazine_size_(magazine_size), high_water_(high_water),
+      slow_allocated_(0) {
+  CHECK_NE(0, magazine_size);
+  CHECK_EQ(0, pthread_key_create(&key_, &ObjectPoolBase::ThreadExit));
+}
+
+ObjectPoolBase::~ObjectPoolBase() {
+  CHECK_EQ(0, pthread_key_delete(key_));
+  MutexLock lock(&mu_);
+  while (caches_) {
+    FreeCacheLocked(caches_);
+  }
+  for (void* p : depot_)
+    ::operator delete(p);
+}
+
+uint64 ObjectPoolBase::list_allocated() const {
+  MutexLock lock(&mu_);
+  uint64 res = exited_allocated_;
+  for (const ThreadCache* c = caches_; c; c = c->next)
+    res += c->allocated.load(std::memory_order_relaxed);
+  return res;
+}
+
+size_t ObjectPoolBase::depot_size() const {
+  MutexLock lock(&mu_);
+  return depot_.size();
+}
+
+ObjectPoolBase::ThreadCache* ObjectPoolBase::CreateCache() {
+  void* mem = ::operator new(sizeof(ThreadCache) + (2 * magazine_size_ - 1) * sizeof(void*));
+  ThreadCache* cache = new (mem) ThreadCache;
+  cache->owner = this;
+  cache->prev = nullptr;
+  cache->count = 0;
+  cache->allocated.store(0, std::memory_order_relaxed);
+  {
+    MutexLock lock(&mu_);
+    cache->next = caches_;
+    if (caches_)
+      caches_->prev = cache;
+    caches_ = cache;
+  }
+  CHECK_EQ(0, pthread_setspecific(key_, cache));
+  return cache;
+}
+
+void* ObjectPoolBase::AllocateSlow() {
+  slow_allocated_.fetch_add(1, std::memory_order_relaxed);
+  return ::operator new(block_size_);
+}
+
+bool ObjectPoolBase::Refill(ThreadCache* cache) {
+  MutexLock lock(&mu_);
+  if (depot_.empty())
+    return false;
+  size_t num = std::min<size_t>(magazine_size_, depot_.size());
+  std::copy(depot_.end() - num, depot_.end(), cache->items + cache->count);
+  depot_.resize(depot_.size() - num);
+  cache->count += num;
+  return true;
+}
+
+void ObjectPoolBase::Flush(ThreadCache* cache, uint32 count) {
+  void** start = cache->items + cache->count - count;
+  cache->count -= count;
+
+  MutexLock lock(&mu_);
+  uint32 keep = count;
+  if (high_water_) {
+    keep = depot_.size() >= high_water_ ? 0 : std::min<size_t>(count, high_water_ - depot_.size());
+  }
+  depot_.insert(depot_.end(), start, start + keep);
+  for (uint32 i = keep; i < count; ++i)
+    ::operator delete(start[i]);
+}
+
+void ObjectPoolBase::FreeCacheLocked(ThreadCache* cache) {
+  for (uint32 i = 0; i < cache->count; ++i)
+    ::operator delete(cache->items[i]);
+  exited_allocated_ += cache->allocated.load(std::memory_order_relaxed);
+  if (cache->prev)
+    cache->prev->next = cache->next;
+  else
+    caches_ = cache->next;
+  if (cache->next)
+    cache->next->prev = cache->prev;
+  cache->~ThreadCache();
+  ::operator delete(cache);
+}
+
+void ObjectPoolBase::ThreadExit(void* arg) {
+  ThreadCache* cache = reinterpret_cast<ThreadCache*>(arg);
+  ObjectPoolBase* me = cache->owner;
+
+  // Give the cached blocks to other threads.
+  me->Flush(cache, cache->count);
+  MutexLock lock(&me->mu_);
+  me->FreeCacheLocked(cache);
+}
+
+}  // namespace base
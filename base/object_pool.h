@@ -0,0 +1,141 @@
+// Copyright 2015, Beeri 15.  All rights reserved.
+// Author: Roman Gershman (romange@gmail.com)
+//
+
+#ifndef _BASE_OBJECT_POOL_H
+#define _BASE_OBJECT_POOL_H
+
+#include <pthread.h>
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "base/integral_types.h"
+#include "base/mutex.h"
+
+namespace base {
+
+// Untyped part of ObjectPool. Manages raw blocks of a fixed size.
+// Every thread caches up to 2 * magazine_size free blocks. When its cache is empty it takes
+// magazine_size blocks from the shared depot, and when the cache is full it gives magazine_size
+// blocks back. Therefore threads touch the depot lock only once per magazine_size operations.
+// If high_water is not 0, the depot keeps at most high_water free blocks and returns the rest
+// to the heap.
+class ObjectPoolBase {
+public:
+  // Number of blocks that were allocated on the heap.
+  uint64 slow_allocated() const { return slow_allocated_.load(std::memory_order_relaxed); }
+
+  // Number of allocations that were served from the pool.
+  uint64 list_allocated() const;
+
+  // Number of free blocks in the depot.
+  size_t depot_size() const;
+
+  size_t high_water() const { return high_water_; }
+
+protected:
+  ObjectPoolBase(size_t block_size, unsigned magazine_size, size_t high_water);
+
+  // All the threads must stop using the pool before it is destroyed.
+  ~ObjectPoolBase();
+
+  void* Allocate() {
+    ThreadCache* cache = GetCache();
+    if (cache->count == 0 && !Refill(cache))
+      return AllocateSlow();
+    cache->IncAllocated();
+    return cache->items[--cache->count];
+  }
+
+  void Deallocate(void* p) {
+    ThreadCache* cache = GetCache();
+    if (cache->count == 2 * magazine_size_)
+      Flush(cache, magazine_size_);
+    cache->items[cache->count++] = p;
+  }
+
+private:
+  struct ThreadCache {
+    ObjectPoolBase* owner;
+    ThreadCache* prev;
+    ThreadCache* next;
+    uint32 count;
+
+    // Written only by the owning thread.
+    std::atomic<uint64> allocated;
+    void* items[1];  // 2 * magazine_size items.
+
+    void IncAllocated() {
+      allocated.store(allocated.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+  };
+
+  ThreadCache* GetCache() {
+    ThreadCache* cache = reinterpret_cast<ThreadCache*>(pthread_getspecific(key_));
+    return cache ? cache : CreateCache();
+  }
+
+  ThreadCache* CreateCache();
+  void* AllocateSlow();
+
+  // Moves up to magazine_size blocks from the depot to the cache.
+  bool Refill(ThreadCache* cache);
+
+  // Moves the last count blocks of the cache to the depot.
+  void Flush(ThreadCache* cache, uint32 count);
+
+  void FreeCacheLocked(ThreadCache* cache);
+
+  static void ThreadExit(void* cache);
+
+  const size_t block_size_;
+  const uint32 magazine_size_;
+  const size_t high_water_;
+  pthread_key_t key_;
+
+  std::atomic<uint64> slow_allocated_;
+
+  mutable Mutex mu_;
+  std::vector<void*> depot_;  // guarded by mu_.
+  ThreadCache* caches_ = nullptr;  // list of live thread caches, guarded by mu_.
+  uint64 exited_allocated_ = 0;  // list_allocated by exited threads, guarded by mu_.
+
+  ObjectPoolBase(const ObjectPoolBase&) = delete;
+  void operator=(const ObjectPoolBase&) = delete;
+};
+
+// Thread-safe pool of T objects. Any thread can allocate and any thread can release.
+// Objects are constructed in New() and destroyed in Release(), only their memory is recycled.
+// Typical usage is a static pool per type that is allocated and freed per request.
+template<typename T> class ObjectPool : public ObjectPoolBase {
+public:
+  explicit ObjectPool(unsigned magazine_size = 32, size_t high_water = 0)
+      : ObjectPoolBase(sizeof(T), magazine_size, high_water) {
+    static_assert(alignof(T) <= alignof(std::max_align_t), "Overaligned types are not supported");
+  }
+
+  template<typename... Args> T* New(Args&&... args) {
+    return new (Allocate()) T(std::forward<Args>(args)...);
+  }
+
+  // t must have been allocated by this pool.
+  void Release(T* t) {
+    t->~T();
+    Deallocate(t);
+  }
+
+  // Allows holding pool objects in std::unique_ptr.
+  class Deleter {
+    ObjectPool* pool_;
+  public:
+    explicit Deleter(ObjectPool* pool = nullptr) : pool_(pool) {}
+    void operator()(T* t) const { pool_->Release(t); }
+  };
+};
+
+}  // namespace base
+
+#endif  // _BASE_OBJECT_POOL_H
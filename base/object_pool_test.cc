@@ -0,0 +1,154 @@
+// Copyright 2015, Beeri 15.  All rights reserved.
+// Author: Roman Gershman (romange@gmail.com)
+//
+
+#include "base/object_pool.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include "base/gtest.h"
+
+namespace base {
+
+namespace {
+
+struct Obj {
+  static std::atomic<int> live;
+  std::string str;
+  int val;
+
+  Obj(int v, const char* s) : str(s), val(v) { ++live; }
+  ~Obj() { --live; }
+};
+
+std::atomic<int> Obj::live(0);
+
+}  // namespace
+
+class ObjectPoolTest : public testing::Test {
+public:
+  ObjectPoolTest() : pool_(4) {}
+
+  void DeallocSlow(Obj* t, int msec) {
+    std::chrono::milliseconds dura(msec);
+    t->val = msec;
+
+    std::this_thread::sleep_for(dura);
+    shared_pool_.Release(t);
+  }
+
+protected:
+  ObjectPool<Obj> pool_;
+  ObjectPool<Obj> shared_pool_;
+  std::default_random_engine re_;
+};
+
+TEST_F(ObjectPoolTest, Basic) {
+  Obj* o = pool_.New(5, "foo");
+  EXPECT_EQ(5, o->val);
+  EXPECT_EQ("foo", o->str);
+  EXPECT_EQ(1, Obj::live);
+  EXPECT_EQ(1, pool_.slow_allocated());
+  EXPECT_EQ(0, pool_.list_allocated());
+
+  pool_.Release(o);
+  EXPECT_EQ(0, Obj::live);
+
+  Obj* o2 = pool_.New(6, "bar");
+  EXPECT_EQ(o, o2);
+  EXPECT_EQ("bar", o2->str);
+  EXPECT_EQ(1, pool_.slow_allocated());
+  EXPECT_EQ(1, pool_.list_allocated());
+
+  std::unique_ptr<Obj, ObjectPool<Obj>::Deleter> ptr(o2, ObjectPool<Obj>::Deleter(&pool_));
+  ptr.reset();
+  EXPECT_EQ(0, Obj::live);
+}
+
+TEST_F(ObjectPoolTest, Depot) {
+  std::vector<Obj*> objs;
+  for (int i = 0; i < 20; ++i)
+    objs.push_back(pool_.New(i, ""));
+
+  // The cache holds 8 blocks, the rest goes to the depot in magazines of 4.
+  for (Obj* o : objs)
+    pool_.Release(o);
+  EXPECT_EQ(12, pool_.depot_size());
+
+  // Another thread reuses the blocks released by this one.
+  objs.clear();
+  std::thread([this, &objs] {
+    for (int i = 0; i < 12; ++i)
+      objs.push_back(pool_.New(i, ""));
+  }).join();
+  EXPECT_EQ(20, pool_.slow_allocated());
+  EXPECT_EQ(12, pool_.list_allocated());
+  EXPECT_EQ(0, pool_.depot_size());
+  for (Obj* o : objs)
+    pool_.Release(o);
+}
+
+TEST_F(ObjectPoolTest, HighWater) {
+  ObjectPool<Obj> pool(4, 6);
+  EXPECT_EQ(6, pool.high_water());
+  std::vector<Obj*> objs;
+  for (int i = 0; i < 40; ++i)
+    objs.push_back(pool.New(i, ""));
+  for (Obj* o : objs)
+    pool.Release(o);
+  EXPECT_EQ(6, pool.depot_size());
+}
+
+TEST_F(ObjectPoolTest, ThreadExit) {
+  // Blocks cached by an exited thread are moved to the depot.
+  std::thread([this] {
+    Obj* o = pool_.New(1, "");
+    pool_.Release(o);
+  }).join();
+  EXPECT_EQ(1, pool_.depot_size());
+  EXPECT_EQ(0, pool_.list_allocated());
+}
+
+TEST_F(ObjectPoolTest, MultiThread) {
+  std::uniform_int_distribution<int> uniform_dist(1, 50);
+  std::vector<std::thread> workers;
+  for (unsigned i = 0; i < 1000; ++i) {
+    workers.emplace_back(&ObjectPoolTest::DeallocSlow, this, shared_pool_.New(i, ""),
+                         uniform_dist(re_));
+    std::this_thread::yield();
+  }
+  for (unsigned i = 0; i < 1000; ++i) {
+    workers[i].join();
+  }
+  EXPECT_GE(shared_pool_.list_allocated(), 100);
+  EXPECT_EQ(0, Obj::live);
+}
+
+static void BM_NewDelete(benchmark::State& state) {
+  std::vector<Obj*> objs(state.range_x());
+  while (state.KeepRunning()) {
+    for (size_t i = 0; i < objs.size(); ++i)
+      objs[i] = new Obj(i, "");
+    for (size_t i = 0; i < objs.size(); ++i)
+      delete objs[i];
+  }
+}
+BENCHMARK(BM_NewDelete)->Arg(16)->Arg(256);
+
+static void BM_ObjectPool(benchmark::State& state) {
+  ObjectPool<Obj> pool;
+  std::vector<Obj*> objs(state.range_x());
+  while (state.KeepRunning()) {
+    for (size_t i = 0; i < objs.size(); ++i)
+      objs[i] = pool.New(i, "");
+    for (size_t i = 0; i < objs.size(); ++i)
+      pool.Release(objs[i]);
+  }
+}
+BENCHMARK(BM_ObjectPool)->Arg(16)->Arg(256);
+
+}  // namespace base
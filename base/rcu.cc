@@ -0,0 +1,148 @@
+// Copyright 2013, Beeri 15.  All rights reserved.
+// Author: Roman Gershman (romange@gmail.com)
+//
+#include "base/rcu.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <vector>
+
+#include "base/logging.h"
+
+namespace base {
+namespace rcu {
+
+namespace detail {
+
+constexpr uint64 ThreadRecord::kInactive;
+
+// Starts from 1 so that no epoch equals kInactive.
+std::atomic<uint64> global_epoch(1);
+__thread ThreadRecord* thread_record = nullptr;
+
+}  // namespace detail
+
+using detail::ThreadRecord;
+using detail::global_epoch;
+
+namespace {
+
+// Deleters are collected in batches of this size before we try to reclaim them.
+constexpr size_t kRetireBatch = 64;
+
+struct Retired {
+  uint64 epoch;
+  std::function<void()> deleter;
+};
+
+// Thread records are never freed, records of exited threads are reused.
+std::atomic<ThreadRecord*> records(nullptr);
+
+Mutex limbo_mu;
+std::vector<Retired> limbo;  // guarded by limbo_mu.
+
+pthread_key_t thread_exit_key;
+pthread_once_t thread_exit_once = PTHREAD_ONCE_INIT;
+
+void ThreadExit(void* arg) {
+  ThreadRecord* rec = reinterpret_cast<ThreadRecord*>(arg);
+  DCHECK_EQ(0, rec->nesting);
+  rec->in_use.store(false, std::memory_order_release);
+}
+
+void InitThreadExitKey() {
+  CHECK_EQ(0, pthread_key_create(&thread_exit_key, ThreadExit));
+}
+
+// Advances the global epoch if all the active readers have observed it.
+// Returns the global epoch.
+uint64 TryAdvance() {
+  uint64 epoch = global_epoch.load(std::memory_order_seq_cst);
+  for (ThreadRecord* rec = records.load(std::memory_order_acquire); rec; rec = rec->next) {
+    uint64 local = rec->epoch.load(std::memory_order_seq_cst);
+    if (local != ThreadRecord::kInactive && local != epoch)
+      return epoch;
+  }
+  global_epoch.compare_exchange_strong(epoch, epoch + 1, std::memory_order_seq_cst);
+  return global_epoch.load(std::memory_order_seq_cst);
+}
+
+// Runs the deleters that are safe at the given global epoch.
+void Collect(uint64 epoch) {
+  std::vector<Retired> ready;
+  {
+    MutexLock lock(&limbo_mu);
+    size_t keep = 0;
+    for (size_t i = 0; i < limbo.size(); ++i) {
+      if (limbo[i].epoch + 2 <= epoch) {
+        ready.push_back(std::move(limbo[i]));
+      } else {
+        limbo[keep++] = std::move(limbo[i]);
+      }
+    }
+    limbo.resize(keep);
+  }
+  for (Retired& r : ready)
+    r.deleter();
+}
+
+}  // namespace
+
+ThreadRecord* detail::RegisterThread() {
+  pthread_once(&thread_exit_once, InitThreadExitKey);
+
+  ThreadRecord* rec = records.load(std::memory_order_acquire);
+  for (; rec; rec = rec->next) {
+    bool expected = false;
+    if (!rec->in_use.load(std::memory_order_relaxed) &&
+        rec->in_use.compare_exchange_strong(expected, true, std::memory_order_acquire))
+      break;
+  }
+  if (rec == nullptr) {
+    rec = new ThreadRecord;
+    rec->epoch.store(ThreadRecord::kInactive, std::memory_order_relaxed);
+    rec->in_use.store(true, std::memory_order_relaxed);
+    ThreadRecord* head = records.load(std::memory_order_relaxed);
+    do {
+      rec->next = head;
+    } while (!records.compare_exchange_weak(head, rec, std::memory_order_release,
+                                            std::memory_order_relaxed));
+  }
+  CHECK_EQ(0, pthread_setspecific(thread_exit_key, rec));
+  thread_record = rec;
+  return rec;
+}
+
+void Retire(std::function<void()> deleter) {
+  uint64 epoch = global_epoch.load(std::memory_order_seq_cst);
+  bool collect;
+  {
+    MutexLock lock(&limbo_mu);
+    limbo.push_back(Retired{epoch, std::move(deleter)});
+    collect = limbo.size() % kRetireBatch == 0;
+  }
+  if (collect)
+    Collect(TryAdvance());
+}
+
+void Synchronize() {
+  ThreadRecord* rec = detail::thread_record;
+  CHECK(rec == nullptr || rec->nesting == 0) << "Synchronize() inside a read section";
+
+  uint64 target = global_epoch.load(std::memory_order_seq_cst) + 2;
+  unsigned spins = 0;
+  uint64 epoch;
+  while ((epoch = TryAdvance()) < target) {
+    if (++spins > 100)
+      sched_yield();
+  }
+  Collect(epoch);
+}
+
+size_t PendingCount() {
+  MutexLock lock(&limbo_mu);
+  return limbo.size();
+}
+
+}  // namespace rcu
+}  // namespace base
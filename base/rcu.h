@@ -0,0 +1,153 @@
+// Copyright 2013, Beeri 15.  All rights reserved.
+// Author: Roman Gershman (romange@gmail.com)
+//
+#ifndef _BASE_RCU_H
+#define _BASE_RCU_H
+
+#include <atomic>
+#include <functional>
+
+#include "base/integral_types.h"
+#include "base/macros.h"
+#include "base/mutex.h"
+
+namespace base {
+
+/*
+  Process wide epoch based reclamation, a userspace flavour of RCU.
+  Readers wrap their accesses to shared objects in rcu::ReadLock. Writers unlink an object
+  so that new readers can not reach it and then pass it to rcu::Retire or rcu::Delete. The
+  object is freed once every read section that could have seen it has finished.
+
+  Every thread announces the global epoch it entered its read section with. The epoch advances
+  when all active readers have announced the current one, and objects retired at epoch E are
+  freed when the epoch reaches E + 2. Read sections are wait-free and may nest but must not
+  block for long, as they hold back reclamation for everybody.
+*/
+namespace rcu {
+
+namespace detail {
+
+struct ThreadRecord {
+  static constexpr uint64 kInactive = 0;
+
+  std::atomic<uint64> epoch;  // kInactive when outside of a read section.
+  std::atomic_bool in_use;
+  uint32 nesting = 0;
+  ThreadRecord* next = nullptr;
+};
+
+extern std::atomic<uint64> global_epoch;
+extern __thread ThreadRecord* thread_record;
+
+ThreadRecord* RegisterThread();
+
+}  // namespace detail
+
+class ReadLock {
+public:
+  ReadLock() {
+    detail::ThreadRecord* rec = detail::thread_record;
+    if (rec == nullptr)
+      rec = detail::RegisterThread();
+    rec_ = rec;
+    if (rec->nesting++ == 0) {
+      // The store must be visible before we read any shared pointer.
+      rec->epoch.store(detail::global_epoch.load(std::memory_order_relaxed),
+                       std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+  }
+
+  ~ReadLock() {
+    if (--rec_->nesting == 0)
+      rec_->epoch.store(detail::ThreadRecord::kInactive, std::memory_order_release);
+  }
+
+private:
+  detail::ThreadRecord* rec_;
+
+  DISALLOW_COPY_AND_ASSIGN(ReadLock);
+};
+
+// Calls deleter after all the current read sections finish. Can be called from any thread,
+// including from inside a read section.
+void Retire(std::function<void()> deleter);
+
+template<typename T> void Delete(T* t) {
+  Retire([t] { delete t; });
+}
+
+// Blocks until all the read sections that started before the call finish and runs the
+// deleters that became safe. Must not be called inside a read section.
+void Synchronize();
+
+// Number of deleters that did not run yet.
+size_t PendingCount();
+
+}  // namespace rcu
+
+/*
+  Holds an immutable T that readers access without locks and writers replace atomically.
+  Readers:
+    Snapshot<Config>::ReadHandle config(snapshot);
+    Use(config->value);
+  Writers either Update() with a new object or Modify() a copy of the current one.
+  Replaced objects are deleted with rcu::Delete.
+*/
+template<typename T> class Snapshot {
+public:
+  explicit Snapshot(T* initial = nullptr) : ptr_(initial) {}
+
+  // No reader may access the snapshot during its destruction.
+  ~Snapshot() { delete ptr_.load(std::memory_order_relaxed); }
+
+  // Keeps the current object alive during its lifetime.
+  class ReadHandle {
+  public:
+    explicit ReadHandle(const Snapshot& snapshot) : ptr_(snapshot.Get()) {}
+
+    const T* get() const { return ptr_; }
+    const T* operator->() const { return ptr_; }
+    const T& operator*() const { return *ptr_; }
+    explicit operator bool() const { return ptr_ != nullptr; }
+
+  private:
+    rcu::ReadLock lock_;  // must be initialized before ptr_.
+    const T* ptr_;
+  };
+
+  // Must be called inside a read section. The result is valid until the section ends.
+  const T* Get() const { return ptr_.load(std::memory_order_acquire); }
+
+  // Takes ownership of new_val.
+  void Update(T* new_val) {
+    T* old = ptr_.exchange(new_val, std::memory_order_seq_cst);
+    if (old)
+      rcu::Delete(old);
+  }
+
+  // Copies the current object, applies f to the copy and publishes it. Concurrent Modify calls
+  // are serialized, Update calls are not.
+  template<typename F> void Modify(F f) {
+    MutexLock lock(&modify_mu_);
+    T* copy;
+    {
+      rcu::ReadLock read_lock;  // protects from concurrent Update calls.
+      const T* cur = ptr_.load(std::memory_order_acquire);
+      copy = cur ? new T(*cur) : new T();
+    }
+    f(copy);
+    Update(copy);
+  }
+
+private:
+  std::atomic<T*> ptr_;
+  Mutex modify_mu_;
+
+  DISALLOW_COPY_AND_ASSIGN(Snapshot);
+};
+
+}  // namespace base
+
+#endif  // _BASE_RCU_H
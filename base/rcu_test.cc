@@ -0,0 +1,120 @@
+// Copyright 2013, Beeri 15.  All rights reserved.
+// Author: Roman Gershman (romange@gmail.com)
+//
+#include "base/rcu.h"
+
+#include <memory>
+#include <thread>
+#include <vector>
+#include "base/gtest.h"
+
+namespace base {
+
+namespace {
+
+struct Config {
+  static std::atomic<int> live;
+
+  int a = 0;
+  int b = 0;
+
+  Config() { ++live; }
+  Config(const Config& o) : a(o.a), b(o.b) { ++live; }
+  ~Config() {
+    a = b = -1;  // poison.
+    --live;
+  }
+};
+
+std::atomic<int> Config::live(0);
+
+}  // namespace
+
+class RcuTest : public testing::Test {
+};
+
+TEST_F(RcuTest, Retire) {
+  bool called = false;
+  {
+    rcu::ReadLock lock;
+    rcu::Retire([&called] { called = true; });
+    {
+      rcu::ReadLock nested;
+    }
+    EXPECT_FALSE(called);
+    EXPECT_EQ(1, rcu::PendingCount());
+  }
+  rcu::Synchronize();
+  EXPECT_TRUE(called);
+  EXPECT_EQ(0, rcu::PendingCount());
+}
+
+TEST_F(RcuTest, Snapshot) {
+  {
+    Snapshot<Config> snapshot(new Config);
+    {
+      Snapshot<Config>::ReadHandle handle(snapshot);
+      EXPECT_EQ(0, handle->a);
+      snapshot.Modify([](Config* c) { c->a = c->b = 1; });
+
+      // The old object is alive while the handle exists.
+      EXPECT_EQ(0, handle->a);
+      EXPECT_EQ(2, Config::live);
+    }
+    rcu::Synchronize();
+    EXPECT_EQ(1, Config::live);
+
+    Snapshot<Config>::ReadHandle handle(snapshot);
+    EXPECT_EQ(1, handle->a);
+  }
+  EXPECT_EQ(0, Config::live);
+}
+
+TEST_F(RcuTest, Concurrent) {
+  Snapshot<Config> snapshot(new Config);
+  std::atomic_bool stop(false);
+  std::atomic<long> bad_reads(0);
+  std::vector<std::thread> readers;
+  for (int i = 0; i < 4; ++i) {
+    readers.emplace_back([&] {
+      while (!stop.load(std::memory_order_relaxed)) {
+        Snapshot<Config>::ReadHandle handle(snapshot);
+        if (handle->a != handle->b || handle->a < 0)
+          bad_reads.fetch_add(1);
+      }
+    });
+  }
+  std::vector<std::thread> writers;
+  for (int i = 0; i < 2; ++i) {
+    writers.emplace_back([&] {
+      for (int j = 0; j < 5000; ++j) {
+        snapshot.Modify([](Config* c) { ++c->a; ++c->b; });
+      }
+    });
+  }
+  for (auto& t : writers)
+    t.join();
+  stop = true;
+  for (auto& t : readers)
+    t.join();
+  EXPECT_EQ(0, bad_reads);
+  {
+    Snapshot<Config>::ReadHandle handle(snapshot);
+    EXPECT_EQ(10000, handle->a);
+  }
+  rcu::Synchronize();
+  EXPECT_EQ(1, Config::live);
+}
+
+static void BM_ReadLock(benchmark::State& state) {
+  Snapshot<Config> snapshot(new Config);
+  long sum = 0;
+  while (state.KeepRunning()) {
+    Snapshot<Config>::ReadHandle handle(snapshot);
+    sum += handle->a;
+  }
+  CHECK_EQ(0, sum);
+}
+BENCHMARK(BM_ReadLock)->ThreadRange(1, 8);
+
+}  // namespace base
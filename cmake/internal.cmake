@@ -13,6 +13,13 @@ set(CMAKE_CXX_FLAGS "${CMAKE_CXX_FLAGS} -fno-builtin-realloc -fno-builtin-free")
 set(CMAKE_CXX_FLAGS "${CMAKE_CXX_FLAGS} -fno-omit-frame-pointer -Wno-unused-parameter ")
 set(CMAKE_CXX_FLAGS "${CMAKE_CXX_FLAGS} -Wno-unused-result")
 
+# Enables AVX2 code paths, for example in base::CuckooMap. The binaries won't run on cpus
+# without AVX2.
+option(USE_AVX2 "Compile with -mavx2" OFF)
+IF(USE_AVX2)
+  set(CMAKE_CXX_FLAGS "${CMAKE_CXX_FLAGS} -mavx2")
+ENDIF()
+
 set(CMAKE_CXX_FLAGS_RELEASE "-O3 -DNDEBUG -gdwarf-2 -g2")
 set(CMAKE_CXX_FLAGS_DEBUG "-O0 -DDEBUG -ggdb")
 MESSAGE (CMAKE_CXX_COMPILER " ${CMAKE_CXX_COMPILER}")
@@ -0,0 +1,611 @@
+// Copyright 2013, Beeri 15.  All rights reserved.
+// Author: Roman Gershman (romange@gmail.com)
+//
+#include "file/column_file.h"
+
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/descriptor.pb.h>
+#include <google/protobuf/descriptor_database.h>
+#include <google/protobuf/dynamic_message.h>
+
+#include "file/file.h"
+#include "file/file_util.h"
+#include "file/filesource.h"
+#include "file/proto_writer.h"
+#include "strings/strcat.h"
+#include "util/coding/fixed.h"
+#include "util/coding/pb_reader.h"
+#include "util/coding/pb_writer.h"
+#include "util/coding/roaring_bitmap.h"
+#include "util/crc32c.h"
+#include "util/sinksource.h"
+
+namespace file {
+
+namespace column_file {
+
+const char kMagicString[] = "CLF1";
+
+}  // namespace column_file
+
+using base::Status;
+using base::StatusCode;
+using strings::Slice;
+using util::coding::ColumnArray;
+using util::coding::FieldStats;
+using util::coding::PbBlockDeserializer;
+using util::coding::PbBlockSerializer;
+using util::coding::PbFieldWriter;
+using util::coding::RoaringBitmap;
+
+using namespace column_file;
+namespace gpb = ::google::protobuf;
+namespace crc32c = util::crc32c;
+
+namespace {
+
+typedef gpb::FieldDescriptor PBFD;
+
+inline Status CorruptionError(StringPiece msg) {
+  return Status(StatusCode::IO_ERROR, StrCat("Corrupted column file: ", msg));
+}
+
+// Forwards the data to the wrapped sink and computes its size and crc on the way.
+class CrcSink : public util::Sink {
+ public:
+  explicit CrcSink(util::Sink* dest) : dest_(dest) {}
+
+  Status Append(Slice slice) {
+    Update(slice);
+    return dest_->Append(slice);
+  }
+
+  Status AppendV(const Slice* slices, size_t count) {
+    for (size_t i = 0; i < count; ++i)
+      Update(slices[i]);
+    return dest_->AppendV(slices, count);
+  }
+
+  uint32 crc() const { return crc_; }
+  uint64 size() const { return size_; }
+
+ private:
+  void Update(Slice slice) {
+    crc_ = crc32c::Extend(crc_, slice.ubuf(), slice.size());
+    size_ += slice.size();
+  }
+
+  util::Sink* dest_;
+  uint32 crc_ = 0;
+  uint64 size_ = 0;
+};
+
+// Must follow the order of PbFieldWriterArray::VisitPreOrder.
+void VisitColumns(const gpb::Descriptor* dscr, const std::string& prefix,
+                  std::function<void(const std::string&, const PBFD*)> cb) {
+  for (int i = 0; i < dscr->field_count(); ++i) {
+    const PBFD* fd = dscr->field(i);
+    std::string path = prefix + fd->name();
+    cb(path, fd);
+    if (fd->cpp_type() == PBFD::CPPTYPE_MESSAGE) {
+      VisitColumns(fd->message_type(), path + ".", cb);
+    }
+  }
+}
+
+void FillColumnStats(const FieldStats& src, ColumnStats* dest) {
+  dest->set_null_count(src.null_count());
+  dest->set_value_count(src.value_count());
+  if (src.value_count() == 0)
+    return;
+  dest->set_distinct_estimate(src.DistinctEstimate());
+  if (!src.has_minmax())
+    return;
+  switch (src.kind()) {
+    case FieldStats::INT:
+      dest->set_min_int(src.min_int());
+      dest->set_max_int(src.max_int());
+    break;
+    case FieldStats::UINT:
+      dest->set_min_uint(src.min_uint());
+      dest->set_max_uint(src.max_uint());
+    break;
+    case FieldStats::DOUBLE:
+      dest->set_min_double(src.min_double());
+      dest->set_max_double(src.max_double());
+    break;
+    case FieldStats::STRING:
+      dest->set_min_str(src.min_str().substr(0, kMaxStatStringLen));
+      if (src.max_str().size() <= kMaxStatStringLen)
+        dest->set_max_str(src.max_str());
+    break;
+    case FieldStats::NONE:
+    break;
+  }
+}
+
+template<typename T> bool RangeMayMatch(ColumnPredicate::Op op, const T& min, const T& max,
+                                        const T& v) {
+  switch (op) {
+    case ColumnPredicate::EQ: return !(v < min) && !(max < v);
+    case ColumnPredicate::LT: return min < v;
+    case ColumnPredicate::LE: return !(v < min);
+    case ColumnPredicate::GT: return v < max;
+    case ColumnPredicate::GE: return !(max < v);
+  }
+  return true;
+}
+
+bool StatsMayMatch(const ColumnPredicate& pred, const ColumnStats& stats) {
+  switch (pred.type) {
+    case ColumnPredicate::INT:
+      if (!stats.has_min_int()) return true;
+      return RangeMayMatch(pred.op, stats.min_int(), stats.max_int(), pred.int_val);
+    case ColumnPredicate::UINT:
+      if (!stats.has_min_uint()) return true;
+      return RangeMayMatch(pred.op, stats.min_uint(), stats.max_uint(), pred.uint_val);
+    case ColumnPredicate::DOUBLE:
+      if (!stats.has_min_double()) return true;
+      return RangeMayMatch(pred.op, stats.min_double(), stats.max_double(), pred.double_val);
+    case ColumnPredicate::STRING: {
+      if (!stats.has_min_str()) return true;
+      StringPiece v(pred.str_val), min_str(stats.min_str());
+      if (stats.has_max_str()) {
+        return RangeMayMatch<StringPiece>(pred.op, min_str, stats.max_str(), v);
+      }
+      // Only the lower bound is known.
+      switch (pred.op) {
+        case ColumnPredicate::EQ: case ColumnPredicate::LE: return !(v < min_str);
+        case ColumnPredicate::LT: return min_str < v;
+        default: return true;
+      }
+    }
+  }
+  return true;
+}
+
+template<typename T> bool Compare(ColumnPredicate::Op op, const T& val, const T& v) {
+  switch (op) {
+    case ColumnPredicate::EQ: return val == v;
+    case ColumnPredicate::LT: return val < v;
+    case ColumnPredicate::LE: return !(v < val);
+    case ColumnPredicate::GT: return v < val;
+    case ColumnPredicate::GE: return !(val < v);
+  }
+  return false;
+}
+
+// Returns true if the predicate type can be evaluated on the column values.
+bool TypeMatches(const ColumnPredicate& pred, const PBFD* fd) {
+  switch (fd->cpp_type()) {
+    case PBFD::CPPTYPE_INT32: case PBFD::CPPTYPE_INT64: case PBFD::CPPTYPE_ENUM:
+      return pred.type == ColumnPredicate::INT;
+    case PBFD::CPPTYPE_UINT32: case PBFD::CPPTYPE_UINT64: case PBFD::CPPTYPE_BOOL:
+      return pred.type == ColumnPredicate::UINT;
+    case PBFD::CPPTYPE_DOUBLE: case PBFD::CPPTYPE_FLOAT:
+      return pred.type == ColumnPredicate::DOUBLE;
+    case PBFD::CPPTYPE_STRING:
+      return pred.type == ColumnPredicate::STRING;
+    default:
+      return false;
+  }
+}
+
+bool ValueMatches(const ColumnPredicate& pred, const ColumnArray& col, size_t i) {
+  switch (pred.type) {
+    case ColumnPredicate::INT: return Compare(pred.op, col.ints[i], pred.int_val);
+    case ColumnPredicate::UINT: return Compare(pred.op, col.uints[i], pred.uint_val);
+    case ColumnPredicate::DOUBLE: return Compare(pred.op, col.doubles[i], pred.double_val);
+    case ColumnPredicate::STRING:
+      return Compare<StringPiece>(pred.op, col.strs[i], pred.str_val);
+  }
+  return false;
+}
+
+size_t NumValues(const ColumnArray& col) {
+  return col.ints.size() + col.uints.size() + col.doubles.size() + col.strs.size();
+}
+
+}  // namespace
+
+ColumnWriter::ColumnWriter(util::Sink* sink, const gpb::Descriptor* dscr, const Options& options)
+    : dest_(sink), dscr_(dscr), options_(options) {
+  Construct();
+}
+
+ColumnWriter::ColumnWriter(StringPiece filename, const gpb::Descriptor* dscr,
+                           const Options& options)
+    : dscr_(dscr), options_(options) {
+  File* file = file_util::OpenOrDie(filename, "w");
+  dest_.reset(new Sink(file, TAKE_OWNERSHIP));
+  Construct();
+}
+
+void ColumnWriter::Construct() {
+  CHECK_GT(options_.block_msg_count, 0);
+  VisitColumns(dscr_, "", [this](const std::string& path, const PBFD*) {
+      footer_.add_column(path);
+    });
+  AddMeta(kProtoSetKey, SerializedFileDescriptorSet(dscr_));
+  AddMeta(kProtoTypeKey, dscr_->full_name());
+}
+
+ColumnWriter::~ColumnWriter() {
+  if (!finished_) {
+    Status st = Finish();
+    LOG_IF(ERROR, !st.ok()) << "Could not finish column file: " << st;
+  }
+}
+
+void ColumnWriter::AddMeta(StringPiece key, strings::Slice value) {
+  CHECK(!finished_);
+  MetaEntry* entry = footer_.add_meta();
+  entry->set_key(key.data(), key.size());
+  entry->set_value(value.data(), value.size());
+}
+
+Status ColumnWriter::Append(strings::Slice slice) {
+  offset_ += slice.size();
+  return dest_->Append(slice);
+}
+
+Status ColumnWriter::Add(const gpb::Message& msg) {
+  CHECK(!finished_);
+  DCHECK_EQ(dscr_, msg.GetDescriptor());
+  if (offset_ == 0) {
+    RETURN_IF_ERROR(Append(Slice(kMagicString, kMagicStringSize)));
+  }
+  if (!block_) {
+    block_.reset(new PbBlockSerializer(dscr_));
+  }
+  block_->Add(msg);
+  ++msgs_added_;
+  if (block_->NumEntries() >= options_.block_msg_count) {
+    return FlushBlock();
+  }
+  return Status::OK;
+}
+
+Status ColumnWriter::FlushBlock() {
+  if (!block_ || block_->NumEntries() == 0)
+    return Status::OK;
+  // Encoders write their chains directly into dest_, the block is never copied as a whole.
+  CrcSink crc_sink(dest_.get());
+  Status st = block_->SerializeTo(&crc_sink);
+  offset_ += crc_sink.size();
+  RETURN_IF_ERROR(st);
+
+  BlockInfo* info = footer_.add_block();
+  info->set_offset(offset_ - crc_sink.size());
+  info->set_size(crc_sink.size());
+  info->set_num_msgs(block_->NumEntries());
+  info->set_crc(crc32c::Mask(crc_sink.crc()));
+  for (const PbFieldWriter* fw : block_->fields()) {
+    FillColumnStats(fw->stats(), info->add_column());
+  }
+  DCHECK_EQ(footer_.column_size(), info->column_size());
+  block_.reset();
+  return Status::OK;
+}
+
+Status ColumnWriter::Finish() {
+  CHECK(!finished_);
+  finished_ = true;
+  if (offset_ == 0) {
+    RETURN_IF_ERROR(Append(Slice(kMagicString, kMagicStringSize)));
+  }
+  RETURN_IF_ERROR(FlushBlock());
+
+  std::string footer_buf = footer_.SerializeAsString();
+  uint8 trailer[kTrailerSize];
+  coding::EncodeFixed32(footer_buf.size(), trailer);
+  coding::EncodeFixed32(crc32c::Mask(crc32c::Value(
+      reinterpret_cast<const uint8*>(footer_buf.data()), footer_buf.size())), trailer + 4);
+  memcpy(trailer + 8, kMagicString, kMagicStringSize);
+
+  RETURN_IF_ERROR(Append(footer_buf));
+  RETURN_IF_ERROR(Append(Slice(trailer, kTrailerSize)));
+  return dest_->Flush();
+}
+
+ColumnPredicate ColumnPredicate::Int(StringPiece column, Op op, int64 v) {
+  ColumnPredicate res;
+  res.column = column.as_string();
+  res.op = op;
+  res.type = INT;
+  res.int_val = v;
+  return res;
+}
+
+ColumnPredicate ColumnPredicate::UInt(StringPiece column, Op op, uint64 v) {
+  ColumnPredicate res;
+  res.column = column.as_string();
+  res.op = op;
+  res.type = UINT;
+  res.uint_val = v;
+  return res;
+}
+
+ColumnPredicate ColumnPredicate::Double(StringPiece column, Op op, double v) {
+  ColumnPredicate res;
+  res.column = column.as_string();
+  res.op = op;
+  res.type = DOUBLE;
+  res.double_val = v;
+  return res;
+}
+
+ColumnPredicate ColumnPredicate::String(StringPiece column, Op op, StringPiece v) {
+  ColumnPredicate res;
+  res.column = column.as_string();
+  res.op = op;
+  res.type = STRING;
+  res.str_val = v.as_string();
+  return res;
+}
+
+ColumnReader::ColumnReader(ReadonlyFile* file, Ownership ownership, bool checksum)
+    : file_(file), ownership_(ownership), checksum_(checksum) {
+}
+
+ColumnReader::ColumnReader(StringPiece filename, bool checksum)
+    : file_(nullptr), ownership_(TAKE_OWNERSHIP), checksum_(checksum) {
+  auto res = ReadonlyFile::Open(filename);
+  CHECK(res.ok()) << res.status << ", file name: " << filename;
+  file_ = CHECK_NOTNULL(res.obj);
+}
+
+ColumnReader::~ColumnReader() {
+  if (ownership_ == TAKE_OWNERSHIP) {
+    CHECK(file_->Close().ok());
+    delete file_;
+  }
+}
+
+Status ColumnReader::Init() {
+  size_t file_size = file_->Size();
+  if (file_size < kMagicStringSize + kTrailerSize)
+    return CorruptionError("file is too small");
+
+  uint8 trailer_buf[kTrailerSize];
+  Slice trailer;
+  RETURN_IF_ERROR(file_->Read(file_size - kTrailerSize, kTrailerSize, &trailer, trailer_buf));
+  if (trailer.size() != kTrailerSize ||
+      memcmp(trailer.data() + 8, kMagicString, kMagicStringSize) != 0) {
+    return CorruptionError("bad trailer");
+  }
+  uint32 footer_size = coding::DecodeFixed32(trailer.ubuf());
+  uint32 footer_crc = crc32c::Unmask(coding::DecodeFixed32(trailer.ubuf() + 4));
+  if (footer_size > file_size - kMagicStringSize - kTrailerSize)
+    return CorruptionError("bad footer size");
+
+  std::unique_ptr<uint8[]> footer_buf(new uint8[footer_size]);
+  Slice footer;
+  RETURN_IF_ERROR(file_->Read(file_size - kTrailerSize - footer_size, footer_size,
+                              &footer, footer_buf.get()));
+  if (footer.size() != footer_size || crc32c::Value(footer.ubuf(), footer_size) != footer_crc)
+    return CorruptionError("footer checksum mismatch");
+  if (!footer_.ParseFromArray(footer.data(), footer.size()))
+    return CorruptionError("could not parse footer");
+
+  RETURN_IF_ERROR(InitDescriptor());
+
+  VisitColumns(dscr_, "", [this](const std::string& path, const PBFD* fd) {
+      column_index_.emplace(path, columns_.size());
+      columns_.push_back(fd);
+    });
+  if (int(columns_.size()) != footer_.column_size())
+    return CorruptionError("column count does not match the schema");
+  for (const BlockInfo& bi : footer_.block()) {
+    if (bi.column_size() != footer_.column_size() ||
+        bi.offset() + bi.size() > file_size - kTrailerSize - footer_size)
+      return CorruptionError("bad block info");
+  }
+  return Status::OK;
+}
+
+Status ColumnReader::InitDescriptor() {
+  std::string type, fd_set;
+  for (const MetaEntry& entry : footer_.meta()) {
+    if (entry.key() == kProtoTypeKey)
+      type = entry.value();
+    else if (entry.key() == kProtoSetKey)
+      fd_set = entry.value();
+  }
+  if (type.empty())
+    return CorruptionError("missing message type");
+
+  dscr_ = gpb::DescriptorPool::generated_pool()->FindMessageTypeByName(type);
+  if (dscr_) {
+    prototype_ = gpb::MessageFactory::generated_factory()->GetPrototype(dscr_);
+    return Status::OK;
+  }
+
+  gpb::FileDescriptorSet fd_set_proto;
+  if (!fd_set_proto.ParseFromString(fd_set))
+    return CorruptionError("could not parse FileDescriptorSet");
+  proto_db_.reset(new gpb::SimpleDescriptorDatabase);
+  for (int i = 0; i < fd_set_proto.file_size(); ++i) {
+    proto_db_->Add(fd_set_proto.file(i));
+  }
+  proto_pool_.reset(new gpb::DescriptorPool(proto_db_.get()));
+  dscr_ = proto_pool_->FindMessageTypeByName(type);
+  if (!dscr_)
+    return CorruptionError(StrCat("can not find type ", type));
+  msg_factory_.reset(new gpb::DynamicMessageFactory(proto_pool_.get()));
+  prototype_ = msg_factory_->GetPrototype(dscr_);
+  return Status::OK;
+}
+
+int ColumnReader::ColumnIndex(StringPiece column) const {
+  auto it = column_index_.find(column.as_string());
+  return it == column_index_.end() ? -1 : it->second;
+}
+
+bool ColumnReader::BlockMayMatch(uint32 block, const std::vector<ColumnPredicate>& preds) const {
+  const BlockInfo& bi = footer_.block(block);
+  for (const ColumnPredicate& pred : preds) {
+    int index = ColumnIndex(pred.column);
+    if (index < 0 || !TypeMatches(pred, columns_[index]))
+      continue;
+    const ColumnStats& stats = bi.column(index);
+
+    // Comparison with a missing value is always false.
+    if (stats.value_count() == 0 || !StatsMayMatch(pred, stats))
+      return false;
+  }
+  return true;
+}
+
+Status ColumnReader::ReadBlockData(uint32 block, Slice* data) {
+  const BlockInfo& bi = footer_.block(block);
+  if (bi.size() > buf_size_) {
+    buf_size_ = bi.size();
+    buf_.reset(new uint8[buf_size_]);
+  }
+  RETURN_IF_ERROR(file_->Read(bi.offset(), bi.size(), data, buf_.get()));
+  if (data->size() != bi.size())
+    return CorruptionError("truncated block");
+  if (checksum_ && bi.has_crc() && crc32c::Unmask(bi.crc()) != crc32c::Value(data->ubuf(),
+                                                                            data->size())) {
+    return CorruptionError(StrCat("block ", block, " checksum mismatch"));
+  }
+  return Status::OK;
+}
+
+Status ColumnReader::DecodeBlock(Slice data, uint32 num_msgs, const RoaringBitmap* selection,
+                                 MessageCb cb) {
+  PbBlockDeserializer deserializer(dscr_);
+  uint32 actual_msgs = 0;
+  RETURN_IF_ERROR(deserializer.Init(data, &actual_msgs));
+  if (num_msgs != actual_msgs)
+    return CorruptionError("inconsistent message count");
+
+  std::unique_ptr<gpb::Message> msg(prototype_->New());
+  RoaringBitmap::Iterator it;
+  if (selection)
+    it = selection->begin();
+  for (uint32 i = 0; i < num_msgs; ++i) {
+    if (selection && (it.Done() || *it >= num_msgs))
+      break;
+    msg->Clear();
+    RETURN_IF_ERROR(deserializer.Read(msg.get()));
+    if (selection) {
+      if (*it != i)
+        continue;
+      ++it;
+    }
+    cb(*msg);
+  }
+  return Status::OK;
+}
+
+Status ColumnReader::ReadBlock(uint32 block, MessageCb cb) {
+  Slice data;
+  RETURN_IF_ERROR(ReadBlockData(block, &data));
+  return DecodeBlock(data, footer_.block(block).num_msgs(), nullptr, cb);
+}
+
+Status ColumnReader::SelectRows(uint32 block, const std::vector<ColumnPredicate>& preds,
+                                RoaringBitmap* selection) {
+  Slice data;
+  RETURN_IF_ERROR(ReadBlockData(block, &data));
+  return SelectRows(data, footer_.block(block).num_msgs(), preds, selection);
+}
+
+Status ColumnReader::SelectRows(Slice data, uint32 num_msgs,
+                                const std::vector<ColumnPredicate>& preds,
+                                RoaringBitmap* selection) {
+  selection->Clear();
+  selection->AddRange(0, num_msgs);
+
+  std::vector<const ColumnPredicate*> eval;
+  std::vector<std::string> paths;
+  for (const ColumnPredicate& pred : preds) {
+    int index = ColumnIndex(pred.column);
+    if (index < 0 || columns_[index]->containing_type() != dscr_ ||
+        !TypeMatches(pred, columns_[index]))
+      continue;
+    eval.push_back(&pred);
+    paths.push_back(pred.column);
+  }
+  if (eval.empty())
+    return Status::OK;
+
+  PbBlockDeserializer deserializer(dscr_);
+  RETURN_IF_ERROR(deserializer.Project(paths));
+  uint32 actual_msgs = 0;
+  RETURN_IF_ERROR(deserializer.Init(data, &actual_msgs));
+  if (num_msgs != actual_msgs)
+    return CorruptionError("inconsistent message count");
+
+  // Columns can be read only once per block.
+  std::unordered_map<std::string, ColumnArray> columns;
+  for (const ColumnPredicate* pred : eval) {
+    auto res = columns.emplace(pred->column, ColumnArray());
+    ColumnArray& col = res.first->second;
+    if (res.second) {
+      RETURN_IF_ERROR(deserializer.ReadColumn(pred->column, &col));
+    }
+    if (!col.counts.empty() && col.counts.size() != num_msgs)
+      return CorruptionError(StrCat("bad column ", pred->column));
+
+    // Repeated fields match if any of their values matches.
+    RoaringBitmap matches;
+    const size_t num_vals = NumValues(col);
+    size_t val_index = 0;
+    for (uint32 row = 0; row < num_msgs; ++row) {
+      uint32 cnt = col.counts.empty() ? 1 : col.counts[row];
+      if (val_index + cnt > num_vals)
+        return CorruptionError(StrCat("bad column ", pred->column));
+      for (uint32 j = 0; j < cnt; ++j) {
+        if (ValueMatches(*pred, col, val_index + j)) {
+          matches.Add(row);
+          break;
+        }
+      }
+      val_index += cnt;
+    }
+    *selection &= matches;
+    if (selection->empty())
+      break;
+  }
+  return Status::OK;
+}
+
+Status ColumnReader::Scan(const std::vector<ColumnPredicate>& preds, MessageCb cb,
+                          uint32* skipped_blocks) {
+  for (int i = 0; i < footer_.block_size(); ++i) {
+    if (!BlockMayMatch(i, preds)) {
+      VLOG(1) << "Skipping block " << i;
+      if (skipped_blocks)
+        ++*skipped_blocks;
+      continue;
+    }
+    RETURN_IF_ERROR(ReadBlock(i, cb));
+  }
+  return Status::OK;
+}
+
+Status ColumnReader::Filter(const std::vector<ColumnPredicate>& preds, MessageCb cb,
+                            uint32* skipped_blocks) {
+  RoaringBitmap selection;
+  for (int i = 0; i < footer_.block_size(); ++i) {
+    if (!BlockMayMatch(i, preds)) {
+      if (skipped_blocks)
+        ++*skipped_blocks;
+      continue;
+    }
+    Slice data;
+    RETURN_IF_ERROR(ReadBlockData(i, &data));
+    uint32 num_msgs = footer_.block(i).num_msgs();
+    RETURN_IF_ERROR(SelectRows(data, num_msgs, preds, &selection));
+    if (selection.empty())
+      continue;
+    RETURN_IF_ERROR(DecodeBlock(data, num_msgs,
+                                selection.Cardinality() == num_msgs ? nullptr : &selection, cb));
+  }
+  return Status::OK;
+}
+
+}  // namespace file
@@ -0,0 +1,220 @@
+// Copyright 2013, Beeri 15.  All rights reserved.
+// Author: Roman Gershman (romange@gmail.com)
+//
+// Column oriented file of protobuf messages. It is the analytic counterpart of the row
+// oriented list file: messages are packed into PbBlockSerializer blocks and the file ends with
+// a footer that holds the schema and per block, per column zone maps (min/max,
+// null count and distinct estimate). Readers use the zone maps to skip blocks that can not
+// satisfy a predicate.
+//
+// File layout:
+//   magic string "CLF1"
+//   block 1 ... block N
+//   footer - serialized column_file::Footer
+//   fixed32 footer size, fixed32 masked crc32c of the footer, magic string "CLF1".
+#ifndef _COLUMN_FILE_H
+#define _COLUMN_FILE_H
+
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "base/status.h"
+#include "file/column_file.pb.h"
+#include "strings/stringpiece.h"
+
+namespace google {
+namespace protobuf {
+class Descriptor;
+class DescriptorPool;
+class FieldDescriptor;
+class DynamicMessageFactory;
+class Message;
+class SimpleDescriptorDatabase;
+}  // namespace protobuf
+}  // namespace google
+
+namespace util {
+class Sink;
+
+namespace coding {
+class PbBlockSerializer;
+class RoaringBitmap;
+}  // namespace coding
+}  // namespace util
+
+namespace file {
+class ReadonlyFile;
+
+namespace column_file {
+
+extern const char kMagicString[];
+const uint8 kMagicStringSize = 4;
+
+// footer size, footer crc and the magic string.
+const uint32 kTrailerSize = 4 + 4 + kMagicStringSize;
+
+// Longer string bounds are truncated in the zone maps.
+const uint32 kMaxStatStringLen = 64;
+
+}  // namespace column_file
+
+class ColumnWriter {
+ public:
+  struct Options {
+    // Number of messages per block. Zone maps have block granularity, therefore smaller
+    // blocks allow finer skipping at the expense of compression ratio.
+    uint32 block_msg_count = 1 << 14;
+
+    Options() {}
+  };
+
+  // Takes ownership over sink.
+  ColumnWriter(util::Sink* sink, const ::google::protobuf::Descriptor* dscr,
+               const Options& options = Options());
+
+  // Create a writer that will overwrite filename with data.
+  ColumnWriter(StringPiece filename, const ::google::protobuf::Descriptor* dscr,
+               const Options& options = Options());
+
+  // Calls Finish if it was not called. Its errors are only logged, call Finish to check them.
+  ~ColumnWriter();
+
+  // Adds user provided meta information about the file. Must be called before Finish.
+  void AddMeta(StringPiece key, strings::Slice value);
+
+  base::Status Add(const ::google::protobuf::Message& msg);
+
+  // Flushes the last block and writes the footer. No messages can be added afterwards.
+  base::Status Finish();
+
+  uint32 num_blocks() const { return footer_.block_size(); }
+  uint64 msgs_added() const { return msgs_added_; }
+
+ private:
+  void Construct();
+  base::Status Append(strings::Slice slice);
+  base::Status FlushBlock();
+
+  std::unique_ptr<util::Sink> dest_;
+  const ::google::protobuf::Descriptor* dscr_;
+  std::unique_ptr<util::coding::PbBlockSerializer> block_;
+  Options options_;
+  column_file::Footer footer_;
+
+  uint64 offset_ = 0;
+  uint64 msgs_added_ = 0;
+  bool finished_ = false;
+
+  ColumnWriter(const ColumnWriter&) = delete;
+  void operator=(const ColumnWriter&) = delete;
+};
+
+// Simple comparison of a column with a constant. The value type must match the column type:
+// int64 for signed integers and enums, uint64 for unsigned integers and bools,
+// double for floating point and string for string/bytes fields.
+// Values of repeated fields are matched if any of the array elements matches.
+struct ColumnPredicate {
+  enum Op {EQ, LT, LE, GT, GE};
+  enum Type {INT, UINT, DOUBLE, STRING};
+
+  std::string column;  // Dot separated path, i.e. "person.id".
+  Op op = EQ;
+  Type type = INT;
+
+  int64 int_val = 0;
+  uint64 uint_val = 0;
+  double double_val = 0;
+  std::string str_val;
+
+  static ColumnPredicate Int(StringPiece column, Op op, int64 v);
+  static ColumnPredicate UInt(StringPiece column, Op op, uint64 v);
+  static ColumnPredicate Double(StringPiece column, Op op, double v);
+  static ColumnPredicate String(StringPiece column, Op op, StringPiece v);
+};
+
+class ColumnReader {
+ public:
+  typedef std::function<void(const ::google::protobuf::Message&)> MessageCb;
+
+  // If checksum is true, verifies block checksums.
+  ColumnReader(ReadonlyFile* file, Ownership ownership, bool checksum = false);
+
+  // This version opens the file and owns it.
+  explicit ColumnReader(StringPiece filename, bool checksum = false);
+  ~ColumnReader();
+
+  // Reads and validates the footer. Must be called before any other method.
+  base::Status Init();
+
+  const column_file::Footer& footer() const { return footer_; }
+  uint32 num_blocks() const { return footer_.block_size(); }
+
+  // Descriptor of the stored messages. Taken from the generated pool if the type is compiled in,
+  // otherwise it is built from the FileDescriptorSet stored in the footer.
+  const ::google::protobuf::Descriptor* descriptor() const { return dscr_; }
+
+  // Returns column index in the footer or -1 if not found.
+  int ColumnIndex(StringPiece column) const;
+
+  // Returns false if the zone maps prove that no message in the block satisfies all the preds.
+  // Unknown columns and type mismatches never cause a block to be skipped.
+  bool BlockMayMatch(uint32 block, const std::vector<ColumnPredicate>& preds) const;
+
+  // Decodes all the messages of the block.
+  base::Status ReadBlock(uint32 block, MessageCb cb);
+
+  // Reads all the blocks that may match preds. Messages inside those blocks are not filtered.
+  // skipped_blocks, if not null, is incremented with the number of pruned blocks.
+  base::Status Scan(const std::vector<ColumnPredicate>& preds, MessageCb cb,
+                    uint32* skipped_blocks = nullptr);
+
+  // Evaluates preds on the messages of the block by decoding only the predicate columns.
+  // selection is filled with the indices of the messages that satisfy all the preds.
+  // Only top level columns are evaluated, predicates on nested or unknown columns and
+  // type mismatches select all the messages.
+  base::Status SelectRows(uint32 block, const std::vector<ColumnPredicate>& preds,
+                          util::coding::RoaringBitmap* selection);
+
+  // Like Scan but calls cb only for the messages selected by SelectRows.
+  base::Status Filter(const std::vector<ColumnPredicate>& preds, MessageCb cb,
+                      uint32* skipped_blocks = nullptr);
+
+ private:
+  base::Status InitDescriptor();
+  base::Status ReadBlockData(uint32 block, strings::Slice* data);
+  base::Status SelectRows(strings::Slice data, uint32 num_msgs,
+                          const std::vector<ColumnPredicate>& preds,
+                          util::coding::RoaringBitmap* selection);
+
+  // Decodes the messages of the block. If selection is not null, calls cb only for the
+  // messages in it.
+  base::Status DecodeBlock(strings::Slice data, uint32 num_msgs,
+                           const util::coding::RoaringBitmap* selection, MessageCb cb);
+
+  ReadonlyFile* file_;
+  Ownership ownership_;
+  bool const checksum_;
+
+  column_file::Footer footer_;
+  const ::google::protobuf::Descriptor* dscr_ = nullptr;
+  std::unique_ptr<::google::protobuf::SimpleDescriptorDatabase> proto_db_;
+  std::unique_ptr<::google::protobuf::DescriptorPool> proto_pool_;
+  std::unique_ptr<::google::protobuf::DynamicMessageFactory> msg_factory_;
+  const ::google::protobuf::Message* prototype_ = nullptr;
+
+  // Field descriptors of the columns in the footer order.
+  std::vector<const ::google::protobuf::FieldDescriptor*> columns_;
+  std::unordered_map<std::string, uint32> column_index_;
+
+  std::unique_ptr<uint8[]> buf_;
+  uint32 buf_size_ = 0;
+
+  ColumnReader(const ColumnReader&) = delete;
+  void operator=(const ColumnReader&) = delete;
+};
+
+}  // namespace file
+
+#endif  // _COLUMN_FILE_H
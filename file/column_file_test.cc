@@ -0,0 +1,200 @@
+// Copyright 2013, Beeri 15.  All rights reserved.
+// Author: Roman Gershman (romange@gmail.com)
+//
+#include "file/column_file.h"
+
+#include "base/gtest.h"
+#include "file/test_util.h"
+#include "strings/strcat.h"
+#include "util/coding/roaring_bitmap.h"
+#include "util/plang/addressbook.pb.h"
+#include "util/sinksource.h"
+
+namespace file {
+
+using tutorial::Person;
+using std::vector;
+namespace gpb = ::google::protobuf;
+
+class ColumnFileTest : public testing::Test {
+protected:
+  // Writes kNumMsgs persons with increasing ids. Every third person does not have an email.
+  void WriteFile(uint32 block_msg_count) {
+    sink_ = new util::StringSink;
+    ColumnWriter::Options opts;
+    opts.block_msg_count = block_msg_count;
+    ColumnWriter writer(sink_, Person::descriptor(), opts);
+    for (uint32 i = 0; i < kNumMsgs; ++i) {
+      Person p = MakePerson(i);
+      ASSERT_TRUE(writer.Add(p).ok());
+    }
+    ASSERT_TRUE(writer.Finish().ok());
+    EXPECT_EQ(kNumMsgs, writer.msgs_added());
+    contents_ = sink_->contents();
+  }
+
+  static Person MakePerson(uint32 i) {
+    Person p;
+    p.set_id(1000 + i);
+    p.set_name(StrCat("name", 100000 + i));
+    if (i % 3)
+      p.set_email(StrCat("e", i, "@foo.com"));
+    for (uint32 j = 0; j < i % 4; ++j) {
+      p.mutable_account()->add_activity_id(i * 10 + j);
+    }
+    return p;
+  }
+
+  std::unique_ptr<ColumnReader> OpenReader(bool checksum = true) {
+    std::unique_ptr<ColumnReader> reader(
+        new ColumnReader(new ReadonlyStringFile(contents_), TAKE_OWNERSHIP, checksum));
+    base::Status st = reader->Init();
+    CHECK(st.ok()) << st;
+    return reader;
+  }
+
+  static constexpr uint32 kNumMsgs = 1000;
+
+  util::StringSink* sink_ = nullptr;  // owned by the writer.
+  std::string contents_;
+};
+
+constexpr uint32 ColumnFileTest::kNumMsgs;
+
+TEST_F(ColumnFileTest, ReadWrite) {
+  WriteFile(100);
+  auto reader = OpenReader();
+  ASSERT_EQ(10, reader->num_blocks());
+  EXPECT_EQ(Person::descriptor(), reader->descriptor());
+
+  uint32 index = 0;
+  auto st = reader->Scan(vector<ColumnPredicate>(), [&index](const gpb::Message& msg) {
+      EXPECT_EQ(MakePerson(index).SerializeAsString(), msg.SerializeAsString()) << index;
+      ++index;
+    });
+  ASSERT_TRUE(st.ok()) << st;
+  EXPECT_EQ(kNumMsgs, index);
+}
+
+TEST_F(ColumnFileTest, ZoneMaps) {
+  WriteFile(100);
+  auto reader = OpenReader();
+  int id_col = reader->ColumnIndex("id");
+  int email_col = reader->ColumnIndex("email");
+  int name_col = reader->ColumnIndex("name");
+  int activity_col = reader->ColumnIndex("account.activity_id");
+  ASSERT_GE(id_col, 0);
+  ASSERT_GE(email_col, 0);
+  ASSERT_GE(activity_col, 0);
+  EXPECT_EQ(-1, reader->ColumnIndex("account.foo"));
+
+  const auto& block = reader->footer().block(2);
+  EXPECT_EQ(100, block.num_msgs());
+
+  const auto& id_stats = block.column(id_col);
+  EXPECT_EQ(1200, id_stats.min_int());
+  EXPECT_EQ(1299, id_stats.max_int());
+  EXPECT_EQ(0, id_stats.null_count());
+  EXPECT_NEAR(100, id_stats.distinct_estimate(), 10);
+
+  const auto& email_stats = block.column(email_col);
+  EXPECT_EQ(33, email_stats.null_count());  // 201, 204, ... 297.
+  EXPECT_EQ(67, email_stats.value_count());
+
+  const auto& name_stats = block.column(name_col);
+  EXPECT_EQ("name100200", name_stats.min_str());
+  EXPECT_EQ("name100299", name_stats.max_str());
+
+  const auto& activity_stats = block.column(activity_col);
+  EXPECT_EQ(2010, activity_stats.min_int());
+  EXPECT_EQ(2992, activity_stats.max_int());
+}
+
+TEST_F(ColumnFileTest, Skip) {
+  WriteFile(100);
+  auto reader = OpenReader();
+
+  vector<ColumnPredicate> preds{ColumnPredicate::Int("id", ColumnPredicate::GE, 1750)};
+  uint32 skipped = 0, count = 0;
+  auto cb = [&count](const gpb::Message&) { ++count; };
+  ASSERT_TRUE(reader->Scan(preds, cb, &skipped).ok());
+  EXPECT_EQ(7, skipped);
+  EXPECT_EQ(300, count);
+
+  preds = {ColumnPredicate::Int("id", ColumnPredicate::EQ, 1305),
+           ColumnPredicate::String("name", ColumnPredicate::LT, "name100350")};
+  skipped = count = 0;
+  ASSERT_TRUE(reader->Scan(preds, cb, &skipped).ok());
+  EXPECT_EQ(9, skipped);
+  EXPECT_EQ(100, count);
+
+  preds = {ColumnPredicate::Int("id", ColumnPredicate::LT, 0)};
+  EXPECT_FALSE(reader->BlockMayMatch(0, preds));
+
+  // Type mismatch or unknown columns never prune.
+  preds = {ColumnPredicate::Double("id", ColumnPredicate::LT, 0),
+           ColumnPredicate::Int("bar", ColumnPredicate::LT, 0)};
+  EXPECT_TRUE(reader->BlockMayMatch(0, preds));
+
+  // bank_name is never set, still its mismatched predicate does not prune.
+  ASSERT_GE(reader->ColumnIndex("account.bank_name"), 0);
+  preds = {ColumnPredicate::Int("account.bank_name", ColumnPredicate::EQ, 0)};
+  EXPECT_TRUE(reader->BlockMayMatch(0, preds));
+  preds = {ColumnPredicate::String("account.bank_name", ColumnPredicate::EQ, "")};
+  EXPECT_FALSE(reader->BlockMayMatch(0, preds));
+}
+
+TEST_F(ColumnFileTest, Filter) {
+  WriteFile(100);
+  auto reader = OpenReader();
+
+  util::coding::RoaringBitmap selection;
+  vector<ColumnPredicate> preds{ColumnPredicate::Int("id", ColumnPredicate::GE, 1250),
+                                ColumnPredicate::String("email", ColumnPredicate::LT, "e260")};
+  ASSERT_TRUE(reader->SelectRows(2, preds, &selection).ok());
+  // 250..259 that have email.
+  EXPECT_EQ(vector<uint32>({50, 51, 53, 54, 56, 57, 59}), selection.ToVector());
+
+  // Nested columns are not evaluated.
+  preds = {ColumnPredicate::Int("account.activity_id", ColumnPredicate::EQ, 2010)};
+  ASSERT_TRUE(reader->SelectRows(2, preds, &selection).ok());
+  EXPECT_EQ(100, selection.Cardinality());
+
+  vector<uint32> ids;
+  auto cb = [&ids](const gpb::Message& msg) {
+    ids.push_back(static_cast<const Person&>(msg).id());
+  };
+  preds = {ColumnPredicate::Int("id", ColumnPredicate::GE, 1750),
+           ColumnPredicate::String("name", ColumnPredicate::LE, "name100760")};
+  uint32 skipped = 0;
+  ASSERT_TRUE(reader->Filter(preds, cb, &skipped).ok());
+  EXPECT_EQ(9, skipped);
+  ASSERT_EQ(11, ids.size());
+  EXPECT_EQ(1750, ids.front());
+  EXPECT_EQ(1760, ids.back());
+
+  ids.clear();
+  preds = {ColumnPredicate::String("email", ColumnPredicate::EQ, "e751@foo.com")};
+  ASSERT_TRUE(reader->Filter(preds, cb).ok());
+  EXPECT_EQ(vector<uint32>({1751}), ids);
+}
+
+TEST_F(ColumnFileTest, Corrupted) {
+  WriteFile(500);
+  contents_[contents_.size() - column_file::kTrailerSize - 3] ^= 1;
+  ColumnReader reader(new ReadonlyStringFile(contents_), TAKE_OWNERSHIP);
+  EXPECT_FALSE(reader.Init().ok());
+}
+
+TEST_F(ColumnFileTest, Empty) {
+  util::StringSink* sink = new util::StringSink;
+  {
+    ColumnWriter writer(sink, Person::descriptor());
+    ASSERT_TRUE(writer.Finish().ok());
+    contents_ = sink->contents();
+  }
+  auto reader = OpenReader();
+  EXPECT_EQ(0, reader->num_blocks());
+}
+
+}  // namespace file
@@ -0,0 +1,16 @@
+// Copyright 2013, Beeri 15.  All rights reserved.
+// Author: Roman Gershman (romange@gmail.com)
+//
+#include "file/file_async.h"
+
+namespace file {
+
+util::Future<base::Status> ReadAsync(util::Executor* executor, ReadonlyFile* file,
+                                     size_t offset, size_t length,
+                                     strings::Slice* result, uint8* buffer) {
+  return util::Async(executor, [file, offset, length, result, buffer] {
+      return file->Read(offset, length, result, buffer);
+    });
+}
+
+}  // namespace file
@@ -0,0 +1,23 @@
+// Copyright 2013, Beeri 15.  All rights reserved.
+// Author: Roman Gershman (romange@gmail.com)
+//
+// Asynchronous reads on top of ReadonlyFile. Kept apart from file/file.h so that the file
+// library does not depend on the executor.
+#ifndef _FILE_FILE_ASYNC_H
+#define _FILE_FILE_ASYNC_H
+
+#include "base/status.h"
+#include "file/file.h"
+#include "util/future.h"
+
+namespace file {
+
+// Runs file->Read on the executor's pool. file, result and buffer must stay valid until
+// the future is set. Several reads may be issued in parallel and joined with util::WhenAll.
+util::Future<base::Status> ReadAsync(util::Executor* executor, ReadonlyFile* file,
+                                     size_t offset, size_t length,
+                                     strings::Slice* result, uint8* buffer);
+
+}  // namespace file
+
+#endif  // _FILE_FILE_ASYNC_H
@@ -0,0 +1,43 @@
+// Copyright 2013, Beeri 15.  All rights reserved.
+// Author: Roman Gershman (romange@gmail.com)
+//
+#include "file/file_async.h"
+
+#include <vector>
+#include "base/gtest.h"
+#include "file/test_util.h"
+
+namespace file {
+
+using strings::Slice;
+
+class FileAsyncTest : public testing::Test {
+protected:
+  FileAsyncTest() : executor_(2) {}
+
+  ~FileAsyncTest() {
+    executor_.Shutdown();
+    executor_.WaitForLoopToExit();
+  }
+
+  util::Executor executor_;
+};
+
+TEST_F(FileAsyncTest, ParallelReads) {
+  ReadonlyStringFile file("0123456789abcdef");
+  std::vector<Slice> results(4);
+  std::vector<util::Future<base::Status>> futures;
+  for (unsigned i = 0; i < results.size(); ++i)
+    futures.push_back(ReadAsync(&executor_, &file, i * 4, 4, &results[i], nullptr));
+
+  std::vector<base::Status> statuses = util::WhenAll(std::move(futures)).Get();
+  for (const base::Status& st : statuses)
+    EXPECT_TRUE(st.ok()) << st;
+  EXPECT_EQ("0123", results[0].as_string());
+  EXPECT_EQ("cdef", results[3].as_string());
+
+  Slice res;
+  EXPECT_FALSE(ReadAsync(&executor_, &file, 10, 10, &res, nullptr).Get().ok());
+}
+
+}  // namespace file
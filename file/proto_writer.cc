@@ -23,8 +23,7 @@ const char kProtoTypeKey[] = "__proto_type__";
 
 namespace gpb = ::google::protobuf;
 
-ProtoWriter::ProtoWriter(StringPiece filename, const gpb::Descriptor* dscr, Options opts)
-    : dscr_(dscr), options_(opts) {
+std::string SerializedFileDescriptorSet(const gpb::Descriptor* dscr) {
   const gpb::FileDescriptor* fd = dscr->file();
   gpb::FileDescriptorSet fd_set;
   std::unordered_set<const gpb::FileDescriptor*> unique_set({fd});
@@ -41,7 +40,12 @@ ProtoWriter::ProtoWriter(StringPiece filename, const gpb::Descriptor* dscr, Opti
       }
     }
   }
-  string fd_set_str = fd_set.SerializeAsString();
+  return fd_set.SerializeAsString();
+}
+
+ProtoWriter::ProtoWriter(StringPiece filename, const gpb::Descriptor* dscr, Options opts)
+    : dscr_(dscr), options_(opts) {
+  string fd_set_str = SerializedFileDescriptorSet(dscr);
   if (opts.format == LIST_FILE) {
     writer_.reset(new ListWriter(filename));
     writer_->AddMeta(kProtoSetKey, fd_set_str);
@@ -28,6 +28,10 @@ class ListWriter;
 extern const char kProtoSetKey[];
 extern const char kProtoTypeKey[];
 
+// Returns serialized FileDescriptorSet of the file defining dscr together with all its
+// dependencies. This is the value stored under kProtoSetKey.
+std::string SerializedFileDescriptorSet(const ::google::protobuf::Descriptor* dscr);
+
 namespace sstable {
 class TableBuilder;
 }  // namespace sstable
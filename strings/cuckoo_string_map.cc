@@ -0,0 +1,138 @@
+// Copyright 2013, Beeri 15.  All rights reserved.
+// Author: Roman Gershman (romange@gmail.com)
+//
+#include "strings/cuckoo_string_map.h"
+
+#include <emmintrin.h>
+#include <cstring>
+
+#include "base/bits.h"
+#include "base/hash.h"
+#include "base/logging.h"
+
+constexpr CuckooStringTable::dense_id CuckooStringTable::npos;
+constexpr unsigned CuckooStringTable::kSlots;
+
+CuckooStringTable::CuckooStringTable(uint32 capacity) {
+  static_assert(sizeof(Bucket) == 48, "Unexpected bucket size");
+
+  // Aim for 90% utilization.
+  uint32 count = 2;
+  while (count * kSlots * 9 / 10 < capacity)
+    count *= 2;
+  entries_.reserve(capacity);
+  Rehash(count);
+}
+
+inline uint64 CuckooStringTable::Hash(StringPiece key) {
+  return base::Fingerprint(key.data(), key.size());
+}
+
+inline uint32 CuckooStringTable::MatchTags(const Bucket& bucket, uint16 tag) {
+  __m128i tags = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bucket.tag));
+  __m128i cmp = _mm_cmpeq_epi16(tags, _mm_set1_epi16(tag));
+
+  // Packs each 16 bit result into a byte so that movemask returns a bit per slot.
+  return _mm_movemask_epi8(_mm_packs_epi16(cmp, _mm_setzero_si128()));
+}
+
+inline CuckooStringTable::dense_id CuckooStringTable::FindInBucket(
+    const Bucket& bucket, uint16 tag, uint64 hash, StringPiece key) const {
+  uint32 mask = MatchTags(bucket, tag);
+  while (mask) {
+    dense_id id = bucket.id[Bits::FindLSBSetNonZero(mask)];
+    const Entry& e = entries_[id];
+    if (e.hash == hash && e.size == key.size() &&
+        (key.empty() || memcmp(e.data, key.data(), key.size()) == 0)) {
+      return id;
+    }
+    mask &= (mask - 1);
+  }
+  return npos;
+}
+
+CuckooStringTable::dense_id CuckooStringTable::find(StringPiece key) const {
+  uint64 hash = Hash(key);
+  uint16 tag = TagOf(hash);
+  dense_id res = FindInBucket(buckets_[Bucket1(hash)], tag, hash, key);
+  if (res != npos)
+    return res;
+  return FindInBucket(buckets_[Bucket2(hash)], tag, hash, key);
+}
+
+std::pair<CuckooStringTable::dense_id, bool> CuckooStringTable::Insert(StringPiece key) {
+  uint64 hash = Hash(key);
+  uint16 tag = TagOf(hash);
+  dense_id res = FindInBucket(buckets_[Bucket1(hash)], tag, hash, key);
+  if (res == npos)
+    res = FindInBucket(buckets_[Bucket2(hash)], tag, hash, key);
+  if (res != npos)
+    return std::make_pair(res, false);
+
+  CHECK_LT(entries_.size(), npos);
+  Entry e;
+  e.data = nullptr;
+  e.size = key.size();
+  e.hash = hash;
+  if (!key.empty()) {
+    char* data = arena_.Allocate(key.size());
+    memcpy(data, key.data(), key.size());
+    e.data = data;
+  }
+  res = entries_.size();
+  entries_.push_back(e);
+  if (!Place(res))
+    Rehash(buckets_.size() * 2);
+  return std::make_pair(res, true);
+}
+
+bool CuckooStringTable::Place(dense_id id) {
+  uint16 tag = TagOf(entries_[id].hash);
+  for (uint32 kick = 0; kick <= max_kicks_; ++kick) {
+    uint64 hash = entries_[id].hash;
+    Bucket* b1 = &buckets_[Bucket1(hash)];
+    Bucket* b2 = &buckets_[Bucket2(hash)];
+    uint32 empty = MatchTags(*b1, 0);
+    Bucket* dest = b1;
+    if (!empty) {
+      empty = MatchTags(*b2, 0);
+      dest = b2;
+    }
+    if (empty) {
+      int i = Bits::FindLSBSetNonZero(empty);
+      dest->tag[i] = tag;
+      dest->id[i] = id;
+      return true;
+    }
+
+    // Both buckets are full, evict a random victim which now needs a place.
+    uint32 r = NextRand();
+    dest = (r & 1) ? b1 : b2;
+    unsigned i = (r >> 1) % kSlots;
+    std::swap(tag, dest->tag[i]);
+    std::swap(id, dest->id[i]);
+  }
+  return false;
+}
+
+void CuckooStringTable::Rehash(uint32 bucket_count) {
+  while (true) {
+    VLOG(1) << "Rehashing " << entries_.size() << " keys into " << bucket_count << " buckets";
+    buckets_.assign(bucket_count, Bucket());
+    bucket_mask_ = bucket_count - 1;
+    max_kicks_ = 16 + 4 * Bits::Log2FloorNonZero(bucket_count);
+
+    bool success = true;
+    for (dense_id id = 0; id < entries_.size() && success; ++id)
+      success = Place(id);
+    if (success)
+      return;
+    bucket_count *= 2;
+  }
+}
+
+void CuckooStringTable::Clear() {
+  entries_.clear();
+  arena_.Reset();
+  std::fill(buckets_.begin(), buckets_.end(), Bucket());
+}
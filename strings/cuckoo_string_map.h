@@ -0,0 +1,169 @@
+// Copyright 2013, Beeri 15.  All rights reserved.
+// Author: Roman Gershman (romange@gmail.com)
+//
+#ifndef _STRINGS_CUCKOO_STRING_MAP_H
+#define _STRINGS_CUCKOO_STRING_MAP_H
+
+#include <vector>
+
+#include "base/arena.h"
+#include "base/integral_types.h"
+#include "strings/stringpiece.h"
+
+/*
+  Cuckoo hash table for string keys, a string flavour of base::CuckooMapTable.
+  Keys are copied into an arena and assigned sequential dense ids that never change.
+  Every bucket holds 8 slots of 16 bit tags and dense ids. A lookup compares all the tags of
+  a bucket with a single SSE2 instruction and compares full keys only for the matching tags,
+  so most of the misses never touch the keys. Each key may reside in one of 2 buckets,
+  which allows utilization of over 90%.
+*/
+class CuckooStringTable {
+public:
+  typedef uint32 dense_id;
+
+  static constexpr dense_id npos = kuint32max;
+
+  explicit CuckooStringTable(uint32 capacity = 0);
+
+  // Returns the dense id of key and true if it was inserted. Dense ids are assigned
+  // sequentially from 0.
+  std::pair<dense_id, bool> Insert(StringPiece key);
+
+  // Returns npos if key is not found.
+  dense_id find(StringPiece key) const;
+
+  StringPiece FromDenseId(dense_id d) const {
+    const Entry& e = entries_[d];
+    return StringPiece(e.data, e.size);
+  }
+
+  void Clear();
+
+  size_t size() const { return entries_.size(); }
+  bool empty() const { return entries_.empty(); }
+
+  // Number of slots.
+  size_t Capacity() const { return buckets_.size() * kSlots; }
+
+  double Utilization() const { return size() * 1.0 / Capacity(); }
+
+  uint64 BytesAllocated() const {
+    return buckets_.capacity() * sizeof(Bucket) + entries_.capacity() * sizeof(Entry) +
+        arena_.MemoryUsage();
+  }
+
+private:
+  static constexpr unsigned kSlots = 8;
+
+  struct Bucket {
+    uint16 tag[kSlots];  // 0 is an empty slot.
+    dense_id id[kSlots];
+  };
+
+  struct Entry {
+    const char* data;
+    uint32 size;
+    uint64 hash;  // kept to avoid rehashing the keys when they move.
+  };
+
+  static uint64 Hash(StringPiece key);
+
+  // The tag and the buckets use different bits of the hash, so that keys sharing a bucket
+  // still have independent tags.
+  static uint16 TagOf(uint64 hash) {
+    uint16 tag = hash;
+    return tag ? tag : 1;
+  }
+
+  uint32 Bucket1(uint64 hash) const { return (hash >> 32) & bucket_mask_; }
+  uint32 Bucket2(uint64 hash) const {
+    uint32 b = (hash >> 16) & bucket_mask_;
+    return b == Bucket1(hash) ? b ^ 1 : b;
+  }
+
+  // Returns a mask with bit i set if bucket.tag[i] == tag.
+  static uint32 MatchTags(const Bucket& bucket, uint16 tag);
+
+  dense_id FindInBucket(const Bucket& bucket, uint16 tag, uint64 hash, StringPiece key) const;
+
+  // Puts id into one of its buckets, kicking out other ids if needed.
+  // Returns false if it failed, in which case some other id was left without a slot.
+  bool Place(dense_id id);
+
+  // Rebuilds the buckets with bucket_count buckets.
+  void Rehash(uint32 bucket_count);
+
+  uint32 NextRand() {
+    rand_state_ ^= rand_state_ << 13;
+    rand_state_ ^= rand_state_ >> 17;
+    rand_state_ ^= rand_state_ << 5;
+    return rand_state_;
+  }
+
+  std::vector<Bucket> buckets_;
+  uint32 bucket_mask_ = 0;
+  uint32 max_kicks_ = 0;
+  uint32 rand_state_ = 1;
+
+  std::vector<Entry> entries_;
+  base::Arena arena_;
+
+  CuckooStringTable(const CuckooStringTable&) = delete;
+  void operator=(const CuckooStringTable&) = delete;
+};
+
+// Maps strings to T. Unlike base::CuckooMap, T may be any copyable type.
+template<typename T> class CuckooStringMap {
+public:
+  typedef CuckooStringTable::dense_id DenseId;
+
+  static constexpr DenseId npos = CuckooStringTable::npos;
+
+  explicit CuckooStringMap(uint32 capacity = 0) : table_(capacity) {
+    values_.reserve(capacity);
+  }
+
+  // Does not overwrite the value if key already exists.
+  std::pair<DenseId, bool> Insert(StringPiece key, const T& val) {
+    auto res = table_.Insert(key);
+    if (res.second)
+      values_.push_back(val);
+    return res;
+  }
+
+  T& operator[](StringPiece key) {
+    return values_[Insert(key, T()).first];
+  }
+
+  DenseId find(StringPiece key) const { return table_.find(key); }
+
+  std::pair<StringPiece, T*> FromDenseId(DenseId d) {
+    return std::pair<StringPiece, T*>(table_.FromDenseId(d), &values_[d]);
+  }
+
+  std::pair<StringPiece, const T*> FromDenseId(DenseId d) const {
+    return std::pair<StringPiece, const T*>(table_.FromDenseId(d), &values_[d]);
+  }
+
+  void Clear() {
+    table_.Clear();
+    values_.clear();
+  }
+
+  size_t size() const { return table_.size(); }
+  bool empty() const { return table_.empty(); }
+  double Utilization() const { return table_.Utilization(); }
+
+  uint64 BytesAllocated() const {
+    return table_.BytesAllocated() + values_.capacity() * sizeof(T);
+  }
+
+private:
+  CuckooStringTable table_;
+  std::vector<T> values_;
+};
+
+template<typename T> constexpr typename CuckooStringMap<T>::DenseId CuckooStringMap<T>::npos;
+
+#endif  // _STRINGS_CUCKOO_STRING_MAP_H
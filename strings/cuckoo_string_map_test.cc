@@ -0,0 +1,172 @@
+// Copyright 2013, Beeri 15.  All rights reserved.
+// Author: Roman Gershman (romange@gmail.com)
+//
+#include "strings/cuckoo_string_map.h"
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "base/gtest.h"
+#include "base/random.h"
+#include "strings/unique_strings.h"
+
+using std::string;
+
+class CuckooStringMapTest : public testing::Test {
+};
+
+TEST_F(CuckooStringMapTest, Basic) {
+  CuckooStringMap<string> m;
+  EXPECT_EQ(CuckooStringTable::npos, m.find("foo"));
+
+  auto res = m.Insert("foo", "bar");
+  EXPECT_TRUE(res.second);
+  EXPECT_EQ(0, res.first);
+  EXPECT_EQ(0, m.find("foo"));
+  EXPECT_EQ("bar", *m.FromDenseId(0).second);
+  EXPECT_EQ("foo", m.FromDenseId(0).first);
+
+  res = m.Insert(string("foo"), "baz");
+  EXPECT_FALSE(res.second);
+  EXPECT_EQ("bar", *m.FromDenseId(res.first).second);
+
+  m[""] = "empty";
+  EXPECT_EQ(1, m.find(""));
+  EXPECT_EQ("empty", m[""]);
+  EXPECT_EQ(2, m.size());
+
+  m.Clear();
+  EXPECT_TRUE(m.empty());
+  EXPECT_EQ(CuckooStringTable::npos, m.find("foo"));
+}
+
+TEST_F(CuckooStringMapTest, Grow) {
+  CuckooStringMap<int> m;
+  const int kLength = 100000;
+  for (int i = 0; i < kLength; ++i) {
+    string key = "key" + std::to_string(i);
+    auto res = m.Insert(key, i);
+    ASSERT_TRUE(res.second);
+    ASSERT_EQ(i, res.first);
+  }
+  EXPECT_EQ(kLength, m.size());
+  for (int i = 0; i < kLength; ++i) {
+    string key = "key" + std::to_string(i);
+    CuckooStringTable::dense_id id = m.find(key);
+    ASSERT_EQ(i, id);
+    ASSERT_EQ(key, m.FromDenseId(id).first);
+    ASSERT_EQ(i, *m.FromDenseId(id).second);
+    ASSERT_EQ(CuckooStringTable::npos, m.find("nokey" + std::to_string(i)));
+  }
+  LOG(INFO) << "Utilization " << m.Utilization() << ", bytes " << m.BytesAllocated();
+}
+
+TEST_F(CuckooStringMapTest, HighLoad) {
+  // The table is sized for 90% utilization and must not regrow.
+  const unsigned kLength = 14745;
+  CuckooStringTable table(kLength);
+  size_t capacity = table.Capacity();
+  for (unsigned i = 0; i < kLength; ++i)
+    table.Insert(std::to_string(i * 7919));
+  EXPECT_EQ(capacity, table.Capacity());
+  EXPECT_GT(table.Utilization(), 0.89);
+}
+
+// Find benchmarks at a given load factor, in percents. Every iteration looks up a present key
+// and a missing one.
+constexpr unsigned kLoadItems = 1 << 16;
+
+static std::vector<string> LoadKeys() {
+  MTRandom rand(30);
+  std::vector<string> keys(kLoadItems * 2);
+  for (string& k : keys)
+    k = "http://www.example.com/" + std::to_string(rand.Rand64());
+  return keys;
+}
+
+static void BM_FindCuckooString(benchmark::State& state) {
+  std::vector<string> keys = LoadKeys();
+
+  // The table has kLoadItems slots.
+  CuckooStringMap<uint32> m(kLoadItems * 9 / 10);
+  const unsigned items = kLoadItems * state.range_x() / 100;
+  for (unsigned i = 0; i < items; ++i)
+    m.Insert(keys[i], i);
+  unsigned i = 0;
+  while (state.KeepRunning()) {
+    base::sink_result(m.find(keys[i]));
+    base::sink_result(m.find(keys[i + kLoadItems]));
+    i = (i + 1) % items;
+  }
+  state.SetLabel(std::to_string(int(m.Utilization() * 100)) + "% utilization");
+}
+BENCHMARK(BM_FindCuckooString)->Arg(50)->Arg(75)->Arg(90);
+
+static void BM_FindDenseMapString(benchmark::State& state) {
+  std::vector<string> keys = LoadKeys();
+  StringPieceDenseMap<uint32> m;
+  m.set_empty_key(StringPiece());
+  for (unsigned i = 0; i < kLoadItems; ++i)
+    m.emplace(keys[i], i);
+  unsigned i = 0;
+  while (state.KeepRunning()) {
+    base::sink_result(m.find(keys[i]) == m.end());
+    base::sink_result(m.find(keys[i + kLoadItems]) == m.end());
+    i = (i + 1) % kLoadItems;
+  }
+}
+BENCHMARK(BM_FindDenseMapString);
+
+static void BM_FindUnorderedMapString(benchmark::State& state) {
+  std::vector<string> keys = LoadKeys();
+  std::unordered_map<StringPiece, uint32> m;
+  for (unsigned i = 0; i < kLoadItems; ++i)
+    m.emplace(keys[i], i);
+  unsigned i = 0;
+  while (state.KeepRunning()) {
+    base::sink_result(m.find(keys[i]) == m.end());
+    base::sink_result(m.find(keys[i + kLoadItems]) == m.end());
+    i = (i + 1) % kLoadItems;
+  }
+}
+BENCHMARK(BM_FindUnorderedMapString);
+
+// StringPieceMap is backed by base::FlatHashMap.
+static void BM_FindStringPieceMap(benchmark::State& state) {
+  std::vector<string> keys = LoadKeys();
+  StringPieceMap<uint32> m;
+  for (unsigned i = 0; i < kLoadItems; ++i)
+    m.emplace(keys[i], i);
+  unsigned i = 0;
+  while (state.KeepRunning()) {
+    base::sink_result(m.find(keys[i]) == m.end());
+    base::sink_result(m.find(keys[i + kLoadItems]) == m.end());
+    i = (i + 1) % kLoadItems;
+  }
+}
+BENCHMARK(BM_FindStringPieceMap);
+
+static void BM_InsertCuckooString(benchmark::State& state) {
+  std::vector<string> keys = LoadKeys();
+  while (state.KeepRunning()) {
+    CuckooStringMap<uint32> m;
+    for (unsigned i = 0; i < kLoadItems; ++i)
+      m.Insert(keys[i], i);
+    base::sink_result(m.size());
+  }
+  state.SetItemsProcessed(state.iterations() * kLoadItems);
+}
+BENCHMARK(BM_InsertCuckooString);
+
+static void BM_InsertDenseMapString(benchmark::State& state) {
+  std::vector<string> keys = LoadKeys();
+  while (state.KeepRunning()) {
+    StringPieceDenseMap<uint32> m;
+    m.set_empty_key(StringPiece());
+    for (unsigned i = 0; i < kLoadItems; ++i)
+      m.emplace(keys[i], i);
+    base::sink_result(m.size());
+  }
+  state.SetItemsProcessed(state.iterations() * kLoadItems);
+}
+BENCHMARK(BM_InsertDenseMapString);
@@ -24,6 +24,12 @@ template<> struct hash<strings::Slice> {
 
 }  // namespace std
 
+// 64 bit hash of StringPiece keys for open addressing tables like base::FlatHashMap.
+struct StringPieceHash {
+  size_t operator()(StringPiece sp) const {
+    return base::Fingerprint(sp.data(), sp.size());
+  }
+};
 
 #endif  // _STRINGS_HASH_H
 
@@ -0,0 +1,230 @@
+// Copyright 2013, Beeri 15.  All rights reserved.
+// Author: Roman Gershman (romange@gmail.com)
+//
+#include "strings/string_interner.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "base/logging.h"
+
+namespace {
+
+constexpr uint32 kMagic = 0x544e4953;  // "SINT"
+constexpr uint32 kVersion = 1;
+
+struct FrozenHeader {
+  uint32 magic;
+  uint32 version;
+  uint32 count;
+  uint32 index_size;
+  uint64 blob_size;
+};
+
+static_assert(sizeof(FrozenHeader) % sizeof(uint64) == 0, "Offsets must be aligned");
+
+inline uint64 FrozenHash(StringPiece str) {
+  return StringPieceHash()(str);
+}
+
+unsigned NumShards(unsigned requested) {
+  CHECK_GT(requested, 0);
+  return 1U << Bits::Log2Ceiling(requested);
+}
+
+}  // namespace
+
+constexpr StringInterner::Id StringInterner::npos;
+constexpr unsigned StringInterner::kFirstChunkBits;
+constexpr unsigned StringInterner::kMaxChunks;
+constexpr FrozenStringInterner::Id FrozenStringInterner::npos;
+
+StringInterner::StringInterner(unsigned num_shards)
+    : num_shards_(NumShards(num_shards)), shard_mask_(num_shards_ - 1), shards_(num_shards_),
+      next_id_(0) {
+  for (auto& chunk : chunks_)
+    chunk.store(nullptr, std::memory_order_relaxed);
+}
+
+StringInterner::~StringInterner() {
+  for (auto& chunk : chunks_)
+    delete[] chunk.load(std::memory_order_relaxed);
+}
+
+StringInterner::Id StringInterner::Intern(StringPiece str) {
+  HashedKey key{str, StringPieceHash()(str)};
+  Shard& shard = ShardOf(key.hash);
+  base::MutexLock lock(&shard.mu);
+  auto it = shard.ids.find(key);
+  if (it != shard.ids.end())
+    return it->second;
+
+  Id id = next_id_.fetch_add(1, std::memory_order_relaxed);
+  CHECK_LT(id, npos);
+  StringPiece stored;
+  if (!str.empty()) {
+    char* data = shard.arena.Allocate(str.size());
+    memcpy(data, str.data(), str.size());
+    stored = StringPiece(data, str.size());
+  }
+  *SlotForWrite(id) = stored;
+  shard.ids.emplace(stored, id);
+  return id;
+}
+
+StringInterner::Id StringInterner::Find(StringPiece str) const {
+  HashedKey key{str, StringPieceHash()(str)};
+  const Shard& shard = ShardOf(key.hash);
+  base::MutexLock lock(&shard.mu);
+  auto it = shard.ids.find(key);
+  return it == shard.ids.end() ? npos : it->second;
+}
+
+StringPiece* StringInterner::SlotForWrite(Id id) {
+  unsigned chunk = ChunkOf(id);
+  StringPiece* ptr = chunks_[chunk].load(std::memory_order_acquire);
+  if (ptr == nullptr) {
+    // Ids from different shards may need the same chunk.
+    base::MutexLock lock(&chunk_mu_);
+    ptr = chunks_[chunk].load(std::memory_order_relaxed);
+    if (ptr == nullptr) {
+      ptr = new StringPiece[1U << (kFirstChunkBits + chunk)];
+      chunks_[chunk].store(ptr, std::memory_order_release);
+    }
+  }
+  return ptr + (id - ChunkStart(chunk));
+}
+
+size_t StringInterner::MemoryUsage() const {
+  size_t res = 0;
+  for (unsigned i = 0; i < num_shards_; ++i) {
+    const Shard& shard = shards_[i];
+    base::MutexLock lock(&shard.mu);
+    res += shard.arena.MemoryUsage() + shard.ids.MemoryUsage();
+  }
+  for (unsigned i = 0; i < kMaxChunks; ++i) {
+    if (chunks_[i].load(std::memory_order_acquire))
+      res += sizeof(StringPiece) << (kFirstChunkBits + i);
+  }
+  return res;
+}
+
+size_t StringInterner::Freeze(std::string* out) const {
+  for (unsigned i = 0; i < num_shards_; ++i)
+    shards_[i].mu.Lock();
+
+  FrozenHeader header;
+  header.magic = kMagic;
+  header.version = kVersion;
+  header.count = next_id_.load(std::memory_order_relaxed);
+  CHECK_LT(header.count, 1U << 30);
+
+  // At most 50% load.
+  header.index_size = 2;
+  while (header.index_size < header.count * 2)
+    header.index_size *= 2;
+  header.blob_size = 0;
+  for (Id id = 0; id < header.count; ++id)
+    header.blob_size += FromId(id).size();
+
+  size_t start = (out->size() + sizeof(uint64) - 1) & ~(sizeof(uint64) - 1);
+  out->resize(start + sizeof(header) + (header.count + 1) * sizeof(uint64) +
+              header.index_size * sizeof(uint64) + header.blob_size);
+  char* dest = &(*out)[start];
+  memcpy(dest, &header, sizeof(header));
+  uint64* offsets = reinterpret_cast<uint64*>(dest + sizeof(header));
+  uint64* index = offsets + header.count + 1;
+  char* blob = reinterpret_cast<char*>(index + header.index_size);
+  memset(index, 0, header.index_size * sizeof(uint64));
+
+  uint64 offset = 0;
+  uint32 mask = header.index_size - 1;
+  for (Id id = 0; id < header.count; ++id) {
+    StringPiece str = FromId(id);
+    offsets[id] = offset;
+    if (!str.empty())
+      memcpy(blob + offset, str.data(), str.size());
+    offset += str.size();
+
+    uint64 hash = FrozenHash(str);
+    uint32 pos = hash & mask;
+    while (index[pos])
+      pos = (pos + 1) & mask;
+    index[pos] = (hash >> 32 << 32) | (id + 1);
+  }
+  offsets[header.count] = offset;
+
+  for (unsigned i = 0; i < num_shards_; ++i)
+    shards_[i].mu.Unlock();
+  return start;
+}
+
+bool FrozenStringInterner::Init(StringPiece data) {
+  FrozenHeader header;
+  if (data.size() < sizeof(header)) {
+    LOG(ERROR) << "Frozen interner is too short " << data.size();
+    return false;
+  }
+  if (reinterpret_cast<uintptr_t>(data.data()) % sizeof(uint64) != 0) {
+    LOG(ERROR) << "Frozen interner is not aligned";
+    return false;
+  }
+  memcpy(&header, data.data(), sizeof(header));
+  if (header.magic != kMagic || header.version != kVersion) {
+    LOG(ERROR) << "Bad frozen interner header " << header.magic << " " << header.version;
+    return false;
+  }
+  uint64 expected = sizeof(header) + (uint64(header.count) + 1) * sizeof(uint64) +
+      uint64(header.index_size) * sizeof(uint64) + header.blob_size;
+  if (expected != data.size() || header.index_size <= header.count ||
+      (header.index_size & (header.index_size - 1)) != 0) {
+    LOG(ERROR) << "Corrupted frozen interner of size " << data.size();
+    return false;
+  }
+  const uint64* offsets = reinterpret_cast<const uint64*>(data.data() + sizeof(header));
+  if (offsets[0] != 0 || offsets[header.count] != header.blob_size ||
+      !std::is_sorted(offsets, offsets + header.count + 1)) {
+    LOG(ERROR) << "Corrupted frozen interner offsets";
+    return false;
+  }
+
+  // Find relies on valid ids and stops at an empty slot.
+  const uint64* index = offsets + header.count + 1;
+  bool has_empty = false;
+  for (uint32 i = 0; i < header.index_size; ++i) {
+    uint32 id_plus_one = uint32(index[i]);
+    if (index[i] == 0) {
+      has_empty = true;
+    } else if (id_plus_one == 0 || id_plus_one > header.count) {
+      LOG(ERROR) << "Corrupted frozen interner index entry " << i;
+      return false;
+    }
+  }
+  if (!has_empty) {
+    LOG(ERROR) << "Frozen interner index is full";
+    return false;
+  }
+  offsets_ = offsets;
+  index_ = index;
+  blob_ = reinterpret_cast<const char*>(index_ + header.index_size);
+  count_ = header.count;
+  index_mask_ = header.index_size - 1;
+  return true;
+}
+
+FrozenStringInterner::Id FrozenStringInterner::Find(StringPiece str) const {
+  if (index_ == nullptr)
+    return npos;
+  uint64 hash = FrozenHash(str);
+  uint32 tag = hash >> 32;
+  for (uint32 pos = hash & index_mask_; ; pos = (pos + 1) & index_mask_) {
+    uint64 entry = index_[pos];
+    if (entry == 0)
+      return npos;
+    if ((entry >> 32) == tag) {
+      Id id = uint32(entry) - 1;
+      if (FromId(id) == str)
+        return id;
+    }
+  }
+}
@@ -0,0 +1,155 @@
+// Copyright 2013, Beeri 15.  All rights reserved.
+// Author: Roman Gershman (romange@gmail.com)
+//
+#ifndef _STRINGS_STRING_INTERNER_H
+#define _STRINGS_STRING_INTERNER_H
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+#include "base/aligned_array.h"
+#include "base/arena.h"
+#include "base/bits.h"
+#include "base/flat_hash_map.h"
+#include "base/integral_types.h"
+#include "base/mutex.h"
+#include "base/port.h"
+#include "strings/hash.h"
+#include "strings/stringpiece.h"
+
+/*
+  Thread-safe string interner which assigns dense 32 bit ids, starting from 0, to strings.
+  Strings are sharded by hash, every shard has its own lock, arena and hash table, so threads
+  interning different strings rarely contend. Ids are global and never change. FromId() does
+  not lock, the strings of all the ids live in a table which is never reallocated.
+
+  Freeze() serializes the interner into a flat buffer, which FrozenStringInterner can use in
+  place. The buffer can be written to a file and mapped by multiple processes, for example
+  with file::ReadonlyFile.
+*/
+class StringInterner {
+public:
+  typedef uint32 Id;
+
+  static constexpr Id npos = kuint32max;
+
+  // num_shards is rounded up to a power of 2.
+  explicit StringInterner(unsigned num_shards = 16);
+  ~StringInterner();
+
+  // Returns the id of str, assigning the next id if str was not interned before.
+  Id Intern(StringPiece str);
+
+  // Returns npos if str was not interned.
+  Id Find(StringPiece str) const;
+
+  // id must have been returned by Intern. The result is valid for the lifetime of the interner.
+  StringPiece FromId(Id id) const {
+    unsigned chunk = ChunkOf(id);
+    return chunks_[chunk].load(std::memory_order_acquire)[id - ChunkStart(chunk)];
+  }
+
+  size_t size() const { return next_id_.load(std::memory_order_acquire); }
+
+  size_t MemoryUsage() const;
+
+  // Appends the frozen representation of the interner to out. Blocks concurrent Intern calls.
+  // FrozenStringInterner requires 8 byte aligned data, therefore out is first padded with zeros
+  // to a multiple of 8 bytes. Returns the offset of the frozen interner in out.
+  size_t Freeze(std::string* out) const;
+
+private:
+  struct HashedKey {
+    StringPiece str;
+    uint64 hash;
+  };
+
+  // Allows lookups by HashedKey without hashing the string again.
+  struct KeyHash : public StringPieceHash {
+    using StringPieceHash::operator();
+    size_t operator()(const HashedKey& k) const { return k.hash; }
+  };
+
+  struct KeyEq {
+    bool operator()(StringPiece a, StringPiece b) const { return a == b; }
+    bool operator()(StringPiece a, const HashedKey& b) const { return a == b.str; }
+  };
+
+  struct Shard {
+    mutable base::Mutex mu;
+    base::Arena arena;
+    base::FlatHashMap<StringPiece, Id, KeyHash, KeyEq> ids;
+  } CACHELINE_ALIGNED;
+
+  // Strings are indexed by id in chunks of growing sizes, chunk i holds
+  // 2^(kFirstChunkBits + i) ids. Chunks are never moved, so readers do not lock.
+  static constexpr unsigned kFirstChunkBits = 10;
+  static constexpr unsigned kMaxChunks = 32 - kFirstChunkBits + 1;
+
+  static unsigned ChunkOf(Id id) {
+    return Bits::Log2FloorNonZero((id >> kFirstChunkBits) + 1);
+  }
+
+  static Id ChunkStart(unsigned chunk) {
+    return ((1U << chunk) - 1) << kFirstChunkBits;
+  }
+
+  // Returns the slot of id, allocating its chunk if needed.
+  StringPiece* SlotForWrite(Id id);
+
+  Shard& ShardOf(uint64 hash) { return shards_[(hash >> 32) & shard_mask_]; }
+  const Shard& ShardOf(uint64 hash) const { return shards_[(hash >> 32) & shard_mask_]; }
+
+  unsigned num_shards_;
+  unsigned shard_mask_;
+  base::AlignedArray<Shard> shards_;
+
+  std::atomic<Id> next_id_;
+
+  // The strings point into shard arenas.
+  std::atomic<StringPiece*> chunks_[kMaxChunks];
+  base::Mutex chunk_mu_;
+
+  StringInterner(const StringInterner&) = delete;
+  void operator=(const StringInterner&) = delete;
+};
+
+/*
+  Read-only view of a buffer produced by StringInterner::Freeze. Does not copy the buffer,
+  which must outlive the view. Thread-safe.
+  The format uses the native byte order:
+    header: magic, version, count, index_size (uint32 each), blob_size (uint64)
+    uint64 offsets[count + 1] - string i is blob[offsets[i], offsets[i + 1])
+    uint64 index[index_size] - linear probing table of (hash >> 32 << 32 | id + 1), 0 is empty
+    char blob[blob_size]
+*/
+class FrozenStringInterner {
+public:
+  typedef StringInterner::Id Id;
+
+  static constexpr Id npos = StringInterner::npos;
+
+  FrozenStringInterner() {}
+
+  // Returns false if data is not a valid, 8 byte aligned frozen interner. Checks the whole
+  // offsets array and index, so that Find and FromId on a corrupted buffer stay within bounds.
+  bool Init(StringPiece data);
+
+  Id Find(StringPiece str) const;
+
+  StringPiece FromId(Id id) const {
+    return StringPiece(blob_ + offsets_[id], offsets_[id + 1] - offsets_[id]);
+  }
+
+  size_t size() const { return count_; }
+
+private:
+  const uint64* offsets_ = nullptr;
+  const uint64* index_ = nullptr;
+  const char* blob_ = nullptr;
+  uint32 count_ = 0;
+  uint32 index_mask_ = 0;
+};
+
+#endif  // _STRINGS_STRING_INTERNER_H
@@ -0,0 +1,184 @@
+// Copyright 2013, Beeri 15.  All rights reserved.
+// Author: Roman Gershman (romange@gmail.com)
+//
+#include "strings/string_interner.h"
+
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+#include "base/gtest.h"
+
+using std::string;
+
+class StringInternerTest : public testing::Test {
+};
+
+TEST_F(StringInternerTest, Basic) {
+  StringInterner interner(3);
+  EXPECT_EQ(StringInterner::npos, interner.Find("foo"));
+  EXPECT_EQ(0, interner.Intern("foo"));
+  EXPECT_EQ(1, interner.Intern("bar"));
+  EXPECT_EQ(0, interner.Intern(string("foo")));
+  EXPECT_EQ(2, interner.Intern(""));
+  EXPECT_EQ(2, interner.Find(""));
+  EXPECT_EQ(1, interner.Find("bar"));
+  EXPECT_EQ("foo", interner.FromId(0));
+  EXPECT_EQ("", interner.FromId(2));
+  EXPECT_EQ(3, interner.size());
+
+  for (int i = 0; i < 10000; ++i)
+    ASSERT_EQ(i + 3, interner.Intern("key" + std::to_string(i)));
+  for (int i = 0; i < 10000; ++i)
+    ASSERT_EQ("key" + std::to_string(i), interner.FromId(i + 3));
+  EXPECT_GT(interner.MemoryUsage(), 0);
+}
+
+// Threads intern overlapping sets of strings. Every string must get a single id and
+// the ids must be dense.
+TEST_F(StringInternerTest, Concurrent) {
+  const unsigned kThreads = 4;
+  const unsigned kKeys = 20000;
+  StringInterner interner;
+  std::vector<std::vector<StringInterner::Id>> ids(kThreads);
+  std::vector<std::thread> threads;
+  for (unsigned t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&, t] {
+      for (unsigned i = 0; i < kKeys; ++i) {
+        unsigned k = (i * (t + 1)) % kKeys;
+        StringInterner::Id id = interner.Intern(std::to_string(k));
+        ids[t].push_back(id);
+        CHECK_EQ(std::to_string(k), interner.FromId(id));
+      }
+    });
+  }
+  for (auto& t : threads)
+    t.join();
+
+  ASSERT_EQ(kKeys, interner.size());
+  std::vector<StringInterner::Id> key_ids(kKeys);
+  for (unsigned k = 0; k < kKeys; ++k) {
+    key_ids[k] = interner.Find(std::to_string(k));
+    ASSERT_LT(key_ids[k], kKeys);
+  }
+  for (unsigned t = 0; t < kThreads; ++t) {
+    for (unsigned i = 0; i < kKeys; ++i)
+      ASSERT_EQ(key_ids[(i * (t + 1)) % kKeys], ids[t][i]);
+  }
+}
+
+TEST_F(StringInternerTest, Freeze) {
+  StringInterner interner;
+  interner.Intern("");
+  for (int i = 0; i < 1000; ++i)
+    interner.Intern("key" + std::to_string(i));
+
+  string buf;
+  interner.Freeze(&buf);
+  FrozenStringInterner frozen;
+  ASSERT_TRUE(frozen.Init(buf));
+  ASSERT_EQ(interner.size(), frozen.size());
+  for (StringInterner::Id id = 0; id < interner.size(); ++id) {
+    ASSERT_EQ(interner.FromId(id), frozen.FromId(id));
+    ASSERT_EQ(id, frozen.Find(interner.FromId(id)));
+  }
+  EXPECT_EQ(FrozenStringInterner::npos, frozen.Find("nokey"));
+
+  // Corrupted offsets and index entries. The header is 24 bytes, index_size is its 4th word.
+  const uint32 count = interner.size();
+  const uint32 index_size = reinterpret_cast<const uint32*>(buf.data())[3];
+  auto corrupt = [&buf](size_t word, uint64 val) {
+    string res = buf;
+    reinterpret_cast<uint64*>(&res[24])[word] = val;
+    return res;
+  };
+  FrozenStringInterner bad;
+  EXPECT_FALSE(bad.Init(corrupt(5, 1 << 20)));
+  EXPECT_FALSE(bad.Init(corrupt(count + 1, (1ULL << 32) | (count + 1))));
+  string full = buf;
+  uint64* index = reinterpret_cast<uint64*>(&full[24]) + count + 1;
+  std::replace(index, index + index_size, uint64(0), uint64(1));
+  EXPECT_FALSE(bad.Init(full));
+
+  EXPECT_FALSE(bad.Init(StringPiece(buf.data(), buf.size() - 1)));
+  buf[0] = 'x';
+  EXPECT_FALSE(bad.Init(buf));
+  EXPECT_EQ(FrozenStringInterner::npos, bad.Find("key1"));
+
+  StringInterner empty;
+  buf.clear();
+  empty.Freeze(&buf);
+  ASSERT_TRUE(frozen.Init(buf));
+  EXPECT_EQ(0, frozen.size());
+  EXPECT_EQ(FrozenStringInterner::npos, frozen.Find(""));
+}
+
+// Freeze pads a non empty output to keep the frozen interner aligned.
+TEST_F(StringInternerTest, FreezeAppend) {
+  StringInterner interner;
+  interner.Intern("foo");
+  interner.Intern("bar");
+
+  string buf("abc");
+  size_t offset = interner.Freeze(&buf);
+  EXPECT_EQ(8, offset);
+  EXPECT_EQ(string("abc\0\0\0\0\0", 8), buf.substr(0, offset));
+
+  FrozenStringInterner frozen;
+  ASSERT_TRUE(frozen.Init(StringPiece(buf.data() + offset, buf.size() - offset)));
+  EXPECT_EQ(2, frozen.size());
+  EXPECT_EQ(1, frozen.Find("bar"));
+
+  // Already aligned outputs are not padded.
+  buf.resize(16);
+  EXPECT_EQ(16, interner.Freeze(&buf));
+}
+
+constexpr unsigned kBenchKeys = 1 << 16;
+
+static std::vector<string> BenchKeys() {
+  std::vector<string> keys(kBenchKeys);
+  for (unsigned i = 0; i < kBenchKeys; ++i)
+    keys[i] = "http://www.example.com/" + std::to_string(i * 7919);
+  return keys;
+}
+
+// Interning of existing strings from multiple threads.
+static void BM_Intern(benchmark::State& state) {
+  static StringInterner* interner = nullptr;
+  static std::vector<string> keys;
+  if (state.thread_index == 0) {
+    keys = BenchKeys();
+    interner = new StringInterner;
+    for (const string& k : keys)
+      interner->Intern(k);
+  }
+  unsigned i = state.thread_index * 7919;
+  while (state.KeepRunning()) {
+    base::sink_result(interner->Intern(keys[i % kBenchKeys]));
+    ++i;
+  }
+  if (state.thread_index == 0) {
+    delete interner;
+    keys.clear();
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Intern)->ThreadRange(1, 8);
+
+static void BM_FrozenFind(benchmark::State& state) {
+  std::vector<string> keys = BenchKeys();
+  StringInterner interner;
+  for (const string& k : keys)
+    interner.Intern(k);
+  string buf;
+  interner.Freeze(&buf);
+  FrozenStringInterner frozen;
+  CHECK(frozen.Init(buf));
+  unsigned i = 0;
+  while (state.KeepRunning()) {
+    base::sink_result(frozen.Find(keys[i]));
+    i = (i + 1) % kBenchKeys;
+  }
+}
+BENCHMARK(BM_FrozenFind);
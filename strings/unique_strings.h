@@ -4,22 +4,17 @@
 #ifndef UNIQUE_STRINGS_H
 #define UNIQUE_STRINGS_H
 
-#include <unordered_map>
-#include <unordered_set>
-
 #include <sparsehash/dense_hash_map>
 
 #include "base/arena.h"
-#include "base/counting_allocator.h"
+#include "base/flat_hash_map.h"
 #include "strings/stringpiece.h"
 #include "strings/hash.h"
 
 
 class UniqueStrings {
 public:
-  typedef std::unordered_set<
-      StringPiece, std::hash<StringPiece>,
-      std::equal_to<StringPiece>, base::counting_allocator<StringPiece>> SSet;
+  typedef base::FlatHashSet<StringPiece, StringPieceHash> SSet;
   typedef SSet::const_iterator const_iterator;
 
   StringPiece Get(StringPiece source) {
@@ -31,7 +26,7 @@ public:
   std::pair<StringPiece, bool> Insert(StringPiece source);
 
   size_t MemoryUsage() const {
-    return arena_.MemoryUsage() +  db_.get_allocator().bytes_allocated(); // db_.size()*sizeof(StringPiece);
+    return arena_.MemoryUsage() + db_.MemoryUsage();
   }
 
   const_iterator begin() { return db_.begin(); }
@@ -73,7 +68,7 @@ public:
 
   void clear() {
     map_.clear();
-    base::Arena().Swap(arena_);
+    arena_.Reset();
   }
 
 protected:
@@ -89,9 +84,11 @@ protected:
   }
 };
 
+// Keys are stored in the arena and the pairs in a flat open addressing table, therefore
+// insertions invalidate iterators and pointers to values.
 template<typename T> class StringPieceMap
-    : public ArenaMapBase<std::unordered_map<StringPiece, T>> {
-  typedef ArenaMapBase<std::unordered_map<StringPiece, T>> Parent;
+    : public ArenaMapBase<base::FlatHashMap<StringPiece, T, StringPieceHash>> {
+  typedef ArenaMapBase<base::FlatHashMap<StringPiece, T, StringPieceHash>> Parent;
 public:
   using typename Parent::value_type;
   using Parent::map_;
@@ -104,7 +101,7 @@ public:
     if (val.first.empty()) {
       it = map_.emplace(StringPiece(), val.second).first;
     } else {
-      it = map_.emplace(AllocateStr(val.first), val.second).first;
+      it = map_.emplace(this->AllocateStr(val.first), val.second).first;
     }
     return std::make_pair(it, true);
   }
@@ -133,7 +130,7 @@ public:
   }
 
   size_t MemoryUsage() const {
-    return this->arena_.MemoryUsage() + map_.size()*sizeof(value_type);
+    return this->arena_.MemoryUsage() + map_.MemoryUsage();
   }
 };
 
@@ -38,3 +38,30 @@ TEST_F(UniqueStringsTest, DenseMap) {
 
   EXPECT_EQ(3, unique["r3"]);
 }
+
+TEST_F(UniqueStringsTest, StringPieceMap) {
+  StringPieceMap<int> m;
+  string key("r1");
+  m[key] = 1;
+  key[1] = '2';
+  m[key] = 2;
+  EXPECT_EQ(2, m.size());
+
+  // Keys are copied into the arena.
+  auto it = m.find("r1");
+  ASSERT_TRUE(it != m.end());
+  EXPECT_EQ(1, it->second);
+  EXPECT_NE(key.data(), m.find("r2")->first.data());
+
+  EXPECT_FALSE(m.emplace("r1", 5).second);
+  EXPECT_TRUE(m.emplace("", 3).second);
+  EXPECT_EQ(3, m[""]);
+  for (int i = 0; i < 1000; ++i)
+    m[std::to_string(i)] += i;
+  EXPECT_EQ(999, m["999"]);
+  EXPECT_GT(m.MemoryUsage(), 0);
+
+  m.clear();
+  EXPECT_EQ(0, m.size());
+  EXPECT_TRUE(m.find("r1") == m.end());
+}
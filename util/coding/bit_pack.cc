@@ -2,6 +2,8 @@
 // Author: Roman Gershman (romange@gmail.com)
 //
 #include "util/coding/bit_pack.h"
+
+#include <cstring>
 #include "base/logging.h"
 
 #ifdef IS_BIG_ENDIAN
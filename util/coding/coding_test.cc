@@ -49,7 +49,8 @@ protected:
   uint32 Finalize() {
     UInt32Encoder encoder;
     encoder.Encode(values_, true);
-    encoder.Swap(&buf_);
+    buf_.resize(encoder.ByteSize());
+    encoder.buffer().CopyTo(buf_.data());
     repeated_overhead_ = encoder.repeated_overhead();
     delta_overhead_ = encoder.delta_overhead();
     direct_overhead_ = encoder.direct_overhead();
@@ -0,0 +1,243 @@
+// Copyright 2013, Beeri 15.  All rights reserved.
+// Author: Roman Gershman (romange@gmail.com)
+//
+#include "util/coding/double_coder.h"
+
+#include <cstring>
+#include "base/bits.h"
+#include "base/endian.h"
+#include "base/logging.h"
+#include "util/coding/varint.h"
+#include "util/sinksource.h"
+
+namespace util {
+namespace coding {
+using base::Status;
+
+namespace {
+
+inline Status ParseError(const char* str) {
+  return Status(base::StatusCode::IO_ERROR, str);
+}
+
+inline uint64 ToBits(double d) {
+  uint64 res;
+  memcpy(&res, &d, sizeof d);
+  return res;
+}
+
+inline double FromBits(uint64 v) {
+  double res;
+  memcpy(&res, &v, sizeof v);
+  return res;
+}
+
+class BitWriter {
+public:
+  explicit BitWriter(std::vector<uint8>* dest) : dest_(dest) {}
+
+  // n <= 32.
+  void Put(uint32 v, uint32 n) {
+    acc_ |= uint64(v) << bits_;
+    bits_ += n;
+    while (bits_ >= 8) {
+      dest_->push_back(acc_ & 0xFF);
+      acc_ >>= 8;
+      bits_ -= 8;
+    }
+  }
+
+  void Put64(uint64 v, uint32 n) {
+    if (n > 32) {
+      Put(v & 0xFFFFFFFF, 32);
+      Put(v >> 32, n - 32);
+    } else {
+      Put(v, n);
+    }
+  }
+
+  void Flush() {
+    if (bits_)
+      dest_->push_back(acc_);
+    acc_ = bits_ = 0;
+  }
+private:
+  std::vector<uint8>* dest_;
+  uint64 acc_ = 0;
+  uint32 bits_ = 0;
+};
+
+void EncodeXor(const std::vector<double>& vals, std::vector<uint8>* dest) {
+  BitWriter writer(dest);
+  uint64 prev = ToBits(vals.front());
+  writer.Put64(prev, 64);
+  uint32 lead = 64, trail = 64;  // No window yet.
+  for (size_t i = 1; i < vals.size(); ++i) {
+    uint64 cur = ToBits(vals[i]);
+    uint64 x = cur ^ prev;
+    prev = cur;
+    if (x == 0) {
+      writer.Put(0, 1);
+      continue;
+    }
+    uint32 lz = 63 - Bits::FindMSBSetNonZero64(x);
+    uint32 tz = Bits::FindLSBSetNonZero64(x);
+    if (lz > 31)
+      lz = 31;
+    if (lead + trail < 64 && lz >= lead && tz >= trail) {
+      writer.Put(1, 2);  // '10' with LSB first order.
+      writer.Put64(x >> trail, 64 - lead - trail);
+      continue;
+    }
+    uint32 sig = 64 - lz - tz;
+    writer.Put(3, 2);
+    writer.Put(lz, 5);
+    writer.Put(sig - 1, 6);
+    writer.Put64(x >> tz, sig);
+    lead = lz;
+    trail = tz;
+  }
+  writer.Flush();
+}
+
+}  // namespace
+
+void DoubleEncoder::Finalize() {
+  buf_.clear();
+  buf_.push_back(PLAIN);
+  uint8 tmp[Varint::kMax32];
+  uint8* end = Varint::Encode32(tmp, vals_.size());
+  buf_.insert(buf_.end(), tmp, end);
+  const size_t header_sz = buf_.size();
+  const size_t plain_sz = vals_.size() * sizeof(double);
+
+  encoding_ = PLAIN;
+  if (vals_.size() > 1) {
+    EncodeXor(vals_, &buf_);
+    if ((buf_.size() - header_sz) * 8 <= plain_sz * 7) {
+      encoding_ = XOR;
+      buf_[0] = XOR;
+    } else {
+      buf_.resize(header_sz);
+    }
+  }
+  if (encoding_ == PLAIN) {
+    buf_.resize(header_sz + plain_sz);
+    for (size_t i = 0; i < vals_.size(); ++i) {
+      LittleEndian::Store64(&buf_[header_sz + i * sizeof(double)], ToBits(vals_[i]));
+    }
+  }
+  VLOG(1) << "Encoded " << vals_.size() << " doubles into " << buf_.size()
+          << " bytes with encoding " << int(encoding_);
+  std::vector<double>().swap(vals_);
+}
+
+uint32 DoubleEncoder::ByteSize() const {
+  return buf_.size();
+}
+
+Status DoubleEncoder::SerializeTo(Sink* sink) const {
+  return sink->Append(strings::Slice(buf_.data(), buf_.size()));
+}
+
+Status DoubleDecoder::Init(strings::Slice slice) {
+  next_ = slice.ubuf();
+  end_ = slice.uend();
+  consumed_ = count_ = 0;
+  acc_ = acc_bits_ = 0;
+  status_ = Status::OK;
+  if (slice.empty())
+    return ParseError("Empty double column");
+  encoding_ = *next_++;
+  next_ = Varint::Parse32WithLimit(next_, end_, &count_);
+  if (next_ == nullptr)
+    return ParseError("Invalid double count");
+  switch (encoding_) {
+    case DoubleEncoder::PLAIN:
+      if (uint64(end_ - next_) < uint64(count_) * sizeof(double))
+        return ParseError("Not enough double bytes");
+    break;
+    case DoubleEncoder::XOR:
+      lead_ = trail_ = 0;
+    break;
+    default:
+      return ParseError("Unknown double encoding");
+  }
+  return Status::OK;
+}
+
+bool DoubleDecoder::ReadBits(uint32 n, uint32* res) {
+  while (acc_bits_ <= 56 && next_ < end_) {
+    acc_ |= uint64(*next_++) << acc_bits_;
+    acc_bits_ += 8;
+  }
+  if (acc_bits_ < n)
+    return false;
+  *res = acc_ & ((uint64(1) << n) - 1);
+  acc_ >>= n;
+  acc_bits_ -= n;
+  return true;
+}
+
+bool DoubleDecoder::ReadBits64(uint32 n, uint64* res) {
+  uint32 lo = 0, hi = 0;
+  if (n > 32) {
+    if (!ReadBits(32, &lo) || !ReadBits(n - 32, &hi))
+      return false;
+  } else if (!ReadBits(n, &lo)) {
+    return false;
+  }
+  *res = (uint64(hi) << 32) | lo;
+  return true;
+}
+
+uint32 DoubleDecoder::Next(double* dest, uint32 max) {
+  uint32 num = std::min(max, count_ - consumed_);
+  if (encoding_ == DoubleEncoder::PLAIN) {
+    for (uint32 i = 0; i < num; ++i) {
+      dest[i] = FromBits(LittleEndian::Load64(next_));
+      next_ += sizeof(double);
+    }
+    consumed_ += num;
+    return num;
+  }
+  if (!status_.ok())
+    return 0;
+  uint32 i = 0;
+  if (num > 0 && consumed_ == 0) {
+    if (!ReadBits64(64, &prev_))
+      return 0;
+    dest[i++] = FromBits(prev_);
+  }
+  uint32 ctrl, tmp;
+  uint64 x;
+  for (; i < num; ++i) {
+    if (!ReadBits(1, &ctrl))
+      break;
+    if (ctrl) {
+      if (!ReadBits(1, &ctrl))
+        break;
+      if (ctrl) {
+        if (!ReadBits(5, &tmp))
+          break;
+        lead_ = tmp;
+        if (!ReadBits(6, &tmp))
+          break;
+        if (lead_ + tmp + 1 > 64) {
+          status_ = ParseError("Corrupt double leading zeros or length");
+          break;
+        }
+        trail_ = 64 - lead_ - (tmp + 1);
+      }
+      if (!ReadBits64(64 - lead_ - trail_, &x))
+        break;
+      prev_ ^= (x << trail_);
+    }
+    dest[i] = FromBits(prev_);
+  }
+  consumed_ += i;
+  return i;
+}
+
+}  // namespace coding
+}  // namespace util
@@ -0,0 +1,87 @@
+// Copyright 2013, Beeri 15.  All rights reserved.
+// Author: Roman Gershman (romange@gmail.com)
+//
+#ifndef _UTIL_CODING_DOUBLE_CODER_H
+#define _UTIL_CODING_DOUBLE_CODER_H
+
+#include <vector>
+#include "base/integral_types.h"
+#include "base/status.h"
+#include "strings/stringpiece.h"
+
+namespace util {
+class Sink;
+namespace coding {
+
+/*
+  Encoder for floating point columns. Floats are widened to doubles, which is lossless.
+  HEADER:
+    1 byte  - encoding type.
+    varint  - number of values.
+  PLAIN: 8 bytes per value, little endian.
+  XOR: bit stream as described in "Gorilla: A Fast, Scalable, In-Memory Time Series Database".
+       The first value is stored as is. Each following value is XORed with the previous one:
+       '0'  - the value repeats.
+       '10' - meaningful bits of the XOR fit into the previous leading/trailing zeros window,
+              followed by the bits inside the window.
+       '11' - 5 bits of leading zeros, 6 bits of meaningful bit count - 1 and the meaningful bits.
+       Bits are written LSB first and the stream is padded to a whole byte.
+  XOR is chosen only if it is at least 1/8 smaller than PLAIN since PLAIN decodes faster.
+*/
+class DoubleEncoder {
+public:
+  enum {PLAIN = 0, XOR = 1};
+
+  void Add(double d) { vals_.push_back(d); }
+
+  // Encodes the values added so far. Add must not be called afterwards.
+  void Finalize();
+
+  // Valid after Finalize.
+  uint32 ByteSize() const;
+  uint8 encoding() const { return encoding_; }
+
+  base::Status SerializeTo(Sink* sink) const;
+private:
+  std::vector<double> vals_;
+  std::vector<uint8> buf_;
+  uint8 encoding_ = PLAIN;
+};
+
+class DoubleDecoder {
+public:
+  base::Status Init(strings::Slice slice);
+
+  uint32 size() const { return count_; }
+
+  bool Next(double* d) { return Next(d, 1) == 1; }
+
+  // Batch decode. Fills up to max values into dest and returns the number of decoded values.
+  uint32 Next(double* dest, uint32 max);
+
+  // Not ok if Next stopped because of corrupted data.
+  const base::Status& status() const { return status_; }
+private:
+  // Reads up to 32 bits.
+  bool ReadBits(uint32 n, uint32* res);
+  bool ReadBits64(uint32 n, uint64* res);
+
+  const uint8* next_ = nullptr;
+  const uint8* end_ = nullptr;
+  uint32 count_ = 0;
+  uint32 consumed_ = 0;
+  uint8 encoding_ = DoubleEncoder::PLAIN;
+
+  // XOR state.
+  uint64 acc_ = 0;
+  uint32 acc_bits_ = 0;
+  uint64 prev_ = 0;
+  uint8 lead_ = 0, trail_ = 0;
+
+  base::Status status_;
+};
+
+}  // namespace coding
+}  // namespace util
+
+#endif  // _UTIL_CODING_DOUBLE_CODER_H
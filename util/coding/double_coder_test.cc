@@ -0,0 +1,145 @@
+// Copyright 2013, Beeri 15.  All rights reserved.
+// Author: Roman Gershman (romange@gmail.com)
+//
+#include "util/coding/double_coder.h"
+
+#include <cmath>
+#include <limits>
+#include <random>
+#include "base/gtest.h"
+#include "util/sinksource.h"
+
+namespace util {
+namespace coding {
+
+class DoubleCoderTest : public testing::Test {
+protected:
+  void Encode(const std::vector<double>& vals) {
+    for (double d : vals)
+      encoder_.Add(d);
+    encoder_.Finalize();
+    ASSERT_TRUE(encoder_.SerializeTo(&ssink_).ok());
+    ASSERT_EQ(encoder_.ByteSize(), ssink_.contents().size());
+    ASSERT_TRUE(decoder_.Init(ssink_.contents()).ok());
+    ASSERT_EQ(vals.size(), decoder_.size());
+  }
+
+  // Compares bits to handle NaNs and negative zeros.
+  static bool SameBits(double a, double b) {
+    return memcmp(&a, &b, sizeof a) == 0;
+  }
+
+  DoubleEncoder encoder_;
+  DoubleDecoder decoder_;
+  util::StringSink ssink_;
+};
+
+TEST_F(DoubleCoderTest, SlowlyVarying) {
+  std::vector<double> vals;
+  double price = 12.5;
+  for (unsigned i = 0; i < 1000; ++i) {
+    if (i % 7 == 0)
+      price += 0.25;
+    vals.push_back(price);
+  }
+  Encode(vals);
+  EXPECT_EQ(DoubleEncoder::XOR, encoder_.encoding());
+  EXPECT_LT(encoder_.ByteSize(), vals.size() * 2);
+
+  double d = 0;
+  for (unsigned i = 0; i < vals.size(); ++i) {
+    ASSERT_TRUE(decoder_.Next(&d)) << i;
+    ASSERT_EQ(vals[i], d) << i;
+  }
+  EXPECT_FALSE(decoder_.Next(&d));
+}
+
+TEST_F(DoubleCoderTest, Random) {
+  std::mt19937_64 rand(10);
+  std::uniform_real_distribution<double> dist(-1e6, 1e6);
+  std::vector<double> vals;
+  for (unsigned i = 0; i < 500; ++i) {
+    vals.push_back(dist(rand));
+  }
+  Encode(vals);
+  EXPECT_EQ(DoubleEncoder::PLAIN, encoder_.encoding());
+
+  std::vector<double> actual(vals.size() + 10);
+  ASSERT_EQ(vals.size(), decoder_.Next(actual.data(), actual.size()));
+  actual.resize(vals.size());
+  EXPECT_EQ(vals, actual);
+}
+
+TEST_F(DoubleCoderTest, Special) {
+  std::vector<double> vals{0.0, -0.0, std::numeric_limits<double>::infinity(),
+                           std::numeric_limits<double>::quiet_NaN(), 1e-300, 1e300,
+                           std::numeric_limits<double>::denorm_min(), 1.0, 1.0, 1.0, 1.0, 1.0,
+                           1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0};
+  Encode(vals);
+  EXPECT_EQ(DoubleEncoder::XOR, encoder_.encoding());
+
+  // Decode in small batches.
+  std::vector<double> actual(vals.size());
+  uint32 pos = 0;
+  while (pos < vals.size()) {
+    uint32 num = decoder_.Next(actual.data() + pos, 3);
+    ASSERT_GT(num, 0);
+    pos += num;
+  }
+  for (unsigned i = 0; i < vals.size(); ++i) {
+    EXPECT_TRUE(SameBits(vals[i], actual[i])) << i;
+  }
+}
+
+TEST_F(DoubleCoderTest, Empty) {
+  Encode(std::vector<double>());
+  double d;
+  EXPECT_FALSE(decoder_.Next(&d));
+
+  EXPECT_FALSE(decoder_.Init(strings::Slice()).ok());
+}
+
+TEST_F(DoubleCoderTest, Single) {
+  Encode(std::vector<double>{M_PI});
+  double d = 0;
+  ASSERT_TRUE(decoder_.Next(&d));
+  EXPECT_EQ(M_PI, d);
+}
+
+TEST_F(DoubleCoderTest, CorruptWindow) {
+  // 2 XOR values: the first one is 1.0, the second has 31 leading zeros and 64 meaningful bits.
+  std::string buf(1, char(DoubleEncoder::XOR));
+  buf.push_back(2);
+  buf.append("\x00\x00\x00\x00\x00\x00\xf0\x3f", 8);
+  buf.append("\xff\x1f", 2);
+  buf.append(16, '\xff');
+  ASSERT_TRUE(decoder_.Init(buf).ok());
+
+  double d[2];
+  EXPECT_EQ(1, decoder_.Next(d, 2));
+  EXPECT_EQ(1.0, d[0]);
+  EXPECT_FALSE(decoder_.status().ok());
+  EXPECT_FALSE(decoder_.Next(d));
+}
+
+static void BM_DecodeXor(benchmark::State& state) {
+  DoubleEncoder encoder;
+  double price = 100;
+  for (int i = 0; i < state.range_x(); ++i) {
+    price += (i % 5 == 0) ? 0.01 : 0;
+    encoder.Add(price);
+  }
+  encoder.Finalize();
+  util::StringSink sink;
+  CHECK(encoder.SerializeTo(&sink).ok());
+  std::vector<double> dest(state.range_x());
+  DoubleDecoder decoder;
+  while (state.KeepRunning()) {
+    CHECK(decoder.Init(sink.contents()).ok());
+    CHECK_EQ(dest.size(), decoder.Next(dest.data(), dest.size()));
+  }
+}
+BENCHMARK(BM_DecodeXor)->Arg(1 << 12)->Arg(1 << 16);
+
+}  // namespace coding
+}  // namespace util
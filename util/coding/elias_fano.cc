@@ -0,0 +1,277 @@
+// Copyright 2013, Beeri 15.  All rights reserved.
+// Author: Roman Gershman (romange@gmail.com)
+//
+#include "util/coding/elias_fano.h"
+
+#include <algorithm>
+#include <cstring>
+#include "base/bits.h"
+#include "base/endian.h"
+#include "util/sinksource.h"
+
+namespace util {
+namespace coding {
+
+using base::Status;
+using std::vector;
+
+namespace {
+
+// Padded so that the words are 8 byte aligned relative to the header.
+constexpr unsigned kHeaderSize = 24;
+
+inline Status ParseError(const char* str) {
+  return Status(base::StatusCode::IO_ERROR, str);
+}
+
+inline size_t NumWords(uint64 bits) {
+  return (bits + 63) / 64;
+}
+
+// Returns the position of the i-th set bit in w. Requires i < popcount(w).
+inline unsigned SelectInWord(uint64 w, unsigned i) {
+  unsigned shift = 0;
+  for (unsigned c; i >= (c = Bits::CountOnes(w & 0xFF)); i -= c) {
+    w >>= 8;
+    shift += 8;
+  }
+  for (; i > 0; --i)
+    w &= (w - 1);
+  return shift + Bits::FindLSBSetNonZero64(w);
+}
+
+Status ReadFully(Source* source, size_t size, uint8* dest) {
+  while (size > 0) {
+    strings::Slice slice = source->Peek();
+    if (slice.empty())
+      return source->status().ok() ? ParseError("Truncated elias-fano sequence") :
+          source->status();
+    size_t count = std::min(size, slice.size());
+    memcpy(dest, slice.data(), count);
+    source->Skip(count);
+    dest += count;
+    size -= count;
+  }
+  return Status::OK;
+}
+
+// Reads in chunks so that a corrupted header does not cause a huge allocation.
+Status ReadWords(Source* source, size_t count, vector<uint64>* dest) {
+  dest->clear();
+  while (dest->size() < count) {
+    size_t start = dest->size();
+    dest->resize(start + std::min<size_t>(count - start, 1 << 16));
+    RETURN_IF_ERROR(ReadFully(source, (dest->size() - start) * sizeof(uint64),
+                              reinterpret_cast<uint8*>(dest->data() + start)));
+  }
+  for (uint64& w : *dest)
+    w = LittleEndian::Load64(&w);
+  return Status::OK;
+}
+
+void AppendWords(const vector<uint64>& words, vector<uint8>* dest) {
+  size_t start = dest->size();
+  dest->resize(start + words.size() * sizeof(uint64));
+  for (size_t i = 0; i < words.size(); ++i)
+    LittleEndian::Store64(dest->data() + start + i * sizeof(uint64), words[i]);
+}
+
+}  // namespace
+
+constexpr unsigned EliasFano::kSampleRate;
+
+void EliasFano::Build(const uint64* values, size_t count) {
+  Clear();
+  if (count == 0)
+    return;
+  uint64 universe = values[count - 1];
+  low_bits_ = universe > count ? Bits::Log2FloorNonZero64(universe / count) : 0;
+  low_mask_ = low_bits_ ? kuint64max >> (64 - low_bits_) : 0;
+  high_size_ = count + (universe >> low_bits_) + 1;
+  low_.assign(NumWords(uint64(count) * low_bits_), 0);
+  high_.assign(NumWords(high_size_), 0);
+
+  for (size_t i = 0; i < count; ++i) {
+    uint64 v = values[i];
+    DCHECK(i == 0 || v >= values[i - 1]) << i;
+    if (low_bits_) {
+      uint64 pos = uint64(i) * low_bits_;
+      uint64 low = v & low_mask_;
+      low_[pos / 64] |= low << (pos % 64);
+      if (pos % 64 + low_bits_ > 64)
+        low_[pos / 64 + 1] |= low >> (64 - pos % 64);
+    }
+    uint64 high_pos = (v >> low_bits_) + i;
+    high_[high_pos / 64] |= 1ULL << (high_pos % 64);
+  }
+  size_ = count;
+  BuildSamples();
+}
+
+void EliasFano::BuildSamples() {
+  one_samples_.clear();
+  zero_samples_.clear();
+  uint64 ones = 0, zeros = 0;
+  for (size_t i = 0; i < high_.size(); ++i) {
+    uint64 w = high_[i];
+    uint64 valid = (i + 1) * 64 <= high_size_ ? kuint64max : (1ULL << (high_size_ % 64)) - 1;
+    uint64 z = ~w & valid;
+    uint64 word_ones = Bits::CountOnes64(w);
+    uint64 word_zeros = Bits::CountOnes64(z);
+
+    // The samples are the positions of the kSampleRate * j-th ones and zeros.
+    for (uint64 next = (ones + kSampleRate - 1) / kSampleRate * kSampleRate;
+         next < ones + word_ones; next += kSampleRate) {
+      one_samples_.push_back(i * 64 + SelectInWord(w, next - ones));
+    }
+    for (uint64 next = (zeros + kSampleRate - 1) / kSampleRate * kSampleRate;
+         next < zeros + word_zeros; next += kSampleRate) {
+      zero_samples_.push_back(i * 64 + SelectInWord(z, next - zeros));
+    }
+    ones += word_ones;
+    zeros += word_zeros;
+  }
+}
+
+uint64 EliasFano::SelectOne(size_t i) const {
+  uint64 pos = one_samples_[i / kSampleRate];
+  unsigned rank = i % kSampleRate;
+  size_t index = pos / 64;
+  uint64 w = high_[index] & (kuint64max << (pos % 64));
+  while (true) {
+    unsigned count = Bits::CountOnes64(w);
+    if (rank < count)
+      return index * 64 + SelectInWord(w, rank);
+    rank -= count;
+    w = high_[++index];
+  }
+}
+
+uint64 EliasFano::SelectZero(uint64 i) const {
+  uint64 pos = zero_samples_[i / kSampleRate];
+  unsigned rank = i % kSampleRate;
+  size_t index = pos / 64;
+  uint64 w = ~high_[index] & (kuint64max << (pos % 64));
+  while (true) {
+    unsigned count = Bits::CountOnes64(w);
+    if (rank < count)
+      return index * 64 + SelectInWord(w, rank);
+    rank -= count;
+    w = ~high_[++index];
+  }
+}
+
+size_t EliasFano::NextGEQ(uint64 x, uint64* value) const {
+  if (size_ > 0) {
+    uint64 high = x >> low_bits_;
+    if (high <= (AccessEncoded(size_ - 1) >> low_bits_)) {
+      // Values with high bits >= high start after the high-th zero.
+      uint64 pos = high == 0 ? 0 : SelectZero(high - 1) + 1;
+      for (size_t i = pos - high; i < size_; ++i, ++pos) {
+        size_t index = pos / 64;
+        uint64 w = high_[index] & (kuint64max << (pos % 64));
+        while (w == 0)
+          w = high_[++index];
+        pos = index * 64 + Bits::FindLSBSetNonZero64(w);
+        uint64 v = ((pos - i) << low_bits_) | LowBits(i);
+        if (v >= x) {
+          if (value)
+            *value = v;
+          return i;
+        }
+      }
+    }
+  }
+  auto it = std::lower_bound(pending_.begin(), pending_.end(), x);
+  if (it != pending_.end() && value)
+    *value = *it;
+  return size_ + (it - pending_.begin());
+}
+
+void EliasFano::shrink_to_fit() {
+  if (pending_.empty())
+    return;
+  vector<uint64> values = ToVector();
+  Build(values.data(), values.size());
+  pending_.shrink_to_fit();
+}
+
+void EliasFano::Clear() {
+  size_ = 0;
+  low_bits_ = 0;
+  low_mask_ = 0;
+  high_size_ = 0;
+  low_.clear();
+  high_.clear();
+  one_samples_.clear();
+  zero_samples_.clear();
+  pending_.clear();
+}
+
+vector<uint64> EliasFano::ToVector() const {
+  vector<uint64> res;
+  res.reserve(size());
+  for (size_t index = 0; index < high_.size(); ++index) {
+    uint64 w = high_[index];
+    while (w) {
+      uint64 pos = index * 64 + Bits::FindLSBSetNonZero64(w);
+      size_t i = res.size();
+      res.push_back(((pos - i) << low_bits_) | LowBits(i));
+      w &= (w - 1);
+    }
+  }
+  res.insert(res.end(), pending_.begin(), pending_.end());
+  return res;
+}
+
+Status EliasFano::SerializeTo(Sink* sink) const {
+  if (!pending_.empty())
+    return Status(base::StatusCode::INVALID_ARGUMENT, "shrink_to_fit was not called");
+  vector<uint8> buf(kHeaderSize, 0);
+  LittleEndian::Store64(buf.data(), size_);
+  LittleEndian::Store64(buf.data() + 8, high_size_);
+  buf[16] = low_bits_;
+  buf.reserve(kHeaderSize + (low_.size() + high_.size()) * sizeof(uint64));
+  AppendWords(low_, &buf);
+  AppendWords(high_, &buf);
+  return sink->Append(strings::Slice(buf.data(), buf.size()));
+}
+
+Status EliasFano::Parse(Source* source) {
+  Clear();
+  alignas(uint64) uint8 header[kHeaderSize];
+  RETURN_IF_ERROR(ReadFully(source, kHeaderSize, header));
+  uint64 count = LittleEndian::Load64(header);
+  uint64 high_size = LittleEndian::Load64(header + 8);
+  unsigned low_bits = header[16];
+
+  // Every value takes at least one bit in high bitvector.
+  if (low_bits >= 64 || count > high_size || high_size > (1ULL << 40) ||
+      (count == 0) != (high_size == 0)) {
+    return ParseError("Bad elias-fano header");
+  }
+  RETURN_IF_ERROR(ReadWords(source, NumWords(count * low_bits), &low_));
+  RETURN_IF_ERROR(ReadWords(source, NumWords(high_size), &high_));
+
+  uint64 ones = 0;
+  for (uint64 w : high_)
+    ones += Bits::CountOnes64(w);
+  if (ones != count || (high_size % 64 && high_.back() >> (high_size % 64))) {
+    Clear();
+    return ParseError("Corrupted elias-fano high bits");
+  }
+  size_ = count;
+  low_bits_ = low_bits;
+  low_mask_ = low_bits_ ? kuint64max >> (64 - low_bits_) : 0;
+  high_size_ = high_size;
+  BuildSamples();
+  return Status::OK;
+}
+
+size_t EliasFano::MemoryUsage() const {
+  return (low_.capacity() + high_.capacity() + one_samples_.capacity() +
+          zero_samples_.capacity() + pending_.capacity()) * sizeof(uint64);
+}
+
+}  // namespace coding
+}  // namespace util
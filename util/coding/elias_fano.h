@@ -0,0 +1,120 @@
+// Copyright 2013, Beeri 15.  All rights reserved.
+// Author: Roman Gershman (romange@gmail.com)
+//
+#ifndef _UTIL_CODING_ELIAS_FANO_H
+#define _UTIL_CODING_ELIAS_FANO_H
+
+#include <vector>
+#include "base/integral_types.h"
+#include "base/logging.h"
+#include "base/status.h"
+
+namespace util {
+class Sink;
+class Source;
+namespace coding {
+
+/*
+  Elias-Fano encoding of a non-decreasing sequence of n uint64 values with maximum u.
+  Every value is split into l = floor(log2(u / n)) low bits, which are stored verbatim, and
+  the high bits, which are stored in unary as a bitvector of n + (u >> l) + 1 bits: value i
+  sets bit (v[i] >> l) + i. The sequence takes at most n * (2 + log2(u / n)) bits.
+  Positions of every kSampleRate-th one and zero in the high bitvector are sampled, so that
+  Access(i) and NextGEQ(x) are a sample lookup followed by a short scan of the bitvector.
+
+  The class also has the interface of an append-only vector so it can replace
+  std::vector<uint32> offsets, e.g. in base::FlatArraysVec. Appended values are kept
+  uncompressed until shrink_to_fit().
+
+  Serialized format, all the integers are little endian:
+    8 bytes - n.
+    8 bytes - number of bits in the high bitvector.
+    1 byte  - l, followed by 7 zero bytes.
+    The words of the low bits followed by the words of the high bitvector, 8 bytes each.
+*/
+class EliasFano {
+public:
+  EliasFano() {}
+
+  // values must be non-decreasing.
+  explicit EliasFano(const std::vector<uint64>& values) { Build(values.data(), values.size()); }
+
+  void Build(const uint64* values, size_t count);
+
+  // Returns the i-th value. Requires i < size().
+  uint64 Access(size_t i) const {
+    return i < size_ ? AccessEncoded(i) : pending_[i - size_];
+  }
+
+  uint64 operator[](size_t i) const { return Access(i); }
+
+  // Returns the index of the first value that is greater or equal to x or size() if there is
+  // no such value. Fills value, if not null, with that value.
+  size_t NextGEQ(uint64 x, uint64* value = nullptr) const;
+
+  void push_back(uint64 v) {
+    DCHECK(empty() || v >= back());
+    pending_.push_back(v);
+  }
+
+  // Compresses the values that were added with push_back.
+  void shrink_to_fit();
+
+  size_t size() const { return size_ + pending_.size(); }
+  bool empty() const { return size() == 0; }
+  uint64 back() const { return Access(size() - 1); }
+
+  void Clear();
+
+  std::vector<uint64> ToVector() const;
+
+  // Requires that all the values are compressed, i.e. shrink_to_fit() was called after
+  // the last push_back.
+  base::Status SerializeTo(Sink* sink) const;
+
+  base::Status Parse(Source* source);
+
+  size_t MemoryUsage() const;
+
+private:
+  static constexpr unsigned kSampleRate = 256;
+
+  uint64 AccessEncoded(size_t i) const {
+    return ((SelectOne(i) - i) << low_bits_) | LowBits(i);
+  }
+
+  uint64 LowBits(size_t i) const {
+    if (low_bits_ == 0)
+      return 0;
+    uint64 pos = uint64(i) * low_bits_;
+    uint64 res = low_[pos / 64] >> (pos % 64);
+    if (pos % 64 + low_bits_ > 64)
+      res |= low_[pos / 64 + 1] << (64 - pos % 64);
+    return res & low_mask_;
+  }
+
+  // Returns the position of the i-th one (zero) in high_.
+  uint64 SelectOne(size_t i) const;
+  uint64 SelectZero(uint64 i) const;
+
+  void BuildSamples();
+
+  size_t size_ = 0;
+  unsigned low_bits_ = 0;
+  uint64 low_mask_ = 0;
+  uint64 high_size_ = 0;  // in bits.
+
+  std::vector<uint64> low_;
+  std::vector<uint64> high_;
+
+  // Positions of every kSampleRate-th one (zero) in high_.
+  std::vector<uint64> one_samples_;
+  std::vector<uint64> zero_samples_;
+
+  std::vector<uint64> pending_;
+};
+
+}  // namespace coding
+}  // namespace util
+
+#endif  // _UTIL_CODING_ELIAS_FANO_H
@@ -0,0 +1,186 @@
+// Copyright 2013, Beeri 15.  All rights reserved.
+// Author: Roman Gershman (romange@gmail.com)
+//
+#include "util/coding/elias_fano.h"
+
+#include <algorithm>
+#include <random>
+#include "base/flat_arrays_vector.h"
+#include "base/gtest.h"
+#include "util/sinksource.h"
+
+namespace util {
+namespace coding {
+
+using std::vector;
+
+// Sorted values with gaps up to max_gap, including runs of duplicates.
+static vector<uint64> RandomValues(unsigned count, uint64 max_gap, unsigned seed) {
+  std::mt19937_64 rand(seed);
+  vector<uint64> res(count);
+  uint64 v = rand() % 100;
+  for (unsigned i = 0; i < count; ++i) {
+    if (rand() % 10)
+      v += rand() % max_gap;
+    res[i] = v;
+  }
+  return res;
+}
+
+class EliasFanoTest : public testing::Test {
+protected:
+  static void CheckNextGEQ(const vector<uint64>& values, const EliasFano& ef, uint64 x) {
+    auto it = std::lower_bound(values.begin(), values.end(), x);
+    uint64 value = kuint64max;
+    ASSERT_EQ(it - values.begin(), ef.NextGEQ(x, &value)) << x;
+    if (it != values.end()) {
+      ASSERT_EQ(*it, value) << x;
+    }
+  }
+};
+
+TEST_F(EliasFanoTest, Access) {
+  for (uint64 max_gap : {1ULL, 2ULL, 100ULL, 1ULL << 20, 1ULL << 40}) {
+    vector<uint64> values = RandomValues(5000, max_gap, max_gap);
+    EliasFano ef(values);
+    ASSERT_EQ(values.size(), ef.size());
+    for (size_t i = 0; i < values.size(); ++i)
+      ASSERT_EQ(values[i], ef.Access(i)) << i << " " << max_gap;
+    EXPECT_EQ(values, ef.ToVector());
+  }
+
+  EliasFano ef;
+  EXPECT_TRUE(ef.empty());
+  EXPECT_EQ(0, ef.NextGEQ(0));
+  EXPECT_TRUE(ef.ToVector().empty());
+
+  vector<uint64> single{0};
+  ef.Build(single.data(), 1);
+  EXPECT_EQ(0, ef[0]);
+  EXPECT_EQ(0, ef.NextGEQ(0));
+  EXPECT_EQ(1, ef.NextGEQ(1));
+
+  vector<uint64> large{1, kuint64max - 5, kuint64max};
+  ef.Build(large.data(), large.size());
+  EXPECT_EQ(large, ef.ToVector());
+  EXPECT_EQ(kuint64max - 5, ef[1]);
+  EXPECT_EQ(2, ef.NextGEQ(kuint64max - 1));
+}
+
+TEST_F(EliasFanoTest, NextGEQ) {
+  for (uint64 max_gap : {1ULL, 3ULL, 1000ULL}) {
+    vector<uint64> values = RandomValues(3000, max_gap, 7);
+    EliasFano ef(values);
+    for (uint64 x = 0; x <= values.back() + 1; x += std::max<uint64>(1, max_gap / 7))
+      CheckNextGEQ(values, ef, x);
+    for (uint64 v : values) {
+      CheckNextGEQ(values, ef, v);
+      CheckNextGEQ(values, ef, v + 1);
+    }
+  }
+}
+
+TEST_F(EliasFanoTest, PushBack) {
+  vector<uint64> values = RandomValues(2000, 50, 3);
+  EliasFano ef;
+  for (unsigned i = 0; i < 1000; ++i)
+    ef.push_back(values[i]);
+  ef.shrink_to_fit();
+  for (unsigned i = 1000; i < values.size(); ++i)
+    ef.push_back(values[i]);
+
+  // Half compressed, half pending.
+  ASSERT_EQ(values.size(), ef.size());
+  EXPECT_EQ(values.back(), ef.back());
+  for (size_t i = 0; i < values.size(); ++i)
+    ASSERT_EQ(values[i], ef[i]);
+  for (uint64 x = 0; x < values.back() + 2; x += 11)
+    CheckNextGEQ(values, ef, x);
+
+  size_t pending_usage = ef.MemoryUsage();
+  ef.shrink_to_fit();
+  EXPECT_LT(ef.MemoryUsage(), pending_usage);
+  EXPECT_EQ(values, ef.ToVector());
+}
+
+TEST_F(EliasFanoTest, Serialize) {
+  vector<uint64> values = RandomValues(10000, 1000, 5);
+  EliasFano ef(values);
+  StringSink sink;
+  ASSERT_TRUE(ef.SerializeTo(&sink).ok());
+  LOG(INFO) << "Serialized " << values.size() << " values into " << sink.contents().size()
+            << " bytes";
+  EXPECT_LT(sink.contents().size(), values.size() * 2);
+
+  // Read in small blocks to check reads that cross block boundaries.
+  StringSource source(sink.contents(), 5);
+  EliasFano parsed;
+  ASSERT_TRUE(parsed.Parse(&source).ok());
+  EXPECT_EQ(0, source.Available());
+  EXPECT_EQ(values, parsed.ToVector());
+  CheckNextGEQ(values, parsed, values[5000]);
+
+  std::string truncated_buf = sink.contents().substr(0, sink.contents().size() - 1);
+  StringSource truncated(truncated_buf);
+  EXPECT_FALSE(parsed.Parse(&truncated).ok());
+  EXPECT_TRUE(parsed.empty());
+
+  std::string corrupted = sink.contents();
+  corrupted[0] ^= 1;
+  StringSource corrupted_source(corrupted);
+  EXPECT_FALSE(parsed.Parse(&corrupted_source).ok());
+
+  EliasFano empty;
+  StringSink empty_sink;
+  ASSERT_TRUE(empty.SerializeTo(&empty_sink).ok());
+  StringSource empty_source(empty_sink.contents());
+  ASSERT_TRUE(parsed.Parse(&empty_source).ok());
+  EXPECT_TRUE(parsed.empty());
+
+  empty.push_back(5);
+  EXPECT_FALSE(empty.SerializeTo(&empty_sink).ok());
+}
+
+TEST_F(EliasFanoTest, FlatArraysVec) {
+  base::FlatArraysVec<int> plain;
+  base::FlatArraysVec<int, EliasFano> compressed;
+  std::mt19937 rand(10);
+  for (unsigned i = 0; i < 1000; ++i) {
+    vector<int> items(rand() % 10, i);
+    plain.Add(items);
+    compressed.Add(items);
+  }
+  compressed.Finalize();
+  ASSERT_EQ(plain.size(), compressed.size());
+  for (unsigned i = 0; i < plain.size(); ++i) {
+    auto expected = plain.range(i);
+    auto actual = compressed.range(i);
+    ASSERT_EQ(vector<int>(expected.begin(), expected.end()),
+              vector<int>(actual.begin(), actual.end()));
+  }
+}
+
+static void BM_Access(benchmark::State& state) {
+  vector<uint64> values = RandomValues(1 << 20, 100, 1);
+  EliasFano ef(values);
+  size_t i = 0;
+  while (state.KeepRunning()) {
+    base::sink_result(ef.Access(i));
+    i = (i + 7919) % values.size();
+  }
+}
+BENCHMARK(BM_Access);
+
+static void BM_NextGEQ(benchmark::State& state) {
+  vector<uint64> values = RandomValues(1 << 20, 100, 1);
+  EliasFano ef(values);
+  uint64 x = 0;
+  while (state.KeepRunning()) {
+    base::sink_result(ef.NextGEQ(x));
+    x = (x + 7919 * 13) % values.back();
+  }
+}
+BENCHMARK(BM_NextGEQ);
+
+}  // namespace coding
+}  // namespace util
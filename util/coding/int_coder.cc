@@ -178,13 +178,12 @@ void UInt32Encoder::EncodeDirect(const uint32* start, const uint32* end, const u
   uint32 size = end - start;
   if (size == 0) return;
   uint8* dest = nullptr;
-  uint32 prev_size = buffer_.size();
+  uint8* begin = nullptr;
   if (size < 128) {
     uint8 header = format::DIRECT_256 | ((bit_width - 1) << kHeaderTypeBits);
     uint32 bytes_count = PackedByteCount(size, bit_width) + BIT_PACK_MARGIN;
     // 1 header byte + 1 byte size.
-    buffer_.resize(prev_size + 1 + 1 + bytes_count);
-    dest = &buffer_.front() + prev_size;
+    begin = dest = Reserve(1 + 1 + bytes_count);
     *dest++ = header;
     *dest++ = size - 1;
     dest = BitPack(start, size, bit_width, dest);
@@ -193,18 +192,17 @@ void UInt32Encoder::EncodeDirect(const uint32* start, const uint32* end, const u
     FastPFor pfor;
     size_t ints_written = pfor.maxCompressedLength(size);
     uint32 bytes_count = ints_written * sizeof(uint32);
-    buffer_.resize(prev_size + 1 + 4 + bytes_count);
-    dest = &buffer_.front() + prev_size;
+    begin = dest = Reserve(1 + 4 + bytes_count);
     *dest++ = format::DIRECT_PFOR;
     pfor.encodeArray(start, size, reinterpret_cast<uint32_t*>(dest + 4), ints_written);
+    CHECK_LE(ints_written * sizeof(uint32), bytes_count);
     LittleEndian::Store32(dest, ints_written * sizeof(uint32));
     dest += ints_written*sizeof(uint32_t) + 4;
-    CHECK_LE(dest - buffer_.data(), buffer_.size());
     direct_overhead_ += 5;
   }
-  buffer_.resize(dest - buffer_.data());
+  Commit(begin, dest);
   VLOG(1) << "FlushDirect: sz " << size << " bit_width: " << int(bit_width) << " bytesize: "
-          << buffer_.size() - prev_size << ", total: " << buffer_.size();
+          << dest - begin << ", total: " << buffer_.size();
 }
 
 void UInt32Encoder::AddRepeatChunk(T val, uint32 count) {
@@ -212,10 +210,8 @@ void UInt32Encoder::AddRepeatChunk(T val, uint32 count) {
   DCHECK_GE(count, format::kMinRepeatCnt);
 
   uint32 written_count = count - format::kMinRepeatCnt;
-  size_t sz = buffer_.size();
-  size_t max_sz = sz + Varint::MaxSize<T>() + 4;  // TYPE DEPENDENT.
-  buffer_.resize(max_sz);
-  uint8* dest = &buffer_.front() + sz;
+  uint8* const begin = Reserve(Varint::MaxSize<T>() + 4);  // TYPE DEPENDENT.
+  uint8* dest = begin;
   if (written_count >= kExtRepCnt) {
     written_count -= kExtRepCnt;
     uint8 bytes = Bits::Bsr(written_count) / 8;
@@ -233,8 +229,8 @@ void UInt32Encoder::AddRepeatChunk(T val, uint32 count) {
   }
   dest = Varint::Encode(dest, val);
   VLOG(1) << "AddRepeatChunk: val " << val << ", count: " << count << " bytesize: "
-          << dest - buffer_.data() - sz;
-  buffer_.resize(dest - buffer_.data());
+          << dest - begin;
+  Commit(begin, dest);
 }
 
 void UInt32Encoder::EncodeDelta(const uint32* start, const uint32 delta_cnt,
@@ -247,8 +243,8 @@ void UInt32Encoder::EncodeDelta(const uint32* start, const uint32 delta_cnt,
   uint8 bc = Bits::Bsr(base) / 8;
 
   size_t sz = buffer_.size();
-  buffer_.resize(sz + bc + 1 + 1);  // bc is really byte count of base - 1.
-  uint8* dest = &buffer_.front() + sz;
+  uint8* const begin = Reserve(bc + 1 + 1);  // bc is really byte count of base - 1.
+  uint8* dest = begin;
   *dest++ = format::DELTA_ENC | (bc << kHeaderTypeBits);
 
   // Store base.
@@ -256,6 +252,7 @@ void UInt32Encoder::EncodeDelta(const uint32* start, const uint32 delta_cnt,
     // VLOG(3) << "baseb: " << (base & 0xFF);
     *dest++ = (base >> i*8) & 0xFF;
   }
+  Commit(begin, dest);
   repeated_overhead_+= (bc + 2);
   if (result.is_repeated) {
     AddRepeatChunk(result.rep_delta, delta_cnt);
@@ -293,10 +290,8 @@ base::Status UInt64Encoder::SerializeTo(Sink* sink) const {
   uint8 buf[4];
   LittleEndian::Store32(buf, lo_.ByteSize());
   RETURN_IF_ERROR(sink->Append(strings::Slice(buf, 4)));
-  RETURN_IF_ERROR(sink->Append(lo_.slice()));
-  RETURN_IF_ERROR(sink->Append(hi_.slice()));
-
-  return Status::OK;
+  RETURN_IF_ERROR(lo_.SerializeTo(sink));
+  return hi_.SerializeTo(sink);
 }
 
 bool UInt32Decoder::Next(T* t) {
@@ -428,7 +423,7 @@ inline bool fill_bit(uint32 v) { return ((v >> 30) & 1) == 1; }
 BitArray::BitArray(uint32 sz, strings::Slice slice) : size_(sz) {
   CHECK_EQ(0, slice.size() % sizeof(uint32));
   data_.resize(slice.size() / sizeof(uint32));
-  const uint32* src = reinterpret_cast<const uint32*>(slice.begin());
+  const uint32* src = reinterpret_cast<const uint32*>(slice.data());
   std::copy(src, src + data_.size(), &data_.front());
 }
 
@@ -7,10 +7,10 @@
 #include <vector>
 #include "base/integral_types.h"
 #include "base/status.h"
-#include "strings/slice.h"
+#include "strings/stringpiece.h"
+#include "util/sinksource.h"
 
 namespace util {
-class Sink;
 namespace coding {
 
 // see https://issues.apache.org/jira/browse/HIVE-4123 for inspiration.
@@ -66,16 +66,18 @@ public:
   size_t Encode(const uint32* src, size_t length, bool encode_everything);
 
   void Reset() {
-    buffer_.clear();
+    buffer_.Clear();
     values_.clear();
     direct_overhead_ = repeated_overhead_ = delta_overhead_ = 0;
   }
 
-  void Swap(std::vector<uint8>* dest) { buffer_.swap(*dest); }
-
   size_t ByteSize() const { return buffer_.size(); }
-  const std::vector<uint8>& buffer() const { return buffer_; }
-  strings::Slice slice() const { return strings::Slice(buffer_.data(), buffer_.size()); }
+
+  // Encoded chunks are written directly into the blocks of buffer_, so the encoded data
+  // is never reallocated or copied until it is serialized.
+  const ChainSink& buffer() const { return buffer_; }
+  base::Status SerializeTo(Sink* sink) const { return buffer_.WriteTo(sink); }
+
   uint32 header_overhead() const {
     return direct_overhead_ + repeated_overhead_ + delta_overhead_;
   }
@@ -107,7 +109,16 @@ private:
 
   void EncodeDelta(const uint32* start, const uint32 delta_cnt, const DeltaResult& result);
 
-  std::vector<uint8> buffer_;
+  // Returns buffer_ memory for writing at least max_size bytes. Written bytes must be committed
+  // with Commit.
+  uint8* Reserve(size_t max_size) {
+    return buffer_.GetAppendBuffer(max_size, Sink::WritableBuffer()).ptr;
+  }
+  void Commit(const uint8* start, const uint8* end) {
+    buffer_.Append(strings::Slice(start, end - start));
+  }
+
+  ChainSink buffer_;
   std::vector<T> values_;
   uint32 repeated_overhead_ = 0;
   uint32 delta_overhead_ = 0;
@@ -185,7 +196,7 @@ private:
 class UInt64Decoder {
 public:
   UInt64Decoder(const uint8* buffer, uint32 size);
-  UInt64Decoder(strings::Slice slice) : UInt64Decoder(slice.data(), slice.size()) {}
+  UInt64Decoder(strings::Slice slice) : UInt64Decoder(slice.ubuf(), slice.size()) {}
 
   bool Next(uint64* t);
   typedef uint64 value_type;
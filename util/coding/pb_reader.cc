@@ -49,11 +49,34 @@ template<typename Coder, typename T> inline Status FillRepeatedField(
   return Status::OK;
 }
 
+base::StatusObject<BitArray*> ParseBitArray(const uint8* start, const uint8* end) {
+  uint32 bit_count = 0;
+  const uint8* next = Varint::Parse32WithLimit(start, end, &bit_count);
+  if (next == nullptr) {
+    return RangeError("r2");
+  }
+  strings::Slice bit_slice(next, end - next);
+  if (bit_slice.size() % sizeof(uint32) != 0) {
+    return Status(base::StatusCode::INTERNAL_ERROR, "Invalid bit array size");
+  }
+  return new BitArray(bit_count, bit_slice);
+}
+
 }  // namespace
 
-PbFieldReader::PbFieldReader(const gpb::FieldDescriptor* fd) : fd_(fd) {
+void ColumnArray::Clear() {
+  counts.clear();
+  ints.clear();
+  uints.clear();
+  doubles.clear();
+  strs.clear();
+}
+
+PbFieldReader::PbFieldReader(const gpb::FieldDescriptor* fd, PbFieldReader* parent)
+    : fd_(fd), parent_(parent) {
+  path_ = parent ? StrCat(parent->path(), ".", fd->name()) : fd->name();
   if (fd_->cpp_type() == PBFD::CPPTYPE_MESSAGE) {
-    submsg_reader_.reset(new PbFieldReaderArray(fd_->message_type()));
+    submsg_reader_.reset(new PbFieldReaderArray(fd_->message_type(), this));
   }
   u1_.has_bit = nullptr;
   u2_.val_uint32 = nullptr;
@@ -68,14 +91,23 @@ PbFieldReader::~PbFieldReader() {
   switch (fd_->cpp_type()) {
     case PBFD::CPPTYPE_INT32:
     case PBFD::CPPTYPE_UINT32:
+    case PBFD::CPPTYPE_ENUM:
       delete u2_.val_uint32;
     break;
     case PBFD::CPPTYPE_INT64:
     case PBFD::CPPTYPE_UINT64:
       delete u2_.val_uint64;
     break;
+    case PBFD::CPPTYPE_DOUBLE:
+    case PBFD::CPPTYPE_FLOAT:
+      delete u2_.double_decoder;
+    break;
     case PBFD::CPPTYPE_STRING:
       delete u2_.str_decoder;
+    break;
+    case PBFD::CPPTYPE_BOOL:
+      delete u2_.val_bool;
+    break;
     default:
     break;
   }
@@ -110,10 +142,28 @@ Status PbFieldReader::Init(const uint8* ptr, uint32 size) {
     case PBFD::CPPTYPE_ENUM:
       ResetPtr(u2_.val_uint32, new UInt32Decoder(ptr, data_sz2));
     break;
+    case PBFD::CPPTYPE_DOUBLE:
+    case PBFD::CPPTYPE_FLOAT:
+      ResetPtr(u2_.double_decoder, new DoubleDecoder());
+      RETURN_IF_ERROR(u2_.double_decoder->Init(Slice(ptr, data_sz2)));
+    break;
     case PBFD::CPPTYPE_UINT64:
     case PBFD::CPPTYPE_INT64:
+      if (data_sz2 < 4)
+        return RangeError("uint64 column");
       ResetPtr(u2_.val_uint64, new UInt64Decoder(ptr, data_sz2));
     break;
+    case PBFD::CPPTYPE_BOOL: {
+      uint32 bits_sz = 0;
+      const uint8* next = Varint::Parse32WithLimit(ptr, end, &bits_sz);
+      if (next == nullptr || next + bits_sz > end)
+        return RangeError("bool column");
+      auto res = ParseBitArray(next, next + bits_sz);
+      if (!res.ok()) return res.status;
+      ResetPtr(u2_.val_bool, res.obj);
+      bool_iter_ = u2_.val_bool->begin();
+    }
+    break;
     default:
       LOG(FATAL) << "Not implemented " << fd_->cpp_type_name();
   }
@@ -141,6 +191,28 @@ Status PbFieldReader::Read(gpb::Message* msg) {
       case PBFD::CPPTYPE_UINT64:
         st = FillRepeatedField<UInt64Decoder, uint64>(refl, fd_, vals_count, u2_.val_uint64, msg);
       break;
+      case PBFD::CPPTYPE_DOUBLE: {
+        auto* dest = refl->MutableRepeatedField<double>(msg, fd_);
+        dest->Resize(vals_count, 0);
+        if (u2_.double_decoder->Next(dest->mutable_data(), vals_count) != vals_count) {
+          RETURN_IF_ERROR(u2_.double_decoder->status());
+          return RangeError("Not enough repeated double");
+        }
+      }
+      break;
+      case PBFD::CPPTYPE_FLOAT: {
+        std::unique_ptr<double[]> tmp(new double[vals_count]);
+        if (u2_.double_decoder->Next(tmp.get(), vals_count) != vals_count) {
+          RETURN_IF_ERROR(u2_.double_decoder->status());
+          return RangeError("Not enough repeated float");
+        }
+        auto* dest = refl->MutableRepeatedField<float>(msg, fd_);
+        dest->Clear();
+        dest->Reserve(vals_count);
+        for (uint32 i = 0; i < vals_count; ++i)
+          dest->Add(tmp[i]);
+      }
+      break;
       case PBFD::CPPTYPE_MESSAGE:{
         auto* arr = refl->MutableRepeatedPtrField<gpb::Message>(msg, fd_);
         arr->Clear();
@@ -158,14 +230,15 @@ Status PbFieldReader::Read(gpb::Message* msg) {
     return st;
   }  // repeated
   if (fd_->is_optional()) {
-    if (has_iter_.Done()) {
+    if (optional_index_ >= optional_count_) {
       return RangeError("r6");
     }
 
-    bool has = *has_iter_;
-    ++has_iter_;
+    bool has = !has_iter_.Done() && *has_iter_ == optional_index_;
+    ++optional_index_;
     if (!has)
       return Status::OK;
+    ++has_iter_;
   }
 
 #define HANDLE_VAL(T, dec, func) {           \
@@ -194,6 +267,33 @@ Status PbFieldReader::Read(gpb::Message* msg) {
     case PBFD::CPPTYPE_INT64:
         HANDLE_VAL(int64, u2_.val_uint64, SetInt64);
     break;
+    case PBFD::CPPTYPE_ENUM: {
+      uint32 val = 0;
+      if (!u2_.val_uint32->Next(&val)) return RangeError("enum finito");
+      const gpb::EnumValueDescriptor* ev =
+          fd_->enum_type()->FindValueByNumber(DecodeZigZag<int32>(val));
+      if (ev == nullptr) return RangeError("enum value");
+      refl->SetEnum(msg, fd_, ev);
+    }
+    break;
+    case PBFD::CPPTYPE_DOUBLE:
+    case PBFD::CPPTYPE_FLOAT: {
+      double val = 0;
+      if (!u2_.double_decoder->Next(&val)) {
+        RETURN_IF_ERROR(u2_.double_decoder->status());
+        return RangeError("double finito");
+      }
+      if (fd_->cpp_type() == PBFD::CPPTYPE_DOUBLE)
+        refl->SetDouble(msg, fd_, val);
+      else
+        refl->SetFloat(msg, fd_, val);
+    }
+    break;
+    case PBFD::CPPTYPE_BOOL:
+      if (bool_iter_.Done()) return RangeError("bool finito");
+      refl->SetBool(msg, fd_, *bool_iter_);
+      ++bool_iter_;
+    break;
     case PBFD::CPPTYPE_MESSAGE: {
       Status st = submsg_reader_->Read(refl->MutableMessage(msg, fd_));
       if (!st.ok()) return st;
@@ -205,6 +305,70 @@ Status PbFieldReader::Read(gpb::Message* msg) {
   return Status::OK;
 }
 
+Status PbFieldReader::ReadColumn(ColumnArray* dest) {
+  dest->Clear();
+  dest->field = fd_;
+  if (fd_->is_repeated()) {
+    uint32 sz = 0;
+    while (u1_.arr_sizes->Next(&sz)) {
+      dest->counts.push_back(sz);
+    }
+  } else if (fd_->is_optional()) {
+    for (; optional_index_ < optional_count_; ++optional_index_) {
+      bool has = !has_iter_.Done() && *has_iter_ == optional_index_;
+      dest->counts.push_back(has);
+      if (has)
+        ++has_iter_;
+    }
+  }
+  uint32 val32 = 0;
+  uint64 val64 = 0;
+  switch (fd_->cpp_type()) {
+    case PBFD::CPPTYPE_INT32:
+    case PBFD::CPPTYPE_ENUM:
+      while (u2_.val_uint32->Next(&val32))
+        dest->ints.push_back(DecodeZigZag<int32>(val32));
+    break;
+    case PBFD::CPPTYPE_UINT32:
+      while (u2_.val_uint32->Next(&val32))
+        dest->uints.push_back(val32);
+    break;
+    case PBFD::CPPTYPE_INT64:
+      while (u2_.val_uint64->Next(&val64))
+        dest->ints.push_back(DecodeZigZag<int64>(val64));
+    break;
+    case PBFD::CPPTYPE_UINT64:
+      while (u2_.val_uint64->Next(&val64))
+        dest->uints.push_back(val64);
+    break;
+    case PBFD::CPPTYPE_DOUBLE:
+    case PBFD::CPPTYPE_FLOAT: {
+      DoubleDecoder* dec = u2_.double_decoder;
+      size_t offset = dest->doubles.size();
+      dest->doubles.resize(offset + dec->size());
+      uint32 num = dec->Next(dest->doubles.data() + offset, dec->size());
+      dest->doubles.resize(offset + num);
+      RETURN_IF_ERROR(dec->status());
+    }
+    break;
+    case PBFD::CPPTYPE_BOOL:
+      for (; !bool_iter_.Done(); ++bool_iter_)
+        dest->uints.push_back(*bool_iter_);
+    break;
+    case PBFD::CPPTYPE_STRING: {
+      Slice sl;
+      while (u2_.str_decoder->Next(&sl))
+        dest->strs.push_back(sl);
+    }
+    break;
+    case PBFD::CPPTYPE_MESSAGE:
+    break;
+    default:
+      LOG(FATAL) << "Not implemented" << fd_->cpp_type_name();
+  }
+  return Status::OK;
+}
+
 base::StatusObject<const uint8*> PbFieldReader::InitMeta(
       const uint8* start, const uint8* end) {
   uint32 data_sz = 0;
@@ -217,25 +381,23 @@ base::StatusObject<const uint8*> PbFieldReader::InitMeta(
     ResetPtr(u1_.arr_sizes, new UInt32Decoder(next, data_sz));
     return start;
   }
-  uint32 bit_count = 0;
-  next = Varint::Parse32WithLimit(next, start, &bit_count);
+  next = Varint::Parse32WithLimit(next, start, &optional_count_);
   if (next == nullptr) {
     return RangeError("r2");
   }
-  strings::Slice bit_slice(next, start - next);
-  if (bit_slice.size() % sizeof(uint32) != 0) {
-    return Status(base::StatusCode::INTERNAL_ERROR, "Invalid bit array size");
-  }
-  ResetPtr(u1_.has_bit, new BitArray(bit_count, bit_slice));
+  ResetPtr(u1_.has_bit, new RoaringBitmap);
+  RETURN_IF_ERROR(u1_.has_bit->Parse(Slice(next, start - next)));
   has_iter_ = u1_.has_bit->begin();
+  optional_index_ = 0;
   return start;
 }
 
-PbFieldReaderArray::PbFieldReaderArray(const gpb::Descriptor* descr) {
+PbFieldReaderArray::PbFieldReaderArray(const gpb::Descriptor* descr,
+                                       PbFieldReader* parent) {
   fields_.resize(descr->field_count());
   for (int i = 0; i < descr->field_count(); ++i) {
     const gpb::FieldDescriptor* fd = descr->field(i);
-    fields_[i] = new PbFieldReader(fd);
+    fields_[i] = new PbFieldReader(fd, parent);
   }
 }
 
@@ -246,6 +408,8 @@ PbFieldReaderArray::~PbFieldReaderArray() {
 
 Status PbFieldReaderArray::Read(gpb::Message* msg) {
   for (PbFieldReader* field : fields_) {
+    if (!field->selected())
+      continue;
     RETURN_IF_ERROR(field->Read(msg));
   }
   return Status::OK;
@@ -259,11 +423,49 @@ PbBlockDeserializer::~PbBlockDeserializer() {
 
 }
 
+PbFieldReader* PbBlockDeserializer::FindReader(StringPiece path) const {
+  for (PbFieldReader* r : readers_) {
+    if (r->path() == path)
+      return r;
+  }
+  return nullptr;
+}
+
+Status PbBlockDeserializer::Project(const std::vector<std::string>& paths) {
+  std::vector<PbFieldReader*> projected;
+  for (const std::string& p : paths) {
+    PbFieldReader* r = FindReader(p);
+    if (r == nullptr) {
+      return Status(base::StatusCode::INVALID_ARGUMENT, StrCat("Unknown field ", p));
+    }
+    projected.push_back(r);
+  }
+  bool select_all = paths.empty();
+  for (PbFieldReader* r : readers_) {
+    r->set_selected(select_all);
+  }
+  for (PbFieldReader* r : projected) {
+    r->VisitPreOrder([](PbFieldReader* child) { child->set_selected(true); });
+    for (PbFieldReader* p = r->parent(); p; p = p->parent()) {
+      p->set_selected(true);
+    }
+  }
+  return Status::OK;
+}
+
+Status PbBlockDeserializer::ReadColumn(StringPiece path, ColumnArray* dest) {
+  PbFieldReader* r = FindReader(path);
+  if (r == nullptr || !r->selected()) {
+    return Status(base::StatusCode::INVALID_ARGUMENT, StrCat("Column is not selected ", path));
+  }
+  return r->ReadColumn(dest);
+}
+
 Status PbBlockDeserializer::Init(strings::Slice block, uint32* num_msgs) {
   DCHECK(!block.empty());
   uint32 field_sizes_arr_sz = 0;
-  const uint8* next = Varint::Parse32(block.begin(), &field_sizes_arr_sz);
-  if (next + field_sizes_arr_sz > block.end())
+  const uint8* next = Varint::Parse32(block.ubuf(), &field_sizes_arr_sz);
+  if (next + field_sizes_arr_sz > block.uend())
     return RangeError("block size");
 
   UInt32Decoder decoder(next, field_sizes_arr_sz);
@@ -276,7 +478,13 @@ Status PbBlockDeserializer::Init(strings::Slice block, uint32* num_msgs) {
     if (!decoder.Next(&size)) {
       return RangeError("field sizes");
     }
-    RETURN_IF_ERROR(v->Init(next, size));
+    if (next + size > block.uend()) {
+      return RangeError("field size");
+    }
+    // Unselected columns are skipped without being decoded.
+    if (v->selected()) {
+      RETURN_IF_ERROR(v->Init(next, size));
+    }
     next += size;
   }
   return Status::OK;
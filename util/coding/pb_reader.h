@@ -5,8 +5,12 @@
 #define _UTIL_CODING_PB_READER_H
 
 #include <memory>
+#include <string>
+#include <vector>
 #include "strings/slice.h"
+#include "util/coding/double_coder.h"
 #include "util/coding/int_coder.h"
+#include "util/coding/roaring_bitmap.h"
 #include "util/coding/string_coder.h"
 #include "base/status.h"
 
@@ -23,9 +27,27 @@ namespace gpb = ::google::protobuf;
 
 class PbFieldReaderArray;
 
+// Raw values of a single column of a block.
+struct ColumnArray {
+  const gpb::FieldDescriptor* field = nullptr;
+
+  // Filled for non-required fields with an entry per instance of the enclosing message:
+  // number of array elements for repeated fields, 0/1 presence for optional fields.
+  std::vector<uint32> counts;
+
+  // Only the array that corresponds to the field type is filled. Message columns have
+  // only counts.
+  std::vector<int64> ints;      // int32, int64 and enums.
+  std::vector<uint64> uints;    // uint32, uint64 and bools.
+  std::vector<double> doubles;  // doubles and floats.
+  std::vector<strings::Slice> strs;  // Point into the block data.
+
+  void Clear();
+};
+
 class PbFieldReader {
 public:
-  PbFieldReader(const gpb::FieldDescriptor* fd);
+  PbFieldReader(const gpb::FieldDescriptor* fd, PbFieldReader* parent = nullptr);
   ~PbFieldReader();
 
   void VisitPreOrder(std::function<void(PbFieldReader*)> cb);
@@ -33,28 +55,53 @@ public:
 
   base::Status Read(gpb::Message* msg);
 
+  // Decodes the rest of the column into dest. Reading the same column afterwards with Read
+  // fails until the reader is initialized with the next block.
+  base::Status ReadColumn(ColumnArray* dest);
+
+  const gpb::FieldDescriptor* field() const { return fd_; }
+  PbFieldReader* parent() const { return parent_; }
+
+  // Dot separated field names from the root message, i.e. "account.activity_id".
+  const std::string& path() const { return path_; }
+
+  // Indices of the enclosing message instances that have this optional field.
+  // Valid for initialized optional fields only.
+  const RoaringBitmap& presence() const { return *u1_.has_bit; }
+
+  // Unselected readers are not initialized and are skipped when messages are read.
+  bool selected() const { return selected_; }
+  void set_selected(bool s) { selected_ = s; }
 private:
   base::StatusObject<const uint8*> InitMeta(const uint8* start, const uint8* end);
 
   const gpb::FieldDescriptor* fd_;
+  PbFieldReader* parent_;
+  std::string path_;
+  bool selected_ = true;
+
   union {
     UInt32Decoder* arr_sizes;
-    BitArray* has_bit;
+    RoaringBitmap* has_bit;
   } u1_;
 
   union {
     UInt64Decoder* val_uint64;
     UInt32Decoder* val_uint32;
     StringDecoder* str_decoder;
+    BitArray* val_bool;
+    DoubleDecoder* double_decoder;  // doubles and floats.
   } u2_;
-  BitArray::Iterator has_iter_;
+  RoaringBitmap::Iterator has_iter_;
+  uint32 optional_count_ = 0, optional_index_ = 0;
+  BitArray::Iterator bool_iter_;
   std::unique_ptr<PbFieldReaderArray> submsg_reader_;
 };
 
 class PbFieldReaderArray {
   std::vector<PbFieldReader*> fields_;
 public:
-  PbFieldReaderArray(const gpb::Descriptor* desc);
+  PbFieldReaderArray(const gpb::Descriptor* desc, PbFieldReader* parent = nullptr);
   ~PbFieldReaderArray();
 
   base::Status Read(gpb::Message* msg);
@@ -65,15 +112,40 @@ public:
   }
 };
 
+/*
+ Reads blocks written by PbBlockSerializer. By default all the columns are decoded.
+ Project() limits decoding to the given field paths: the rest of the columns are skipped by
+ their byte offsets and are left unset in the messages returned by Read.
+ Selected columns can also be read as raw arrays with ReadColumn, without materializing
+ the messages.
+ Usage:
+   PbBlockDeserializer reader(descriptor);
+   RETURN_IF_ERROR(reader.Project({"id", "account.activity_id"}));
+   RETURN_IF_ERROR(reader.Init(block, &num_msgs));
+   ColumnArray ids;
+   RETURN_IF_ERROR(reader.ReadColumn("id", &ids));
+*/
 class PbBlockDeserializer {
 public:
   explicit PbBlockDeserializer(const gpb::Descriptor* desc);
   ~PbBlockDeserializer();
 
+  // Selects columns by their dot separated paths. A message path selects all its subfields.
+  // Ancestors of the selected columns are selected as well since their presence data is
+  // needed to reconstruct the messages. An empty list selects all the columns.
+  // Must be called before Init.
+  base::Status Project(const std::vector<std::string>& paths);
+
   base::Status Init(strings::Slice block, uint32* num_msgs);
   base::Status Read(gpb::Message* msg) {
     return root_.Read(msg);
   }
+
+  // Decodes the whole column of the current block. See PbFieldReader::ReadColumn.
+  base::Status ReadColumn(StringPiece path, ColumnArray* dest);
+
+  // Returns nullptr if the path is not found.
+  PbFieldReader* FindReader(StringPiece path) const;
 private:
   PbFieldReaderArray root_;
   std::vector<PbFieldReader*> readers_;
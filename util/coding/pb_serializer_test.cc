@@ -66,7 +66,7 @@ TEST_F(PbSerializerTest, Basic) {
   strings::Slice contents(ssink.contents());
   file::FileCloser fc(file::Open("sink.bin", "w"));
   uint64 w = 0;
-  CHECK(fc->Write(contents.data(), contents.size(), &w).ok());
+  CHECK(fc->Write(contents, &w).ok());
   EXPECT_EQ(604, book.ByteSize());
   // EXPECT_EQ(0, contents.size());
 
@@ -85,5 +85,88 @@ TEST_F(PbSerializerTest, Basic) {
   }
 }
 
+TEST_F(PbSerializerTest, Projection) {
+  PbBlockSerializer writer(AddressBook::descriptor());
+  for (int j = 0; j < 100; ++j) {
+    AddressBook book;
+    book.add_ts(j * 1000);
+    Person* p = book.add_person();
+    p->set_id(j);
+    p->set_name(IntToString(j));
+    for (int k = 0; k < j % 3; ++k) {
+      auto* phone = p->add_phone();
+      phone->set_number(IntToString(j * 10 + k));
+      if (k)
+        phone->set_type(Person::WORK);
+    }
+    writer.Add(book);
+  }
+  util::StringSink ssink;
+  ASSERT_TRUE(writer.SerializeTo(&ssink).ok());
+  strings::Slice contents(ssink.contents());
+
+  PbBlockDeserializer reader(AddressBook::descriptor());
+  EXPECT_FALSE(reader.Project({"person.foo"}).ok());
+  ASSERT_TRUE(reader.Project({"person.phone", "ts"}).ok());
+  EXPECT_TRUE(reader.FindReader("person")->selected());
+  EXPECT_TRUE(reader.FindReader("person.phone.type")->selected());
+  EXPECT_FALSE(reader.FindReader("person.name")->selected());
+  EXPECT_FALSE(reader.FindReader("tmp")->selected());
+
+  uint32 num_msgs = 0;
+  ASSERT_TRUE(reader.Init(contents, &num_msgs).ok());
+  ASSERT_EQ(100, num_msgs);
+  for (int j = 0; j < 100; ++j) {
+    AddressBook actual;
+    auto st = reader.Read(&actual);
+    ASSERT_TRUE(st.ok()) << st;
+    ASSERT_EQ(1, actual.ts_size());
+    EXPECT_EQ(j * 1000, actual.ts(0));
+    ASSERT_EQ(1, actual.person_size());
+    const Person& p = actual.person(0);
+    EXPECT_FALSE(p.has_id());
+    EXPECT_FALSE(p.has_name());
+    ASSERT_EQ(j % 3, p.phone_size());
+    for (int k = 0; k < p.phone_size(); ++k) {
+      EXPECT_EQ(IntToString(j * 10 + k), p.phone(k).number());
+      EXPECT_EQ(k > 0, p.phone(k).has_type());
+    }
+  }
+  EXPECT_FALSE(reader.ReadColumn("person.id", nullptr).ok());
+}
+
+TEST_F(PbSerializerTest, ReadColumn) {
+  PbBlockSerializer writer(Person::descriptor());
+  for (int j = 0; j < 1000; ++j) {
+    Person p;
+    p.set_id(-j);
+    p.set_name(IntToString(j));
+    if (j % 2)
+      p.set_email("foo");
+    writer.Add(p);
+  }
+  util::StringSink ssink;
+  ASSERT_TRUE(writer.SerializeTo(&ssink).ok());
+
+  PbBlockDeserializer reader(Person::descriptor());
+  ASSERT_TRUE(reader.Project({"id", "email"}).ok());
+  uint32 num_msgs = 0;
+  ASSERT_TRUE(reader.Init(ssink.contents(), &num_msgs).ok());
+
+  ColumnArray ids, emails;
+  ASSERT_TRUE(reader.ReadColumn("id", &ids).ok());
+  ASSERT_TRUE(reader.ReadColumn("email", &emails).ok());
+  EXPECT_TRUE(ids.counts.empty());
+  ASSERT_EQ(1000, ids.ints.size());
+  for (int j = 0; j < 1000; ++j) {
+    ASSERT_EQ(-j, ids.ints[j]);
+  }
+  ASSERT_EQ(1000, emails.counts.size());
+  EXPECT_EQ(1, emails.counts[1]);
+  EXPECT_EQ(0, emails.counts[2]);
+  ASSERT_EQ(500, emails.strs.size());
+  EXPECT_EQ("foo", emails.strs[0]);
+}
+
 }  // namespace coding
 }  // namespace util
@@ -3,6 +3,9 @@
 //
 #include "util/coding/pb_writer.h"
 
+#include <cmath>
+#include "base/bits.h"
+#include "base/hash.h"
 #include "strings/strcat.h"
 #include "strings/stringprintf.h"
 #include "util/coding/varint.h"
@@ -23,11 +26,11 @@ inline Status AppendUInt32(uint32 v, Sink* sink) {
 }
 
 
-Status SerializeEncoder(const vector<uint8>& vec, Sink* sink) {
-  VLOG(1) << "Serializing uint32 array with " << vec.size() << " bytes + "
-          << Varint::Length32(vec.size());
-  Status status = AppendUInt32(vec.size(), sink);
-  status.AddError(sink->Append(vec));
+Status SerializeEncoder(const UInt32Encoder& encoder, Sink* sink) {
+  VLOG(1) << "Serializing uint32 array with " << encoder.ByteSize() << " bytes + "
+          << Varint::Length32(encoder.ByteSize());
+  Status status = AppendUInt32(encoder.ByteSize(), sink);
+  status.AddError(encoder.SerializeTo(sink));
   return status;
 }
 
@@ -47,8 +50,82 @@ template<typename T> inline typename std::make_unsigned<T>::type
   return std::is_signed<T>::value ? (t >> SHR) ^ (t << 1) : t;
 }
 
+template<typename T> inline
+  typename std::conditional<std::is_signed<T>::value, int64, uint64>::type StatValue(T t) {
+  return t;
+}
+
 }  // namespace
 
+void FieldStats::Add(int64 v) {
+  DCHECK(kind_ == NONE || kind_ == INT);
+  if (value_count_++ == 0) {
+    kind_ = INT;
+    min_.i = max_.i = v;
+  } else {
+    min_.i = std::min(min_.i, v);
+    max_.i = std::max(max_.i, v);
+  }
+  AddHash(base::Murmur32(v));
+}
+
+void FieldStats::Add(uint64 v) {
+  DCHECK(kind_ == NONE || kind_ == UINT);
+  if (value_count_++ == 0) {
+    kind_ = UINT;
+    min_.u = max_.u = v;
+  } else {
+    min_.u = std::min(min_.u, v);
+    max_.u = std::max(max_.u, v);
+  }
+  AddHash(base::Murmur32(v));
+}
+
+void FieldStats::Add(double v) {
+  DCHECK(kind_ == NONE || kind_ == DOUBLE);
+  kind_ = DOUBLE;
+  ++value_count_;
+  uint64 bits;
+  memcpy(&bits, &v, sizeof v);
+  AddHash(base::Murmur32(bits));
+  if (std::isnan(v)) {
+    ++nan_count_;
+    return;
+  }
+  if (value_count_ == nan_count_ + 1) {
+    min_.d = max_.d = v;
+  } else {
+    min_.d = std::min(min_.d, v);
+    max_.d = std::max(max_.d, v);
+  }
+}
+
+void FieldStats::Add(StringPiece v) {
+  DCHECK(kind_ == NONE || kind_ == STRING);
+  if (value_count_++ == 0) {
+    kind_ = STRING;
+    v.CopyToString(&min_str_);
+    v.CopyToString(&max_str_);
+  } else if (v < min_str_) {
+    v.CopyToString(&min_str_);
+  } else if (v > max_str_) {
+    v.CopyToString(&max_str_);
+  }
+  AddHash(base::MurmurHash3_x86_32(v.ubuf(), v.size(), 10));
+}
+
+uint32 FieldStats::DistinctEstimate() const {
+  constexpr double kNumBits = kBitmapWords * 64;
+  uint32 zeros = 0;
+  for (uint64 w : bitmap_) {
+    zeros += 64 - Bits::CountOnes64(w);
+  }
+  if (zeros == 0)  // Saturated.
+    return value_count_;
+  double estimate = -kNumBits * std::log(zeros / kNumBits);
+  return std::min<uint32>(value_count_, std::lround(estimate));
+}
+
 PbFieldWriter::PbFieldWriter(const gpb::FieldDescriptor* fd) : fd_(fd) {
   if (fd_->cpp_type() == PBFD::CPPTYPE_MESSAGE) {
     msg_writer_.reset(new PbFieldWriterArray(fd_->message_type()));
@@ -56,8 +133,10 @@ PbFieldWriter::PbFieldWriter(const gpb::FieldDescriptor* fd) : fd_(fd) {
 }
 
 #define HANDLE_REP(T, enc) { const auto& arr = refl->GetRepeatedField<T>(msg, fd_); \
-          for (T v : arr) \
-            enc.push_back(EncodeZigZag<T>(v)); }
+          for (T v : arr) { \
+            enc.push_back(EncodeZigZag<T>(v)); \
+            stats_.Add(StatValue<T>(v)); \
+          } }
 
 void PbFieldWriter::Add(const gpb::Message& msg) {
   const gpb::Reflection* refl = msg.GetReflection();
@@ -65,6 +144,8 @@ void PbFieldWriter::Add(const gpb::Message& msg) {
   if (fd_->is_repeated()) {
     uint32 sz = refl->FieldSize(msg, fd_);
     arr_sizes_.push_back(sz);
+    if (sz == 0)
+      stats_.AddNull();
     switch (fd_->cpp_type()) {
       case PBFD::CPPTYPE_INT32:
           HANDLE_REP(int32, val_uint32_);
@@ -84,9 +165,22 @@ void PbFieldWriter::Add(const gpb::Message& msg) {
         }*/
           HANDLE_REP(uint64, val_uint64_);
       break;
+      case PBFD::CPPTYPE_DOUBLE:
+        for (double v : refl->GetRepeatedField<double>(msg, fd_)) {
+          double_encoder_.Add(v);
+          stats_.Add(v);
+        }
+      break;
+      case PBFD::CPPTYPE_FLOAT:
+        for (float v : refl->GetRepeatedField<float>(msg, fd_)) {
+          double_encoder_.Add(v);
+          stats_.Add(double(v));
+        }
+      break;
       case PBFD::CPPTYPE_ENUM: {
           const auto* enum_descr = refl->GetEnum(msg, fd_);
           val_uint32_.push_back(EncodeZigZag<int>(enum_descr->number()));
+          stats_.Add(int64(enum_descr->number()));
       }
       break;
       case PBFD::CPPTYPE_MESSAGE: {
@@ -103,26 +197,49 @@ void PbFieldWriter::Add(const gpb::Message& msg) {
   }
   if (!fd_->is_required()) {
     bool exists = refl->HasField(msg, fd_);
-    has_bit_.Push(exists);
-    if (!exists)
+    if (exists)
+      has_bit_.Add(optional_count_);
+    ++optional_count_;
+    if (!exists) {
+      stats_.AddNull();
       return;
+    }
   }
   switch (fd_->cpp_type()) {
-    case PBFD::CPPTYPE_UINT32:
-      val_uint32_.push_back(refl->GetUInt32(msg, fd_));
+    case PBFD::CPPTYPE_UINT32: {
+      uint32 v = refl->GetUInt32(msg, fd_);
+      val_uint32_.push_back(v);
+      stats_.Add(uint64(v));
+    }
     break;
-    case PBFD::CPPTYPE_INT32:
-      val_uint32_.push_back(EncodeZigZag<int32>(refl->GetInt32(msg, fd_)));
+    case PBFD::CPPTYPE_INT32: {
+      int32 v = refl->GetInt32(msg, fd_);
+      val_uint32_.push_back(EncodeZigZag<int32>(v));
+      stats_.Add(int64(v));
+    }
     break;
-    case PBFD::CPPTYPE_UINT64:
-      val_uint64_.push_back(refl->GetUInt64(msg, fd_));
+    case PBFD::CPPTYPE_UINT64: {
+      uint64 v = refl->GetUInt64(msg, fd_);
+      val_uint64_.push_back(v);
+      stats_.Add(v);
+    }
     break;
-    case PBFD::CPPTYPE_INT64:
-      val_uint64_.push_back(EncodeZigZag<int64>(refl->GetInt64(msg, fd_)));
+    case PBFD::CPPTYPE_INT64: {
+      int64 v = refl->GetInt64(msg, fd_);
+      val_uint64_.push_back(EncodeZigZag<int64>(v));
+      stats_.Add(v);
+    }
     break;
     case PBFD::CPPTYPE_STRING: {
       const string& str = refl->GetStringReference(msg, fd_, &tmp);
       str_encoder_.Add(str);
+      stats_.Add(StringPiece(str));
+    }
+    break;
+    case PBFD::CPPTYPE_ENUM: {
+      int32 v = refl->GetEnum(msg, fd_)->number();
+      val_uint32_.push_back(EncodeZigZag<int32>(v));
+      stats_.Add(int64(v));
     }
     break;
     case PBFD::CPPTYPE_MESSAGE:
@@ -130,33 +247,37 @@ void PbFieldWriter::Add(const gpb::Message& msg) {
     break;
     case PBFD::CPPTYPE_DOUBLE: {
       double d = refl->GetDouble(msg, fd_);
-      char* ptr = reinterpret_cast<char*>(&d);
-      val_uint64_.push_back(*reinterpret_cast<uint64*>(ptr));
+      double_encoder_.Add(d);
+      stats_.Add(d);
     }
     break;
-    case PBFD::CPPTYPE_BOOL:
-      val_bool_.Push(refl->GetBool(msg, fd_));
+    case PBFD::CPPTYPE_FLOAT: {
+      double d = refl->GetFloat(msg, fd_);
+      double_encoder_.Add(d);
+      stats_.Add(d);
+    }
+    break;
+    case PBFD::CPPTYPE_BOOL: {
+      bool b = refl->GetBool(msg, fd_);
+      val_bool_.Push(b);
+      stats_.Add(uint64(b));
+    }
     break;
     default:
       LOG(FATAL) << "Not implemented: " << fd_->cpp_type_name();
   }
 }
 
-inline void Encode32(std::vector<uint32>* v, vector<uint8>* dest) {
+inline void Encode32(std::vector<uint32>* v, UInt32Encoder* encoder) {
   if (v->empty())
     return;
-  UInt32Encoder encoder;
-  encoder.Encode(*v, true);
-  encoder.Swap(dest);
+  encoder->Encode(*v, true);
   std::vector<uint32>().swap(*v);
 }
 
 void PbFieldWriter::Finalize() {
-  UInt32Encoder encoder;
   if (fd_->is_repeated()) {
-    Encode32(&arr_sizes_, &data_buf_[0]);
-  } else if (fd_->is_optional()) {
-    has_bit_.Finalize();
+    Encode32(&arr_sizes_, &arr_sizes_enc_);
   }
 
   switch (fd_->cpp_type()) {
@@ -164,12 +285,15 @@ void PbFieldWriter::Finalize() {
       str_encoder_.Finalize();
     break;
     case PBFD::CPPTYPE_UINT32: case PBFD::CPPTYPE_INT32: case PBFD::CPPTYPE_ENUM:
-      Encode32(&val_uint32_, &data_buf_[1]);
+      Encode32(&val_uint32_, &val32_enc_);
     break;
-    case PBFD::CPPTYPE_UINT64: case PBFD::CPPTYPE_INT64: case PBFD::CPPTYPE_DOUBLE:
+    case PBFD::CPPTYPE_UINT64: case PBFD::CPPTYPE_INT64:
       enc64_.Encode(val_uint64_, true);
       std::vector<uint64>().swap(val_uint64_);
     break;
+    case PBFD::CPPTYPE_DOUBLE: case PBFD::CPPTYPE_FLOAT:
+      double_encoder_.Finalize();
+    break;
     case PBFD::CPPTYPE_BOOL:
       val_bool_.Finalize();
     break;
@@ -183,9 +307,9 @@ void PbFieldWriter::Finalize() {
 uint32 PbFieldWriter::ByteSize() const {
   uint32 size = 0;
   if (fd_->is_repeated()) {
-    size += ByteSizeWithLength(data_buf_[0].size());
+    size += ByteSizeWithLength(arr_sizes_enc_.ByteSize());
   } else if (fd_->is_optional()) {
-    size += ByteSizeWithLength(has_bit_.ByteSize() + Varint::Length32(has_bit_.size()));
+    size += ByteSizeWithLength(has_bit_.ByteSize() + Varint::Length32(optional_count_));
   }
   switch (fd_->cpp_type()) {
     case PBFD::CPPTYPE_STRING:
@@ -194,13 +318,16 @@ uint32 PbFieldWriter::ByteSize() const {
     case PBFD::CPPTYPE_UINT32:
     case PBFD::CPPTYPE_INT32:
     case PBFD::CPPTYPE_ENUM:
-      size += data_buf_[1].size();
+      size += val32_enc_.ByteSize();
     break;
     case PBFD::CPPTYPE_UINT64:
     case PBFD::CPPTYPE_INT64:
-    case PBFD::CPPTYPE_DOUBLE:
       size += enc64_.ByteSize();
     break;
+    case PBFD::CPPTYPE_DOUBLE:
+    case PBFD::CPPTYPE_FLOAT:
+      size += double_encoder_.ByteSize();
+    break;
     case PBFD::CPPTYPE_BOOL:
       size += ByteSizeWithLength(val_bool_.ByteSize() + Varint::Length32(val_bool_.size()));
     break;
@@ -215,9 +342,11 @@ uint32 PbFieldWriter::ByteSize() const {
 Status PbFieldWriter::SerializeTo(Sink* sink) const {
   VLOG(1) << "Serializing field " << fd_->full_name();
   if (fd_->is_repeated()) {
-    RETURN_IF_ERROR(SerializeEncoder(data_buf_[0], sink));
+    RETURN_IF_ERROR(SerializeEncoder(arr_sizes_enc_, sink));
   } else if (fd_->is_optional()) {
-    RETURN_IF_ERROR(SerializeBitArray(has_bit_, sink));
+    RETURN_IF_ERROR(AppendUInt32(has_bit_.ByteSize() + Varint::Length32(optional_count_), sink));
+    RETURN_IF_ERROR(AppendUInt32(optional_count_, sink));
+    RETURN_IF_ERROR(has_bit_.SerializeTo(sink));
   }
   switch (fd_->cpp_type()) {
     case PBFD::CPPTYPE_STRING:
@@ -227,13 +356,16 @@ Status PbFieldWriter::SerializeTo(Sink* sink) const {
     case PBFD::CPPTYPE_UINT32:
     case PBFD::CPPTYPE_INT32:
     case PBFD::CPPTYPE_ENUM:
-      RETURN_IF_ERROR(sink->Append(data_buf_[1]));
+      RETURN_IF_ERROR(val32_enc_.SerializeTo(sink));
     break;
     case PBFD::CPPTYPE_UINT64:
     case PBFD::CPPTYPE_INT64:
-    case PBFD::CPPTYPE_DOUBLE:
       RETURN_IF_ERROR(enc64_.SerializeTo(sink));
     break;
+    case PBFD::CPPTYPE_DOUBLE:
+    case PBFD::CPPTYPE_FLOAT:
+      RETURN_IF_ERROR(double_encoder_.SerializeTo(sink));
+    break;
     case PBFD::CPPTYPE_BOOL:
       RETURN_IF_ERROR(SerializeBitArray(val_bool_, sink));
     break;
@@ -301,12 +433,12 @@ Status PbBlockSerializer::SerializeTo(Sink* sink) {
     total_size += fw->ByteSize();
     field_sizes.push_back(fw->ByteSize());
   }
-  std::vector<uint8> fs_buf;
-  Encode32(&field_sizes, &fs_buf);
-  total_size += ByteSizeWithLength(fs_buf.size());
+  UInt32Encoder fs_encoder;
+  Encode32(&field_sizes, &fs_encoder);
+  total_size += ByteSizeWithLength(fs_encoder.ByteSize());
 
   VLOG(1) << "Serialize all fields column sizes. Block size is " << total_size;
-  RETURN_IF_ERROR(SerializeEncoder(fs_buf, sink));
+  RETURN_IF_ERROR(SerializeEncoder(fs_encoder, sink));
   for (PbFieldWriter* fw : all_fields_) {
     RETURN_IF_ERROR(fw->SerializeTo(sink));
   }
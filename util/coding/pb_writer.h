@@ -5,7 +5,10 @@
 #define _UTIL_CODING_PB_WRITER_H
 
 #include "base/arena.h"
+#include "strings/stringpiece.h"
+#include "util/coding/double_coder.h"
 #include "util/coding/int_coder.h"
+#include "util/coding/roaring_bitmap.h"
 #include "util/coding/string_coder.h"
 #include "util/status.h"
 #include <memory>
@@ -27,6 +30,61 @@ namespace coding {
 class PbFieldWriterArray;
 namespace gpb = ::google::protobuf;
 
+// Zone map statistics of a single column gathered while messages are added.
+// Integral values (enums and bools included) are tracked as int64 or uint64 according to
+// their signedness, floating point values as double and strings by their bytes.
+// Null count is the number of messages that do not have the field (or have an empty array
+// for repeated fields).
+class FieldStats {
+public:
+  enum Kind : uint8 {NONE = 0, INT = 1, UINT = 2, DOUBLE = 3, STRING = 4};
+
+  void AddNull() { ++null_count_; }
+
+  void Add(int64 v);
+  void Add(uint64 v);
+  void Add(double v);
+  void Add(StringPiece v);
+
+  Kind kind() const { return kind_; }
+  uint32 null_count() const { return null_count_; }
+  uint32 value_count() const { return value_count_; }
+
+  // Min/max are defined only if has_minmax() is true. For doubles NaNs are ignored.
+  bool has_minmax() const { return value_count_ > nan_count_; }
+  int64 min_int() const { return min_.i; }
+  int64 max_int() const { return max_.i; }
+  uint64 min_uint() const { return min_.u; }
+  uint64 max_uint() const { return max_.u; }
+  double min_double() const { return min_.d; }
+  double max_double() const { return max_.d; }
+  const std::string& min_str() const { return min_str_; }
+  const std::string& max_str() const { return max_str_; }
+
+  // Linear counting estimate of the number of distinct values.
+  uint32 DistinctEstimate() const;
+
+private:
+  void AddHash(uint32 hash) {
+    bitmap_[(hash / 64) % kBitmapWords] |= (1ULL << (hash % 64));
+  }
+
+  static constexpr unsigned kBitmapWords = 16;  // 1024 bits.
+
+  union Value {
+    int64 i;
+    uint64 u;
+    double d;
+  } min_, max_;
+
+  std::string min_str_, max_str_;
+  uint32 null_count_ = 0;
+  uint32 value_count_ = 0;
+  uint32 nan_count_ = 0;
+  Kind kind_ = NONE;
+  uint64 bitmap_[kBitmapWords] = {0};
+};
+
 class PbFieldWriter {
 public:
   PbFieldWriter(const gpb::FieldDescriptor* fd);
@@ -39,18 +97,27 @@ public:
 
   Status SerializeTo(Sink* sink) const;
   std::string FieldName() const;
+
+  const gpb::FieldDescriptor* field() const { return fd_; }
+  const FieldStats& stats() const { return stats_; }
 private:
   typedef gpb::FieldDescriptor PBFD;
   const gpb::FieldDescriptor* fd_;
 
   std::vector<uint32> arr_sizes_, val_uint32_;
   std::vector<uint64> val_uint64_;
-  std::vector<uint8> data_buf_[2];
+  UInt32Encoder arr_sizes_enc_, val32_enc_;
   UInt64Encoder enc64_;
 
-  util::coding::BitArray has_bit_, val_bool_;
+  // Indices of the instances that have the optional field.
+  RoaringBitmap has_bit_;
+  uint32 optional_count_ = 0;
+
+  util::coding::BitArray val_bool_;
   StringEncoder str_encoder_;
+  DoubleEncoder double_encoder_;  // doubles and floats.
   std::unique_ptr<PbFieldWriterArray> msg_writer_;
+  FieldStats stats_;
 
   PbFieldWriter(const PbFieldWriter&) = delete;
   void operator=(const PbFieldWriter&) = delete;
@@ -103,6 +170,9 @@ public:
   // Number of messages addes so far.
   uint32 NumEntries() const { return size_; }
 
+  // All the field writers in pre-order, i.e. the order their columns are serialized.
+  const std::vector<PbFieldWriter*>& fields() const { return all_fields_; }
+
   std::string DebugStats() const;
 };
 
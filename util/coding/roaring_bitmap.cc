@@ -0,0 +1,642 @@
+// Copyright 2013, Beeri 15.  All rights reserved.
+// Author: Roman Gershman (romange@gmail.com)
+//
+#include "util/coding/roaring_bitmap.h"
+
+#include <algorithm>
+#include <iterator>
+#include "base/bits.h"
+#include "base/endian.h"
+#include "base/logging.h"
+#include "util/coding/varint.h"
+#include "util/sinksource.h"
+
+namespace util {
+namespace coding {
+
+using base::Status;
+using std::vector;
+
+namespace {
+
+inline Status ParseError(const char* str) {
+  return Status(base::StatusCode::IO_ERROR, str);
+}
+
+inline uint32 LowBits(uint32 x) { return x & 0xFFFF; }
+inline uint16 HighBits(uint32 x) { return x >> 16; }
+
+inline void AppendVarint(uint32 v, vector<uint8>* dest) {
+  uint8 buf[Varint::kMax32];
+  uint8* end = Varint::Encode32(buf, v);
+  dest->insert(dest->end(), buf, end);
+}
+
+inline void Append16(uint16 v, vector<uint8>* dest) {
+  dest->push_back(v & 0xFF);
+  dest->push_back(v >> 8);
+}
+
+inline uint32 CountWords(const uint64* w, uint32 count) {
+  uint32 res = 0;
+  for (uint32 i = 0; i < count; ++i)
+    res += Bits::CountOnes64(w[i]);
+  return res;
+}
+
+// Returns the position of the i-th set bit in w. Requires i < popcount(w).
+inline uint32 SelectInWord(uint64 w, uint32 i) {
+  for (; i > 0; --i)
+    w &= (w - 1);
+  return Bits::FindLSBSetNonZero64(w);
+}
+
+}  // namespace
+
+constexpr uint32 RoaringBitmap::kMaxArraySize;
+constexpr uint32 RoaringBitmap::kBitmapWords;
+
+bool RoaringBitmap::Container::Contains(uint16 v) const {
+  if (is_bitmap())
+    return (bitmap[v / 64] >> (v % 64)) & 1;
+  return std::binary_search(array.begin(), array.end(), v);
+}
+
+bool RoaringBitmap::Container::Add(uint16 v) {
+  if (is_bitmap()) {
+    uint64& w = bitmap[v / 64];
+    uint64 mask = uint64(1) << (v % 64);
+    if (w & mask)
+      return false;
+    w |= mask;
+    ++card;
+    return true;
+  }
+  auto it = std::lower_bound(array.begin(), array.end(), v);
+  if (it != array.end() && *it == v)
+    return false;
+  array.insert(it, v);
+  if (++card > kMaxArraySize)
+    ToBitmap();
+  return true;
+}
+
+bool RoaringBitmap::Container::Remove(uint16 v) {
+  if (is_bitmap()) {
+    uint64& w = bitmap[v / 64];
+    uint64 mask = uint64(1) << (v % 64);
+    if ((w & mask) == 0)
+      return false;
+    w &= ~mask;
+    --card;
+    Shrink();
+    return true;
+  }
+  auto it = std::lower_bound(array.begin(), array.end(), v);
+  if (it == array.end() || *it != v)
+    return false;
+  array.erase(it);
+  --card;
+  return true;
+}
+
+uint32 RoaringBitmap::Container::Rank(uint16 v) const {
+  if (!is_bitmap())
+    return std::upper_bound(array.begin(), array.end(), v) - array.begin();
+  uint32 word = v / 64;
+  uint32 bit = v % 64;
+  uint64 mask = (bit == 63) ? ~uint64(0) : (uint64(1) << (bit + 1)) - 1;
+  return CountWords(bitmap.data(), word) + Bits::CountOnes64(bitmap[word] & mask);
+}
+
+uint16 RoaringBitmap::Container::Select(uint32 i) const {
+  DCHECK_LT(i, card);
+  if (!is_bitmap())
+    return array[i];
+  for (uint32 j = 0; j < kBitmapWords; ++j) {
+    uint32 cnt = Bits::CountOnes64(bitmap[j]);
+    if (i < cnt)
+      return j * 64 + SelectInWord(bitmap[j], i);
+    i -= cnt;
+  }
+  LOG(FATAL) << "Bad cardinality " << card;
+  return 0;
+}
+
+void RoaringBitmap::Container::ToBitmap() {
+  if (is_bitmap())
+    return;
+  bitmap.assign(kBitmapWords, 0);
+  for (uint16 v : array)
+    bitmap[v / 64] |= uint64(1) << (v % 64);
+  vector<uint16>().swap(array);
+}
+
+void RoaringBitmap::Container::Shrink() {
+  if (!is_bitmap() || card > kMaxArraySize)
+    return;
+  array.clear();
+  array.reserve(card);
+  for (uint32 i = 0; i < kBitmapWords; ++i) {
+    uint64 w = bitmap[i];
+    while (w) {
+      array.push_back(i * 64 + Bits::FindLSBSetNonZero64(w));
+      w &= (w - 1);
+    }
+  }
+  vector<uint64>().swap(bitmap);
+}
+
+uint32 RoaringBitmap::Container::CountRuns() const {
+  uint32 runs = 0;
+  if (is_bitmap()) {
+    uint64 prev_top = 0;
+    for (uint64 w : bitmap) {
+      // Run starts are set bits whose predecessor bit is not set.
+      runs += Bits::CountOnes64(w & ~((w << 1) | prev_top));
+      prev_top = w >> 63;
+    }
+    return runs;
+  }
+  for (size_t i = 0; i < array.size(); ++i) {
+    if (i == 0 || array[i] != array[i - 1] + 1)
+      ++runs;
+  }
+  return runs;
+}
+
+uint32 RoaringBitmap::Container::SerializedSize() const {
+  // key and type.
+  uint32 res = 3;
+  uint32 runs = CountRuns();
+  uint32 run_sz = Varint::Length32(runs) + runs * 4;
+  uint32 other_sz = is_bitmap() ? kBitmapWords * 8 : Varint::Length32(card - 1) + card * 2;
+  return res + std::min(run_sz, other_sz);
+}
+
+void RoaringBitmap::Container::Serialize(vector<uint8>* dest) const {
+  Append16(key, dest);
+  uint32 runs = CountRuns();
+  uint32 run_sz = Varint::Length32(runs) + runs * 4;
+  uint32 other_sz = is_bitmap() ? kBitmapWords * 8 : Varint::Length32(card - 1) + card * 2;
+  if (run_sz < other_sz) {
+    dest->push_back(RUN);
+    AppendVarint(runs, dest);
+    uint32 start = 0, last = 0;
+    bool first = true;
+    auto add_val = [&](uint32 v) {
+      if (first || v != last + 1) {
+        if (!first) {
+          Append16(start, dest);
+          Append16(last - start, dest);
+        }
+        start = v;
+        first = false;
+      }
+      last = v;
+    };
+    if (is_bitmap()) {
+      for (uint32 i = 0; i < kBitmapWords; ++i) {
+        uint64 w = bitmap[i];
+        while (w) {
+          add_val(i * 64 + Bits::FindLSBSetNonZero64(w));
+          w &= (w - 1);
+        }
+      }
+    } else {
+      for (uint16 v : array)
+        add_val(v);
+    }
+    Append16(start, dest);
+    Append16(last - start, dest);
+    return;
+  }
+  if (is_bitmap()) {
+    dest->push_back(BITMAP);
+    size_t pos = dest->size();
+    dest->resize(pos + kBitmapWords * 8);
+    for (uint32 i = 0; i < kBitmapWords; ++i) {
+      LittleEndian::Store64(&(*dest)[pos + i * 8], bitmap[i]);
+    }
+    return;
+  }
+  dest->push_back(ARRAY);
+  AppendVarint(card - 1, dest);
+  for (uint16 v : array)
+    Append16(v, dest);
+}
+
+size_t RoaringBitmap::LowerBound(uint16 key) const {
+  size_t lo = 0, hi = containers_.size();
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    if (containers_[mid].key < key)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+RoaringBitmap::Container* RoaringBitmap::Find(uint16 key) {
+  size_t i = LowerBound(key);
+  return (i < containers_.size() && containers_[i].key == key) ? &containers_[i] : nullptr;
+}
+
+const RoaringBitmap::Container* RoaringBitmap::Find(uint16 key) const {
+  size_t i = LowerBound(key);
+  return (i < containers_.size() && containers_[i].key == key) ? &containers_[i] : nullptr;
+}
+
+void RoaringBitmap::Add(uint32 x) {
+  uint16 key = HighBits(x);
+  size_t i = LowerBound(key);
+  if (i == containers_.size() || containers_[i].key != key) {
+    Container c;
+    c.key = key;
+    containers_.insert(containers_.begin() + i, std::move(c));
+  }
+  containers_[i].Add(LowBits(x));
+}
+
+void RoaringBitmap::AddRange(uint32 start, uint32 end) {
+  while (start < end) {
+    uint16 key = HighBits(start);
+    uint32 chunk_end = std::min<uint64>(end, (uint64(key) + 1) << 16);
+    size_t i = LowerBound(key);
+    if (i == containers_.size() || containers_[i].key != key) {
+      Container c;
+      c.key = key;
+      containers_.insert(containers_.begin() + i, std::move(c));
+    }
+    Container& c = containers_[i];
+    if (chunk_end - start + c.card > kMaxArraySize)
+      c.ToBitmap();
+    if (c.is_bitmap()) {
+      for (uint32 v = start; v < chunk_end; ++v) {
+        c.bitmap[LowBits(v) / 64] |= uint64(1) << (v % 64);
+      }
+      c.card = CountWords(c.bitmap.data(), kBitmapWords);
+      c.Shrink();  // the range may overlap the existing values.
+    } else {
+      for (uint32 v = start; v < chunk_end; ++v)
+        c.Add(LowBits(v));
+    }
+    start = chunk_end;
+  }
+}
+
+void RoaringBitmap::Remove(uint32 x) {
+  size_t i = LowerBound(HighBits(x));
+  if (i == containers_.size() || containers_[i].key != HighBits(x))
+    return;
+  containers_[i].Remove(LowBits(x));
+  if (containers_[i].card == 0)
+    containers_.erase(containers_.begin() + i);
+}
+
+bool RoaringBitmap::Contains(uint32 x) const {
+  const Container* c = Find(HighBits(x));
+  return c && c->Contains(LowBits(x));
+}
+
+uint64 RoaringBitmap::Cardinality() const {
+  uint64 res = 0;
+  for (const Container& c : containers_)
+    res += c.card;
+  return res;
+}
+
+uint64 RoaringBitmap::Rank(uint32 x) const {
+  uint16 key = HighBits(x);
+  uint64 res = 0;
+  for (const Container& c : containers_) {
+    if (c.key < key) {
+      res += c.card;
+    } else {
+      if (c.key == key)
+        res += c.Rank(LowBits(x));
+      break;
+    }
+  }
+  return res;
+}
+
+bool RoaringBitmap::Select(uint64 i, uint32* res) const {
+  for (const Container& c : containers_) {
+    if (i < c.card) {
+      *res = (uint32(c.key) << 16) | c.Select(i);
+      return true;
+    }
+    i -= c.card;
+  }
+  return false;
+}
+
+void RoaringBitmap::And(const Container& a, const Container& b, Container* dest) {
+  dest->key = a.key;
+  if (a.is_bitmap() && b.is_bitmap()) {
+    dest->bitmap.resize(kBitmapWords);
+    for (uint32 i = 0; i < kBitmapWords; ++i)
+      dest->bitmap[i] = a.bitmap[i] & b.bitmap[i];
+    dest->card = CountWords(dest->bitmap.data(), kBitmapWords);
+    dest->Shrink();
+    return;
+  }
+  if (!a.is_bitmap() && !b.is_bitmap()) {
+    std::set_intersection(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(),
+                          std::back_inserter(dest->array));
+  } else {
+    const Container& arr = a.is_bitmap() ? b : a;
+    const Container& bm = a.is_bitmap() ? a : b;
+    for (uint16 v : arr.array) {
+      if (bm.Contains(v))
+        dest->array.push_back(v);
+    }
+  }
+  dest->card = dest->array.size();
+}
+
+void RoaringBitmap::Or(const Container& a, const Container& b, Container* dest) {
+  dest->key = a.key;
+  if (!a.is_bitmap() && !b.is_bitmap()) {
+    std::set_union(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(),
+                   std::back_inserter(dest->array));
+    dest->card = dest->array.size();
+    if (dest->card > kMaxArraySize)
+      dest->ToBitmap();
+    return;
+  }
+  dest->bitmap.assign(kBitmapWords, 0);
+  for (const Container* c : {&a, &b}) {
+    if (c->is_bitmap()) {
+      for (uint32 i = 0; i < kBitmapWords; ++i)
+        dest->bitmap[i] |= c->bitmap[i];
+    } else {
+      for (uint16 v : c->array)
+        dest->bitmap[v / 64] |= uint64(1) << (v % 64);
+    }
+  }
+  dest->card = CountWords(dest->bitmap.data(), kBitmapWords);
+}
+
+void RoaringBitmap::AndNot(const Container& a, const Container& b, Container* dest) {
+  dest->key = a.key;
+  if (!a.is_bitmap()) {
+    if (b.is_bitmap()) {
+      for (uint16 v : a.array) {
+        if (!b.Contains(v))
+          dest->array.push_back(v);
+      }
+    } else {
+      std::set_difference(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(),
+                          std::back_inserter(dest->array));
+    }
+    dest->card = dest->array.size();
+    return;
+  }
+  dest->bitmap = a.bitmap;
+  if (b.is_bitmap()) {
+    for (uint32 i = 0; i < kBitmapWords; ++i)
+      dest->bitmap[i] &= ~b.bitmap[i];
+  } else {
+    for (uint16 v : b.array)
+      dest->bitmap[v / 64] &= ~(uint64(1) << (v % 64));
+  }
+  dest->card = CountWords(dest->bitmap.data(), kBitmapWords);
+  dest->Shrink();
+}
+
+RoaringBitmap& RoaringBitmap::operator&=(const RoaringBitmap& o) {
+  vector<Container> res;
+  size_t i = 0, j = 0;
+  while (i < containers_.size() && j < o.containers_.size()) {
+    const Container& a = containers_[i];
+    const Container& b = o.containers_[j];
+    if (a.key < b.key) {
+      ++i;
+    } else if (b.key < a.key) {
+      ++j;
+    } else {
+      Container c;
+      And(a, b, &c);
+      if (c.card)
+        res.push_back(std::move(c));
+      ++i;
+      ++j;
+    }
+  }
+  containers_.swap(res);
+  return *this;
+}
+
+RoaringBitmap& RoaringBitmap::operator|=(const RoaringBitmap& o) {
+  vector<Container> res;
+  res.reserve(containers_.size() + o.containers_.size());
+  size_t i = 0, j = 0;
+  while (i < containers_.size() || j < o.containers_.size()) {
+    if (j == o.containers_.size() ||
+        (i < containers_.size() && containers_[i].key < o.containers_[j].key)) {
+      res.push_back(std::move(containers_[i++]));
+    } else if (i == containers_.size() || o.containers_[j].key < containers_[i].key) {
+      res.push_back(o.containers_[j++]);
+    } else {
+      Container c;
+      Or(containers_[i], o.containers_[j], &c);
+      res.push_back(std::move(c));
+      ++i;
+      ++j;
+    }
+  }
+  containers_.swap(res);
+  return *this;
+}
+
+RoaringBitmap& RoaringBitmap::AndNot(const RoaringBitmap& o) {
+  vector<Container> res;
+  res.reserve(containers_.size());
+  size_t j = 0;
+  for (Container& a : containers_) {
+    while (j < o.containers_.size() && o.containers_[j].key < a.key)
+      ++j;
+    if (j == o.containers_.size() || o.containers_[j].key != a.key) {
+      res.push_back(std::move(a));
+      continue;
+    }
+    Container c;
+    AndNot(a, o.containers_[j], &c);
+    if (c.card)
+      res.push_back(std::move(c));
+  }
+  containers_.swap(res);
+  return *this;
+}
+
+bool RoaringBitmap::operator==(const RoaringBitmap& o) const {
+  if (containers_.size() != o.containers_.size())
+    return false;
+  for (size_t i = 0; i < containers_.size(); ++i) {
+    const Container& a = containers_[i];
+    const Container& b = o.containers_[i];
+    // Containers with the same cardinality have the same kind.
+    if (a.key != b.key || a.card != b.card || a.array != b.array || a.bitmap != b.bitmap)
+      return false;
+  }
+  return true;
+}
+
+vector<uint32> RoaringBitmap::ToVector() const {
+  vector<uint32> res;
+  res.reserve(Cardinality());
+  ForEach([&res](uint32 v) { res.push_back(v); });
+  return res;
+}
+
+uint32 RoaringBitmap::ByteSize() const {
+  uint32 res = Varint::Length32(containers_.size());
+  for (const Container& c : containers_)
+    res += c.SerializedSize();
+  return res;
+}
+
+Status RoaringBitmap::SerializeTo(Sink* sink) const {
+  vector<uint8> buf;
+  buf.reserve(ByteSize());
+  AppendVarint(containers_.size(), &buf);
+  for (const Container& c : containers_)
+    c.Serialize(&buf);
+  return sink->Append(strings::Slice(buf.data(), buf.size()));
+}
+
+Status RoaringBitmap::Parse(strings::Slice slice, uint32* consumed) {
+  containers_.clear();
+  const uint8* next = slice.ubuf();
+  const uint8* end = slice.uend();
+  uint32 count = 0;
+  next = Varint::Parse32WithLimit(next, end, &count);
+  if (next == nullptr)
+    return ParseError("Bad container count");
+  if (count > (1 << 16))
+    return ParseError("Too many containers");
+  containers_.resize(count);
+  for (uint32 i = 0; i < count; ++i) {
+    if (end - next < 3)
+      return ParseError("Truncated container");
+    Container& c = containers_[i];
+    c.key = LittleEndian::Load16(next);
+    if (i > 0 && c.key <= containers_[i - 1].key)
+      return ParseError("Unsorted containers");
+    uint8 type = next[2];
+    next += 3;
+    uint32 num = 0;
+    switch (type) {
+      case ARRAY:
+        next = Varint::Parse32WithLimit(next, end, &num);
+        if (next == nullptr || num >= kMaxArraySize || uint32(end - next) < (num + 1) * 2)
+          return ParseError("Bad array container");
+        c.card = num + 1;
+        c.array.resize(c.card);
+        for (uint32 j = 0; j < c.card; ++j, next += 2) {
+          c.array[j] = LittleEndian::Load16(next);
+          if (j > 0 && c.array[j] <= c.array[j - 1])
+            return ParseError("Unsorted array container");
+        }
+      break;
+      case BITMAP:
+        if (uint32(end - next) < kBitmapWords * 8)
+          return ParseError("Bad bitmap container");
+        c.bitmap.resize(kBitmapWords);
+        for (uint32 j = 0; j < kBitmapWords; ++j, next += 8)
+          c.bitmap[j] = LittleEndian::Load64(next);
+        c.card = CountWords(c.bitmap.data(), kBitmapWords);
+        if (c.card == 0)
+          return ParseError("Empty container");
+        c.Shrink();
+      break;
+      case RUN: {
+        next = Varint::Parse32WithLimit(next, end, &num);
+        if (next == nullptr || num == 0 || uint64(end - next) < uint64(num) * 4)
+          return ParseError("Bad run container");
+        int32 last = -1;
+        for (uint32 j = 0; j < num; ++j, next += 4) {
+          uint32 start = LittleEndian::Load16(next);
+          uint32 stop = start + LittleEndian::Load16(next + 2) + 1;
+          if (int32(start) <= last || stop > (1 << 16))
+            return ParseError("Bad run");
+          for (uint32 v = start; v < stop; ++v) {
+            if (c.is_bitmap()) {
+              c.bitmap[v / 64] |= uint64(1) << (v % 64);
+              ++c.card;
+            } else {
+              c.array.push_back(v);
+              if (++c.card > kMaxArraySize)
+                c.ToBitmap();
+            }
+          }
+          last = stop - 1;
+        }
+      }
+      break;
+      default:
+        return ParseError("Unknown container type");
+    }
+  }
+  if (consumed)
+    *consumed = next - slice.ubuf();
+  return Status::OK;
+}
+
+size_t RoaringBitmap::MemoryUsage() const {
+  size_t res = containers_.capacity() * sizeof(Container);
+  for (const Container& c : containers_) {
+    res += c.array.capacity() * sizeof(uint16) + c.bitmap.capacity() * sizeof(uint64);
+  }
+  return res;
+}
+
+RoaringBitmap::Iterator::Iterator(const RoaringBitmap& bm) : bm_(&bm) {
+  Load();
+}
+
+void RoaringBitmap::Iterator::Load() {
+  for (; cont_ < bm_->containers_.size(); ++cont_) {
+    const Container& c = bm_->containers_[cont_];
+    uint32 base = uint32(c.key) << 16;
+    pos_ = 0;
+    if (!c.is_bitmap()) {
+      val_ = base + c.array[0];
+      return;
+    }
+    for (; pos_ < kBitmapWords; ++pos_) {
+      word_ = c.bitmap[pos_];
+      if (word_) {
+        val_ = base + pos_ * 64 + Bits::FindLSBSetNonZero64(word_);
+        return;
+      }
+    }
+  }
+}
+
+void RoaringBitmap::Iterator::Advance() {
+  const Container& c = bm_->containers_[cont_];
+  uint32 base = uint32(c.key) << 16;
+  if (!c.is_bitmap()) {
+    if (++pos_ < c.array.size()) {
+      val_ = base + c.array[pos_];
+      return;
+    }
+  } else {
+    word_ &= (word_ - 1);
+    while (word_ == 0 && ++pos_ < kBitmapWords)
+      word_ = c.bitmap[pos_];
+    if (word_) {
+      val_ = base + pos_ * 64 + Bits::FindLSBSetNonZero64(word_);
+      return;
+    }
+  }
+  ++cont_;
+  Load();
+}
+
+}  // namespace coding
+}  // namespace util
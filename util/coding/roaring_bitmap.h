@@ -0,0 +1,173 @@
+// Copyright 2013, Beeri 15.  All rights reserved.
+// Author: Roman Gershman (romange@gmail.com)
+//
+#ifndef _UTIL_CODING_ROARING_BITMAP_H
+#define _UTIL_CODING_ROARING_BITMAP_H
+
+#include <vector>
+#include "base/bits.h"
+#include "base/integral_types.h"
+#include "base/status.h"
+#include "strings/stringpiece.h"
+
+namespace util {
+class Sink;
+namespace coding {
+
+/*
+  Compressed bitmap of uint32 values based on "Better bitmap performance with Roaring bitmaps"
+  by Chambi, Lemire et al.
+  The universe is split into chunks of 2^16 values by the high 16 bits. Each non-empty chunk
+  is held in a container that is either a sorted array of the low 16 bits (up to 4096 values)
+  or a bitmap of 2^16 bits. Set operations work container by container and choose the
+  cheapest algorithm for each pair of container kinds.
+
+  Serialized format:
+    varint - number of containers.
+    per container:
+      2 bytes - key (high 16 bits) little endian.
+      1 byte  - container type: ARRAY, BITMAP or RUN.
+      ARRAY:  varint cardinality - 1, followed by low 16 bit values, 2 bytes each.
+      BITMAP: 8192 bytes of bitmap words, little endian.
+      RUN:    varint number of runs, followed by (start, length - 1) pairs, 2 bytes each.
+  Runs are used in serialization only, when they are smaller than the other representations.
+  In memory they are expanded into arrays or bitmaps.
+*/
+class RoaringBitmap {
+public:
+  RoaringBitmap() {}
+
+  void Add(uint32 x);
+
+  // Adds all the values in range [start, end).
+  void AddRange(uint32 start, uint32 end);
+
+  void Remove(uint32 x);
+  bool Contains(uint32 x) const;
+
+  void Clear() { containers_.clear(); }
+  bool empty() const { return containers_.empty(); }
+
+  uint64 Cardinality() const;
+
+  // Returns the number of values that are smaller or equal to x.
+  uint64 Rank(uint32 x) const;
+
+  // Sets res to the i-th smallest value (zero based). Returns false if i >= Cardinality().
+  bool Select(uint64 i, uint32* res) const;
+
+  RoaringBitmap& operator&=(const RoaringBitmap& o);
+  RoaringBitmap& operator|=(const RoaringBitmap& o);
+
+  // Removes all the values that are in o.
+  RoaringBitmap& AndNot(const RoaringBitmap& o);
+
+  bool operator==(const RoaringBitmap& o) const;
+  bool operator!=(const RoaringBitmap& o) const { return !(*this == o); }
+
+  // Calls cb for each value in increasing order.
+  template<typename Cb> void ForEach(Cb cb) const;
+
+  // Returns values in increasing order.
+  std::vector<uint32> ToVector() const;
+
+  uint32 ByteSize() const;
+  base::Status SerializeTo(Sink* sink) const;
+
+  // Reads a bitmap that was serialized by SerializeTo. Fills consumed, if not null,
+  // with the number of bytes read from slice.
+  base::Status Parse(strings::Slice slice, uint32* consumed = nullptr);
+
+  // Forward iterator over the values.
+  class Iterator;
+  Iterator begin() const;
+
+  // Memory used by the containers.
+  size_t MemoryUsage() const;
+private:
+  static constexpr uint32 kMaxArraySize = 4096;
+  static constexpr uint32 kBitmapWords = (1 << 16) / 64;
+  enum ContainerType : uint8 {ARRAY = 0, BITMAP = 1, RUN = 2};
+
+  struct Container {
+    uint16 key = 0;
+    uint32 card = 0;
+    std::vector<uint16> array;  // Sorted values if bitmap is empty.
+    std::vector<uint64> bitmap;  // kBitmapWords words if this is a bitmap container.
+
+    bool is_bitmap() const { return !bitmap.empty(); }
+    bool Contains(uint16 v) const;
+    bool Add(uint16 v);
+    bool Remove(uint16 v);
+    uint32 Rank(uint16 v) const;
+    uint16 Select(uint32 i) const;
+
+    void ToBitmap();
+
+    // Converts to array if the cardinality is small enough.
+    void Shrink();
+
+    uint32 CountRuns() const;
+    uint32 SerializedSize() const;
+    void Serialize(std::vector<uint8>* dest) const;
+  };
+
+  // Returns index of the container with key or the position where it should be inserted.
+  size_t LowerBound(uint16 key) const;
+  Container* Find(uint16 key);
+  const Container* Find(uint16 key) const;
+
+  static void And(const Container& a, const Container& b, Container* dest);
+  static void Or(const Container& a, const Container& b, Container* dest);
+  static void AndNot(const Container& a, const Container& b, Container* dest);
+
+  std::vector<Container> containers_;
+};
+
+class RoaringBitmap::Iterator {
+  const RoaringBitmap* bm_ = nullptr;
+  size_t cont_ = 0;
+  uint32 pos_ = 0;  // position inside the array or the bitmap word index.
+  uint64 word_ = 0;
+  uint32 val_ = 0;
+
+  void Load();
+  void Advance();
+public:
+  Iterator() {}
+  explicit Iterator(const RoaringBitmap& bm);
+
+  bool Done() const { return bm_ == nullptr || cont_ >= bm_->containers_.size(); }
+
+  // Requires: !Done().
+  uint32 operator*() const { return val_; }
+  Iterator& operator++() {
+    Advance();
+    return *this;
+  }
+};
+
+inline RoaringBitmap::Iterator RoaringBitmap::begin() const { return Iterator(*this); }
+
+template<typename Cb> void RoaringBitmap::ForEach(Cb cb) const {
+  for (const Container& c : containers_) {
+    uint32 base = uint32(c.key) << 16;
+    if (c.is_bitmap()) {
+      for (uint32 i = 0; i < kBitmapWords; ++i) {
+        uint64 w = c.bitmap[i];
+        while (w) {
+          cb(base + i * 64 + Bits::FindLSBSetNonZero64(w));
+          w &= (w - 1);
+        }
+      }
+    } else {
+      for (uint16 v : c.array)
+        cb(base + v);
+    }
+  }
+}
+
+}  // namespace coding
+}  // namespace util
+
+#endif  // _UTIL_CODING_ROARING_BITMAP_H
@@ -0,0 +1,207 @@
+// Copyright 2013, Beeri 15.  All rights reserved.
+// Author: Roman Gershman (romange@gmail.com)
+//
+#include "util/coding/roaring_bitmap.h"
+
+#include <random>
+#include <set>
+#include "base/gtest.h"
+#include "util/sinksource.h"
+
+namespace util {
+namespace coding {
+
+using std::set;
+using std::vector;
+
+class RoaringBitmapTest : public testing::Test {
+protected:
+  static RoaringBitmap FromSet(const set<uint32>& s) {
+    RoaringBitmap res;
+    for (uint32 v : s)
+      res.Add(v);
+    return res;
+  }
+
+  static vector<uint32> ToVector(const set<uint32>& s) {
+    return vector<uint32>(s.begin(), s.end());
+  }
+
+  // Sparse values spread over several containers, dense ranges and a full chunk.
+  static set<uint32> RandomSet(unsigned seed) {
+    std::mt19937 rand(seed);
+    set<uint32> res;
+    for (unsigned i = 0; i < 3000; ++i)
+      res.insert(rand() % (1 << 20));
+    for (unsigned i = 0; i < 10000; ++i)
+      res.insert((3 << 16) + rand() % (1 << 16));
+    uint32 start = (5 << 16) + seed * 1000;
+    for (uint32 v = start; v < start + 70000; ++v)
+      res.insert(v);
+    return res;
+  }
+};
+
+TEST_F(RoaringBitmapTest, Basic) {
+  RoaringBitmap bm;
+  EXPECT_TRUE(bm.empty());
+  EXPECT_FALSE(bm.Contains(5));
+  bm.Add(5);
+  bm.Add(1 << 20);
+  bm.Add(5);
+  bm.Add(kuint32max);
+  EXPECT_EQ(3, bm.Cardinality());
+  EXPECT_TRUE(bm.Contains(5));
+  EXPECT_TRUE(bm.Contains(1 << 20));
+  EXPECT_TRUE(bm.Contains(kuint32max));
+  EXPECT_FALSE(bm.Contains(6));
+  EXPECT_EQ(vector<uint32>({5, 1 << 20, kuint32max}), bm.ToVector());
+
+  bm.Remove(1 << 20);
+  bm.Remove(7);
+  EXPECT_EQ(2, bm.Cardinality());
+  EXPECT_FALSE(bm.Contains(1 << 20));
+}
+
+TEST_F(RoaringBitmapTest, ArrayToBitmap) {
+  RoaringBitmap bm;
+  for (uint32 i = 0; i < 10000; ++i)
+    bm.Add(i * 3);
+  EXPECT_EQ(10000, bm.Cardinality());
+  for (uint32 i = 0; i < 30000; ++i) {
+    ASSERT_EQ(i % 3 == 0, bm.Contains(i)) << i;
+  }
+  for (uint32 i = 0; i < 9000; ++i)
+    bm.Remove(i * 3);
+  EXPECT_EQ(1000, bm.Cardinality());
+  EXPECT_TRUE(bm.Contains(27000));
+  EXPECT_FALSE(bm.Contains(26997));
+}
+
+TEST_F(RoaringBitmapTest, RankSelect) {
+  set<uint32> s = RandomSet(1);
+  RoaringBitmap bm = FromSet(s);
+  ASSERT_EQ(s.size(), bm.Cardinality());
+
+  uint64 index = 0;
+  uint32 val = 0;
+  for (uint32 v : s) {
+    ASSERT_TRUE(bm.Select(index, &val));
+    ASSERT_EQ(v, val) << index;
+    ASSERT_EQ(index + 1, bm.Rank(v)) << v;
+    ++index;
+  }
+  EXPECT_FALSE(bm.Select(index, &val));
+  EXPECT_EQ(0, bm.Rank(*s.begin() - 1));
+  EXPECT_EQ(s.size(), bm.Rank(kuint32max));
+}
+
+TEST_F(RoaringBitmapTest, SetOps) {
+  set<uint32> a = RandomSet(1), b = RandomSet(2);
+  RoaringBitmap ra = FromSet(a), rb = FromSet(b);
+
+  set<uint32> expected;
+  std::set_intersection(a.begin(), a.end(), b.begin(), b.end(),
+                        std::inserter(expected, expected.end()));
+  RoaringBitmap tmp = ra;
+  tmp &= rb;
+  EXPECT_EQ(ToVector(expected), tmp.ToVector());
+  EXPECT_EQ(expected.size(), tmp.Cardinality());
+
+  expected.clear();
+  std::set_union(a.begin(), a.end(), b.begin(), b.end(),
+                 std::inserter(expected, expected.end()));
+  tmp = ra;
+  tmp |= rb;
+  EXPECT_EQ(ToVector(expected), tmp.ToVector());
+  EXPECT_EQ(expected.size(), tmp.Cardinality());
+
+  expected.clear();
+  std::set_difference(a.begin(), a.end(), b.begin(), b.end(),
+                      std::inserter(expected, expected.end()));
+  tmp = ra;
+  tmp.AndNot(rb);
+  EXPECT_EQ(ToVector(expected), tmp.ToVector());
+  EXPECT_EQ(expected.size(), tmp.Cardinality());
+
+  tmp = ra;
+  tmp.AndNot(ra);
+  EXPECT_TRUE(tmp.empty());
+}
+
+TEST_F(RoaringBitmapTest, Iterator) {
+  set<uint32> s = RandomSet(3);
+  RoaringBitmap bm = FromSet(s);
+  vector<uint32> actual;
+  for (auto it = bm.begin(); !it.Done(); ++it)
+    actual.push_back(*it);
+  EXPECT_EQ(ToVector(s), actual);
+  EXPECT_TRUE(RoaringBitmap().begin().Done());
+}
+
+TEST_F(RoaringBitmapTest, Serialize) {
+  for (unsigned seed = 0; seed < 3; ++seed) {
+    RoaringBitmap bm = FromSet(RandomSet(seed));
+    util::StringSink sink;
+    ASSERT_TRUE(bm.SerializeTo(&sink).ok());
+    ASSERT_EQ(bm.ByteSize(), sink.contents().size());
+
+    RoaringBitmap parsed;
+    uint32 consumed = 0;
+    ASSERT_TRUE(parsed.Parse(sink.contents(), &consumed).ok());
+    EXPECT_EQ(sink.contents().size(), consumed);
+    EXPECT_TRUE(bm == parsed);
+  }
+  util::StringSink sink;
+  RoaringBitmap empty, parsed;
+  ASSERT_TRUE(empty.SerializeTo(&sink).ok());
+  ASSERT_TRUE(parsed.Parse(sink.contents()).ok());
+  EXPECT_TRUE(parsed.empty());
+  EXPECT_FALSE(parsed.Parse(strings::Slice()).ok());
+}
+
+TEST_F(RoaringBitmapTest, Runs) {
+  RoaringBitmap bm;
+  bm.AddRange(0, 100000);
+  bm.AddRange(200000, 200010);
+  EXPECT_EQ(100010, bm.Cardinality());
+  EXPECT_TRUE(bm.Contains(99999));
+  EXPECT_FALSE(bm.Contains(100000));
+
+  // Overlapping ranges keep the container kind determined by the cardinality.
+  RoaringBitmap overlap, single;
+  overlap.AddRange(0, 4000);
+  overlap.AddRange(100, 4050);
+  single.AddRange(0, 4050);
+  EXPECT_EQ(4050, overlap.Cardinality());
+  EXPECT_TRUE(overlap == single);
+  single.Remove(4049);
+  overlap.Remove(4049);
+  EXPECT_TRUE(overlap == single);
+
+  // Dense runs are serialized compactly.
+  EXPECT_LT(bm.ByteSize(), 30);
+  util::StringSink sink;
+  ASSERT_TRUE(bm.SerializeTo(&sink).ok());
+  RoaringBitmap parsed;
+  ASSERT_TRUE(parsed.Parse(sink.contents()).ok());
+  EXPECT_TRUE(bm == parsed);
+}
+
+static void BM_And(benchmark::State& state) {
+  std::mt19937 rand(10);
+  RoaringBitmap a, b;
+  for (int i = 0; i < state.range_x(); ++i) {
+    a.Add(rand() % (1 << 20));
+    b.Add(rand() % (1 << 20));
+  }
+  while (state.KeepRunning()) {
+    RoaringBitmap tmp = a;
+    tmp &= b;
+    CHECK(!tmp.empty());
+  }
+}
+BENCHMARK(BM_And)->Arg(1 << 12)->Arg(1 << 18);
+
+}  // namespace coding
+}  // namespace util
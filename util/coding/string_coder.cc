@@ -4,6 +4,7 @@
 #include "util/coding/string_coder.h"
 
 #include <zlib.h>
+#include <cstring>
 #include "base/bits.h"
 #include "strings/strcat.h"
 #include "util/sinksource.h"
@@ -30,6 +31,37 @@ inline Status ParseError(string str) {
   return Status(base::StatusCode::IO_ERROR, std::move(str));
 }
 
+// Compresses src into dest using zlib format, block by block. Returns false on error.
+bool Deflate(const ChainSink& src, ChainSink* dest) {
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  if (deflateInit(&stream, Z_DEFAULT_COMPRESSION) != Z_OK)
+    return false;
+  std::vector<strings::Slice> blocks = src.Blocks();
+  int res = Z_OK;
+  for (size_t i = 0; i <= blocks.size() && res == Z_OK; ++i) {
+    int flush = Z_FINISH;
+    if (i < blocks.size()) {
+      stream.next_in = const_cast<uint8*>(blocks[i].ubuf());
+      stream.avail_in = blocks[i].size();
+      flush = Z_NO_FLUSH;
+    }
+    do {
+      Sink::WritableBuffer buf = dest->GetAppendBuffer(64, Sink::WritableBuffer(), 4096);
+      stream.next_out = buf.ptr;
+      stream.avail_out = buf.capacity;
+      res = deflate(&stream, flush);
+      dest->Append(buf.Prefix(buf.capacity - stream.avail_out));
+      if (res == Z_BUF_ERROR && flush == Z_NO_FLUSH) {  // No progress is possible, not an error.
+        res = Z_OK;
+        break;
+      }
+    } while (res == Z_OK && (stream.avail_in > 0 || stream.avail_out == 0 || flush == Z_FINISH));
+  }
+  deflateEnd(&stream);
+  return res == Z_STREAM_END;
+}
+
 inline uint32 LoadBigEndian(const uint8* src, uint8 bc) {
   uint32 r = *src++;
   for (uint8 i = 0; i < bc; ++i) {
@@ -47,7 +79,7 @@ StringEncoder::StringEncoder() {
 
 void StringEncoder::Add(strings::Slice slice) {
   // VecSlice item(buf_.size(), slice.size());
-  buf_.insert(buf_.end(), slice.begin(), slice.end());
+  buf_.Append(slice);
   /*auto res = unique_strings_.insert(item);
   if (!res.second) {
     buf_.resize(item.first);
@@ -59,31 +91,27 @@ void StringEncoder::Add(strings::Slice slice) {
 }
 
 uint32 StringEncoder::ByteSize() const {
-  return buf_.size() + buf2_.size() + header_sz_;
+  return buf_.size() + lengths_enc_.ByteSize() + header_sz_;
 }
 
 void StringEncoder::Finalize() {
-  UInt32Encoder coder;
-  coder.Encode(lengths_, true);
-  coder.Swap(&buf2_);
+  lengths_enc_.Encode(lengths_, true);
+  std::vector<uint32>().swap(lengths_);
   {
-    uint8 bc = NumFixedBytes(buf2_.size());
+    uint8 bc = NumFixedBytes(lengths_enc_.ByteSize());
     header_sz_ = bc + 2;
     header_ = RAW | (bc << 6);
   }
   if (buf_.size() > 63) {
-    uLongf buf_size = compressBound(buf_.size());
-    std::vector<uint8> compressed_buf(buf_size, 0);
-    int res = compress(&compressed_buf.front(), &buf_size, buf_.data(), buf_.size());
-    if (res != Z_OK) {
+    ChainSink compressed(4096, 1 << 16);
+    if (!Deflate(buf_, &compressed)) {
       LOG(ERROR) << "Compression error";
-    } else if (buf_size + (buf_.size() / 6) <= buf_.size()) {
-      VLOG(1) << "Compressing from " << buf_.size() << " to " << buf_size;
+    } else if (compressed.size() + (buf_.size() / 6) <= buf_.size()) {
+      VLOG(1) << "Compressing from " << buf_.size() << " to " << compressed.size();
       uncompr_sz_ = buf_.size();
       uint8 ubc = NumFixedBytes(uncompr_sz_);
       header_sz_ += (ubc + 1);
-      compressed_buf.resize(buf_size);
-      compressed_buf.swap(buf_);
+      buf_.Swap(&compressed);
       header_ |= COMPRESSED | (ZLIB_TYPE << 2) | (ubc << 4);
     }
   }
@@ -98,25 +126,24 @@ base::Status StringEncoder::SerializeTo(Sink* sink) const {
   uint8 tmp_buf[header_sz_ + 4]; // 4 bytes padding in case of bugs :)
   uint8* next = tmp_buf;
   *next++ = header_;
-  VLOG(1) << "Storing " << count_ << " strings " << " with " << buf2_.size()
+  VLOG(1) << "Storing " << count_ << " strings " << " with " << lengths_enc_.ByteSize()
           << " bytes for lengths and bufsize: " << buf_.size();
   if (uncompr_sz_) {
     next = StoreBigEndian(uncompr_sz_, (header_ >> 4) & 3, next);
   }
-  next = StoreBigEndian(buf2_.size(), header_ >> 6, next);
+  next = StoreBigEndian(lengths_enc_.ByteSize(), header_ >> 6, next);
   CHECK_EQ(header_sz_, next - tmp_buf);
   strings::Slice part(tmp_buf, header_sz_);
   RETURN_IF_ERROR(sink->Append(part));
-  part.set(buf2_.data(), buf2_.size());
-  RETURN_IF_ERROR(sink->Append(part));
+  RETURN_IF_ERROR(lengths_enc_.SerializeTo(sink));
 
-  return sink->Append(strings::Slice(buf_.data(), buf_.size()));
+  return buf_.WriteTo(sink);
 }
 
 Status StringDecoder::Init(strings::Slice slice) {
   uint32 total_sz = 0, lenc_sz;
   uint32 tmp;
-  const uint8* next = slice.begin(), *dstart;
+  const uint8* next = slice.ubuf(), *dstart;
   uint8 header, enc_type;
 
   if (slice.size() < 2) goto err;
@@ -132,7 +159,7 @@ Status StringDecoder::Init(strings::Slice slice) {
   }
   {
     uint8 bc = (header >> 6) & 3;
-    if (next + bc > slice.end()) goto err;
+    if (next + bc > slice.uend()) goto err;
     lenc_sz = LoadBigEndian(next, bc);
     next += (bc + 1);
   }
@@ -145,18 +172,18 @@ Status StringDecoder::Init(strings::Slice slice) {
   }
   VLOG(1) << "Loading " << count_ << " strings";
   dstart = next + lenc_sz;
-  if (count_ == 0 || dstart > slice.end())
+  if (count_ == 0 || dstart > slice.uend())
     goto err;
   if (enc_type == StringEncoder::COMPRESSED) {
     uLongf sz = inflated_buf_.size();
-    VLOG(1) << "Decompressing into " << sz << " bytes from " << slice.end() - dstart << " bytes";
-    int res = uncompress(&inflated_buf_.front(), &sz, dstart, slice.end() - dstart);
+    VLOG(1) << "Decompressing into " << sz << " bytes from " << slice.uend() - dstart << " bytes";
+    int res = uncompress(&inflated_buf_.front(), &sz, dstart, slice.uend() - dstart);
     if (res != Z_OK) return ParseError(StrCat("zlib error: ", zError(res)));
     if (sz != inflated_buf_.size())
       return ParseError("Inconsistent inflated size");
-    raw_.set(inflated_buf_.data(), sz);
+    raw_ = strings::Slice(inflated_buf_.data(), sz);
   } else {
-    raw_.set(dstart, slice.end());
+    raw_ = strings::Slice(dstart, slice.uend() - dstart);
   }
 
   if (total_sz != raw_.size())
@@ -48,8 +48,8 @@ namespace coding {
 */
 class StringEncoder {
   // typedef std::pair<uint32, uint32> VecSlice;  // offset, length pair.
-  std::vector<uint8> buf_;             // continous char buffer.
-  std::vector<uint8> buf2_;
+  ChainSink buf_;             // string bytes, compressed after Finalize if it pays off.
+  UInt32Encoder lengths_enc_;
   uint32 uncompr_sz_ = 0;
   uint8 header_ = 0;
   uint8 header_sz_ = 5;
@@ -107,13 +107,6 @@ public:
   uint32 size() const { return count_; }
 
   bool Next(strings::Slice* st);
-
-  bool Next(StringPiece* st) {
-    strings::Slice sl;
-    if (!Next(&sl)) return false;
-    st->set(sl.charptr(), sl.size());
-    return true;
-  }
 };
 
 }  // namespace coding
@@ -3,14 +3,18 @@
 //
 #include "util/executor.h"
 
+#include <algorithm>
 #include <atomic>
+#include <deque>
 #include <event2/event.h>
 #include <event2/thread.h>
 #include <pthread.h>
 #include <signal.h>
+#include <vector>
 
+#include "base/event_count.h"
 #include "base/logging.h"
-#include "base/sync_queue.h"
+#include "base/mutex.h"
 #include "util/proc_stats.h"
 
 #define PTHREAD_CALL(x) \
@@ -19,8 +23,6 @@
     CHECK_EQ(0, my_err) << strerror(my_err); \
   } while(false)
 
-static constexpr int kThreadStackSize = 65536;
-
 namespace util {
 
 static pthread_once_t eventlib_init_once = PTHREAD_ONCE_INIT;
@@ -30,6 +32,14 @@ static void InitExecutorModule() {
   CHECK_EQ(0, evthread_use_pthreads());
 }
 
+static void PinThread(pthread_t thread, const std::vector<unsigned>& cpu_ids) {
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  for (unsigned id : cpu_ids)
+    CPU_SET(id, &cpus);
+  PTHREAD_CALL(setaffinity_np(thread, sizeof(cpus), &cpus));
+}
+
 static void ExecutorSigHandler(int sig, siginfo_t *info, void *secret) {
   LOG(INFO) << "Catched signal " << sig << ": " << strsignal(sig);
   if (signal_executor_instance) {
@@ -37,15 +47,176 @@ static void ExecutorSigHandler(int sig, siginfo_t *info, void *secret) {
   }
 }
 
+namespace {
+
+typedef std::function<void()> Task;
+
+/*
+  Work stealing deque from "Dynamic Circular Work-Stealing Deque" by Chase and Lev,
+  with the memory orderings from "Correct and Efficient Work-Stealing for Weak Memory Models"
+  by Le et al. The owner thread pushes and pops at the bottom, other threads steal from the top.
+  Arrays that were replaced when growing are kept until the deque is destroyed because
+  stealers may still read from them.
+*/
+class TaskDeque {
+  struct Array {
+    explicit Array(int64 capacity) : mask(capacity - 1),
+        slots(new std::atomic<Task*>[capacity]) {}
+
+    int64 capacity() const { return mask + 1; }
+    Task* Get(int64 i) const { return slots[i & mask].load(std::memory_order_relaxed); }
+    void Put(int64 i, Task* t) { slots[i & mask].store(t, std::memory_order_relaxed); }
+
+    int64 mask;
+    std::unique_ptr<std::atomic<Task*>[]> slots;
+  };
+
+  std::atomic<int64> top_, bottom_;
+  std::atomic<Array*> array_;
+  std::vector<std::unique_ptr<Array>> arrays_;  // owns all the arrays, accessed by owner only.
+
+  Array* Grow(Array* a, int64 bottom, int64 top) {
+    Array* res = new Array(a->capacity() * 2);
+    for (int64 i = top; i < bottom; ++i)
+      res->Put(i, a->Get(i));
+    arrays_.emplace_back(res);
+    array_.store(res, std::memory_order_release);
+    return res;
+  }
+public:
+  TaskDeque() : top_(0), bottom_(0) {
+    arrays_.emplace_back(new Array(64));
+    array_.store(arrays_.back().get(), std::memory_order_relaxed);
+  }
+
+  ~TaskDeque() {
+    Array* a = array_.load(std::memory_order_relaxed);
+    for (int64 i = top_.load(std::memory_order_relaxed); i < bottom_.load(); ++i)
+      delete a->Get(i);
+  }
+
+  // Owner only.
+  void Push(Task* t) {
+    int64 b = bottom_.load(std::memory_order_relaxed);
+    int64 top = top_.load(std::memory_order_acquire);
+    Array* a = array_.load(std::memory_order_relaxed);
+    if (b - top > a->mask)
+      a = Grow(a, b, top);
+    a->Put(b, t);
+    bottom_.store(b + 1, std::memory_order_release);
+  }
+
+  // Owner only. Returns the most recently pushed task or null if the deque is empty.
+  Task* Pop() {
+    int64 b = bottom_.load(std::memory_order_relaxed) - 1;
+    Array* a = array_.load(std::memory_order_relaxed);
+    bottom_.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64 top = top_.load(std::memory_order_relaxed);
+    if (top > b) {
+      bottom_.store(b + 1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    Task* res = a->Get(b);
+    if (top == b) {
+      // The last task, race with the stealers.
+      if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                                        std::memory_order_relaxed)) {
+        res = nullptr;
+      }
+      bottom_.store(b + 1, std::memory_order_relaxed);
+    }
+    return res;
+  }
+
+  // Any thread. Returns the oldest task or null if the deque is empty or the race was lost.
+  Task* Steal() {
+    int64 top = top_.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64 b = bottom_.load(std::memory_order_acquire);
+    if (top >= b)
+      return nullptr;
+    Array* a = array_.load(std::memory_order_acquire);
+    Task* res = a->Get(top);
+    if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                                      std::memory_order_relaxed)) {
+      return nullptr;
+    }
+    return res;
+  }
+
+  bool empty() const {
+    return bottom_.load(std::memory_order_seq_cst) <= top_.load(std::memory_order_seq_cst);
+  }
+};
+
+}  // namespace
+
+/*
+  The thread pool is a work stealing scheduler. Each pool thread owns a deque of tasks.
+  Tasks added from a pool thread go to its own deque, tasks added from other threads go to
+  an injection queue. A thread without work takes tasks from the injection queue and
+  then steals from the other threads starting from a random victim. When no work is found,
+  the thread parks on an EventCount and is woken by the next Add.
+
+  In numa aware mode every node has its own injection queue and a thread looks for work on
+  its own node first: its injection queue, then its workers. Only then it turns to the other
+  nodes.
+*/
 class Executor::Rep {
-  event_base* base_ = nullptr;
+  struct Worker {
+    Rep* owner = nullptr;
+    unsigned node = 0;  // index into queues_.
+    TaskDeque deque;
+    uint32 rand_state;
+    pthread_t thread;
+
+    uint32 NextRand() {
+      // xorshift32.
+      rand_state ^= rand_state << 13;
+      rand_state ^= rand_state >> 17;
+      rand_state ^= rand_state << 5;
+      return rand_state;
+    }
+  };
+
+  // The worker that runs on the current thread, if any.
+  static __thread Worker* current_worker_;
+
+  struct EventLoop {
+    Rep* owner;
+    event_base* base;
+    pthread_t thread;
+  };
+
+  std::vector<std::unique_ptr<EventLoop>> loops_;
+  std::atomic<uint32> next_loop_;
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+
+  // Tasks added from non-pool threads.
+  struct TaskQueue {
+    base::Mutex mu;
+    std::deque<Task*> tasks;
+    std::atomic<size_t> size{0};
+    std::vector<unsigned> cpus;  // cpus of the node.
+  };
+
+  // One queue per numa node or a single one.
+  std::vector<std::unique_ptr<TaskQueue>> queues_;
+
+  // Maps system numa node to the index of its queue, -1 if the executor does not use the node.
+  std::vector<int> node_queue_;
+  std::atomic<uint32> next_queue_;
+
+  Executor::Options opts_;
+
+  // Parked workers wait on it.
+  base::EventCount parked_;
 
-  base::sync_queue<std::function<void()>> tasks_queue_;
-  std::vector<pthread_t> pool_threads_;
-  pthread_t event_loop_thread_;
   pthread_cond_t shut_down_cond_ = PTHREAD_COND_INITIALIZER;
   pthread_mutex_t mutex_ = PTHREAD_MUTEX_INITIALIZER;
-  bool shut_down_;
+  uint32 loops_finished_count_;  // number of event loops that exited.
 
   std::atomic_bool start_cancel_;  // signals worker threads that they should stop running.
   uint32 poolthreads_finished_count_;  // number of worker threads that finished their run.
@@ -55,50 +226,136 @@ class Executor::Rep {
 
   static void* RunEventBase(void* me);
   static void* RunPoolThread(void* me);
+
+  Task* PopInjected(unsigned queue);
+
+  // Steals from the workers of w's node if local is true and from the rest otherwise.
+  Task* Steal(Worker* w, bool local);
+  Task* FindTask(Worker* w);
+  bool HasWork() const;
+  void Park();
+
+  void WakeOne() { parked_.Notify(); }
 public:
-  Rep() {
-    shut_down_ = false;
+  explicit Rep(const Executor::Options& opts) : next_loop_(0), next_queue_(0), opts_(opts) {
+    unsigned num_loops = opts.num_event_loops;
+    CHECK_GT(num_loops, 0);
+    CHECK(!opts.cpus.empty());
+    loops_finished_count_ = 0;
     start_cancel_ = false;
     poolthreads_finished_count_ = 0;
 
-    base_ = CHECK_NOTNULL(event_base_new());
+    const CpuTopology& topology = sys::Topology();
+    if (opts.numa_aware) {
+      node_queue_.assign(topology.num_nodes(), -1);
+      for (unsigned cpu : opts.cpus) {
+        unsigned node = topology.NodeOf(cpu);
+        if (node_queue_[node] < 0) {
+          node_queue_[node] = queues_.size();
+          queues_.emplace_back(new TaskQueue);
+        }
+        queues_[node_queue_[node]]->cpus.push_back(cpu);
+      }
+    } else {
+      queues_.emplace_back(new TaskQueue);
+      queues_.back()->cpus = opts.cpus;
+    }
+
+    for (unsigned i = 0; i < num_loops; ++i) {
+      EventLoop* loop = new EventLoop;
+      loop->owner = this;
+      loop->base = CHECK_NOTNULL(event_base_new());
+      loops_.emplace_back(loop);
+    }
+
+    char buf[30] = {0};
     pthread_attr_t attrs;
     PTHREAD_CALL(attr_init(&attrs));
-    PTHREAD_CALL(attr_setstacksize(&attrs, kThreadStackSize));
-    PTHREAD_CALL(create(&event_loop_thread_, &attrs,  Executor::Rep::RunEventBase, this));
-    PTHREAD_CALL(setname_np(event_loop_thread_, "EventBaseThd"));
+    PTHREAD_CALL(attr_setstacksize(&attrs, opts.stack_size));
+    bool restricted = opts.cpus.size() < topology.cpus.size();
+    for (unsigned i = 0; i < num_loops; ++i) {
+      EventLoop* loop = loops_[i].get();
+      PTHREAD_CALL(create(&loop->thread, &attrs,  Executor::Rep::RunEventBase, loop));
+      if (num_loops == 1) {
+        strcpy(buf, "EventBaseThd");
+      } else {
+        sprintf(buf, "EventBaseThd_%d", i);
+      }
+      PTHREAD_CALL(setname_np(loop->thread, buf));
+      if (opts.pin_loops) {
+        PinThread(loop->thread, {opts.cpus[i % opts.cpus.size()]});
+      } else if (restricted) {
+        PinThread(loop->thread, opts.cpus);
+      }
+    }
     PTHREAD_CALL(attr_destroy(&attrs));
   }
 
   ~Rep() {
     StartCancel();
     WaitShutdown();
-    event_base_free(base_);
+    for (auto& loop : loops_)
+      event_base_free(loop->base);
+    for (auto& q : queues_) {
+      for (Task* t : q->tasks)
+        delete t;
+    }
+  }
+
+  unsigned num_loops() const { return loops_.size(); }
+  unsigned num_queues() const { return queues_.size(); }
+
+  event_base* base(unsigned index) {
+    DCHECK_LT(index, loops_.size());
+    return loops_[index]->base;
+  }
+
+  event_base* NextBase() {
+    uint32 index = next_loop_.fetch_add(1, std::memory_order_relaxed);
+    return loops_[index % loops_.size()]->base;
   }
 
-  event_base* base() { return base_; }
+  event_base* BaseForKey(uint64 key) {
+    // Mix the key so that sequential keys, like file descriptors, spread evenly.
+    key *= 0x9E3779B97F4A7C15ULL;
+    return loops_[(key >> 32) % loops_.size()]->base;
+  }
 
   void StartCancel() {
     start_cancel_ = true;
-    event_base_loopexit(base_, NULL); // signal to exit.
+    for (auto& loop : loops_)
+      event_base_loopexit(loop->base, NULL); // signal to exit.
+    parked_.NotifyAll();
   }
 
   bool was_cancelled() const { return start_cancel_; }
 
   void SetupThreadPool(unsigned num_threads) {
-    CHECK(pool_threads_.empty());
+    CHECK(workers_.empty());
     CHECK_GT(num_threads, 0);
-    pool_threads_.resize(num_threads);
+
+    // All the workers must exist before the threads start stealing from each other.
+    for (unsigned i = 0; i < num_threads; ++i) {
+      Worker* w = new Worker;
+      w->owner = this;
+      w->node = i % queues_.size();
+      w->rand_state = i * 2654435761U + 1;
+      workers_.emplace_back(w);
+    }
 
     char buf[30] = {0};
     pthread_attr_t attrs;
     PTHREAD_CALL(attr_init(&attrs));
-    PTHREAD_CALL(attr_setstacksize(&attrs, kThreadStackSize));
+    PTHREAD_CALL(attr_setstacksize(&attrs, opts_.stack_size));
+    bool pin = opts_.numa_aware || opts_.cpus.size() < sys::Topology().cpus.size();
 
     for (unsigned i = 0; i < num_threads; ++i) {
-      PTHREAD_CALL(create(&pool_threads_[i],  &attrs,  Executor::Rep::RunPoolThread, this));
+      Worker* w = workers_[i].get();
+      PTHREAD_CALL(create(&w->thread,  &attrs,  Executor::Rep::RunPoolThread, w));
       sprintf(buf, "ExecPool_%d", i);
-      PTHREAD_CALL(setname_np(pool_threads_[i], buf));
+      PTHREAD_CALL(setname_np(w->thread, buf));
+      if (pin)
+        PinThread(w->thread, queues_[w->node]->cpus);
     }
     PTHREAD_CALL(attr_destroy(&attrs));
   }
@@ -107,34 +364,128 @@ public:
     PTHREAD_CALL(mutex_lock(&mutex_));
     // We do not use pthread_join because it can not be used from multiple threads.
     // Here we allow the flexibility for several threads to wait for the loop to exit.
-    while (!shut_down_) {
+    while (loops_finished_count_ < loops_.size()) {
       PTHREAD_CALL(cond_wait(&shut_down_cond_, &mutex_));
     }
 
-    while (poolthreads_finished_count_ < pool_threads_.size()) {
+    while (poolthreads_finished_count_ < workers_.size()) {
       PTHREAD_CALL(cond_wait(&finished_pool_threads_, &mutex_));
     }
     PTHREAD_CALL(mutex_unlock(&mutex_));
   }
 
-  void Add(std::function<void()> f) {
+  bool Add(std::function<void()> f) {
     if (was_cancelled())
-      return;
-    tasks_queue_.push(f);
+      return false;
+    Task* t = new Task(std::move(f));
+    Worker* w = current_worker_;
+    if (w && w->owner == this) {
+      w->deque.Push(t);
+    } else {
+      TaskQueue* q = queues_[CallerQueue()].get();
+      base::MutexLock lock(&q->mu);
+      q->tasks.push_back(t);
+      q->size.fetch_add(1, std::memory_order_relaxed);
+    }
+    WakeOne();
+    return true;
+  }
+
+  // The queue of the caller's node. Callers outside of the executor nodes are spread evenly.
+  unsigned CallerQueue() {
+    if (queues_.size() == 1)
+      return 0;
+    unsigned node = sys::CurrentNode();
+    if (node < node_queue_.size() && node_queue_[node] >= 0)
+      return node_queue_[node];
+    return next_queue_.fetch_add(1, std::memory_order_relaxed) % queues_.size();
   }
 };
 
+__thread Executor::Rep::Worker* Executor::Rep::current_worker_ = nullptr;
+
+Task* Executor::Rep::PopInjected(unsigned queue) {
+  TaskQueue* q = queues_[queue].get();
+  if (q->size.load(std::memory_order_relaxed) == 0)
+    return nullptr;
+  base::MutexLock lock(&q->mu);
+  if (q->tasks.empty())
+    return nullptr;
+  Task* res = q->tasks.front();
+  q->tasks.pop_front();
+  q->size.fetch_sub(1, std::memory_order_relaxed);
+  return res;
+}
+
+Task* Executor::Rep::Steal(Worker* w, bool local) {
+  const size_t num = workers_.size();
+  size_t start = w->NextRand() % num;
+  for (size_t i = 0; i < num; ++i) {
+    Worker* victim = workers_[(start + i) % num].get();
+    if (victim == w || (victim->node == w->node) != local)
+      continue;
+    Task* t = victim->deque.Steal();
+    if (t)
+      return t;
+  }
+  return nullptr;
+}
+
+Task* Executor::Rep::FindTask(Worker* w) {
+  Task* t = w->deque.Pop();
+  if (t)
+    return t;
+  t = PopInjected(w->node);
+
+  // Steal may lose races to other stealers, so we try a few rounds.
+  for (unsigned i = 0; i < 3 && !t; ++i)
+    t = Steal(w, true);
+
+  if (!t && queues_.size() > 1) {
+    for (unsigned i = 1; i < queues_.size() && !t; ++i)
+      t = PopInjected((w->node + i) % queues_.size());
+    for (unsigned i = 0; i < 3 && !t; ++i)
+      t = Steal(w, false);
+  }
+  // We took a task that was not ours, there might be more for the parked workers.
+  if (t && HasWork())
+    WakeOne();
+  return t;
+}
+
+bool Executor::Rep::HasWork() const {
+  for (const auto& q : queues_) {
+    if (q->size.load(std::memory_order_seq_cst) > 0)
+      return true;
+  }
+  for (const auto& w : workers_) {
+    if (!w->deque.empty())
+      return true;
+  }
+  return false;
+}
+
+void Executor::Rep::Park() {
+  base::EventCount::Key key = parked_.PrepareWait();
+  if (HasWork() || start_cancel_) {
+    parked_.CancelWait();
+  } else {
+    parked_.Wait(key);
+  }
+}
+
 void* Executor::Rep::RunEventBase(void* arg) {
-  Executor::Rep* me = (Executor::Rep*)arg;
+  EventLoop* loop = (EventLoop*)arg;
+  Executor::Rep* me = loop->owner;
 
   int res;
-  while ((res = event_base_dispatch(me->base_)) == 1) {
+  while ((res = event_base_dispatch(loop->base)) == 1) {
     pthread_yield();
   }
 
   VLOG(1) << "Finished running event_base_dispatch with res: " << res;
   PTHREAD_CALL(mutex_lock(&me->mutex_));
-  me->shut_down_ = true;
+  ++me->loops_finished_count_;
   PTHREAD_CALL(cond_broadcast(&me->shut_down_cond_));
   PTHREAD_CALL(mutex_unlock(&me->mutex_));
 
@@ -142,15 +493,22 @@ void* Executor::Rep::RunEventBase(void* arg) {
 }
 
 void* Executor::Rep::RunPoolThread(void* arg) {
-  Executor::Rep* me = (Executor::Rep*)arg;
+  Worker* w = (Worker*)arg;
+  Executor::Rep* me = w->owner;
+  current_worker_ = w;
   while (!me->start_cancel_) {
-    std::function<void()> val;
-    bool res = me->tasks_queue_.pop(5, &val);
-    if (res) val();
+    Task* t = me->FindTask(w);
+    if (t) {
+      (*t)();
+      delete t;
+    } else {
+      me->Park();
+    }
   }
+  current_worker_ = nullptr;
   char buf[30] = {0};
   pthread_getname_np(pthread_self(), buf, sizeof buf);
-  VLOG(1) << "Finished running ThreadPool thread " << buf << " with " << me->tasks_queue_.size();
+  VLOG(1) << "Finished running ThreadPool thread " << buf;
   PTHREAD_CALL(mutex_lock(&me->mutex_));
   ++me->poolthreads_finished_count_;
   PTHREAD_CALL(cond_broadcast(&me->finished_pool_threads_));
@@ -160,18 +518,35 @@ void* Executor::Rep::RunPoolThread(void* arg) {
 }
 
 
-Executor::Executor(unsigned int num_threads) {
-  pthread_once(&eventlib_init_once, InitExecutorModule);
-  rep_.reset(new Rep());
+static Executor::Options MakeOptions(unsigned num_threads, unsigned num_event_loops,
+                                     bool pin_loops) {
+  Executor::Options opts;
+  opts.num_threads = num_threads;
+  opts.num_event_loops = num_event_loops;
+  opts.pin_loops = pin_loops;
+  return opts;
+}
+
+Executor::Executor(unsigned int num_threads) : Executor(num_threads, 1) {
+}
+
+Executor::Executor(unsigned int num_threads, unsigned int num_event_loops, bool pin_loops)
+    : Executor(MakeOptions(num_threads, num_event_loops, pin_loops)) {
+}
 
-  if (num_threads == 0) {
-    uint32 num_cpus = sys::NumCPUs();
-    if (num_cpus == 0)
-      num_threads = 2;
-    else
-      num_threads = num_cpus * 2;
+Executor::Executor(const Options& opts) {
+  pthread_once(&eventlib_init_once, InitExecutorModule);
+  Options o = opts;
+  if (o.cpus.empty()) {
+    for (const auto& cpu : sys::Topology().cpus)
+      o.cpus.push_back(cpu.id);
   }
-  rep_->SetupThreadPool(num_threads);
+  if (o.num_event_loops == 0)
+    o.num_event_loops = o.cpus.size();
+  if (o.num_threads == 0)
+    o.num_threads = o.cpus.size() * 2;
+  rep_.reset(new Rep(o));
+  rep_->SetupThreadPool(o.num_threads);
 }
 
 Executor::~Executor() {
@@ -179,12 +554,32 @@ Executor::~Executor() {
 }
 
 event_base* Executor::ebase() {
-  return rep_->base();
+  return rep_->base(0);
+}
+
+unsigned Executor::num_event_loops() const {
+  return rep_->num_loops();
+}
+
+event_base* Executor::ebase(unsigned index) {
+  return rep_->base(index);
+}
+
+event_base* Executor::NextEventBase() {
+  return rep_->NextBase();
+}
+
+event_base* Executor::EventBaseForKey(uint64 key) {
+  return rep_->BaseForKey(key);
+}
+
+unsigned Executor::num_task_queues() const {
+  return rep_->num_queues();
 }
 
 
-void Executor::Add(std::function<void()> f) {
-  rep_->Add(f);
+bool Executor::Add(std::function<void()> f) {
+  return rep_->Add(std::move(f));
 }
 
 void Executor::Shutdown() {
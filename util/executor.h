@@ -4,7 +4,11 @@
 #ifndef _EXECUTOR_H
 #define _EXECUTOR_H
 
+#include <functional>
 #include <memory>
+#include <vector>
+
+#include "base/integral_types.h"
 
 struct event_base;
 
@@ -15,14 +19,58 @@ class Executor {
   std::unique_ptr<Rep> rep_;
 
 public:
+  struct Options {
+    // 0 means 2 threads per cpu in cpus.
+    unsigned num_threads = 0;
+
+    // 0 means one event loop per cpu in cpus.
+    unsigned num_event_loops = 1;
+
+    // Cpus that the executor threads may run on. Empty means all the online cpus.
+    std::vector<unsigned> cpus;
+
+    // Pins event loop i to cpus[i % cpus.size()].
+    bool pin_loops = false;
+
+    // Spreads the pool threads evenly over the numa nodes of cpus and pins each one to the cpus
+    // of its node. Every node gets its own queue for tasks added from outside of the pool;
+    // a task goes to the queue of the node the caller runs on and the pool threads prefer
+    // the tasks and the victims of their own node.
+    bool numa_aware = false;
+
+    size_t stack_size = 65536;
+  };
+
+  explicit Executor(const Options& opts);
+
   // if num_threads is 0, then Executor will choose number of threads automatically
   // based on the number of cpus in the system.
   explicit Executor(unsigned int num_threads = 0);
+
+  // Thread-per-core mode: runs num_event_loops event loops, each one on its own thread.
+  // If num_event_loops is 0, a loop is created for each cpu. If pin_loops is true, loop i is
+  // pinned to cpu i modulo the number of cpus.
+  Executor(unsigned int num_threads, unsigned int num_event_loops, bool pin_loops = false);
   ~Executor();
 
+  // Returns the first event loop.
   event_base* ebase();
 
-  void Add(std::function<void()> f);
+  unsigned num_event_loops() const;
+  event_base* ebase(unsigned index);
+
+  // Picks the event loops in round-robin order.
+  event_base* NextEventBase();
+
+  // Maps key, for example a connection hash, to an event loop. The same key always maps to the
+  // same loop.
+  event_base* EventBaseForKey(uint64 key);
+
+  // Number of per-node task queues, 1 unless the executor is numa aware.
+  unsigned num_task_queues() const;
+
+  // Returns false if the executor was shut down, in which case f is not run.
+  bool Add(std::function<void()> f);
 
   // Async function that tells Executor to shut down all its worker threads and its event loop.
   void Shutdown();
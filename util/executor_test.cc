@@ -3,8 +3,13 @@
 //
 #include "util/executor.h"
 #include <atomic>
+#include <cstring>
+#include <event2/event.h>
+#include <sched.h>
+#include <set>
 #include <thread>
 #include <gtest/gtest.h>
+#include "util/proc_stats.h"
 
 namespace util {
 
@@ -29,6 +34,45 @@ TEST_F(ExecutorTest, Basic) {
   EXPECT_EQ(10, val);
 }
 
+// Tasks that spawn tasks go to the local deques of the pool threads and are stolen by others.
+TEST_F(ExecutorTest, Spawn) {
+  Executor executor(4);
+  std::atomic_long val(0);
+  std::function<void(int)> spawn = [&](int depth) {
+    val.fetch_add(1);
+    if (depth == 0)
+      return;
+    for (int i = 0; i < 3; ++i) {
+      executor.Add([&spawn, depth]() { spawn(depth - 1); });
+    }
+  };
+  executor.Add([&spawn]() { spawn(7); });
+
+  // 3^0 + 3^1 + ... + 3^7 tasks.
+  const long kExpected = (6561 - 1) / 2;
+  for (int i = 0; i < 1000 && val < kExpected; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  EXPECT_EQ(kExpected, val);
+  executor.Shutdown();
+  executor.WaitForLoopToExit();
+}
+
+// Parked threads are woken by Add, one task at a time.
+TEST_F(ExecutorTest, PingPong) {
+  Executor executor(2);
+  std::atomic_long val(0);
+  for (long i = 0; i < 200; ++i) {
+    executor.Add([&val]() { val.fetch_add(1); });
+    while (val <= i) {
+      std::this_thread::yield();
+    }
+  }
+  EXPECT_EQ(200, val);
+  executor.Shutdown();
+  executor.WaitForLoopToExit();
+}
+
 TEST_F(ExecutorTest, ManyExecutors) {
   for (int i = 0; i < 1300; ++i) {
     Executor* executor = new Executor;
@@ -37,4 +81,73 @@ TEST_F(ExecutorTest, ManyExecutors) {
   }
 }
 
-}  // namespace util
\ No newline at end of file
+static void IncCb(evutil_socket_t fd, short what, void* arg) {
+  reinterpret_cast<std::atomic_long*>(arg)->fetch_add(1);
+}
+
+TEST_F(ExecutorTest, MultiLoop) {
+  Executor executor(2, 4);
+  ASSERT_EQ(4, executor.num_event_loops());
+  EXPECT_EQ(executor.ebase(0), executor.ebase());
+
+  std::set<event_base*> bases;
+  for (unsigned i = 0; i < 4; ++i)
+    bases.insert(executor.NextEventBase());
+  EXPECT_EQ(4, bases.size());
+  EXPECT_EQ(executor.EventBaseForKey(17), executor.EventBaseForKey(17));
+
+  // Every loop runs its own events.
+  std::atomic_long val(0);
+  for (event_base* base : bases) {
+    struct timeval tv = {0, 1000};
+    ASSERT_EQ(0, event_base_once(base, -1, EV_TIMEOUT, IncCb, &val, &tv));
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_EQ(4, val);
+  executor.Shutdown();
+  executor.WaitForLoopToExit();
+}
+
+TEST_F(ExecutorTest, Options) {
+  const CpuTopology& topology = sys::Topology();
+  unsigned cpu = topology.cpus.back().id;
+
+  Executor::Options opts;
+  opts.num_threads = 3;
+  opts.num_event_loops = 0;
+  opts.cpus.push_back(cpu);
+  opts.pin_loops = true;
+  opts.numa_aware = true;
+  opts.stack_size = 1 << 20;
+  Executor executor(opts);
+  EXPECT_EQ(1, executor.num_event_loops());
+  EXPECT_EQ(1, executor.num_task_queues());
+
+  std::atomic_long val(0), wrong_cpu(0);
+  for (int i = 0; i < 100; ++i) {
+    executor.Add([&val, &wrong_cpu, cpu, i]() {
+      // Uses more than the default stack size.
+      char buf[200000];
+      memset(buf, i, sizeof buf);
+      if (unsigned(sched_getcpu()) != cpu)
+        wrong_cpu.fetch_add(1);
+      val.fetch_add(buf[i] == char(i));
+    });
+  }
+  for (int i = 0; i < 1000 && val < 100; ++i)
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  EXPECT_EQ(100, val);
+  EXPECT_EQ(0, wrong_cpu);
+
+  struct timeval tv = {0, 1000};
+  ASSERT_EQ(0, event_base_once(executor.ebase(), -1, EV_TIMEOUT, [](int, short, void* arg) {
+        if (unsigned(sched_getcpu()) != *(unsigned*)arg)
+          ++*(unsigned*)arg;
+      }, &cpu, &tv));
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  EXPECT_EQ(topology.cpus.back().id, cpu);
+  executor.Shutdown();
+  executor.WaitForLoopToExit();
+}
+
+}  // namespace util
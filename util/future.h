@@ -0,0 +1,353 @@
+// Copyright 2013, Beeri 15.  All rights reserved.
+// Author: Roman Gershman (romange@gmail.com)
+//
+#ifndef _UTIL_FUTURE_H
+#define _UTIL_FUTURE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "base/logging.h"
+#include "base/object_pool.h"
+#include "util/executor.h"
+
+namespace util {
+
+/*
+  Single shot futures for chaining asynchronous steps without nesting callbacks:
+
+    Async(executor, [] { return ReadKey(); })
+      .Then(executor, [channel](string key) { return LookupAsync(channel, key); })
+      .Then(executor, [](Response* resp) { return resp->value(); });
+
+  A continuation that returns a Future<U> produces a Future<U> that becomes ready together with
+  the inner future, so several asynchronous hops chain flatly. WhenAll joins fan-out results.
+  Continuations passed with an executor run on its pool threads, with a null executor they
+  run inline on the thread that provides the value. If the executor was shut down, they run
+  inline as well.
+  Functions that return void produce Future<Unit>.
+  The shared state of every future is allocated from a per-type ObjectPool.
+*/
+template<typename T> class Future;
+template<typename T> class Promise;
+
+// The value of futures of functions that return void.
+struct Unit {};
+
+namespace detail {
+
+template<typename T> class FutureState {
+public:
+  typedef std::function<void(T&&)> Continuation;
+
+  static FutureState* New() { return pool().New(); }
+
+  void AddRef() { refs_.fetch_add(1, std::memory_order_relaxed); }
+  void AddPromise() { promises_.fetch_add(1, std::memory_order_relaxed); }
+
+  void Unref() {
+    if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+      pool().Release(this);
+  }
+
+  void SetValue(T&& val) {
+    new (&storage_) T(std::move(val));
+    uint32 expected = EMPTY;
+    if (!state_.compare_exchange_strong(expected, HAS_VALUE, std::memory_order_acq_rel)) {
+      CHECK_EQ(HAS_CONTINUATION, expected) << "Value was already set";
+      Fire();
+    }
+  }
+
+  // Takes over the reference of the future.
+  void SetContinuation(Executor* executor, Continuation cont) {
+    executor_ = executor;
+    cont_ = std::move(cont);
+    uint32 expected = EMPTY;
+    if (state_.compare_exchange_strong(expected, HAS_CONTINUATION, std::memory_order_acq_rel))
+      return;
+    if (expected == ABANDONED) {
+      cont_ = nullptr;
+      Unref();
+    } else {
+      DCHECK_EQ(HAS_VALUE, expected);
+      Fire();
+    }
+  }
+
+  // Called when a promise handle is destroyed.
+  void ReleasePromise() {
+    if (promises_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      // No value will ever come, so the continuation is dropped together with the future's
+      // reference, now or when it is set.
+      uint32 st = state_.load(std::memory_order_acquire);
+      while (st == EMPTY || st == HAS_CONTINUATION) {
+        if (state_.compare_exchange_weak(st, ABANDONED, std::memory_order_acq_rel)) {
+          if (st == HAS_CONTINUATION) {
+            cont_ = nullptr;
+            Unref();
+          }
+          break;
+        }
+      }
+    }
+    Unref();
+  }
+
+  bool ready() const { return state_.load(std::memory_order_acquire) == HAS_VALUE; }
+
+private:
+  enum { EMPTY, HAS_VALUE, HAS_CONTINUATION, DONE, ABANDONED };
+
+  friend class base::ObjectPool<FutureState>;
+
+  FutureState() : refs_(1), promises_(0), state_(EMPTY) {}
+
+  ~FutureState() {
+    uint32 st = state_.load(std::memory_order_relaxed);
+    if (st == HAS_VALUE || st == DONE)
+      value()->~T();
+  }
+
+  T* value() { return reinterpret_cast<T*>(&storage_); }
+
+  // Holds the reference of the continuation, so a task that the executor drops at
+  // shutdown releases the state instead of leaking it.
+  class RunTask {
+  public:
+    explicit RunTask(FutureState* st) : st_(st) {}
+    RunTask(const RunTask& o) : st_(o.st_) { st_->AddRef(); }
+    RunTask(RunTask&& o) : st_(o.st_) { o.st_ = nullptr; }
+    ~RunTask() {
+      if (st_)
+        st_->Unref();
+    }
+
+    void operator()() { st_->Run(); }
+
+  private:
+    FutureState* st_;
+  };
+
+  void Fire() {
+    state_.store(DONE, std::memory_order_relaxed);
+    if (executor_) {
+      AddRef();
+      if (executor_->Add(RunTask(this))) {
+        Unref();
+        return;
+      }
+    }
+    Run();
+    Unref();
+  }
+
+  void Run() {
+    Continuation cont(std::move(cont_));
+    cont(std::move(*value()));
+  }
+
+  static base::ObjectPool<FutureState>& pool() {
+    static base::ObjectPool<FutureState> state_pool;
+    return state_pool;
+  }
+
+  std::atomic<uint32> refs_;
+  std::atomic<uint32> promises_;
+  std::atomic<uint32> state_;
+  Executor* executor_ = nullptr;
+  Continuation cont_;
+  typename std::aligned_storage<sizeof(T), alignof(T)>::type storage_;
+};
+
+template<typename T> struct UnwrapFuture {
+  typedef T type;
+};
+
+template<typename T> struct UnwrapFuture<Future<T>> {
+  typedef T type;
+};
+
+// Calls f and returns its result or Unit if f returns void.
+template<typename R> struct Invoke {
+  typedef R type;
+
+  template<typename F, typename... Args> static R Call(F& f, Args&&... args) {
+    return f(std::forward<Args>(args)...);
+  }
+};
+
+template<> struct Invoke<void> {
+  typedef Unit type;
+
+  template<typename F, typename... Args> static Unit Call(F& f, Args&&... args) {
+    f(std::forward<Args>(args)...);
+    return Unit();
+  }
+};
+
+}  // namespace detail
+
+// The producer side. Handles are copyable and all refer to the same state; the value must be
+// set exactly once. If all the handles are destroyed without a value, the continuation of
+// the future is dropped.
+template<typename T> class Promise {
+public:
+  Promise() : state_(detail::FutureState<T>::New()) { state_->AddPromise(); }
+
+  Promise(const Promise& o) : state_(o.state_) {
+    state_->AddRef();
+    state_->AddPromise();
+  }
+
+  Promise& operator=(const Promise&) = delete;
+
+  ~Promise() { state_->ReleasePromise(); }
+
+  // Can be called once per promise.
+  Future<T> GetFuture() {
+    CHECK(!future_taken_);
+    future_taken_ = true;
+    state_->AddRef();
+    return Future<T>(state_);
+  }
+
+  void SetValue(T val) const { state_->SetValue(std::move(val)); }
+
+private:
+  detail::FutureState<T>* state_;
+  bool future_taken_ = false;
+};
+
+// The consumer side. Move only, the value can be consumed once: either by a continuation or
+// by Get().
+template<typename T> class Future {
+public:
+  Future() : state_(nullptr) {}
+  Future(Future&& o) : state_(o.state_) { o.state_ = nullptr; }
+  Future& operator=(Future&& o) {
+    std::swap(state_, o.state_);
+    return *this;
+  }
+
+  ~Future() {
+    if (state_)
+      state_->Unref();
+  }
+
+  bool valid() const { return state_ != nullptr; }
+  bool ready() const { return state_->ready(); }
+
+  // Calls f(T) when the value is set. Consumes the future.
+  void OnReady(Executor* executor, std::function<void(T&&)> f) {
+    CHECK(state_);
+    detail::FutureState<T>* st = state_;
+    state_ = nullptr;
+    st->SetContinuation(executor, std::move(f));
+  }
+
+  // Calls f(T) when the value is set and returns the future of its result. If f returns
+  // Future<U>, the result is Future<U> as well, if it returns void the result is
+  // Future<Unit>. Consumes the future.
+  template<typename F> auto Then(Executor* executor, F f) -> Future<typename detail::UnwrapFuture<
+      typename detail::Invoke<decltype(f(std::declval<T>()))>::type>::type> {
+    typedef detail::Invoke<decltype(f(std::declval<T>()))> Invoke;
+    typedef typename detail::UnwrapFuture<typename Invoke::type>::type R;
+    Promise<R> promise;
+    Future<R> res = promise.GetFuture();
+    OnReady(executor, [promise, f](T&& val) mutable {
+        Fulfill(promise, Invoke::Call(f, std::move(val)));
+      });
+    return res;
+  }
+
+  // Blocks until the value is set. Blocks forever if the promise was abandoned.
+  // Consumes the future.
+  T Get() {
+    std::mutex mu;
+    std::condition_variable cv;
+    std::unique_ptr<T> res;
+    OnReady(nullptr, [&](T&& val) {
+        std::lock_guard<std::mutex> lock(mu);
+        res.reset(new T(std::move(val)));
+        cv.notify_one();
+      });
+    std::unique_lock<std::mutex> lock(mu);
+    cv.wait(lock, [&res] { return res != nullptr; });
+    return std::move(*res);
+  }
+
+private:
+  friend class Promise<T>;
+
+  explicit Future(detail::FutureState<T>* state) : state_(state) {}
+
+  template<typename U> static void Fulfill(Promise<U>& p, U&& val) {
+    p.SetValue(std::move(val));
+  }
+
+  template<typename U> static void Fulfill(Promise<U>& p, Future<U>&& inner) {
+    inner.OnReady(nullptr, [p](U&& val) { p.SetValue(std::move(val)); });
+  }
+
+  detail::FutureState<T>* state_;
+
+  Future(const Future&) = delete;
+  void operator=(const Future&) = delete;
+};
+
+template<typename T> Future<T> MakeReadyFuture(T val) {
+  Promise<T> promise;
+  promise.SetValue(std::move(val));
+  return promise.GetFuture();
+}
+
+// Runs f() on the executor's pool and returns the future of its result, Future<Unit> if f
+// returns void. If the executor was already shut down, f runs inline. If it shuts down
+// while f is queued, f is dropped and the future is never fulfilled.
+template<typename F> auto Async(Executor* executor, F f)
+    -> Future<typename detail::Invoke<decltype(f())>::type> {
+  typedef detail::Invoke<decltype(f())> Invoke;
+  typedef typename Invoke::type R;
+  Promise<R> promise;
+  Future<R> res = promise.GetFuture();
+  if (!executor->Add([promise, f]() mutable { promise.SetValue(Invoke::Call(f)); }))
+    promise.SetValue(Invoke::Call(f));
+  return res;
+}
+
+// Returns the future of all the values, in the order of the input futures.
+template<typename T> Future<std::vector<T>> WhenAll(std::vector<Future<T>> futures) {
+  struct Join {
+    explicit Join(size_t count) : pending(count) { values.resize(count); }
+
+    Promise<std::vector<T>> promise;
+    std::vector<T> values;
+    std::atomic<size_t> pending;
+  };
+
+  std::shared_ptr<Join> join = std::make_shared<Join>(futures.size());
+  Future<std::vector<T>> res = join->promise.GetFuture();
+  if (futures.empty()) {
+    join->promise.SetValue(std::vector<T>());
+    return res;
+  }
+  for (size_t i = 0; i < futures.size(); ++i) {
+    futures[i].OnReady(nullptr, [join, i](T&& val) {
+        join->values[i] = std::move(val);
+        if (join->pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+          join->promise.SetValue(std::move(join->values));
+      });
+  }
+  return res;
+}
+
+}  // namespace util
+
+#endif  // _UTIL_FUTURE_H
@@ -0,0 +1,123 @@
+// Copyright 2013, Beeri 15.  All rights reserved.
+// Author: Roman Gershman (romange@gmail.com)
+//
+#include "util/future.h"
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include "base/gtest.h"
+
+namespace util {
+
+class FutureTest : public testing::Test {
+protected:
+  FutureTest() : executor_(4) {}
+
+  ~FutureTest() {
+    executor_.Shutdown();
+    executor_.WaitForLoopToExit();
+  }
+
+  Executor executor_;
+};
+
+TEST_F(FutureTest, Basic) {
+  Promise<int> promise;
+  Future<int> future = promise.GetFuture();
+  EXPECT_FALSE(future.ready());
+  std::thread setter([promise] { promise.SetValue(5); });
+  EXPECT_EQ(5, future.Get());
+  setter.join();
+
+  Future<std::string> ready = MakeReadyFuture(std::string("foo"));
+  EXPECT_TRUE(ready.ready());
+  EXPECT_EQ("foo", ready.Get());
+}
+
+TEST_F(FutureTest, Then) {
+  // Inline continuation of a ready value.
+  int val = 0;
+  MakeReadyFuture(3).OnReady(nullptr, [&val](int&& v) { val = v; });
+  EXPECT_EQ(3, val);
+
+  Future<std::string> res = Async(&executor_, [] { return 20; })
+      .Then(&executor_, [](int v) { return v + 1; })
+      .Then(&executor_, [this](int v) {
+          // Asynchronous hop, the chain continues when the inner future is set.
+          return Async(&executor_, [v] { return v * 2; });
+        })
+      .Then(nullptr, [](int v) { return std::to_string(v); });
+  EXPECT_EQ("42", res.Get());
+}
+
+TEST_F(FutureTest, Void) {
+  std::atomic<int> val(0);
+  Future<Unit> done = Async(&executor_, [&val] { val = 5; })
+      .Then(&executor_, [&val](Unit) { val = val * 2; });
+  done.Get();
+  EXPECT_EQ(10, val.load());
+
+  Future<int> res = Async(&executor_, [] {}).Then(nullptr, [](Unit) { return 7; });
+  EXPECT_EQ(7, res.Get());
+}
+
+TEST_F(FutureTest, ShutdownExecutor) {
+  Executor executor(1);
+  executor.Shutdown();
+  executor.WaitForLoopToExit();
+  EXPECT_FALSE(executor.Add([] {}));
+
+  // Work for a shut down executor runs inline.
+  Future<int> res = Async(&executor, [] { return 3; })
+      .Then(&executor, [](int v) { return v + 1; });
+  EXPECT_TRUE(res.ready());
+  EXPECT_EQ(4, res.Get());
+}
+
+TEST_F(FutureTest, WhenAll) {
+  std::vector<Future<int>> futures;
+  for (int i = 0; i < 100; ++i)
+    futures.push_back(Async(&executor_, [i] { return i * i; }));
+  std::vector<int> res = WhenAll(std::move(futures)).Get();
+  ASSERT_EQ(100, res.size());
+  for (int i = 0; i < 100; ++i)
+    EXPECT_EQ(i * i, res[i]);
+
+  EXPECT_TRUE(WhenAll(std::vector<Future<int>>()).Get().empty());
+}
+
+TEST_F(FutureTest, Abandoned) {
+  std::shared_ptr<int> tracker = std::make_shared<int>(0);
+  {
+    Promise<int> promise;
+    promise.GetFuture().OnReady(nullptr, [tracker](int&&) { ++*tracker; });
+    EXPECT_EQ(2, tracker.use_count());
+  }
+  // The continuation was released without being called.
+  EXPECT_EQ(1, tracker.use_count());
+
+  Future<int> future;
+  {
+    Promise<int> promise;
+    future = promise.GetFuture();
+  }
+  future.OnReady(nullptr, [tracker](int&&) { ++*tracker; });
+  EXPECT_EQ(1, tracker.use_count());
+  EXPECT_EQ(0, *tracker);
+}
+
+static void BM_ThenChain(benchmark::State& state) {
+  const int kLen = state.range_x();
+  while (state.KeepRunning()) {
+    Promise<int> promise;
+    Future<int> future = promise.GetFuture();
+    for (int i = 0; i < kLen; ++i)
+      future = future.Then(nullptr, [](int v) { return v + 1; });
+    promise.SetValue(0);
+    CHECK_EQ(kLen, future.Get());
+  }
+}
+BENCHMARK(BM_ThenChain)->Arg(1)->Arg(16);
+
+}  // namespace util
@@ -37,6 +37,8 @@ struct CallbackPayload {
 };
 
 VarzMapCount http_requests("http_requests");
+VarzMapCount::Handle http_received = http_requests.GetHandle("received");
+VarzMapCount::Handle http_handled = http_requests.GetHandle("handled");
 
 int AddKVToVec(evhtp_kv_t* kv, void* arg) {
   Request::KeyValueArray* dest = reinterpret_cast<Request::KeyValueArray*>(arg);
@@ -220,13 +222,13 @@ void Server::Rep::main_callback(evhtp_request_t* req, void* arg) {
   Request::Rep req_rep{req};
   Request request(&req_rep);
   VLOG(2) << "Getting http requests " << request.uri();
-  http_requests.Inc("received");
+  http_received.Inc();
 
   Response::Rep response_rep{req};
   Response response(&response_rep);
   response.SetContentType(Response::kTextMime);
 
-  http_requests.Inc("handled");
+  http_handled.Inc();
   payload->handler(request, &response);
 }
 
@@ -4,6 +4,10 @@
 
 #include "util/http/varz_stats.h"
 
+#include <algorithm>
+#include "base/distributed_rw_lock.h"
+#include "base/hash.h"
+#include "base/logging.h"
 #include "strings/strcat.h"
 #include "strings/stringprintf.h"
 
@@ -13,7 +17,12 @@ namespace http {
 
 typedef std::lock_guard<std::mutex> mguard;
 
-static std::mutex g_varz_mutex;
+// Guards the global list. Nodes are added and removed rarely, while the list is scanned on
+// every status page request.
+static base::DistributedRWLock g_varz_lock;
+
+constexpr unsigned VarzListNode::kNumShards;
+__thread unsigned VarzListNode::thread_shard_ = kuint32max;
 
 static string CountToHTML(long count) {
   string res;
@@ -23,7 +32,7 @@ static string CountToHTML(long count) {
 
 VarzListNode::VarzListNode(const char* name)
   : name_(name), prev_(nullptr) {
-  mguard guard(g_varz_mutex);
+  base::DistributedRWLock::WriteHolder guard(&g_varz_lock);
   next_ = global_list();
   if (next_) {
     next_->prev_ = this;
@@ -32,7 +41,7 @@ VarzListNode::VarzListNode(const char* name)
 }
 
 VarzListNode::~VarzListNode() {
-  mguard guard(g_varz_mutex);
+  base::DistributedRWLock::WriteHolder guard(&g_varz_lock);
   if (global_list() == this) {
     global_list() = next_;
   } else {
@@ -52,7 +61,7 @@ VarzListNode* & VarzListNode::global_list() {
 
 void VarzListNode::IterateValues(
   std::function<void(const std::string&, const std::string&)> cb) {
-  mguard guard(g_varz_mutex);
+  base::DistributedRWLock::ReadHolder guard(&g_varz_lock);
   for (VarzListNode* node = global_list(); node != nullptr; node = node->next_) {
     if (node->name_ != nullptr) {
       cb(node->name_, node->PrintHTML());
@@ -60,9 +69,73 @@ void VarzListNode::IterateValues(
   }
 }
 
-void VarzMapCount::IncBy(StringPiece key, int32 delta) {
-  std::lock_guard<std::mutex> lock(mutex_);
-  map_counts_[key] += delta;
+void VarzListNode::AssignThreadShard() {
+  static std::atomic<unsigned> next_shard(0);
+  thread_shard_ = next_shard.fetch_add(1, std::memory_order_relaxed) % kNumShards;
+}
+
+template<typename V> VarzMapBase<V>::VarzMapBase(const char* varname)
+    : VarzListNode(varname) {
+  CHECK_EQ(0, pthread_key_create(&key_, &VarzMapBase::ThreadExit));
+}
+
+template<typename V> VarzMapBase<V>::~VarzMapBase() {
+  CHECK_EQ(0, pthread_key_delete(key_));
+  for (Buffer* buf : buffers_)
+    delete buf;
+}
+
+template<typename V> auto VarzMapBase<V>::CreateBuffer() -> Buffer* {
+  Buffer* buf = new Buffer;
+  buf->owner = this;
+  {
+    mguard lock(mu_);
+    buffers_.push_back(buf);
+  }
+  CHECK_EQ(0, pthread_setspecific(key_, buf));
+  return buf;
+}
+
+template<typename V> StringPiece VarzMapBase<V>::StoreKey(StringPiece key) {
+  mguard lock(mu_);
+  return keys_.Get(key);
+}
+
+template<typename V> void VarzMapBase<V>::ThreadExit(void* ptr) {
+  Buffer* buf = static_cast<Buffer*>(ptr);
+  VarzMapBase* me = buf->owner;
+  {
+    mguard lock(me->mu_);
+    for (const auto& k_v : buf->vals)
+      AddTo(k_v.second, &me->exited_[k_v.first]);
+    me->buffers_.erase(std::find(me->buffers_.begin(), me->buffers_.end(), buf));
+  }
+  delete buf;
+}
+
+template<typename V> void VarzMapBase<V>::Merge(Map* res) const {
+  mguard lock(mu_);
+  for (const auto& k_v : exited_)
+    AddTo(k_v.second, &(*res)[k_v.first]);
+  for (Buffer* buf : buffers_) {
+    mguard buf_lock(buf->mu);
+    for (const auto& k_v : buf->vals)
+      AddTo(k_v.second, &(*res)[k_v.first]);
+  }
+}
+
+template class VarzMapBase<long>;
+template class VarzMapBase<std::pair<double, unsigned long>>;
+
+VarzMapCount::Handle VarzMapCount::GetHandle(StringPiece key) {
+  mguard lock(handles_mutex_);
+  std::unique_ptr<base::AlignedArray<Cell>>& cells = handles_[key];
+  if (!cells) {
+    cells.reset(new base::AlignedArray<Cell>(kNumShards));
+    for (Cell& cell : *cells)
+      cell.val.store(0, std::memory_order_relaxed);
+  }
+  return Handle(cells->begin());
 }
 
 std::string KeyValueWithStyle(StringPiece key, StringPiece val) {
@@ -72,20 +145,40 @@ std::string KeyValueWithStyle(StringPiece key, StringPiece val) {
 }
 
 string VarzMapCount::PrintHTML() const {
-  std::lock_guard<std::mutex> lock(mutex_);
-  string result;
+  Map merged;
+  Merge(&merged);
+  {
+    mguard lock(handles_mutex_);
+    for (const auto& k_v : handles_) {
+      long& val = merged[k_v.first];
+      for (const Cell& cell : *k_v.second)
+        val += cell.val.load(std::memory_order_relaxed);
+    }
+  }
 
-  for (const auto& k_v : map_counts_) {
+  string result;
+  for (const auto& k_v : merged) {
     StrAppend(&result, KeyValueWithStyle(k_v.first, SimpleItoa(k_v.second)));
   }
   return result;
 }
 
 string VarzMapAverage::PrintHTML() const {
-  std::lock_guard<std::mutex> lock(mutex_);
-  string result;
+  Map merged;
+  Merge(&merged);
+  {
+    mguard lock(handles_mutex_);
+    for (const auto& k_v : handles_) {
+      auto& val = merged[k_v.first];
+      for (const Cell& cell : *k_v.second) {
+        val.first += cell.sum.load(std::memory_order_relaxed);
+        val.second += cell.count.load(std::memory_order_relaxed);
+      }
+    }
+  }
 
-  for (const auto& k_v : map_) {
+  string result;
+  for (const auto& k_v : merged) {
     string val;
     if (k_v.second.second > 0)
       val = StringPrintf("%.3f", k_v.second.first / k_v.second.second);
@@ -98,11 +191,17 @@ string VarzMapAverage::PrintHTML() const {
   return result;
 }
 
-void VarzMapAverage::IncBy(const string& key, double delta) {
-  std::lock_guard<std::mutex> lock(mutex_);
-  auto& val = map_[key];
-  val.first += delta;
-  ++val.second;
+VarzMapAverage::Handle VarzMapAverage::GetHandle(StringPiece key) {
+  mguard lock(handles_mutex_);
+  std::unique_ptr<base::AlignedArray<Cell>>& cells = handles_[key];
+  if (!cells) {
+    cells.reset(new base::AlignedArray<Cell>(kNumShards));
+    for (Cell& cell : *cells) {
+      cell.sum.store(0, std::memory_order_relaxed);
+      cell.count.store(0, std::memory_order_relaxed);
+    }
+  }
+  return Handle(cells->begin());
 }
 
 std::string VarzCount::PrintHTML() const {
@@ -113,4 +212,32 @@ std::string VarzQps::PrintHTML() const {
   return CountToHTML(val_.Get());
 }
 
+std::string VarzQuantiles::PrintHTML() const {
+  util::QuantileSketch sketch;
+  window_.MergeLast(0, decltype(window_)::SIZE, &sketch);
+
+  string result = KeyValueWithStyle("count", SimpleItoa(sketch.count()));
+  StrAppend(&result, KeyValueWithStyle("average", StringPrintf("%.3f", sketch.Average())));
+  for (double q : {0.5, 0.9, 0.99, 0.999}) {
+    StrAppend(&result, KeyValueWithStyle(StringPrintf("p%g", q * 100),
+                                         StringPrintf("%.3f", sketch.Quantile(q))));
+  }
+  StrAppend(&result, KeyValueWithStyle("max", StringPrintf("%.3f", sketch.max())));
+  return result;
+}
+
+void VarzTopK::IncBy(StringPiece key, uint32 delta) {
+  uint64 hash = base::Fingerprint(key.data(), key.size());
+  distinct_.Add(hash);
+  top_.Add(key, hash, delta);
+}
+
+std::string VarzTopK::PrintHTML() const {
+  string result = KeyValueWithStyle("distinct", SimpleItoa(distinct_.Estimate()));
+  for (const auto& k_v : top_.TopK()) {
+    StrAppend(&result, KeyValueWithStyle(k_v.first, SimpleItoa(k_v.second)));
+  }
+  return result;
+}
+
 }  // namespace http
\ No newline at end of file
@@ -4,14 +4,22 @@
 #ifndef VARZ_STATS_H
 #define VARZ_STATS_H
 
+#include <pthread.h>
 #include <atomic>
 #include <functional>
+#include <memory>
 #include <mutex>
 #include <unordered_map>
 #include <string>
+#include <vector>
+#include "base/aligned_array.h"
+#include "base/flat_hash_map.h"
 #include "base/integral_types.h"
+#include "base/port.h"
 #include "strings/stringpiece.h"
 #include "strings/unique_strings.h"
+#include "util/stats/quantile_sketch.h"
+#include "util/stats/sketches.h"
 #include "util/stats/sliding_counter.h"
 
 namespace http {
@@ -26,49 +34,176 @@ public:
   static void IterateValues(std::function<void(const std::string&, const std::string&)> cb);
 protected:
   virtual std::string PrintHTML() const = 0;
+
+  static constexpr unsigned kNumShards = 16;
+
+  // Threads are assigned shards in round robin order, so that up to kNumShards threads
+  // can update a varz without sharing locks or cache lines.
+  static unsigned ThreadShard() {
+    if (PREDICT_FALSE(thread_shard_ == kuint32max))
+      AssignThreadShard();
+    return thread_shard_;
+  }
+
 private:
   // Returns the head to varz linked list. Note that the list becomes invalid after at least one
   // linked list node was destroyed.
   static VarzListNode* & global_list();
 
+  static void AssignThreadShard();
+  static __thread unsigned thread_shard_;
+
 
   const char* name_;
   VarzListNode* next_;
   VarzListNode* prev_;
 };
 
+// Base of the map varz. Every thread accumulates its updates in its own buffer, which is
+// registered with a pthread key like the ObjectPool thread caches. A buffer is locked by its
+// thread on every update and by PrintHTML, which merges all the buffers, so the threads never
+// contend with each other. Keys are copied once per varz and the buffers refer to these copies.
+// Buffers of exited threads are merged into a single map.
+template<typename V> class VarzMapBase : public VarzListNode {
+protected:
+  typedef base::FlatHashMap<StringPiece, V, StringPieceHash> Map;
+
+  explicit VarzMapBase(const char* varname);
+
+  // All the threads must stop updating the varz before it is destroyed.
+  ~VarzMapBase();
+
+  void Add(StringPiece key, const V& delta) {
+    Buffer* buf = GetBuffer();
+    {
+      std::lock_guard<std::mutex> lock(buf->mu);
+      auto it = buf->vals.find(key);
+      if (it != buf->vals.end()) {
+        AddTo(delta, &it->second);
+        return;
+      }
+    }
+    // Only this thread inserts into its buffer, so the key is still missing.
+    StringPiece stored_key = StoreKey(key);
+    std::lock_guard<std::mutex> lock(buf->mu);
+    buf->vals.emplace(stored_key, delta);
+  }
+
+  // Adds the values of all the threads to res.
+  void Merge(Map* res) const;
+
+  static void AddTo(long src, long* dest) { *dest += src; }
+
+  static void AddTo(const std::pair<double, unsigned long>& src,
+                    std::pair<double, unsigned long>* dest) {
+    dest->first += src.first;
+    dest->second += src.second;
+  }
+
+private:
+  struct Buffer {
+    VarzMapBase* owner;
+    std::mutex mu;
+    Map vals;
+  };
+
+  Buffer* GetBuffer() {
+    Buffer* buf = static_cast<Buffer*>(pthread_getspecific(key_));
+    return buf ? buf : CreateBuffer();
+  }
+
+  Buffer* CreateBuffer();
+  StringPiece StoreKey(StringPiece key);
+
+  static void ThreadExit(void* buf);
+
+  pthread_key_t key_;
+
+  mutable std::mutex mu_;
+  UniqueStrings keys_;  // guarded by mu_.
+  std::vector<Buffer*> buffers_;  // guarded by mu_.
+  Map exited_;  // guarded by mu_.
+};
+
 /**
   Represents a family (map) of counters. Each counter has its own key name.
+  Hot keys should be incremented via Handle which does not hash the key and does not lock.
 **/
-class VarzMapCount : public VarzListNode {
+class VarzMapCount : public VarzMapBase<long> {
+  struct Cell {
+    std::atomic_long val;
+  } CACHELINE_ALIGNED;
+
 public:
-  explicit VarzMapCount(const char* varname) : VarzListNode(varname) {}
+  // Counter of a single key. Valid as long as the VarzMapCount.
+  class Handle {
+  public:
+    void IncBy(int32 delta) {
+      cells_[ThreadShard()].val.fetch_add(delta, std::memory_order_relaxed);
+    }
+
+    void Inc() { IncBy(1); }
+
+  private:
+    friend class VarzMapCount;
+    explicit Handle(Cell* cells) : cells_(cells) {}
+
+    Cell* cells_;
+  };
+
+  explicit VarzMapCount(const char* varname) : VarzMapBase(varname) {}
 
   // Increments key by delta.
-  void IncBy(StringPiece key, int32 delta);
+  void IncBy(StringPiece key, int32 delta) { Add(key, delta); }
 
   void Inc(StringPiece key) { IncBy(key, 1); }
 
+  Handle GetHandle(StringPiece key);
+
 private:
   std::string PrintHTML() const override;
 
-  mutable std::mutex mutex_;
-  StringPieceMap<long> map_counts_;
+  mutable std::mutex handles_mutex_;
+  StringPieceMap<std::unique_ptr<base::AlignedArray<Cell>>> handles_;
 };
 
-// represents a family of averages.
-class VarzMapAverage : public VarzListNode {
+// represents a family of averages. Buffered like VarzMapCount.
+class VarzMapAverage : public VarzMapBase<std::pair<double, unsigned long>> {
+  struct Cell {
+    std::atomic<double> sum;
+    std::atomic_ulong count;
+  } CACHELINE_ALIGNED;
+
 public:
-  explicit VarzMapAverage(const char* varname) : VarzListNode(varname) {}
+  // Average of a single key. Valid as long as the VarzMapAverage.
+  class Handle {
+  public:
+    void IncBy(double delta) {
+      Cell& cell = cells_[ThreadShard()];
+      double sum = cell.sum.load(std::memory_order_relaxed);
+      while (!cell.sum.compare_exchange_weak(sum, sum + delta, std::memory_order_relaxed)) {
+      }
+      cell.count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+  private:
+    friend class VarzMapAverage;
+    explicit Handle(Cell* cells) : cells_(cells) {}
+
+    Cell* cells_;
+  };
 
-  void IncBy(const string& key, double delta);
+  explicit VarzMapAverage(const char* varname) : VarzMapBase(varname) {}
+
+  void IncBy(StringPiece key, double delta) { Add(key, std::make_pair(delta, 1UL)); }
+
+  Handle GetHandle(StringPiece key);
 
 private:
   string PrintHTML() const override;
 
-  mutable std::mutex mutex_;
-
-  std::unordered_map<string, std::pair<double, unsigned long>> map_;
+  mutable std::mutex handles_mutex_;
+  StringPieceMap<std::unique_ptr<base::AlignedArray<Cell>>> handles_;
 };
 
 class VarzCount : public VarzListNode {
@@ -92,7 +227,39 @@ public:
 private:
   string PrintHTML() const override;
 
-  mutable util::QPSCount val_;
+  mutable util::ShardedQPSCount val_;
+};
+
+// Quantiles of values, e.g. latencies, over the last minute.
+class VarzQuantiles : public VarzListNode {
+public:
+  explicit VarzQuantiles(const char* varname) : VarzListNode(varname) {}
+
+  void Add(double value) { window_.Add(value); }
+
+private:
+  string PrintHTML() const override;
+
+  util::SlidingSecondQuantiles<6, 10> window_;
+};
+
+// Tracks the k most frequent keys and the number of distinct keys. Unlike VarzMapCount,
+// memory does not grow with the number of keys and the counts are estimates.
+class VarzTopK : public VarzListNode {
+public:
+  explicit VarzTopK(const char* varname, unsigned k = 10)
+    : VarzListNode(varname), top_(k) {}
+
+  // Lock-free unless key enters the top k.
+  void IncBy(StringPiece key, uint32 delta);
+
+  void Inc(StringPiece key) { IncBy(key, 1); }
+
+private:
+  string PrintHTML() const override;
+
+  util::HyperLogLog distinct_;
+  util::HeavyHitters top_;
 };
 
 class VarzFunction : public VarzListNode {
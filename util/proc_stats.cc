@@ -3,6 +3,8 @@
 //
 #include "util/proc_stats.h"
 
+#include <sched.h>
+#include <algorithm>
 #include <mutex>
 #include "base/walltime.h"
 #include "strings/numbers.h"
@@ -36,8 +38,125 @@ static void InitCpuInfo() {
   fclose(f);
 }
 
+// Parses cpu lists like "0-3,8,10-11".
+static std::vector<unsigned> ParseCpuList(const char* str) {
+  std::vector<unsigned> res;
+  while (*str) {
+    char* end;
+    unsigned long first = strtoul(str, &end, 10);
+    if (end == str)
+      break;
+    unsigned long last = first;
+    if (*end == '-') {
+      str = end + 1;
+      last = strtoul(str, &end, 10);
+    }
+    for (unsigned long i = first; i <= last; ++i)
+      res.push_back(i);
+    str = end;
+    if (*str == ',')
+      ++str;
+  }
+  return res;
+}
+
+// Returns false if the file does not exist.
+static bool ReadSysLine(const char* path, char* buf, size_t size) {
+  FILE* f = fopen(path, "r");
+  if (f == NULL)
+    return false;
+  bool res = fgets(buf, size, f) != NULL;
+  fclose(f);
+  return res;
+}
+
+static unsigned ReadSysUInt(const char* path) {
+  char buf[64];
+  if (!ReadSysLine(path, buf, sizeof buf))
+    return 0;
+  return ParseLeadingUDec32Value(buf, 0);
+}
+
+static CpuTopology* cpu_topology = nullptr;
+static std::once_flag topology_once;
+
+static void InitTopology() {
+  CpuTopology* topo = new CpuTopology;
+  char buf[1024];
+  std::vector<unsigned> online;
+  if (ReadSysLine("/sys/devices/system/cpu/online", buf, sizeof buf))
+    online = ParseCpuList(buf);
+  if (online.empty()) {
+    unsigned num = std::max(1U, sys::NumCPUs());
+    for (unsigned i = 0; i < num; ++i)
+      online.push_back(i);
+  }
+
+  for (unsigned node = 0; ; ++node) {
+    char path[100];
+    snprintf(path, sizeof path, "/sys/devices/system/node/node%u/cpulist", node);
+    if (!ReadSysLine(path, buf, sizeof buf))
+      break;
+    topo->node_cpus.push_back(ParseCpuList(buf));
+  }
+  if (topo->node_cpus.empty())
+    topo->node_cpus.push_back(online);
+
+  for (unsigned id : online) {
+    CpuTopology::Cpu cpu;
+    cpu.id = id;
+    char path[100];
+    snprintf(path, sizeof path, "/sys/devices/system/cpu/cpu%u/topology/physical_package_id", id);
+    cpu.package = ReadSysUInt(path);
+    snprintf(path, sizeof path, "/sys/devices/system/cpu/cpu%u/topology/core_id", id);
+    cpu.core = ReadSysUInt(path);
+    cpu.node = 0;
+    for (unsigned node = 0; node < topo->node_cpus.size(); ++node) {
+      const auto& cpus = topo->node_cpus[node];
+      if (std::find(cpus.begin(), cpus.end(), id) != cpus.end()) {
+        cpu.node = node;
+        break;
+      }
+    }
+    topo->cpus.push_back(cpu);
+  }
+
+  // Drop offline cpus and nodes without cpus, for example memory-only nodes.
+  auto& nodes = topo->node_cpus;
+  for (auto& cpus : nodes) {
+    cpus.erase(std::remove_if(cpus.begin(), cpus.end(), [&online](unsigned id) {
+          return std::find(online.begin(), online.end(), id) == online.end();
+        }), cpus.end());
+  }
+  unsigned dest = 0;
+  for (unsigned node = 0; node < nodes.size(); ++node) {
+    if (nodes[node].empty())
+      continue;
+    for (auto& cpu : topo->cpus) {
+      if (cpu.node == node)
+        cpu.node = dest;
+    }
+    nodes[dest++].swap(nodes[node]);
+  }
+  nodes.resize(dest);
+
+  cpu_topology = topo;
+}
+
+unsigned CpuTopology::NodeOf(unsigned cpu_id) const {
+  for (const Cpu& cpu : cpus) {
+    if (cpu.id == cpu_id)
+      return cpu.node;
+  }
+  return 0;
+}
+
 ProcessStats ProcessStats::Read() {
   ProcessStats stats;
+  const CpuTopology& topo = sys::Topology();
+  stats.num_cpus = topo.cpus.size();
+  stats.num_nodes = topo.num_nodes();
+
   FILE* f = fopen("/proc/self/status", "r");
   if (f == nullptr)
     return stats;
@@ -91,6 +210,19 @@ unsigned int NumCPUs() {
   return CPU_NUM;
 }
 
+const CpuTopology& Topology() {
+  std::call_once(topology_once, InitTopology);
+  return *cpu_topology;
+}
+
+unsigned CurrentNode() {
+  const CpuTopology& topo = Topology();
+  if (topo.num_nodes() == 1)
+    return 0;
+  int cpu = sched_getcpu();
+  return cpu < 0 ? 0 : topo.NodeOf(cpu);
+}
+
 }  // namespace sys
 
 }  // namespace util
@@ -98,6 +230,7 @@ unsigned int NumCPUs() {
 std::ostream& operator<<(std::ostream& os, const util::ProcessStats& stats) {
   os << "VmPeak: " << stats.vm_peak << "kb, VmSize: " << stats.vm_size
      << "kb, VmRSS: " << stats.vm_rss << "kb, Start Time: "
-     << PrintLocalTime(stats.start_time_seconds);
+     << PrintLocalTime(stats.start_time_seconds) << ", CPUs: " << stats.num_cpus
+     << ", NUMA nodes: " << stats.num_nodes;
   return os;
 }
@@ -5,6 +5,7 @@
 #define PROC_STATUS_H
 
 #include <ostream>
+#include <vector>
 
 #include "base/integral_types.h"
 
@@ -18,11 +19,41 @@ struct ProcessStats {
   // Start time of the process in seconds since epoch.
   uint64 start_time_seconds = 0;
 
+  // Online cpus and numa nodes in the system.
+  uint32 num_cpus = 0;
+  uint32 num_nodes = 0;
+
   static ProcessStats Read();
 };
 
+// Layout of the online cpus, read from /sys/devices/system.
+struct CpuTopology {
+  struct Cpu {
+    unsigned id;
+    unsigned node;
+    unsigned package;  // physical socket.
+    unsigned core;
+  };
+
+  std::vector<Cpu> cpus;
+
+  // cpu ids of every numa node. Systems without numa have a single node with all the cpus.
+  std::vector<std::vector<unsigned>> node_cpus;
+
+  unsigned num_nodes() const { return node_cpus.size(); }
+
+  // Returns the node of the cpu or 0 if the cpu is unknown.
+  unsigned NodeOf(unsigned cpu_id) const;
+};
+
 namespace sys {
   unsigned int NumCPUs();
+
+  // Read once and cached.
+  const CpuTopology& Topology();
+
+  // Returns the numa node of the cpu the calling thread runs on.
+  unsigned CurrentNode();
 }  // namespace sys
 
 }  // namespace util
@@ -10,6 +10,7 @@
 #include <event2/event.h>
 
 #include "base/logging.h"
+#include "base/object_pool.h"
 #include "base/thread_annotations.h"
 #include "strings/numbers.h"
 
@@ -203,7 +204,7 @@ void Channel::Rep::ConnectWithAddrInfo(int cause) {
     if (state == SHUTTING_DOWN)
       return;
     FlushOutstanding();
-    this->bev.reset(bufferevent_socket_new(executor_->ebase(), -1,
+    this->bev.reset(bufferevent_socket_new(executor_->EventBaseForKey(uint64(this)), -1,
                                            BEV_OPT_CLOSE_ON_FREE | BEV_OPT_THREADSAFE),
                     bufferevent_deleter);
     m_reader.reset(new MessageReader(std::bind(&Channel::Rep::ReplyHandler, this, _1, _2),
@@ -409,5 +410,37 @@ void Channel::CallMethod(const gpb::MethodDescriptor* method,
                    deadline_.load());
 }
 
+namespace {
+
+// Sets the promise of CallAsync. Allocated from a pool since there is one per call.
+class PromiseClosure : public gpb::Closure {
+  Context* context_;
+  Promise<Context*> promise_;
+public:
+  static base::ObjectPool<PromiseClosure>& pool() {
+    static base::ObjectPool<PromiseClosure> closure_pool;
+    return closure_pool;
+  }
+
+  explicit PromiseClosure(Context* context) : context_(context) {}
+
+  Future<Context*> GetFuture() { return promise_.GetFuture(); }
+
+  void Run() {
+    promise_.SetValue(context_);
+    pool().Release(this);
+  }
+};
+
+}  // namespace
+
+Future<Context*> Channel::CallAsync(const gpb::MethodDescriptor* method, Context* context,
+                                    const gpb::Message* request, gpb::Message* response) {
+  PromiseClosure* done = PromiseClosure::pool().New(context);
+  Future<Context*> res = done->GetFuture();
+  CallMethod(method, context, request, response, done);
+  return res;
+}
+
 }  // namespace rpc
 }  // namespace util
@@ -13,6 +13,7 @@
 
 #include <google/protobuf/service.h>
 #include "strings/stringpiece.h"
+#include "util/future.h"
 
 struct bufferevent;
 
@@ -42,6 +43,16 @@ class Channel : public gpb::RpcChannel {
                           gpb::Message* response,
                           gpb::Closure* done);
 
+  // Future based CallMethod. The future is set to context once the call finishes, the caller
+  // then checks context->Failed(). context, request and response must live until then.
+  // Chains of calls can be built with Future::Then, for example:
+  //   channel->CallAsync(m1, &c1, &req1, &resp1).Then(executor, [&](Context* c) {
+  //       FillRequest(resp1, &req2);
+  //       return channel->CallAsync(m2, &c2, &req2, &resp2);
+  //     });
+  Future<Context*> CallAsync(const gpb::MethodDescriptor* method, Context* context,
+                             const gpb::Message* request, gpb::Message* response);
+
   // Waits for the channel to connect.
   bool WaitToConnect(uint32 milliseconds = kuint32max);
 
@@ -106,7 +106,7 @@ RpcServer::Rep::~Rep() {
   std::this_thread::sleep_for(std::chrono::milliseconds(140));
 }
 
-// The following function runs in base_event_loop thread.
+// The following function runs in the event loop thread of conn.
 // TODO: should not call any user code directly.
 void RpcServer::Rep::IncomingRpcHandler(ServerConnection* conn, strings::Slice cntrl,
                                         strings::Slice msg) {
@@ -179,11 +179,13 @@ void RpcServer::Rep::Open(const sockaddr_in& addr, Executor* executor) {
 void RpcServer::Rep::accept_conn_cb(struct evconnlistener *listener,
                                     int socket_fd, struct sockaddr *address, int socklen,
                                     void *ctx) {
-  struct event_base* base = evconnlistener_get_base(listener);
+  RpcServer::Rep* me = reinterpret_cast<RpcServer::Rep*>(ctx);
+
+  // Spread the connections across the event loops of the executor.
+  struct event_base* base = me->executor_->NextEventBase();
   struct bufferevent* bev = bufferevent_socket_new(base, socket_fd,
      BEV_OPT_CLOSE_ON_FREE | BEV_OPT_THREADSAFE);
 
-  RpcServer::Rep* me = reinterpret_cast<RpcServer::Rep*>(ctx);
   ServerConnection* conn =
       new ServerConnection(bev, std::bind(&Rep::IncomingRpcHandler, me, _1, _2, _3));
 
@@ -30,6 +30,9 @@ public:
   explicit RpcServer(const std::string& name, http::Server* server = nullptr);
 
   ~RpcServer();
+
+  // Listens on the first event loop of executor. Accepted connections are distributed
+  // round-robin across all its event loops.
   void Open(int port, Executor* executor);
 
   void ExportService(::google::protobuf::Service* service);
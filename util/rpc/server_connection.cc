@@ -6,6 +6,7 @@
 #include <event2/bufferevent.h>
 #include <event2/event.h>
 
+#include "base/object_pool.h"
 #include "util/rpc/rpc_common.h"
 #include "util/rpc/rpc_message_reader.h"
 
@@ -15,6 +16,12 @@ using std::string;
 namespace util {
 namespace rpc {
 
+namespace {
+
+base::ObjectPool<ServerConnection::Call> call_pool;
+
+}  // namespace
+
 ServerConnection::ServerConnection(
     bufferevent* buff_ev,
     std::function<void(ServerConnection*, strings::Slice, strings::Slice)> cb)
@@ -66,6 +73,12 @@ void ServerConnection::ScheduleClose() {
   tmp.swap(bev_);
 }
 
+ServerConnection::Call* ServerConnection::AllocateCall(int64 id, gpb::Message* req,
+                                                       gpb::Message* resp) {
+  AddRef();
+  return call_pool.New(id, req, resp);
+}
+
 void ServerConnection::ReadErrorCallback() {
   int sfd = bufferevent_getfd(bev_.get());
   if (sfd != -1) {
@@ -98,7 +111,7 @@ void ServerConnection::ReplierCb(Call* call) {
     }
   }
   auto r = DecRef();
-  delete call;
+  call_pool.Release(call);
   VLOG(1) << "ReplierCb end " << tmp.get() << " " << r;
 }
 
@@ -41,10 +41,8 @@ public:
   static void readcb(struct bufferevent* bev, void *ptr);
   static void connection_event_cb(struct bufferevent *bev, short events, void *ctx);
 
-  Call* AllocateCall(int64 id, gpb::Message* req, gpb::Message* resp) {
-    AddRef();
-    return new Call{id, req, resp};
-  }
+  // Calls are allocated per request from a shared pool.
+  Call* AllocateCall(int64 id, gpb::Message* req, gpb::Message* resp);
 
   void ReadErrorCallback();
 
@@ -3,108 +3,173 @@
 //
 #include "util/scheduler.h"
 
-#include <sys/time.h>
+#include <time.h>
 #include <algorithm>
 #include "base/logging.h"
+#include "base/pthread_utils.h"
+#include "util/executor.h"
 
-using std::chrono::milliseconds;
+using std::chrono::microseconds;
 namespace util {
 
-Scheduler::Scheduler() : next_id_(10), scheduler_thread_(&Scheduler::ThreadMain, this) {
-  cond_var_ = PTHREAD_COND_INITIALIZER;
+namespace {
+
+// Expired callbacks are passed to the executor in chunks of this size.
+constexpr size_t kDispatchBatch = 32;
+
+// Handles hold the wheel id and the shard index in the lowest bits.
+constexpr unsigned kShardBits = 3;
+
+}  // namespace
+
+constexpr uint32 Scheduler::kTickUsec;
+constexpr unsigned Scheduler::kNumShards;
+
+Scheduler::Scheduler(Executor* executor) : executor_(executor),
+    start_(std::chrono::steady_clock::now()), planned_wakeup_(kuint64max) {
+  static_assert((1 << kShardBits) >= kNumShards, "Not enough bits for the shard index");
   mutex_ = PTHREAD_MUTEX_INITIALIZER;
+  base::InitCondVarWithClock(CLOCK_MONOTONIC, &cond_var_);
+  for (unsigned i = 0; i < kNumShards; ++i)
+    shards_[i].reset(new Shard(0));
+  scheduler_thread_ = std::thread(&Scheduler::ThreadMain, this);
 }
 
 Scheduler::~Scheduler() {
   pthread_mutex_lock(&mutex_);
-  next_id_ = 0;
+  stop_ = true;
   pthread_cond_signal(&cond_var_);
   pthread_mutex_unlock(&mutex_);
   scheduler_thread_.join();
+  pthread_cond_destroy(&cond_var_);
+}
+
+uint64 Scheduler::NowTick() const {
+  auto elapsed = std::chrono::steady_clock::now() - start_;
+  return std::chrono::duration_cast<microseconds>(elapsed).count() / kTickUsec;
+}
+
+Scheduler::Shard* Scheduler::ShardForThisThread(unsigned* index) {
+  static std::atomic<uint32> next_thread_index(0);
+  static __thread uint32 thread_index = kuint32max;
+  if (thread_index == kuint32max)
+    thread_index = next_thread_index.fetch_add(1, std::memory_order_relaxed);
+  *index = thread_index % kNumShards;
+  return shards_[*index].get();
 }
 
 Scheduler::handler_t Scheduler::Schedule(
-    std::function<void()> f, milliseconds period, bool is_periodic) {
+    std::function<void()> f, microseconds period, bool is_periodic) {
   DCHECK(f) << "f is not valid!";
-  DCHECK(period != milliseconds::zero()) << "period should be non-zero.";
-  pthread_mutex_lock(&mutex_);
+  DCHECK(period != microseconds::zero()) << "period should be non-zero.";
 
-  handler_t cur_id = next_id_++;
+  // The period is rounded up to whole ticks, but NowTick floors the current time, so
+  // a callback may still run up to one tick early.
+  uint64 ticks = std::max<uint64>(1, (period.count() + kTickUsec - 1) / kTickUsec);
+  uint64 deadline = NowTick() + ticks;
 
-  uint64 special_duration = is_periodic ? period.count() : 0;
-  scheduler_map_.emplace(cur_id, Params{f, special_duration});
-  ScheduleHandlerLocked(period.count(), cur_id);
-
-  pthread_cond_signal(&cond_var_);
-  pthread_mutex_unlock(&mutex_);
+  unsigned shard_index;
+  Shard* shard = ShardForThisThread(&shard_index);
+  TimerWheel::Id id;
+  {
+    base::MutexLock lock(&shard->mu);
+    id = shard->wheel.Add(std::move(f), deadline, is_periodic ? ticks : 0);
+  }
 
-  return cur_id;
+  if (deadline < planned_wakeup_.load(std::memory_order_acquire)) {
+    pthread_mutex_lock(&mutex_);
+    wakeup_ = true;
+    pthread_cond_signal(&cond_var_);
+    pthread_mutex_unlock(&mutex_);
+  }
+  return (id << kShardBits) | shard_index;
 }
 
 bool Scheduler::Remove(handler_t h) {
-  pthread_mutex_lock(&mutex_);
-  bool res = scheduler_map_.erase(h) != 0;
-  pthread_mutex_unlock(&mutex_);
-  return res;
-}
-
-inline void Scheduler::ScheduleHandlerLocked(uint64 period, handler_t h) {
-  struct timeval now;
-  gettimeofday(&now, NULL);
-  period += now.tv_sec * 1000;
-  period += now.tv_usec / 1000;
-  queue_.emplace_back(period, h);
-  std::push_heap(queue_.begin(), queue_.end(), std::greater<scheduled_pair>());
+  if (h == INVALID_HANDLE)
+    return false;
+  Shard* shard = shards_[h & ((1 << kShardBits) - 1)].get();
+  base::MutexLock lock(&shard->mu);
+  return shard->wheel.Remove(h >> kShardBits);
 }
 
 Scheduler& Scheduler::Default() {
-  static Scheduler scheduler;
+  // Executor::Default is constructed first, therefore it outlives the scheduler.
+  static Scheduler scheduler(&Executor::Default());
   return scheduler;
 }
 
+void Scheduler::Dispatch(std::vector<std::function<void()>>* expired) {
+  if (!executor_) {
+    for (auto& f : *expired)
+      f();
+    expired->clear();
+    return;
+  }
+  for (size_t i = 0; i < expired->size(); i += kDispatchBatch) {
+    size_t end = std::min(expired->size(), i + kDispatchBatch);
+    std::shared_ptr<std::vector<std::function<void()>>> batch(
+        new std::vector<std::function<void()>>(std::make_move_iterator(expired->begin() + i),
+                                               std::make_move_iterator(expired->begin() + end)));
+    auto run = [batch]() {
+      for (auto& f : *batch)
+        f();
+    };
+    // The executor rejects tasks after it was shut down, the callbacks still must run.
+    if (!executor_->Add(run))
+      run();
+  }
+  expired->clear();
+}
+
 void Scheduler::ThreadMain() {
-  pthread_mutex_lock(&mutex_);
-  struct timespec time_spec;
-  while (next_id_ != 0) {
-    if (queue_.empty()) {
-      VLOG(2) << "before pthread_cond_wait";
-      pthread_cond_wait(&cond_var_, &mutex_);
-      VLOG(2) << "after pthread_cond_wait";
-      continue;
-    }
-    uint64 next = queue_.front().first;
-    VLOG(1) << "Next timepoint in millis " << next;
-    time_spec.tv_sec = next/1000;
-    time_spec.tv_nsec = (next % 1000) * 1000000UL;
-    int status = pthread_cond_timedwait(&cond_var_, &mutex_, &time_spec);
-    if (status == 0) {
-      continue;
+  std::vector<std::function<void()>> expired;
+  while (true) {
+    // Schedule calls that arrive while we scan the wheels always wake us up.
+    planned_wakeup_.store(kuint64max, std::memory_order_release);
+
+    uint64 now = NowTick();
+    uint64 next = kuint64max;
+    for (unsigned i = 0; i < kNumShards; ++i) {
+      Shard* shard = shards_[i].get();
+      base::MutexLock lock(&shard->mu);
+      shard->wheel.Advance(now, &expired);
+      next = std::min(next, shard->wheel.NextExpiration());
     }
-    if (status != ETIMEDOUT) {
-      LOG(ERROR) << "Error in pthread_cond_timedwait "  << status;
+    VLOG(2) << "Tick " << now << " expired " << expired.size() << ", next tick " << next;
+    Dispatch(&expired);
+
+    pthread_mutex_lock(&mutex_);
+    if (stop_) {
+      pthread_mutex_unlock(&mutex_);
+      break;
     }
-    // we reached the next time point. Lets pull it out of the queue,
-    // and try to run the callback.
-    std::pop_heap(queue_.begin(), queue_.end(), std::greater<scheduled_pair>());
-    handler_t h = queue_.back().second;
-    queue_.pop_back();
-    auto it = scheduler_map_.find(h);
-    if (it == scheduler_map_.end())
-      continue;
-    const Params& params = it->second;
-    auto f = params.callback;
-    DCHECK(f);
-    if (params.duration_ms != 0) {
-      // It's a periodic function. Schedule it again.
-      ScheduleHandlerLocked(params.duration_ms,  h);
-    } else {
-      scheduler_map_.erase(it);
+    if (!wakeup_) {
+      planned_wakeup_.store(next, std::memory_order_release);
+      if (next == kuint64max) {
+        pthread_cond_wait(&cond_var_, &mutex_);
+      } else {
+        uint64 cur = NowTick();
+        if (next > cur) {
+          uint64 wait_usec = (next - cur) * kTickUsec;
+          struct timespec abstime;
+          clock_gettime(CLOCK_MONOTONIC, &abstime);
+          abstime.tv_sec += wait_usec / 1000000;
+          abstime.tv_nsec += (wait_usec % 1000000) * 1000;
+          if (abstime.tv_nsec >= 1000000000L) {
+            ++abstime.tv_sec;
+            abstime.tv_nsec -= 1000000000L;
+          }
+          int status = pthread_cond_timedwait(&cond_var_, &mutex_, &abstime);
+          if (status != 0 && status != ETIMEDOUT) {
+            LOG(ERROR) << "Error in pthread_cond_timedwait "  << status;
+          }
+        }
+      }
     }
+    wakeup_ = false;
     pthread_mutex_unlock(&mutex_);
-    f();
-    pthread_mutex_lock(&mutex_);
   }
-  pthread_mutex_unlock(&mutex_);
 }
 
-}  // namespace util
\ No newline at end of file
+}  // namespace util
@@ -4,35 +4,45 @@
 #ifndef SCHEDULER_H
 #define SCHEDULER_H
 
+#include <atomic>
 #include <chrono>
 #include <pthread.h>
 #include <functional>
+#include <memory>
 #include <thread>
-#include <unordered_map>
 #include <vector>
 
 #include "base/integral_types.h"
+#include "base/mutex.h"
+#include "util/timer_wheel.h"
 
 namespace util {
 
+class Executor;
+
 // This class is threadsafe.
+// Timers live in several timing wheels, each guarded by its own mutex. Every thread
+// schedules into its own wheel, so concurrent Schedule/Remove calls rarely contend.
+// The timer thread advances the wheels and dispatches expired callbacks in batches.
 class Scheduler {
-  struct Params {
-    std::function<void()> callback;
-    uint64 duration_ms;
-  };
-
 public:
-  typedef uint32 handler_t;
-  static constexpr uint32 INVALID_HANDLE = 0;
+  typedef uint64 handler_t;
+  static constexpr handler_t INVALID_HANDLE = 0;
 
-  Scheduler();
+  // Resolution of the scheduler.
+  static constexpr uint32 kTickUsec = 100;
+
+  // If executor is not null, expired callbacks run on its pool, otherwise they run on
+  // the scheduler thread.
+  explicit Scheduler(Executor* executor = nullptr);
 
   // Shuts down the scheduling thread.
   ~Scheduler();
 
-  // period can not be 0.
-  handler_t Schedule(std::function<void()> f, std::chrono::milliseconds period,
+  // period can not be 0. Periodic callbacks keep their rate: if a run is late, the next one
+  // is scheduled one period after the late run. When callbacks run on an executor, a slow
+  // periodic callback may overlap with its next run.
+  handler_t Schedule(std::function<void()> f, std::chrono::microseconds period,
                      bool is_periodic = true);
 
   // Returns true if removal succeeded or false if the handler was not found
@@ -40,28 +50,41 @@ public:
   // has been removed already.
   bool Remove(handler_t h);
 
+  // Dispatches the callbacks on Executor::Default(), so a slow callback does not delay
+  // other timers.
   static Scheduler& Default();
 private:
-  // typedef std::chrono::time_point<std::chrono::system_clock> time_point;
-  // milliseconds
-  typedef std::pair<uint64, handler_t> scheduled_pair;
+  static constexpr unsigned kNumShards = 8;
 
-  void ThreadMain();  // exits when next_id_ is 0 (assuming that we never reach maxuint32)
+  struct Shard {
+    base::Mutex mu;
+    TimerWheel wheel;
 
-  void ScheduleHandlerLocked(uint64 milliseconds, handler_t h);
+    explicit Shard(uint64 now) : wheel(now) {}
+  };
 
-  std::unordered_map<handler_t, Params> scheduler_map_;
+  uint64 NowTick() const;
+  Shard* ShardForThisThread(unsigned* index);
 
-  std::vector<scheduled_pair> queue_;
+  void ThreadMain();
 
-  handler_t next_id_;
-  pthread_mutex_t mutex_;
-  std::thread scheduler_thread_;
+  // Runs or dispatches the expired callbacks.
+  void Dispatch(std::vector<std::function<void()>>* expired);
+
+  Executor* executor_;
+  std::chrono::steady_clock::time_point start_;
+  std::unique_ptr<Shard> shards_[kNumShards];
 
+  // The tick the timer thread sleeps until. Schedule wakes it only for earlier deadlines.
+  std::atomic<uint64> planned_wakeup_;
+  bool wakeup_ = false;  // guarded by mutex_.
+  bool stop_ = false;  // guarded by mutex_.
+  pthread_mutex_t mutex_;
   pthread_cond_t cond_var_;
-  // std::condition_variable ;
+
+  std::thread scheduler_thread_;
 };
 
 }  // namespace util
 
-#endif  // SCHEDULER_H
\ No newline at end of file
+#endif  // SCHEDULER_H
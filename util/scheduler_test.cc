@@ -2,11 +2,13 @@
 // Author: Roman Gershman (romange@gmail.com)
 //
 #include "util/scheduler.h"
+#include "util/executor.h"
 #include "util/proc_stats.h"
 
+#include <future>
 #include <mutex>
-#include <gtest/gtest.h>
 #include <gmock/gmock.h>
+#include "base/gtest.h"
 
 using ::testing::AllOf;
 using ::testing::Ge;
@@ -39,7 +41,20 @@ TEST_F(SchedulerTest, ProcStats) {
   EXPECT_GE(stats.vm_peak, stats.vm_size);
   EXPECT_GE(stats.vm_rss, 0);
   EXPECT_GE(stats.start_time_seconds, 1341904000);
+  EXPECT_GT(stats.num_cpus, 0);
+  EXPECT_GT(stats.num_nodes, 0);
   cout << "Stats: " << stats << endl;
+
+  const CpuTopology& topology = sys::Topology();
+  EXPECT_EQ(stats.num_cpus, topology.cpus.size());
+  size_t node_cpus = 0;
+  for (const auto& cpus : topology.node_cpus)
+    node_cpus += cpus.size();
+  EXPECT_EQ(stats.num_cpus, node_cpus);
+  for (const auto& cpu : topology.cpus) {
+    EXPECT_LT(cpu.node, topology.num_nodes());
+    EXPECT_EQ(cpu.node, topology.NodeOf(cpu.id));
+  }
 }
 
 TEST_F(SchedulerTest, Basic) {
@@ -95,4 +110,28 @@ TEST_F(SchedulerTest, Precision) {
   }
 }
 
+TEST_F(SchedulerTest, Executor) {
+  Executor executor(2);
+  {
+    Scheduler scheduler(&executor);
+    std::atomic<int> count(0);
+    for (int i = 0; i < 100; ++i) {
+      scheduler.Schedule([&count]() { count.fetch_add(1); }, milliseconds(5), false);
+    }
+    this_thread::sleep_for(milliseconds(100));
+    EXPECT_EQ(100, count.load());
+  }
+  executor.Shutdown();
+}
+
+// A blocked callback of the default scheduler does not delay the other timers.
+TEST_F(SchedulerTest, Default) {
+  std::promise<void> unblock, done;
+  Scheduler::Default().Schedule([&unblock]() { unblock.get_future().wait(); },
+                                milliseconds(1), false);
+  Scheduler::Default().Schedule([&done]() { done.set_value(); }, milliseconds(10), false);
+  EXPECT_EQ(future_status::ready, done.get_future().wait_for(chrono::seconds(5)));
+  unblock.set_value();
+}
+
 }  // namespace util
\ No newline at end of file
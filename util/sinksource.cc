@@ -3,6 +3,9 @@
 //
 
 #include "util/sinksource.h"
+
+#include <algorithm>
+#include <cstring>
 #include "base/logging.h"
 #include "base/port.h"
 
@@ -19,8 +22,125 @@ Sink::WritableBuffer Sink::GetAppendBuffer(
   return scratch;
 }
 
+Status Sink::AppendV(const Slice* slices, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    RETURN_IF_ERROR(Append(slices[i]));
+  }
+  return Status::OK;
+}
+
 Status Sink::Flush() { return Status::OK; }
 
+Status StringSink::AppendV(const Slice* slices, size_t count) {
+  size_t total = contents_.size();
+  for (size_t i = 0; i < count; ++i)
+    total += slices[i].size();
+  contents_.reserve(total);
+  for (size_t i = 0; i < count; ++i)
+    contents_.append(slices[i].data(), slices[i].size());
+  return Status::OK;
+}
+
+Status ChainSink::Append(Slice slice) {
+  if (slice.empty())
+    return Status::OK;
+  if (!blocks_.empty()) {
+    Block& last = blocks_.back();
+    uint8* next = last.buf.get() + last.size;
+    if (slice.ubuf() == next) {
+      // Committing the memory returned by GetAppendBuffer.
+      DCHECK_LE(last.size + slice.size(), last.capacity);
+      last.size += slice.size();
+      size_ += slice.size();
+      return Status::OK;
+    }
+  }
+  const uint8* src = slice.ubuf();
+  size_t left = slice.size();
+  while (left > 0) {
+    Block* block = blocks_.empty() ? nullptr : &blocks_.back();
+    if (block == nullptr || block->size == block->capacity)
+      block = &AddBlock(left);
+    size_t sz = std::min(left, block->capacity - block->size);
+    memcpy(block->buf.get() + block->size, src, sz);
+    block->size += sz;
+    src += sz;
+    left -= sz;
+  }
+  size_ += slice.size();
+  return Status::OK;
+}
+
+Sink::WritableBuffer ChainSink::GetAppendBuffer(size_t min_capacity, WritableBuffer /*scratch*/,
+                                                size_t desired_capacity_hint) {
+  Block* block = blocks_.empty() ? nullptr : &blocks_.back();
+  if (block == nullptr || block->capacity - block->size < std::max<size_t>(min_capacity, 1)) {
+    block = &AddBlock(std::max(min_capacity, desired_capacity_hint));
+  }
+  return WritableBuffer(block->buf.get() + block->size, block->capacity - block->size);
+}
+
+ChainSink::Block& ChainSink::AddBlock(size_t min_capacity) {
+  size_t capacity = init_block_size_;
+  if (!blocks_.empty())
+    capacity = std::min<size_t>(blocks_.back().capacity * 2, max_block_size_);
+  capacity = std::max(capacity, min_capacity);
+  blocks_.emplace_back();
+  Block& block = blocks_.back();
+  block.buf.reset(new uint8[capacity]);
+  block.capacity = capacity;
+  return block;
+}
+
+void ChainSink::Clear() {
+  blocks_.clear();
+  size_ = 0;
+}
+
+void ChainSink::Swap(ChainSink* other) {
+  blocks_.swap(other->blocks_);
+  std::swap(size_, other->size_);
+  std::swap(init_block_size_, other->init_block_size_);
+  std::swap(max_block_size_, other->max_block_size_);
+}
+
+std::vector<Slice> ChainSink::Blocks() const {
+  std::vector<Slice> res;
+  res.reserve(blocks_.size());
+  for (const Block& b : blocks_) {
+    if (b.size)
+      res.emplace_back(b.buf.get(), b.size);
+  }
+  return res;
+}
+
+Status ChainSink::WriteTo(Sink* sink) const {
+  std::vector<Slice> parts = Blocks();
+  if (parts.empty())
+    return Status::OK;
+  return sink->AppendV(parts.data(), parts.size());
+}
+
+void ChainSink::CopyTo(uint8* dest) const {
+  for (const Block& b : blocks_) {
+    memcpy(dest, b.buf.get(), b.size);
+    dest += b.size;
+  }
+}
+
+std::string ChainSink::ToString() const {
+  std::string res(size_, '\0');
+  CopyTo(reinterpret_cast<uint8*>(&res.front()));
+  return res;
+}
+
+size_t ChainSink::MemoryUsage() const {
+  size_t res = 0;
+  for (const Block& b : blocks_)
+    res += b.capacity;
+  return res;
+}
+
 BufferredSource::BufferredSource(uint32 bufsize) : buffer_(new uint8[bufsize]),
   buf_size_(bufsize) {
   peek_pos_ = buffer_.get();
@@ -7,6 +7,7 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 #include "base/integral_types.h"
 #include "base/macros.h"
 #include "strings/stringpiece.h"
@@ -62,6 +63,10 @@ class Sink {
     WritableBuffer scratch,
     size_t desired_capacity_hint = 0);
 
+  // Appends count slices in order. Sinks that can write several buffers at once (writev-like)
+  // should override it. The default implementation calls Append for each slice.
+  virtual base::Status AppendV(const strings::Slice* slices, size_t count);
+
   // Flushes internal buffers. The default implemenation does nothing. Sink
   // subclasses may use internal buffers that require calling Flush() at the end
   // of the stream.
@@ -78,10 +83,69 @@ public:
     contents_.append(slice.data(), slice.length());
     return base::Status::OK;
   }
+
+  // Reserves the total size once before copying.
+  base::Status AppendV(const strings::Slice* slices, size_t count);
+
   std::string& contents() { return contents_; }
   const std::string& contents() const { return contents_; }
 };
 
+// Sink that keeps its data in a chain of memory blocks. Blocks are never reallocated,
+// therefore growing the sink does not copy the data written so far and does not require
+// twice the memory like a growing vector does.
+// GetAppendBuffer returns memory inside the current block, so encoders can write directly
+// into it and the following Append of that memory does not copy.
+// Block sizes start with init_block_size and double up to max_block_size. No memory is
+// allocated until the first write.
+class ChainSink : public Sink {
+public:
+  explicit ChainSink(uint32 init_block_size = 256, uint32 max_block_size = 1 << 16)
+      : init_block_size_(init_block_size), max_block_size_(max_block_size) {}
+
+  base::Status Append(strings::Slice slice);
+
+  // Ignores scratch and always returns an internal buffer of at least min_capacity bytes.
+  WritableBuffer GetAppendBuffer(size_t min_capacity, WritableBuffer scratch,
+                                 size_t desired_capacity_hint = 0);
+
+  // Total number of bytes appended.
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  // Releases all the blocks.
+  void Clear();
+
+  void Swap(ChainSink* other);
+
+  // Written parts of the blocks, in order.
+  std::vector<strings::Slice> Blocks() const;
+
+  // Passes all the blocks to sink with a single AppendV call.
+  base::Status WriteTo(Sink* sink) const;
+
+  // Copies the contents into dest, which must have size() bytes.
+  void CopyTo(uint8* dest) const;
+
+  std::string ToString() const;
+
+  // Bytes allocated by the blocks.
+  size_t MemoryUsage() const;
+private:
+  struct Block {
+    std::unique_ptr<uint8[]> buf;
+    size_t size = 0;
+    size_t capacity = 0;
+  };
+
+  // Adds a block with at least min_capacity bytes.
+  Block& AddBlock(size_t min_capacity);
+
+  std::vector<Block> blocks_;
+  size_t size_ = 0;
+  uint32 init_block_size_, max_block_size_;
+};
+
 // An abstract interface for an object that produces a sequence of bytes.
 //
 // Example:
@@ -98,4 +98,51 @@ TEST_F(SourceTest, MinSize) {
   EXPECT_EQ(original_.size(), compared);
 }
 
+TEST(ChainSinkTest, Basic) {
+  ChainSink sink(16, 64);
+  EXPECT_TRUE(sink.empty());
+  EXPECT_EQ(0, sink.MemoryUsage());
+
+  string expected;
+  for (int i = 0; i < 100; ++i) {
+    string part(i % 37, 'a' + i % 26);
+    ASSERT_TRUE(sink.Append(part).ok());
+    expected.append(part);
+  }
+  EXPECT_EQ(expected.size(), sink.size());
+  EXPECT_EQ(expected, sink.ToString());
+  EXPECT_GT(sink.Blocks().size(), 1);
+
+  StringSink dest;
+  ASSERT_TRUE(sink.WriteTo(&dest).ok());
+  EXPECT_EQ(expected, dest.contents());
+
+  sink.Clear();
+  EXPECT_TRUE(sink.empty());
+  EXPECT_TRUE(sink.Blocks().empty());
+}
+
+TEST(ChainSinkTest, AppendBuffer) {
+  ChainSink sink(16, 64);
+  string expected;
+  for (int i = 0; i < 50; ++i) {
+    Sink::WritableBuffer buf = sink.GetAppendBuffer(i + 1, Sink::WritableBuffer());
+    ASSERT_GE(buf.capacity, i + 1);
+    memset(buf.ptr, 'a' + i % 26, i + 1);
+    const uint8* before = buf.ptr;
+    ASSERT_TRUE(sink.Append(buf.Prefix(i + 1)).ok());
+    expected.append(i + 1, 'a' + i % 26);
+
+    // The appended bytes were written in place.
+    vector<Slice> blocks = sink.Blocks();
+    EXPECT_EQ(before + i + 1, blocks.back().ubuf() + blocks.back().size());
+  }
+  EXPECT_EQ(expected, sink.ToString());
+
+  // Data is never moved when the chain grows.
+  Slice first = sink.Blocks().front();
+  sink.GetAppendBuffer(1000, Sink::WritableBuffer());
+  EXPECT_EQ(first.data(), sink.Blocks().front().data());
+}
+
 }  // namespace util
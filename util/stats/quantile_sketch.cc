@@ -0,0 +1,135 @@
+// Copyright 2013, Beeri 15.  All rights reserved.
+// Author: Roman Gershman (romange@gmail.com)
+//
+#include "util/stats/quantile_sketch.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "base/logging.h"
+
+namespace util {
+
+// Smaller values are counted as zeros.
+static constexpr double kMinIndexable = 1e-9;
+
+constexpr double QuantileSketch::kDefaultAccuracy;
+constexpr unsigned QuantileSketch::kDefaultMaxBuckets;
+
+QuantileSketch::QuantileSketch(double relative_accuracy, unsigned max_buckets)
+    : max_buckets_(max_buckets) {
+  CHECK(relative_accuracy > 0 && relative_accuracy < 1) << relative_accuracy;
+  CHECK_GT(max_buckets, 0);
+  gamma_ = (1 + relative_accuracy) / (1 - relative_accuracy);
+  inv_log_gamma_ = 1.0 / std::log(gamma_);
+}
+
+int32 QuantileSketch::Index(double value) const {
+  return int32(std::ceil(std::log(value) * inv_log_gamma_));
+}
+
+double QuantileSketch::Value(int32 index) const {
+  return 2 * std::pow(gamma_, index) / (gamma_ + 1);
+}
+
+void QuantileSketch::Add(double value) {
+  if (value < 0)
+    value = 0;
+  if (count_ == 0) {
+    min_ = max_ = value;
+  } else {
+    min_ = std::min(min_, value);
+    max_ = std::max(max_, value);
+  }
+  ++count_;
+  sum_ += value;
+  if (value < kMinIndexable)
+    ++zero_count_;
+  else
+    AddToBucket(Index(value), 1);
+}
+
+void QuantileSketch::AddToBucket(int32 index, uint32 count) {
+  if (counts_.empty()) {
+    offset_ = index;
+    counts_.push_back(0);
+  }
+  if (index < offset_) {
+    // Prepend empty buckets, or count the value in the lowest bucket if there is no room.
+    unsigned grow = std::min<unsigned>(offset_ - index, max_buckets_ - counts_.size());
+    counts_.insert(counts_.begin(), grow, 0);
+    offset_ -= grow;
+    index = std::max(index, offset_);
+  } else if (index - offset_ >= int32(counts_.size())) {
+    unsigned size = index - offset_ + 1;
+    if (size > max_buckets_) {
+      // Collapse the lowest buckets into the new lowest one.
+      unsigned shift = size - max_buckets_;
+      if (shift >= counts_.size()) {
+        uint32 total = 0;
+        for (uint32 c : counts_)
+          total += c;
+        counts_.assign(1, total);
+      } else {
+        uint32 collapsed = 0;
+        for (unsigned i = 0; i < shift; ++i)
+          collapsed += counts_[i];
+        counts_.erase(counts_.begin(), counts_.begin() + shift);
+        counts_[0] += collapsed;
+      }
+      offset_ += shift;
+      size = max_buckets_;
+    }
+    counts_.resize(size, 0);
+  }
+  counts_[index - offset_] += count;
+}
+
+void QuantileSketch::Merge(const QuantileSketch& other) {
+  CHECK_EQ(gamma_, other.gamma_);
+  if (other.count_ == 0)
+    return;
+  if (count_ == 0) {
+    min_ = other.min_;
+    max_ = other.max_;
+  } else {
+    min_ = std::min(min_, other.min_);
+    max_ = std::max(max_, other.max_);
+  }
+  count_ += other.count_;
+  sum_ += other.sum_;
+  zero_count_ += other.zero_count_;
+
+  // Start from the highest bucket so that if other spans more than max_buckets_,
+  // the range is set by its top and its lowest buckets are collapsed.
+  for (size_t i = other.counts_.size(); i-- > 0;) {
+    if (other.counts_[i])
+      AddToBucket(other.offset_ + i, other.counts_[i]);
+  }
+}
+
+void QuantileSketch::Clear() {
+  counts_.clear();
+  offset_ = 0;
+  zero_count_ = count_ = 0;
+  sum_ = min_ = max_ = 0;
+}
+
+double QuantileSketch::Quantile(double q) const {
+  if (count_ == 0)
+    return 0;
+  if (q >= 1)
+    return max_;
+  uint64 rank = q <= 0 ? 0 : uint64(q * (count_ - 1));
+  if (rank < zero_count_)
+    return min_;
+  uint64 sum = zero_count_;
+  for (size_t i = 0; i < counts_.size(); ++i) {
+    sum += counts_[i];
+    if (sum > rank)
+      return std::max(min_, std::min(Value(offset_ + i), max_));
+  }
+  return max_;
+}
+
+}  // namespace util
@@ -0,0 +1,177 @@
+// Copyright 2013, Beeri 15.  All rights reserved.
+// Author: Roman Gershman (romange@gmail.com)
+//
+#ifndef _UTIL_QUANTILE_SKETCH_H
+#define _UTIL_QUANTILE_SKETCH_H
+
+#include <mutex>
+#include <vector>
+#include "base/integral_types.h"
+#include "util/stats/sliding_counter.h"
+
+namespace util {
+
+/*
+  Mergeable quantile sketch of non-negative values (DDSketch). Values are counted in
+  logarithmic buckets of ratio gamma = (1 + a) / (1 - a), therefore every quantile is
+  returned with relative error at most a. Buckets are kept in a dense array that covers only
+  the observed range. When the range needs more than max_buckets, the lowest buckets are
+  collapsed, so high quantiles (latency tails) stay accurate and the memory stays bounded by
+  max_buckets * 4 bytes.
+*/
+class QuantileSketch {
+public:
+  static constexpr double kDefaultAccuracy = 0.02;
+  static constexpr unsigned kDefaultMaxBuckets = 256;
+
+  explicit QuantileSketch(double relative_accuracy = kDefaultAccuracy,
+                          unsigned max_buckets = kDefaultMaxBuckets);
+
+  // Negative values are counted as 0.
+  void Add(double value);
+
+  // other must have the same relative accuracy.
+  void Merge(const QuantileSketch& other);
+
+  void Clear();
+
+  // q in [0, 1]. Returns 0 for an empty sketch.
+  double Quantile(double q) const;
+
+  uint64 count() const { return count_; }
+  double min() const { return count_ ? min_ : 0; }
+  double max() const { return count_ ? max_ : 0; }
+  double Average() const { return count_ ? sum_ / count_ : 0; }
+
+  size_t MemoryUsage() const { return sizeof(*this) + counts_.capacity() * sizeof(uint32); }
+
+private:
+  int32 Index(double value) const;
+
+  // Representative value of the bucket, within relative_accuracy of all its values.
+  double Value(int32 index) const;
+
+  void AddToBucket(int32 index, uint32 count);
+
+  double gamma_;
+  double inv_log_gamma_;
+  unsigned max_buckets_;
+
+  // counts_[i] is the count of the bucket offset_ + i.
+  int32 offset_ = 0;
+  std::vector<uint32> counts_;
+  uint64 zero_count_ = 0;
+
+  uint64 count_ = 0;
+  double sum_ = 0;
+  double min_ = 0;
+  double max_ = 0;
+};
+
+/*
+  Quantiles over a sliding window of NUM bins, PRECISION seconds each. Keeps a QuantileSketch
+  per bin and rotates the bins with the SlidingSecondBase clock like SlidingSecondCounterT.
+  Thread-safe.
+*/
+template<unsigned NUM, unsigned PRECISION> class SlidingSecondQuantiles
+    : public SlidingSecondBase {
+public:
+  static constexpr unsigned SIZE = NUM;
+  static constexpr unsigned SPAN = PRECISION*NUM;
+
+  explicit SlidingSecondQuantiles(double relative_accuracy = QuantileSketch::kDefaultAccuracy,
+                                  unsigned max_buckets = QuantileSketch::kDefaultMaxBuckets);
+
+  void Add(double value) {
+    std::lock_guard<std::mutex> lock(mu_);
+    bins_[MoveTsIfNeeded()].Add(value);
+  }
+
+  // Merges last count bins, starting from (last_ts_ - offset) and going back, into dest.
+  // Same semantics as SlidingSecondCounterT::SumLast.
+  void MergeLast(unsigned offset, unsigned count, QuantileSketch* dest) const;
+
+  // Quantile over the whole window.
+  double Quantile(double q) const {
+    QuantileSketch sketch(accuracy_, max_buckets_);
+    MergeLast(0, NUM, &sketch);
+    return sketch.Quantile(q);
+  }
+
+  void Reset() {
+    std::lock_guard<std::mutex> lock(mu_);
+    for (QuantileSketch& bin : bins_)
+      bin.Clear();
+  }
+
+  size_t MemoryUsage() const;
+
+  static unsigned span() { return SPAN; }
+  static unsigned bin_span() {return PRECISION; }
+
+private:
+  // Must be called under mu_. Clears the bins that went out of the window and returns
+  // the current bin.
+  unsigned MoveTsIfNeeded() const;
+
+  double accuracy_;
+  unsigned max_buckets_;
+  mutable std::mutex mu_;
+  mutable QuantileSketch bins_[NUM];
+};
+
+/*********************************************
+ Implementation section.
+**********************************************/
+
+template<unsigned NUM, unsigned PRECISION>
+    SlidingSecondQuantiles<NUM, PRECISION>::SlidingSecondQuantiles(
+        double relative_accuracy, unsigned max_buckets)
+    : accuracy_(relative_accuracy), max_buckets_(max_buckets) {
+  static_assert(NUM > 1, "Invalid window size");
+  for (QuantileSketch& bin : bins_)
+    bin = QuantileSketch(relative_accuracy, max_buckets);
+}
+
+template<unsigned NUM, unsigned PRECISION>
+    unsigned SlidingSecondQuantiles<NUM, PRECISION>::MoveTsIfNeeded() const {
+  uint32 current_time = CurrentTime() / PRECISION;
+  uint32 last_ts = last_ts_;
+  if (last_ts >= current_time)
+    return last_ts % NUM;
+  if (last_ts + NUM <= current_time) {
+    for (QuantileSketch& bin : bins_)
+      bin.Clear();
+  } else {
+    for (uint32 i = last_ts + 1; i <= current_time; ++i)
+      bins_[i % NUM].Clear();
+  }
+  last_ts_.atomic().store(current_time, std::memory_order_relaxed);
+  return current_time % NUM;
+}
+
+template<unsigned NUM, unsigned PRECISION>
+    void SlidingSecondQuantiles<NUM, PRECISION>::MergeLast(
+        unsigned offset, unsigned count, QuantileSketch* dest) const {
+  DCHECK_LT(offset, NUM);
+  if (count > NUM - offset)
+    count = NUM - offset;
+  std::lock_guard<std::mutex> lock(mu_);
+  int32 start = int32(MoveTsIfNeeded()) - offset - count + 1;
+  if (start < 0) start += NUM;
+  for (unsigned i = 0; i < count; ++i)
+    dest->Merge(bins_[(start + i) % NUM]);
+}
+
+template<unsigned NUM, unsigned PRECISION>
+    size_t SlidingSecondQuantiles<NUM, PRECISION>::MemoryUsage() const {
+  std::lock_guard<std::mutex> lock(mu_);
+  size_t res = sizeof(*this) - sizeof(bins_);
+  for (const QuantileSketch& bin : bins_)
+    res += bin.MemoryUsage();
+  return res;
+}
+
+}  // namespace util
+
+#endif  // _UTIL_QUANTILE_SKETCH_H
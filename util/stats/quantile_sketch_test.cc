@@ -0,0 +1,130 @@
+// Copyright 2013, Beeri 15.  All rights reserved.
+// Author: Roman Gershman (romange@gmail.com)
+//
+#include "util/stats/quantile_sketch.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "base/gtest.h"
+#include "base/random.h"
+
+namespace util {
+
+// Log-uniform values from 1 to ~8000.
+static std::vector<double> Values(unsigned count) {
+  std::vector<double> values(count);
+  MTRandom rand(10);
+  for (double& v : values)
+    v = std::exp(rand.RandDouble() * 9);
+  return values;
+}
+
+class QuantileSketchTest : public testing::Test {
+};
+
+TEST_F(QuantileSketchTest, Accuracy) {
+  QuantileSketch sketch;
+  EXPECT_EQ(0, sketch.Quantile(0.5));
+
+  std::vector<double> values = Values(100000);
+  for (double v : values)
+    sketch.Add(v);
+  std::sort(values.begin(), values.end());
+  EXPECT_EQ(values.size(), sketch.count());
+  EXPECT_EQ(values.front(), sketch.min());
+  EXPECT_EQ(values.back(), sketch.max());
+  for (double q : {0.0, 0.01, 0.25, 0.5, 0.9, 0.99, 0.999, 1.0}) {
+    double expected = values[q * (values.size() - 1)];
+    EXPECT_NEAR(expected, sketch.Quantile(q), expected * QuantileSketch::kDefaultAccuracy) << q;
+  }
+  EXPECT_LE(sketch.MemoryUsage(), 2048);
+
+  sketch.Clear();
+  sketch.Add(0);
+  sketch.Add(-5);
+  sketch.Add(7);
+  EXPECT_EQ(0, sketch.Quantile(0.5));
+  EXPECT_EQ(7, sketch.Quantile(1));
+}
+
+TEST_F(QuantileSketchTest, CollapseLowest) {
+  QuantileSketch sketch(0.01, 64);
+  std::vector<double> values = Values(10000);
+  for (double v : values)
+    sketch.Add(v);
+  std::sort(values.begin(), values.end());
+
+  // 64 buckets of 1% cover less than 4x, so only the highest quantiles are accurate.
+  for (double q : {0.99, 0.999}) {
+    double expected = values[q * (values.size() - 1)];
+    EXPECT_NEAR(expected, sketch.Quantile(q), expected * 0.01) << q;
+  }
+  EXPECT_GE(sketch.Quantile(0.01), values.back() / 4);
+  EXPECT_LE(sketch.MemoryUsage(), sizeof(sketch) + 64 * sizeof(uint32) * 2);
+}
+
+TEST_F(QuantileSketchTest, Merge) {
+  QuantileSketch all, a, b;
+  std::vector<double> values = Values(10000);
+  for (unsigned i = 0; i < values.size(); ++i) {
+    all.Add(values[i]);
+    (i % 3 ? a : b).Add(values[i] * (i % 3 ? 1 : 1000));
+  }
+  a.Merge(b);
+  EXPECT_EQ(all.count(), a.count());
+  EXPECT_LE(a.max(), all.max() * 1000);
+  QuantileSketch empty;
+  a.Merge(empty);
+  empty.Merge(all);
+  for (double q : {0.1, 0.5, 0.99})
+    EXPECT_EQ(all.Quantile(q), empty.Quantile(q));
+}
+
+TEST_F(QuantileSketchTest, Sliding) {
+  SlidingSecondBase::SetCurrentTime_Test(100);
+  SlidingSecondQuantiles<6, 10> window;
+  for (unsigned i = 1; i <= 100; ++i)
+    window.Add(i);
+  EXPECT_NEAR(50, window.Quantile(0.5), 1);
+
+  SlidingSecondBase::SetCurrentTime_Test(110);
+  for (unsigned i = 0; i < 100; ++i)
+    window.Add(1000);
+  EXPECT_NEAR(1000, window.Quantile(0.99), 20);
+  EXPECT_NEAR(100, window.Quantile(0.5), 2);
+
+  QuantileSketch last;
+  window.MergeLast(0, 1, &last);
+  EXPECT_EQ(100, last.count());
+  EXPECT_NEAR(1000, last.Quantile(0.01), 20);
+
+  QuantileSketch prev;
+  window.MergeLast(1, 1, &prev);
+  EXPECT_EQ(100, prev.count());
+  EXPECT_EQ(100, prev.max());
+
+  // The first bin goes out of the window.
+  SlidingSecondBase::SetCurrentTime_Test(160);
+  EXPECT_NEAR(1000, window.Quantile(0.01), 20);
+  SlidingSecondBase::SetCurrentTime_Test(170);
+  EXPECT_EQ(0, window.Quantile(0.5));
+  EXPECT_LT(window.MemoryUsage(), 8192);
+
+  window.Add(5);
+  window.Reset();
+  EXPECT_EQ(0, window.Quantile(0.5));
+}
+
+static void BM_Add(benchmark::State& state) {
+  QuantileSketch sketch;
+  std::vector<double> values = Values(1 << 12);
+  unsigned i = 0;
+  while (state.KeepRunning()) {
+    sketch.Add(values[i++ & ((1 << 12) - 1)]);
+  }
+  base::sink_result(sketch.count());
+}
+BENCHMARK(BM_Add);
+
+}  // namespace util
@@ -0,0 +1,178 @@
+// Copyright 2013, Beeri 15.  All rights reserved.
+// Author: Roman Gershman (romange@gmail.com)
+//
+#include "util/stats/sketches.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "base/bits.h"
+#include "base/logging.h"
+
+namespace util {
+
+HyperLogLog::HyperLogLog(unsigned precision) : precision_(precision) {
+  CHECK(precision >= 4 && precision <= 18) << precision;
+  registers_.reset(new std::atomic<uint8>[1U << precision]);
+  Clear();
+}
+
+uint8 HyperLogLog::Rank(uint64 hash) const {
+  // The sentinel bit limits the rank to 64 - precision_ + 1.
+  uint64 w = (hash << precision_) | (1ULL << (precision_ - 1));
+  return 64 - Bits::FindMSBSetNonZero64(w);
+}
+
+void HyperLogLog::UpdateRegister(unsigned index, uint8 rank) {
+  uint8 current = registers_[index].load(std::memory_order_relaxed);
+  while (rank > current &&
+         !registers_[index].compare_exchange_weak(current, rank, std::memory_order_relaxed)) {
+  }
+}
+
+uint64 HyperLogLog::Estimate() const {
+  const unsigned m = 1U << precision_;
+  double sum = 0;
+  unsigned zeros = 0;
+  for (unsigned i = 0; i < m; ++i) {
+    uint8 reg = registers_[i].load(std::memory_order_relaxed);
+    sum += std::ldexp(1.0, -reg);
+    zeros += (reg == 0);
+  }
+  double alpha = m == 16 ? 0.673 : m == 32 ? 0.697 : m == 64 ? 0.709 : 0.7213 / (1 + 1.079 / m);
+  double estimate = alpha * m * m / sum;
+
+  // Linear counting is more accurate for small cardinalities. 64-bit hashes do not need
+  // the large range correction.
+  if (estimate <= 2.5 * m && zeros > 0)
+    estimate = m * std::log(double(m) / zeros);
+  return uint64(estimate + 0.5);
+}
+
+void HyperLogLog::Merge(const HyperLogLog& other) {
+  CHECK_EQ(precision_, other.precision_);
+  for (unsigned i = 0; i < (1U << precision_); ++i)
+    UpdateRegister(i, other.registers_[i].load(std::memory_order_relaxed));
+}
+
+void HyperLogLog::Clear() {
+  for (unsigned i = 0; i < (1U << precision_); ++i)
+    registers_[i].store(0, std::memory_order_relaxed);
+}
+
+CountMinSketch::CountMinSketch(unsigned width_bits, unsigned depth)
+    : width_(1U << width_bits), depth_(depth) {
+  CHECK_LT(width_bits, 32);
+  CHECK_GT(depth, 0);
+  counters_.reset(new std::atomic<uint64>[size_t(depth_) * width_]);
+  Clear();
+}
+
+uint64 CountMinSketch::Add(uint64 hash, uint32 delta) {
+  uint64 res = kuint64max;
+  for (unsigned row = 0; row < depth_; ++row) {
+    uint64 val = Cell(hash, row).fetch_add(delta, std::memory_order_relaxed) + delta;
+    res = std::min(res, val);
+  }
+  return res;
+}
+
+uint64 CountMinSketch::Estimate(uint64 hash) const {
+  uint64 res = kuint64max;
+  for (unsigned row = 0; row < depth_; ++row)
+    res = std::min(res, Cell(hash, row).load(std::memory_order_relaxed));
+  return res;
+}
+
+void CountMinSketch::Clear() {
+  for (size_t i = 0; i < size_t(depth_) * width_; ++i)
+    counters_[i].store(0, std::memory_order_relaxed);
+}
+
+HeavyHitters::HeavyHitters(unsigned k, unsigned width_bits, unsigned depth)
+    : counts_(width_bits, depth), k_(k), threshold_(0), hashes_(new std::atomic<uint64>[k]),
+      keys_(k) {
+  CHECK_GT(k, 0);
+  for (unsigned i = 0; i < k_; ++i)
+    hashes_[i].store(0, std::memory_order_relaxed);
+}
+
+bool HeavyHitters::IsCandidate(uint64 hash) const {
+  for (unsigned i = 0; i < k_; ++i) {
+    if (hashes_[i].load(std::memory_order_relaxed) == hash)
+      return true;
+  }
+  return false;
+}
+
+void HeavyHitters::Add(StringPiece key, uint64 hash, uint32 delta) {
+  if (hash == 0)
+    hash = 1;
+  uint64 estimate = counts_.Add(hash, delta);
+  if (estimate <= threshold_.load(std::memory_order_relaxed) || IsCandidate(hash))
+    return;
+
+  std::lock_guard<std::mutex> lock(mu_);
+  if (IsCandidate(hash))
+    return;
+
+  // Replace an empty slot or the candidate with the smallest estimate.
+  unsigned victim = 0;
+  uint64 victim_count = kuint64max;
+  for (unsigned i = 0; i < k_; ++i) {
+    uint64 h = hashes_[i].load(std::memory_order_relaxed);
+    uint64 count = h ? counts_.Estimate(h) : 0;
+    if (count < victim_count) {
+      victim = i;
+      victim_count = count;
+    }
+  }
+  if (victim_count < estimate) {
+    keys_[victim] = key.as_string();
+    hashes_[victim].store(hash, std::memory_order_relaxed);
+    victim_count = kuint64max;
+    for (unsigned i = 0; i < k_; ++i) {
+      uint64 h = hashes_[i].load(std::memory_order_relaxed);
+      victim_count = std::min(victim_count, h ? counts_.Estimate(h) : 0);
+    }
+  }
+  threshold_.store(victim_count, std::memory_order_relaxed);
+}
+
+std::vector<std::pair<std::string, uint64>> HeavyHitters::TopK() const {
+  std::vector<std::pair<std::string, uint64>> res;
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    for (unsigned i = 0; i < k_; ++i) {
+      uint64 h = hashes_[i].load(std::memory_order_relaxed);
+      if (h)
+        res.emplace_back(keys_[i], counts_.Estimate(h));
+    }
+  }
+  std::sort(res.begin(), res.end(),
+            [](const std::pair<std::string, uint64>& a, const std::pair<std::string, uint64>& b) {
+              return a.second > b.second;
+            });
+  return res;
+}
+
+void HeavyHitters::Clear() {
+  std::lock_guard<std::mutex> lock(mu_);
+  counts_.Clear();
+  for (unsigned i = 0; i < k_; ++i) {
+    hashes_[i].store(0, std::memory_order_relaxed);
+    keys_[i].clear();
+  }
+  threshold_.store(0, std::memory_order_relaxed);
+}
+
+size_t HeavyHitters::MemoryUsage() const {
+  std::lock_guard<std::mutex> lock(mu_);
+  size_t res = sizeof(*this) + counts_.MemoryUsage() - sizeof(counts_) +
+      k_ * (sizeof(std::atomic<uint64>) + sizeof(std::string));
+  for (const std::string& key : keys_)
+    res += key.capacity();
+  return res;
+}
+
+}  // namespace util
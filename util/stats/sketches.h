@@ -0,0 +1,121 @@
+// Copyright 2013, Beeri 15.  All rights reserved.
+// Author: Roman Gershman (romange@gmail.com)
+//
+#ifndef _UTIL_SKETCHES_H
+#define _UTIL_SKETCHES_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include "base/integral_types.h"
+#include "strings/stringpiece.h"
+
+namespace util {
+
+/*
+  Estimates the number of distinct 64-bit hashes with 2^precision one byte registers.
+  The standard error is 1.04 / sqrt(2^precision), i.e. 1.6% for the default 4KB.
+  Add is lock-free and thread-safe.
+*/
+class HyperLogLog {
+public:
+  explicit HyperLogLog(unsigned precision = 12);
+
+  void Add(uint64 hash) {
+    unsigned index = hash >> (64 - precision_);
+    uint8 rank = Rank(hash);
+    if (rank > registers_[index].load(std::memory_order_relaxed))
+      UpdateRegister(index, rank);
+  }
+
+  uint64 Estimate() const;
+
+  // other must have the same precision.
+  void Merge(const HyperLogLog& other);
+
+  void Clear();
+
+  size_t MemoryUsage() const { return sizeof(*this) + (1U << precision_); }
+
+private:
+  // Position of the first set bit in the hash bits that are not used for the index.
+  uint8 Rank(uint64 hash) const;
+  void UpdateRegister(unsigned index, uint8 rank);
+
+  unsigned precision_;
+  std::unique_ptr<std::atomic<uint8>[]> registers_;
+};
+
+/*
+  Count-Min sketch: depth rows of 2^width_bits counters. Estimate never underestimates and
+  overestimates by at most e * total / 2^width_bits with probability 1 - exp(-depth).
+  Add is lock-free and thread-safe.
+*/
+class CountMinSketch {
+public:
+  explicit CountMinSketch(unsigned width_bits = 10, unsigned depth = 4);
+
+  // Returns the estimate of hash including delta.
+  uint64 Add(uint64 hash, uint32 delta = 1);
+
+  uint64 Estimate(uint64 hash) const;
+
+  void Clear();
+
+  size_t MemoryUsage() const { return sizeof(*this) + size_t(depth_) * width_ * sizeof(uint64); }
+
+private:
+  std::atomic<uint64>& Cell(uint64 hash, unsigned row) const {
+    // Double hashing with the two halves of the hash.
+    uint32 h1 = hash, h2 = (hash >> 32) | 1;
+    return counters_[row * width_ + ((h1 + row * h2) & (width_ - 1))];
+  }
+
+  unsigned width_;
+  unsigned depth_;
+  std::unique_ptr<std::atomic<uint64>[]> counters_;
+};
+
+/*
+  Tracks the k most frequent keys. Counts are kept in a CountMinSketch and a key is copied
+  into the table of k candidates only when its estimate exceeds the smallest estimate among
+  the candidates. Therefore Add takes a lock only when a key enters the top k and memory does
+  not depend on the number of distinct keys. Thread-safe.
+*/
+class HeavyHitters {
+public:
+  explicit HeavyHitters(unsigned k, unsigned width_bits = 10, unsigned depth = 4);
+
+  // hash must be a good 64-bit hash of key.
+  void Add(StringPiece key, uint64 hash, uint32 delta = 1);
+
+  // Returns up to k keys with their estimated counts, sorted by decreasing count.
+  std::vector<std::pair<std::string, uint64>> TopK() const;
+
+  void Clear();
+
+  size_t MemoryUsage() const;
+
+private:
+  bool IsCandidate(uint64 hash) const;
+
+  CountMinSketch counts_;
+  unsigned k_;
+
+  // The smallest estimate among the candidates once the table is full, 0 before that.
+  // Can only lag behind the actual estimates.
+  std::atomic<uint64> threshold_;
+
+  // Hashes of the candidates, 0 for an empty slot. Written under mu_.
+  std::unique_ptr<std::atomic<uint64>[]> hashes_;
+
+  mutable std::mutex mu_;
+  std::vector<std::string> keys_;
+};
+
+}  // namespace util
+
+#endif  // _UTIL_SKETCHES_H
@@ -0,0 +1,138 @@
+// Copyright 2013, Beeri 15.  All rights reserved.
+// Author: Roman Gershman (romange@gmail.com)
+//
+#include "util/stats/sketches.h"
+
+#include <thread>
+#include "base/gtest.h"
+#include "base/hash.h"
+
+namespace util {
+
+static uint64 Hash(const std::string& key) {
+  return base::Fingerprint(key);
+}
+
+class SketchesTest : public testing::Test {
+};
+
+TEST_F(SketchesTest, HyperLogLog) {
+  HyperLogLog hll;
+  EXPECT_EQ(0, hll.Estimate());
+  for (unsigned count : {10, 1000, 100000, 1000000}) {
+    hll.Clear();
+    for (unsigned i = 0; i < count; ++i) {
+      uint64 h = Hash(std::to_string(i));
+      hll.Add(h);
+      hll.Add(h);
+    }
+    EXPECT_NEAR(count, hll.Estimate(), count * 0.05 + 1) << count;
+  }
+  EXPECT_LE(hll.MemoryUsage(), 4200);
+
+  HyperLogLog a, b;
+  for (unsigned i = 0; i < 20000; ++i)
+    (i % 2 ? a : b).Add(Hash(std::to_string(i)));
+  a.Merge(b);
+  EXPECT_NEAR(20000, a.Estimate(), 1000);
+}
+
+TEST_F(SketchesTest, CountMin) {
+  CountMinSketch cms(8, 4);
+  EXPECT_EQ(0, cms.Estimate(Hash("foo")));
+  EXPECT_EQ(5, cms.Add(Hash("foo"), 5));
+  EXPECT_EQ(6, cms.Add(Hash("foo")));
+  for (unsigned i = 0; i < 1000; ++i)
+    cms.Add(Hash(std::to_string(i)));
+  uint64 foo = cms.Estimate(Hash("foo"));
+  EXPECT_GE(foo, 6);
+  EXPECT_LE(foo, 6 + 1000 * 2.72 / 256);
+  cms.Clear();
+  EXPECT_EQ(0, cms.Estimate(Hash("foo")));
+}
+
+// Zipf-like traffic: key i appears about 10000 / (i + 1) times.
+TEST_F(SketchesTest, HeavyHitters) {
+  HeavyHitters hh(5);
+  EXPECT_TRUE(hh.TopK().empty());
+  for (unsigned round = 0; round < 10000; ++round) {
+    for (unsigned i = 0; i < 1000 && round < 10000 / (i + 1); ++i) {
+      std::string key = "key" + std::to_string(i);
+      hh.Add(key, Hash(key));
+    }
+  }
+  auto top = hh.TopK();
+  ASSERT_EQ(5, top.size());
+  for (unsigned i = 0; i < 5; ++i) {
+    EXPECT_EQ("key" + std::to_string(i), top[i].first);
+    EXPECT_GE(top[i].second, 10000 / (i + 1));
+  }
+  size_t mem = hh.MemoryUsage();
+  for (unsigned i = 0; i < 100000; ++i) {
+    std::string key = "rare" + std::to_string(i);
+    hh.Add(key, Hash(key));
+  }
+  EXPECT_EQ(mem, hh.MemoryUsage());
+  EXPECT_EQ("key0", hh.TopK()[0].first);
+
+  hh.Clear();
+  EXPECT_TRUE(hh.TopK().empty());
+}
+
+TEST_F(SketchesTest, Concurrent) {
+  HeavyHitters hh(3);
+  HyperLogLog hll;
+  std::vector<std::thread> threads;
+  for (unsigned t = 0; t < 4; ++t) {
+    threads.emplace_back([&hh, &hll, t] {
+      for (unsigned i = 0; i < 20000; ++i) {
+        std::string key = std::to_string(i % 7 == 0 ? i % 3 : t * 100000 + i);
+        uint64 h = Hash(key);
+        hll.Add(h);
+        hh.Add(key, h);
+      }
+    });
+  }
+  for (auto& t : threads)
+    t.join();
+  auto top = hh.TopK();
+  ASSERT_EQ(3, top.size());
+  for (const auto& k_v : top) {
+    EXPECT_LT(k_v.first, "3");
+    EXPECT_GE(k_v.second, 4 * 20000 / 21);
+  }
+  EXPECT_NEAR(4 * 20000 * 6 / 7, hll.Estimate(), 3000);
+}
+
+static void BM_HeavyHittersAdd(benchmark::State& state) {
+  static HeavyHitters* hh = nullptr;
+  if (state.thread_index == 0)
+    hh = new HeavyHitters(10);
+  std::vector<std::pair<std::string, uint64>> keys;
+  for (unsigned i = 0; i < 1024; ++i) {
+    std::string key = "http://www.example.com/" + std::to_string(i * i % 97);
+    keys.emplace_back(key, Hash(key));
+  }
+  unsigned i = 0;
+  while (state.KeepRunning()) {
+    const auto& k = keys[i++ % keys.size()];
+    hh->Add(k.first, k.second);
+  }
+  if (state.thread_index == 0) {
+    delete hh;
+  }
+}
+BENCHMARK(BM_HeavyHittersAdd)->ThreadRange(1, 8);
+
+static void BM_HyperLogLogAdd(benchmark::State& state) {
+  HyperLogLog hll;
+  uint64 h = 1;
+  while (state.KeepRunning()) {
+    hll.Add(h);
+    h = h * 6364136223846793005ULL + 1442695040888963407ULL;
+  }
+  base::sink_result(hll.Estimate());
+}
+BENCHMARK(BM_HyperLogLogAdd);
+
+}  // namespace util
@@ -21,6 +21,7 @@ static pthread_t g_time_update_thread = 0;
 static bool g_test_used = false;
 
 std::atomic<uint32> SlidingSecondBase::current_time_global_ = ATOMIC_VAR_INIT(0);
+__thread unsigned SlidingSecondBase::thread_index_ = kuint32max;
 
 SlidingSecondBase::SlidingSecondBase() {
   pthread_once(&g_init_once, &SlidingSecondBase::InitTimeGlobal);
@@ -52,16 +53,15 @@ void* SlidingSecondBase::UpdateTimeGlobal(void*) {
   return nullptr;
 }
 
+void SlidingSecondBase::AssignThreadIndex() {
+  static std::atomic<unsigned> next_index(0);
+  thread_index_ = next_index.fetch_add(1, std::memory_order_relaxed);
+}
+
 void SlidingSecondBase::SetCurrentTime_Test(uint32 time_val) {
   g_test_used = true;
   current_time_global_.store(time_val, std::memory_order_release);
 }
 
-uint32 QPSCount::Get() const {
-  constexpr unsigned kWinSize = decltype(window_)::SIZE - 1;
-
-  return window_.SumLast(1, kWinSize) / kWinSize; // Average over kWinSize values.
-}
-
 
 }  // namespace util
\ No newline at end of file
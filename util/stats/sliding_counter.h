@@ -9,6 +9,7 @@
 #include "base/atomic_wrapper.h"
 #include "base/integral_types.h"
 #include "base/logging.h"
+#include "base/port.h"
 
 namespace util {
 
@@ -21,13 +22,21 @@ protected:
 
   static uint32 CurrentTime() { return current_time_global_.load(std::memory_order_relaxed); }
 
+  // Returns a small number which is assigned to each thread in round robin order.
+  static unsigned ThreadIndex() {
+    if (PREDICT_FALSE(thread_index_ == kuint32max))
+      AssignThreadIndex();
+    return thread_index_;
+  }
 
   mutable base::atomic_wrapper<uint32> last_ts_;
 private:
   static void InitTimeGlobal();
   static void* UpdateTimeGlobal(void*);
+  static void AssignThreadIndex();
 
   static std::atomic<uint32> current_time_global_;
+  static __thread unsigned thread_index_;
 };
 
 template<typename T, unsigned NUM, unsigned PRECISION> class SlidingSecondCounterT
@@ -95,11 +104,62 @@ public:
 template<unsigned NUM, unsigned PRECISION> using SlidingSecondCounter =
     SlidingSecondCounterT<uint32, NUM, PRECISION>;
 
-class QPSCount {
+// SlidingSecondCounterT for counters that are incremented by many threads.
+// Every thread increments one of SHARDS cache line aligned counters, so threads do not
+// contend on the bins or on last_ts_. Every shard rotates its bins like SlidingSecondCounterT
+// does, and reads sum all the shards. DecIfNotLess is not supported because it can not be
+// atomic across shards.
+template<typename T, unsigned NUM, unsigned PRECISION, unsigned SHARDS = 16>
+    class ShardedSlidingSecondCounterT : public SlidingSecondBase {
+  struct Shard {
+    SlidingSecondCounterT<T, NUM, PRECISION> counter;
+  } CACHELINE_ALIGNED;
+
+  Shard shards_[SHARDS];
+
+public:
+  static constexpr unsigned SIZE = NUM;
+  static constexpr unsigned SPAN = PRECISION*NUM;
+
+  void Inc() { IncBy(1); }
+
+  // Returns the previous value of the current bin of this thread's shard.
+  T IncBy(int32 delta) {
+    return shards_[ThreadIndex() % SHARDS].counter.IncBy(delta);
+  }
+
+  T SumLast(unsigned offset, unsigned count = unsigned(-1)) const {
+    T sum = 0;
+    for (const Shard& shard : shards_)
+      sum += shard.counter.SumLast(offset, count);
+    return sum;
+  }
+
+  T Sum() const {
+    T sum = 0;
+    for (const Shard& shard : shards_)
+      sum += shard.counter.Sum();
+    return sum;
+  }
+
+  void Reset() {
+    for (Shard& shard : shards_)
+      shard.counter.Reset();
+  }
+
+  static unsigned span() { return SPAN; }
+  static unsigned bin_span() {return PRECISION; }
+};
+
+template<unsigned NUM, unsigned PRECISION> using ShardedSlidingSecondCounter =
+    ShardedSlidingSecondCounterT<uint32, NUM, PRECISION>;
+
+// Window is SlidingSecondCounter<10, 1> or ShardedSlidingSecondCounter<10, 1>.
+template<typename Window> class QPSCountT {
   // We store 1s resolution in 10 cells window.
   // This way we can reliable read 8 already finished counts when we have another 2
   // to be filled up.
-  SlidingSecondCounter<10, 1> window_;
+  Window window_;
 
 public:
   void Reset() { window_.Reset(); }
@@ -108,9 +168,19 @@ public:
     window_.Inc();
   }
 
-  uint32 Get() const;
+  uint32 Get() const {
+    constexpr unsigned kWinSize = Window::SIZE - 1;
+
+    return window_.SumLast(1, kWinSize) / kWinSize; // Average over kWinSize values.
+  }
 };
 
+typedef QPSCountT<SlidingSecondCounter<10, 1>> QPSCount;
+
+// For counters that are incremented by many threads. Takes about 1KB (a cache line per shard)
+// instead of the 44 bytes of QPSCount.
+typedef QPSCountT<ShardedSlidingSecondCounter<10, 1>> ShardedQPSCount;
+
 
 
 /*********************************************
@@ -3,6 +3,8 @@
 //
 #include "util/stats/sliding_counter.h"
 
+#include <thread>
+#include <vector>
 #include "base/gtest.h"
 #include "base/logging.h"
 #include "util/stats/hour_counter.h"
@@ -50,6 +52,47 @@ TEST_F(SlidingSecondCounterTest, Basic) {
   EXPECT_LE(sizeof(SlidingSecondCounter<10,1>), 44);
 }
 
+TEST_F(SlidingSecondCounterTest, Sharded) {
+  SlidingSecondBase::SetCurrentTime_Test(1);
+  ShardedSlidingSecondCounter<10,1> counter;
+  std::vector<std::thread> threads;
+  for (unsigned i = 0; i < 20; ++i) {
+    threads.emplace_back([&counter] {
+      for (unsigned j = 0; j < 1000; ++j)
+        counter.Inc();
+    });
+  }
+  for (auto& t : threads)
+    t.join();
+  EXPECT_EQ(20000, counter.Sum());
+
+  SlidingSecondBase::SetCurrentTime_Test(2);
+  EXPECT_EQ(0, counter.SumLast(0, 1));
+  EXPECT_EQ(20000, counter.SumLast(1, 1));
+  counter.IncBy(5);
+  EXPECT_EQ(5, counter.SumLast(0, 1));
+  EXPECT_EQ(20005, counter.Sum());
+
+  SlidingSecondBase::SetCurrentTime_Test(11);
+  EXPECT_EQ(5, counter.Sum());
+  SlidingSecondBase::SetCurrentTime_Test(12);
+  EXPECT_EQ(0, counter.Sum());
+
+  QPSCount qps;
+  ShardedQPSCount sharded_qps;
+  for (unsigned i = 0; i < 90; ++i) {
+    qps.Inc();
+    sharded_qps.Inc();
+  }
+  SlidingSecondBase::SetCurrentTime_Test(13);
+  EXPECT_EQ(10, qps.Get());
+  EXPECT_EQ(10, sharded_qps.Get());
+  EXPECT_LT(sizeof(qps), 64);
+  counter.Inc();
+  counter.Reset();
+  EXPECT_EQ(0, counter.Sum());
+}
+
 #if 0
 DECLARE_BENCHMARK_FUNC(BM_IncFresh, iters) {
   SlidingCounterBase<uint32, 17> window;
@@ -67,6 +110,29 @@ DECLARE_BENCHMARK_FUNC(BM_IncSecondCounter, iters) {
   }
 }
 
+// Increments the counter from 4 threads.
+template<typename Counter> void IncFromThreads(Counter* counter, int iters) {
+  std::vector<std::thread> threads;
+  for (unsigned i = 0; i < 4; ++i) {
+    threads.emplace_back([counter, iters] {
+      for (int j = 0; j < iters / 4; ++j)
+        counter->Inc();
+    });
+  }
+  for (auto& t : threads)
+    t.join();
+}
+
+DECLARE_BENCHMARK_FUNC(BM_IncShared4Threads, iters) {
+  SlidingSecondCounter<10,1> cnt;
+  IncFromThreads(&cnt, iters);
+}
+
+DECLARE_BENCHMARK_FUNC(BM_IncSharded4Threads, iters) {
+  ShardedSlidingSecondCounter<10,1> cnt;
+  IncFromThreads(&cnt, iters);
+}
+
 #if 0
 DECLARE_BENCHMARK_FUNC(BM_Sum, iters) {
   SlidingCounterBase<uint32, 17> window;
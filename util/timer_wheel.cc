@@ -0,0 +1,175 @@
+// Copyright 2013, Beeri 15.  All rights reserved.
+// Author: Roman Gershman (romange@gmail.com)
+//
+#include "util/timer_wheel.h"
+
+#include <algorithm>
+#include "base/bits.h"
+#include "base/logging.h"
+
+namespace util {
+
+constexpr unsigned TimerWheel::kLevelBits;
+constexpr unsigned TimerWheel::kSlots;
+constexpr unsigned TimerWheel::kLevels;
+constexpr uint64 TimerWheel::kMaxRange;
+
+namespace {
+
+inline uint64 RotateRight(uint64 v, unsigned shift) {
+  return shift == 0 ? v : (v >> shift) | (v << (64 - shift));
+}
+
+}  // namespace
+
+TimerWheel::TimerWheel(uint64 now_tick) : now_(now_tick) {
+  std::fill(heads_, heads_ + kLevels * kSlots, kNil);
+  std::fill(occupied_, occupied_ + kLevels, 0);
+}
+
+unsigned TimerWheel::SlotFor(uint64 deadline) const {
+  // The furthest tick the top level can hold: the start of the slot just before now_'s slot
+  // in the next rotation. Later deadlines are parked there and cascade again. A deadline
+  // that maps to now_'s own top level slot would be processed and relinked forever.
+  constexpr unsigned kTopShift = (kLevels - 1) * kLevelBits;
+  uint64 furthest = ((now_ >> kTopShift) + kSlots - 1) << kTopShift;
+  deadline = std::min(std::max(deadline, now_), furthest);
+  uint64 masked = (deadline ^ now_) | (kSlots - 1);
+  unsigned level = Bits::FindMSBSetNonZero64(masked) / kLevelBits;
+  level = std::min(level, kLevels - 1);
+  return level * kSlots + ((deadline >> (level * kLevelBits)) & (kSlots - 1));
+}
+
+void TimerWheel::Link(uint32 index) {
+  Timer& t = timers_[index];
+  unsigned slot = SlotFor(t.deadline);
+  t.slot = slot;
+  t.prev = kNil;
+  t.next = heads_[slot];
+  if (t.next != kNil)
+    timers_[t.next].prev = index;
+  heads_[slot] = index;
+  occupied_[slot / kSlots] |= uint64(1) << (slot % kSlots);
+}
+
+void TimerWheel::Unlink(uint32 index) {
+  Timer& t = timers_[index];
+  DCHECK_NE(kNoSlot, t.slot);
+  if (t.prev != kNil) {
+    timers_[t.prev].next = t.next;
+  } else {
+    heads_[t.slot] = t.next;
+    if (t.next == kNil)
+      occupied_[t.slot / kSlots] &= ~(uint64(1) << (t.slot % kSlots));
+  }
+  if (t.next != kNil)
+    timers_[t.next].prev = t.prev;
+  t.slot = kNoSlot;
+  t.prev = t.next = kNil;
+}
+
+void TimerWheel::Free(uint32 index) {
+  Timer& t = timers_[index];
+  t.cb = nullptr;
+  t.generation = (t.generation + 1) & kGenerationMask;
+  if (t.generation == 0)
+    t.generation = 1;
+  free_list_.push_back(index);
+  --size_;
+}
+
+TimerWheel::Id TimerWheel::Add(Callback cb, uint64 deadline_tick, uint64 period_ticks) {
+  uint32 index;
+  if (free_list_.empty()) {
+    index = timers_.size();
+    timers_.emplace_back();
+  } else {
+    index = free_list_.back();
+    free_list_.pop_back();
+  }
+  Timer& t = timers_[index];
+  t.cb = std::move(cb);
+  t.deadline = deadline_tick;
+  t.period = period_ticks;
+  Link(index);
+  ++size_;
+  return (uint64(t.generation) << 32) | index;
+}
+
+bool TimerWheel::Remove(Id id) {
+  uint32 index = id & kuint32max;
+  if (index >= timers_.size())
+    return false;
+  Timer& t = timers_[index];
+  if (t.generation != (id >> 32) || t.slot == kNoSlot)
+    return false;
+  Unlink(index);
+  Free(index);
+  return true;
+}
+
+bool TimerWheel::NextSlot(unsigned* slot, uint64* tick) const {
+  bool found = false;
+  for (unsigned level = 0; level < kLevels; ++level) {
+    if (occupied_[level] == 0)
+      continue;
+    const unsigned shift = level * kLevelBits;
+    const unsigned now_index = (now_ >> shift) & (kSlots - 1);
+
+    // Slots before now_index belong to the next rotation of this level.
+    unsigned dist = Bits::FindLSBSetNonZero64(RotateRight(occupied_[level], now_index));
+    uint64 level_start = (now_ >> shift >> kLevelBits) << kLevelBits << shift;
+    uint64 slot_tick = level_start + (uint64(now_index + dist) << shift);
+    slot_tick = std::max(slot_tick, now_);
+    if (!found || slot_tick < *tick) {
+      found = true;
+      *tick = slot_tick;
+      *slot = level * kSlots + ((now_index + dist) & (kSlots - 1));
+    }
+  }
+  return found;
+}
+
+uint64 TimerWheel::NextExpiration() const {
+  unsigned slot;
+  uint64 tick;
+  return NextSlot(&slot, &tick) ? tick : kuint64max;
+}
+
+void TimerWheel::ProcessSlot(unsigned slot, uint64 target, std::vector<Callback>* expired) {
+  uint32 index = heads_[slot];
+  heads_[slot] = kNil;
+  occupied_[slot / kSlots] &= ~(uint64(1) << (slot % kSlots));
+
+  while (index != kNil) {
+    Timer& t = timers_[index];
+    uint32 next = t.next;
+    t.slot = kNoSlot;
+    t.prev = t.next = kNil;
+    if (t.deadline > now_) {
+      Link(index);  // cascade to a lower level.
+    } else if (t.period) {
+      expired->push_back(t.cb);
+      t.deadline += t.period;
+      if (t.deadline <= target)
+        t.deadline = target + t.period;  // we are late, do not fire a burst.
+      Link(index);
+    } else {
+      expired->push_back(std::move(t.cb));
+      Free(index);
+    }
+    index = next;
+  }
+}
+
+void TimerWheel::Advance(uint64 tick, std::vector<Callback>* expired) {
+  unsigned slot;
+  uint64 slot_tick;
+  while (NextSlot(&slot, &slot_tick) && slot_tick <= tick) {
+    now_ = slot_tick;
+    ProcessSlot(slot, tick, expired);
+  }
+  now_ = std::max(now_, tick);
+}
+
+}  // namespace util
@@ -0,0 +1,98 @@
+// Copyright 2013, Beeri 15.  All rights reserved.
+// Author: Roman Gershman (romange@gmail.com)
+//
+#ifndef _UTIL_TIMER_WHEEL_H
+#define _UTIL_TIMER_WHEEL_H
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+#include "base/integral_types.h"
+
+namespace util {
+
+/*
+  Hierarchical timing wheel as in "Hashed and Hierarchical Timing Wheels" by Varghese and Lauck.
+  Time is measured in abstract ticks. There are kLevels wheels of 64 slots each, a slot at
+  level L spans 64^L ticks. A timer is placed at the lowest level at which its deadline and
+  the current tick differ only in the bits covered by the level. When the wheel reaches a slot
+  at a higher level, its timers cascade to the lower levels. Add and Remove are O(1), Advance
+  skips empty slots using per level occupancy bitmaps.
+  Timers are kept in a slab and linked into slot lists by index. Ids carry a generation so
+  stale ids are rejected after their slab entry is reused.
+  This class is not thread-safe.
+*/
+class TimerWheel {
+public:
+  typedef uint64 Id;  // never 0.
+  typedef std::function<void()> Callback;
+
+  static constexpr unsigned kLevelBits = 6;
+  static constexpr unsigned kSlots = 1 << kLevelBits;
+  static constexpr unsigned kLevels = 6;
+
+  // Deadlines further than about kMaxRange ticks are reached by cascading several times.
+  static constexpr uint64 kMaxRange = uint64(1) << (kLevelBits * kLevels);
+
+  explicit TimerWheel(uint64 now_tick = 0);
+
+  // Adds a timer that expires at deadline_tick. Deadlines in the past expire on the next
+  // Advance. If period_ticks is not 0 the timer is re-armed after each expiry.
+  Id Add(Callback cb, uint64 deadline_tick, uint64 period_ticks = 0);
+
+  // Returns false if the timer does not exist or is a one-shot timer that already expired.
+  bool Remove(Id id);
+
+  // Moves the wheel to tick and appends the callbacks of all the expired timers to expired.
+  // One-shot timers are removed, periodic ones are re-armed.
+  void Advance(uint64 tick, std::vector<Callback>* expired);
+
+  // Returns the tick at which Advance will next have work to do or kuint64max if the wheel
+  // is empty. For timers on the upper levels this is the tick at which they cascade, which
+  // can be earlier than their deadline.
+  uint64 NextExpiration() const;
+
+  uint64 now() const { return now_; }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+private:
+  static constexpr uint32 kNil = kuint32max;
+  static constexpr uint32 kGenerationMask = (1 << 28) - 1;
+  static constexpr uint16 kNoSlot = kuint16max;
+
+  struct Timer {
+    Callback cb;
+    uint64 deadline = 0;
+    uint64 period = 0;
+    uint32 prev = kNil, next = kNil;
+    uint32 generation = 1;
+    uint16 slot = kNoSlot;
+  };
+
+  // Returns the level and the slot (level * kSlots + index) for a deadline relative to now_.
+  unsigned SlotFor(uint64 deadline) const;
+
+  void Link(uint32 index);
+  void Unlink(uint32 index);
+  void Free(uint32 index);
+
+  // Expires or cascades all the timers in slot. Periodic timers are re-armed after target,
+  // the tick Advance moves to.
+  void ProcessSlot(unsigned slot, uint64 target, std::vector<Callback>* expired);
+
+  // Finds the earliest non-empty slot. Returns false if the wheel is empty.
+  bool NextSlot(unsigned* slot, uint64* tick) const;
+
+  std::vector<Timer> timers_;
+  std::vector<uint32> free_list_;
+  uint32 heads_[kLevels * kSlots];
+  uint64 occupied_[kLevels];
+  uint64 now_;
+  size_t size_ = 0;
+};
+
+}  // namespace util
+
+#endif  // _UTIL_TIMER_WHEEL_H
@@ -0,0 +1,134 @@
+// Copyright 2013, Beeri 15.  All rights reserved.
+// Author: Roman Gershman (romange@gmail.com)
+//
+#include "util/timer_wheel.h"
+
+#include "base/gtest.h"
+#include "base/macros.h"
+
+namespace util {
+using std::vector;
+
+class TimerWheelTest : public testing::Test {
+protected:
+  TimerWheel::Callback Push(int val) {
+    return [this, val]() { vec_.push_back(val); };
+  }
+
+  // Advances the wheel and runs the expired callbacks.
+  void Advance(uint64 tick) {
+    std::vector<TimerWheel::Callback> expired;
+    wheel_.Advance(tick, &expired);
+    for (auto& f : expired)
+      f();
+  }
+
+  TimerWheel wheel_;
+  vector<int> vec_;
+};
+
+TEST_F(TimerWheelTest, Basic) {
+  EXPECT_EQ(kuint64max, wheel_.NextExpiration());
+  wheel_.Add(Push(2), 20);
+  wheel_.Add(Push(1), 10);
+  wheel_.Add(Push(3), 30);
+  EXPECT_EQ(3, wheel_.size());
+  EXPECT_EQ(10, wheel_.NextExpiration());
+
+  Advance(9);
+  EXPECT_TRUE(vec_.empty());
+  Advance(20);
+  EXPECT_EQ((vector<int>{1, 2}), vec_);
+  EXPECT_EQ(30, wheel_.NextExpiration());
+  Advance(100);
+  EXPECT_EQ((vector<int>{1, 2, 3}), vec_);
+  EXPECT_TRUE(wheel_.empty());
+}
+
+TEST_F(TimerWheelTest, Cascade) {
+  const uint64 kDeadlines[] = {64, 65, 4095, 4096, 100000, 1ULL << 40};
+  for (uint64 d : kDeadlines)
+    wheel_.Add(Push(d & 0xFFFFF), d);
+  for (size_t i = 0; i < arraysize(kDeadlines); ++i) {
+    Advance(kDeadlines[i] - 1);
+    ASSERT_EQ(i, vec_.size()) << kDeadlines[i];
+    Advance(kDeadlines[i]);
+    ASSERT_EQ(i + 1, vec_.size()) << kDeadlines[i];
+  }
+  EXPECT_TRUE(wheel_.empty());
+}
+
+// A deadline beyond the top level must not map to the slot of the current tick.
+TEST_F(TimerWheelTest, BeyondMaxRange) {
+  TimerWheel wheel(5);
+  const uint64 deadline = 5 + TimerWheel::kMaxRange + 100;
+  wheel.Add(Push(1), deadline);
+  std::vector<TimerWheel::Callback> expired;
+  wheel.Advance(10, &expired);
+  EXPECT_TRUE(expired.empty());
+  wheel.Advance(deadline - 1, &expired);
+  EXPECT_TRUE(expired.empty());
+  wheel.Advance(deadline, &expired);
+  EXPECT_EQ(1, expired.size());
+  EXPECT_TRUE(wheel.empty());
+
+  // The same from a tick at the end of a top level rotation.
+  const uint64 now = TimerWheel::kMaxRange - 1;
+  wheel.Advance(now, &expired);
+  wheel.Add(Push(2), now + 3 * TimerWheel::kMaxRange);
+  wheel.Advance(now + 3 * TimerWheel::kMaxRange - 1, &expired);
+  EXPECT_EQ(1, expired.size());
+  wheel.Advance(now + 3 * TimerWheel::kMaxRange, &expired);
+  EXPECT_EQ(2, expired.size());
+}
+
+TEST_F(TimerWheelTest, Remove) {
+  TimerWheel::Id id1 = wheel_.Add(Push(1), 100);
+  TimerWheel::Id id2 = wheel_.Add(Push(2), 5000);
+  EXPECT_TRUE(wheel_.Remove(id2));
+  EXPECT_FALSE(wheel_.Remove(id2));
+  EXPECT_LE(wheel_.NextExpiration(), 100);
+
+  Advance(200);
+  EXPECT_FALSE(wheel_.Remove(id1));
+
+  // The slab entry is reused, but the stale id stays invalid.
+  TimerWheel::Id id3 = wheel_.Add(Push(3), 300);
+  EXPECT_NE(id1, id3);
+  EXPECT_FALSE(wheel_.Remove(id1));
+  EXPECT_TRUE(wheel_.Remove(id3));
+  Advance(10000);
+  EXPECT_EQ((vector<int>{1}), vec_);
+}
+
+TEST_F(TimerWheelTest, Periodic) {
+  TimerWheel::Id id = wheel_.Add(Push(1), 10, 10);
+  wheel_.Add(Push(2), 25);
+  for (uint64 t = 1; t <= 50; ++t)
+    Advance(t);
+  EXPECT_EQ((vector<int>{1, 1, 2, 1, 1, 1}), vec_);
+
+  // A late Advance fires the timer once.
+  vec_.clear();
+  Advance(1000);
+  EXPECT_EQ((vector<int>{1}), vec_);
+  EXPECT_EQ(1010, wheel_.NextExpiration());
+  EXPECT_TRUE(wheel_.Remove(id));
+  EXPECT_TRUE(wheel_.empty());
+}
+
+static void BM_TimerWheelAddRemove(benchmark::State& state) {
+  TimerWheel wheel;
+  std::vector<TimerWheel::Id> ids(state.range_x());
+  uint64 tick = 0;
+  while (state.KeepRunning()) {
+    for (size_t i = 0; i < ids.size(); ++i)
+      ids[i] = wheel.Add([] {}, tick + 1 + (i * 7919) % 100000);
+    for (size_t i = 0; i < ids.size(); ++i)
+      wheel.Remove(ids[i]);
+    ++tick;
+  }
+}
+BENCHMARK(BM_TimerWheelAddRemove)->Arg(1024);
+
+}  // namespace util